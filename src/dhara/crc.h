@@ -0,0 +1,24 @@
+/**
+ * @file		crc.h
+ * @author		Andrew Loebs
+ * @brief		Header file of the dhara crc helper
+ *
+ * Table-driven CRC-32 (IEEE 802.3, reflected) used to fingerprint page contents.
+ *
+ */
+
+#ifndef DHARA_CRC_H_
+#define DHARA_CRC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief Initial value for a new CRC computation
+#define DHARA_CRC_INIT 0xffffffff
+
+/// @brief Updates a running CRC-32 with a block of data
+/// @note Start with DHARA_CRC_INIT and feed the result of each call into the next. The result is
+/// not post-inverted since it's only ever compared against other values from this function.
+uint32_t dhara_crc32(uint32_t crc, const uint8_t *data, size_t len);
+
+#endif // DHARA_CRC_H_
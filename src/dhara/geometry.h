@@ -0,0 +1,82 @@
+/**
+ * @file		geometry.h
+ * @author		Andrew Loebs
+ * @brief		Compile-time geometry configuration for the dhara journal and map
+ *
+ * By default the journal and map take every shift and mask from the fields of struct dhara_nand
+ * (and the journal's checkpoint period), so they work with any chip. When the geometry is known
+ * at build time, define DHARA_FIXED_LOG2_PAGE_SIZE, DHARA_FIXED_LOG2_PPB and
+ * DHARA_FIXED_NUM_BLOCKS (and DHARA_FIXED_LOG2_PROG_SIZE, if used) to pin it: the accessors below
+ * then expand to constants, and the radix depth of the map shrinks to the number of bits needed
+ * to number every page of the chip -- shortening each trace_path and the metadata stored with
+ * each page.
+ *
+ * The struct dhara_nand handed to the journal must describe the same geometry, and a volume
+ * formatted with one radix depth can't be read back with another.
+ *
+ * A fixed geometry also allows the spare-area metadata format (DHARA_OOB_META): instead of
+ * grouping pages under checkpoint pages, every page carries its own journal header and a compact
+ * copy of its map metadata in its spare area, written by the same program operation as its data.
+ * No checkpoint pages are programmed, and a sync never has to pad out a checkpoint group.
+ *
+ */
+
+#ifndef DHARA_GEOMETRY_H_
+#define DHARA_GEOMETRY_H_
+
+/// @brief Floor / ceiling of log2 for 32 bit constants (usable in #if)
+#define DHARA_FLOOR_LOG2_2(x)  (((x)&0x2) ? 1 : 0)
+#define DHARA_FLOOR_LOG2_4(x)  (((x)&0xc) ? 2 + DHARA_FLOOR_LOG2_2((x) >> 2) : DHARA_FLOOR_LOG2_2(x))
+#define DHARA_FLOOR_LOG2_8(x)  (((x)&0xf0) ? 4 + DHARA_FLOOR_LOG2_4((x) >> 4) : DHARA_FLOOR_LOG2_4(x))
+#define DHARA_FLOOR_LOG2_16(x) (((x)&0xff00) ? 8 + DHARA_FLOOR_LOG2_8((x) >> 8) : DHARA_FLOOR_LOG2_8(x))
+#define DHARA_FLOOR_LOG2(x)                                                                        \
+    (((x)&0xffff0000) ? 16 + DHARA_FLOOR_LOG2_16((x) >> 16) : DHARA_FLOOR_LOG2_16(x))
+#define DHARA_CEIL_LOG2(x) (((x) <= 1) ? 0 : DHARA_FLOOR_LOG2((x)-1) + 1)
+
+#ifdef DHARA_FIXED_NUM_BLOCKS
+#define DHARA_FIXED_GEOMETRY 1
+
+/// @brief Largest unit programmed in one operation, if smaller than a page (0 otherwise)
+#ifndef DHARA_FIXED_LOG2_PROG_SIZE
+#define DHARA_FIXED_LOG2_PROG_SIZE 0
+#endif
+
+#define DHARA_LOG2_PAGE_SIZE(n)  DHARA_FIXED_LOG2_PAGE_SIZE
+#define DHARA_LOG2_PPB(n)        DHARA_FIXED_LOG2_PPB
+#define DHARA_NUM_BLOCKS(n)      DHARA_FIXED_NUM_BLOCKS
+#define DHARA_LOG2_PROG_SIZE(n)  DHARA_FIXED_LOG2_PROG_SIZE
+
+/// @brief Radix tree depth -- one bit per level, enough to number every page of the chip
+/// @note Sector numbers handed to the map must stay below (1 << DHARA_RADIX_DEPTH). Layers that
+/// number sectors beyond the page count of the chip need to define a larger depth.
+#ifndef DHARA_RADIX_DEPTH
+#define DHARA_RADIX_DEPTH DHARA_CEIL_LOG2(DHARA_FIXED_NUM_BLOCKS << DHARA_FIXED_LOG2_PPB)
+#endif
+
+#else
+#define DHARA_FIXED_GEOMETRY 0
+
+#define DHARA_LOG2_PAGE_SIZE(n)  ((n)->log2_page_size)
+#define DHARA_LOG2_PPB(n)        ((n)->log2_ppb)
+#define DHARA_NUM_BLOCKS(n)      ((n)->num_blocks)
+#define DHARA_LOG2_PROG_SIZE(n)  ((n)->log2_prog_size)
+
+/// @brief Radix tree depth -- the full width of dhara_sector_t
+#ifndef DHARA_RADIX_DEPTH
+#define DHARA_RADIX_DEPTH 32
+#endif
+
+#endif // DHARA_FIXED_NUM_BLOCKS
+
+/// @brief Selects the spare-area metadata format (see above)
+#ifndef DHARA_OOB_META
+#define DHARA_OOB_META 0
+#endif
+
+/// @brief Bytes per sector number / page pointer in spare-area metadata (2 or 3)
+/// @note Every page number and (1 << DHARA_RADIX_DEPTH) must fit below the all-ones value.
+#ifndef DHARA_OOB_PTR_SIZE
+#define DHARA_OOB_PTR_SIZE 2
+#endif
+
+#endif // DHARA_GEOMETRY_H_
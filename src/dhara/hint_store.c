@@ -0,0 +1,209 @@
+/**
+ * @file		hint_store.c
+ * @author		Andrew Loebs
+ * @brief		Implementation file of the dhara resume hint store
+ *
+ */
+
+#include "hint_store.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "bytes.h"
+#include "crc.h"
+
+// defines
+// record layout, at the start of its page (the rest of the page is left 0xff)
+#define MAGIC_OFFSET      0
+#define EPOCH_OFFSET      3
+#define CHECKPOINT_OFFSET 4
+#define SEQ_OFFSET        8
+#define CRC_OFFSET        12
+#define RECORD_SIZE       16
+
+// private function prototypes
+static dhara_page_t block_page(const dhara_hint_store_t *s, unsigned int block, unsigned int i);
+static int read_record(const dhara_hint_store_t *s, dhara_page_t p, struct dhara_journal_hint *hint,
+                       uint32_t *seq);
+static int put_record(dhara_hint_store_t *s, const struct dhara_journal_hint *hint,
+                      dhara_error_t *err);
+static void advance(dhara_hint_store_t *s);
+static int start_block(dhara_hint_store_t *s, dhara_error_t *err);
+
+// private variables
+static const uint8_t magic[3] = {'D', 'h', 'h'};
+
+// public function definitions
+void dhara_hint_store_init(dhara_hint_store_t *s, const struct dhara_nand *n,
+                           dhara_block_t first_block, unsigned int num_blocks, uint8_t *page_buf)
+{
+    s->nand = n;
+    s->first_block = first_block;
+    s->num_blocks = num_blocks;
+    s->page_buf = page_buf;
+
+    // with nothing loaded, the first record goes to the first block of the area
+    s->block = num_blocks - 1;
+    s->next = DHARA_PAGE_NONE;
+    s->seq = 0;
+    s->last_valid = 0;
+}
+
+int dhara_hint_store_load(dhara_hint_store_t *s, struct dhara_journal_hint *hint)
+{
+    struct dhara_journal_hint h;
+    uint32_t seq;
+    bool found = false;
+
+    // the block written last is the one whose first record is the newest
+    for (unsigned int b = 0; b < s->num_blocks; b++) {
+        if (dhara_nand_is_bad(s->nand, s->first_block + b)) continue;
+
+        if (!read_record(s, block_page(s, b, 0), &h, &seq) &&
+            (!found || ((int32_t)(seq - s->seq) > 0))) {
+            found = true;
+            s->block = b;
+            s->seq = seq;
+        }
+    }
+    if (!found) return -1;
+
+    // records fill a block from its first page on -- binary search for the last one
+    const unsigned int ppb = 1u << DHARA_LOG2_PPB(s->nand);
+    unsigned int low = 0;
+    unsigned int high = ppb - 1;
+    while (low < high) {
+        const unsigned int mid = (low + high + 1) >> 1;
+        if (!read_record(s, block_page(s, s->block, mid), &h, &seq)) {
+            low = mid;
+        }
+        else {
+            high = mid - 1;
+        }
+    }
+    if (read_record(s, block_page(s, s->block, low), hint, &s->seq)) return -1;
+
+    s->next = block_page(s, s->block, low);
+    advance(s);
+
+    // a withdrawn hint leaves nothing to go on
+    if (DHARA_PAGE_NONE == hint->checkpoint) return -1;
+    s->last = *hint;
+    s->last_valid = 1;
+    return 0;
+}
+
+int dhara_hint_store_save(dhara_hint_store_t *s, const struct dhara_journal_hint *hint,
+                          dhara_error_t *err)
+{
+    if (s->last_valid && (s->last.checkpoint == hint->checkpoint) &&
+        (s->last.epoch == hint->epoch)) {
+        return 0;
+    }
+
+    if (put_record(s, hint, err)) return -1;
+    s->last = *hint;
+    s->last_valid = 1;
+    return 0;
+}
+
+int dhara_hint_store_withdraw(dhara_hint_store_t *s, dhara_error_t *err)
+{
+    if (!s->last_valid) return 0;
+
+    // a record naming no checkpoint
+    const struct dhara_journal_hint none = {.checkpoint = DHARA_PAGE_NONE, .epoch = 0};
+    if (put_record(s, &none, err)) return -1;
+    s->last_valid = 0;
+    return 0;
+}
+
+// private function definitions
+static dhara_page_t block_page(const dhara_hint_store_t *s, unsigned int block, unsigned int i)
+{
+    return ((s->first_block + block) << DHARA_LOG2_PPB(s->nand)) + i;
+}
+
+/// @brief Reads the record at page p
+/// @return 0 if the page holds an intact record, -1 otherwise
+static int read_record(const dhara_hint_store_t *s, dhara_page_t p, struct dhara_journal_hint *hint,
+                       uint32_t *seq)
+{
+    uint8_t rec[RECORD_SIZE];
+    if (dhara_nand_read(s->nand, p, 0, sizeof(rec), rec, NULL)) return -1;
+
+    if (memcmp(&rec[MAGIC_OFFSET], magic, sizeof(magic)) ||
+        (dhara_r32(&rec[CRC_OFFSET]) != dhara_crc32(DHARA_CRC_INIT, rec, CRC_OFFSET))) {
+        return -1;
+    }
+
+    hint->epoch = rec[EPOCH_OFFSET];
+    hint->checkpoint = dhara_r32(&rec[CHECKPOINT_OFFSET]);
+    *seq = dhara_r32(&rec[SEQ_OFFSET]);
+    return 0;
+}
+
+/// @brief Writes a record to the next free page of the area
+static int put_record(dhara_hint_store_t *s, const struct dhara_journal_hint *hint,
+                      dhara_error_t *err)
+{
+    const size_t page_size = (size_t)1 << DHARA_LOG2_PAGE_SIZE(s->nand);
+    for (unsigned int tries = 0; tries <= s->num_blocks; tries++) {
+        // skip any page left programmed by an interrupted save
+        while ((DHARA_PAGE_NONE != s->next) && !dhara_nand_is_free(s->nand, s->next)) {
+            advance(s);
+        }
+        if ((DHARA_PAGE_NONE == s->next) && start_block(s, err)) return -1;
+
+        uint8_t *rec = s->page_buf;
+        memset(rec, 0xff, page_size);
+        memcpy(&rec[MAGIC_OFFSET], magic, sizeof(magic));
+        rec[EPOCH_OFFSET] = hint->epoch;
+        dhara_w32(&rec[CHECKPOINT_OFFSET], hint->checkpoint);
+        dhara_w32(&rec[SEQ_OFFSET], s->seq + 1);
+        dhara_w32(&rec[CRC_OFFSET], dhara_crc32(DHARA_CRC_INIT, rec, CRC_OFFSET));
+
+        if (!dhara_nand_prog(s->nand, s->next, rec, err)) {
+            s->seq++;
+            advance(s);
+            return 0;
+        }
+        if (DHARA_E_BAD_BLOCK != *err) return -1;
+
+        // retire the block, and carry on in the next one
+        dhara_nand_mark_bad(s->nand, s->first_block + s->block);
+        s->next = DHARA_PAGE_NONE;
+    }
+
+    dhara_set_error(err, DHARA_E_TOO_BAD);
+    return -1;
+}
+
+/// @brief Moves on to the next page of the current block, if there is one
+static void advance(dhara_hint_store_t *s)
+{
+    const dhara_page_t ppb_mask = (1u << DHARA_LOG2_PPB(s->nand)) - 1;
+    s->next++;
+    if (!(s->next & ppb_mask)) s->next = DHARA_PAGE_NONE;
+}
+
+/// @brief Erases the next good block of the area, and moves the write position to its start
+static int start_block(dhara_hint_store_t *s, dhara_error_t *err)
+{
+    for (unsigned int i = 0; i < s->num_blocks; i++) {
+        s->block = (s->block + 1) % s->num_blocks;
+        const dhara_block_t b = s->first_block + s->block;
+        if (dhara_nand_is_bad(s->nand, b)) continue;
+
+        if (!dhara_nand_erase(s->nand, b, err)) {
+            s->next = block_page(s, s->block, 0);
+            return 0;
+        }
+        if (DHARA_E_BAD_BLOCK != *err) return -1;
+        dhara_nand_mark_bad(s->nand, b);
+    }
+
+    dhara_set_error(err, DHARA_E_TOO_BAD);
+    return -1;
+}
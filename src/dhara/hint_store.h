@@ -0,0 +1,69 @@
+/**
+ * @file		hint_store.h
+ * @author		Andrew Loebs
+ * @brief		Header file of the dhara resume hint store
+ *
+ * Keeps journal resume hints (see dhara_journal_get_hint()) in a few blocks reserved outside the
+ * journal, so that a resume after a clean shutdown can go straight to the last checkpoint instead
+ * of searching the chip for it.
+ *
+ * A hint is only safe to use while nothing has been written to the journal after it (see
+ * dhara_journal_resume_hint()). So a hint saved after a sync is withdrawn before the next write,
+ * by writing a record that names no checkpoint -- a mount after a clean shutdown finds a hint,
+ * and any other mount runs the usual search.
+ *
+ * Each record takes one page, as a small checksummed header at the start of it. Records are written
+ * to the pages of a block in order; once a block is full, the next block of the area is erased
+ * and written, and so on round the area. The previous block keeps its records until the area
+ * wraps back to it, so a failed program or erase never leaves the area without a hint.
+ *
+ * Loading a hint takes a record read per block of the area to find the current one, and a binary
+ * search of that block for its last record.
+ *
+ */
+
+#ifndef DHARA_HINT_STORE_H_
+#define DHARA_HINT_STORE_H_
+
+#include <stdint.h>
+
+#include "journal.h"
+#include "nand.h"
+
+/// @brief State of a hint store
+typedef struct {
+    const struct dhara_nand *nand;
+    dhara_block_t first_block;
+    unsigned int num_blocks;
+    uint8_t *page_buf; // a page buffer for programs
+
+    // block (index into the area) and page the next record goes to, and its sequence number
+    unsigned int block;
+    dhara_page_t next;
+    uint32_t seq;
+
+    // newest hint in the store, unless it's been withdrawn since
+    struct dhara_journal_hint last;
+    int last_valid;
+} dhara_hint_store_t;
+
+/// @brief Sets up a store on the num_blocks blocks of n starting at first_block
+/// @note The blocks must be outside of any journal. No NAND operations are performed.
+void dhara_hint_store_init(dhara_hint_store_t *s, const struct dhara_nand *n,
+                           dhara_block_t first_block, unsigned int num_blocks, uint8_t *page_buf);
+
+/// @brief Finds the most recent hint in the store
+/// @return 0 on success, -1 if the store holds no hint, or it has been withdrawn
+int dhara_hint_store_load(dhara_hint_store_t *s, struct dhara_journal_hint *hint);
+
+/// @brief Writes a hint to the store, unless it's the one written (or loaded) last
+/// @return 0 on success, -1 if no good block of the store could take it
+int dhara_hint_store_save(dhara_hint_store_t *s, const struct dhara_journal_hint *hint,
+                          dhara_error_t *err);
+
+/// @brief Withdraws the newest hint, if it hasn't been already
+/// @note Call before anything is written to the journal the hint describes.
+/// @return 0 on success, -1 if no good block of the store could take the record
+int dhara_hint_store_withdraw(dhara_hint_store_t *s, dhara_error_t *err);
+
+#endif // DHARA_HINT_STORE_H_
@@ -17,24 +17,41 @@
 #include <string.h>
 #include "journal.h"
 #include "bytes.h"
+#include "crc.h"
 
 /************************************************************************
  * Metapage binary format
  */
 
+/* The last byte of the magic identifies the layout of the header and
+ * of the page metadata: the optional header fields, and the radix depth
+ * (which sets DHARA_META_SIZE). A build finds no journal on a chip
+ * formatted with another layout, instead of misreading its checkpoints.
+ * The original layout -- no optional fields, 32 levels -- keeps 'a'.
+ */
+#if (DHARA_RADIX_DEPTH < 1) || (DHARA_RADIX_DEPTH > 32)
+#error "DHARA_RADIX_DEPTH must be between 1 and 32"
+#endif
+
+#define HDR_FORMAT		((DHARA_RADIX_DEPTH - 1) | \
+				 (DHARA_WRAP_COUNT ? 0x20 : 0) | \
+				 (DHARA_TXN ? 0x40 : 0) | \
+				 (DHARA_PPC_SELECT ? 0x80 : 0))
+#define HDR_MAGIC_LAST		((uint8_t)('a' ^ 31 ^ HDR_FORMAT))
+
 /* Does the page buffer contain a valid checkpoint page? */
 static inline int hdr_has_magic(const uint8_t *buf)
 {
 	return (buf[0] == 'D') &&
 	       (buf[1] == 'h') &&
-	       (buf[2] == 'a');
+	       (buf[2] == HDR_MAGIC_LAST);
 }
 
 static inline void hdr_put_magic(uint8_t *buf)
 {
 	buf[0] = 'D';
 	buf[1] = 'h';
-	buf[2] = 'a';
+	buf[2] = HDR_MAGIC_LAST;
 }
 
 /* What epoch is this page? */
@@ -78,6 +95,56 @@ static inline void hdr_set_bb_last(uint8_t *buf, dhara_page_t count)
 	dhara_w32(buf + 12, count);
 }
 
+#if DHARA_WRAP_COUNT
+static inline uint32_t hdr_get_wraps(const uint8_t *buf)
+{
+	return dhara_r32(buf + 16);
+}
+
+static inline void hdr_set_wraps(uint8_t *buf, uint32_t count)
+{
+	dhara_w32(buf + 16, count);
+}
+#endif
+
+#if DHARA_TXN
+/* Root and tail the open transaction began with, after the wrap count */
+#define HDR_TXN_OFFSET		(16 + (DHARA_WRAP_COUNT ? 4 : 0))
+
+static inline dhara_page_t hdr_get_txn_root(const uint8_t *buf)
+{
+	return dhara_r32(buf + HDR_TXN_OFFSET);
+}
+
+static inline void hdr_set_txn_root(uint8_t *buf, dhara_page_t root)
+{
+	dhara_w32(buf + HDR_TXN_OFFSET, root);
+}
+
+static inline dhara_page_t hdr_get_txn_tail(const uint8_t *buf)
+{
+	return dhara_r32(buf + HDR_TXN_OFFSET + 4);
+}
+
+static inline void hdr_set_txn_tail(uint8_t *buf, dhara_page_t tail)
+{
+	dhara_w32(buf + HDR_TXN_OFFSET + 4, tail);
+}
+#endif
+
+#if DHARA_PPC_SELECT
+/* The checkpoint period is the last byte of the header */
+static inline uint8_t hdr_get_ppc(const uint8_t *buf)
+{
+	return buf[DHARA_HEADER_SIZE - 1];
+}
+
+static inline void hdr_set_ppc(uint8_t *buf, uint8_t log2_ppc)
+{
+	buf[DHARA_HEADER_SIZE - 1] = log2_ppc;
+}
+#endif
+
 /* Clear user metadata */
 static inline void hdr_clear_user(uint8_t *buf, uint8_t log2_page_size)
 {
@@ -92,6 +159,96 @@ static inline size_t hdr_user_offset(uint8_t which)
 		which * DHARA_META_SIZE;
 }
 
+#if DHARA_OOB_META
+/************************************************************************
+ * Spare-area record format
+ */
+
+#define REC_META_OFFSET		(DHARA_HEADER_SIZE + DHARA_COOKIE_SIZE)
+#define REC_CHECK_OFFSET	(REC_META_OFFSET + DHARA_OOB_META_SIZE)
+
+/* Page pointers and sector numbers are stored in DHARA_OOB_PTR_SIZE
+ * bytes, with all-ones standing for "none".
+ */
+static inline void rec_put_word(uint8_t *buf, uint32_t v)
+{
+	int i;
+
+	for (i = 0; i < DHARA_OOB_PTR_SIZE; i++)
+		buf[i] = v >> (i << 3);
+}
+
+static inline uint32_t rec_get_word(const uint8_t *buf)
+{
+	const uint32_t none = (1 << (DHARA_OOB_PTR_SIZE << 3)) - 1;
+	uint32_t v = 0;
+	int i;
+
+	for (i = 0; i < DHARA_OOB_PTR_SIZE; i++)
+		v |= ((uint32_t)buf[i]) << (i << 3);
+
+	return (v == none) ? 0xffffffff : v;
+}
+
+static void rec_put_meta(uint8_t *rec, const uint8_t *meta)
+{
+	int i;
+
+	if (!meta) {
+		memset(rec + REC_META_OFFSET, 0xff, DHARA_OOB_META_SIZE);
+		return;
+	}
+
+	for (i = 0; i < (DHARA_META_SIZE >> 2); i++)
+		rec_put_word(rec + REC_META_OFFSET + i * DHARA_OOB_PTR_SIZE,
+			     dhara_r32(meta + (i << 2)));
+}
+
+static void rec_get_meta(const uint8_t *rec, uint8_t *meta)
+{
+	int i;
+
+	for (i = 0; i < (DHARA_META_SIZE >> 2); i++)
+		dhara_w32(meta + (i << 2),
+			  rec_get_word(rec + REC_META_OFFSET +
+				       i * DHARA_OOB_PTR_SIZE));
+}
+
+/* The check value covers the whole record. It catches pages whose
+ * program was interrupted, as well as bit errors in spare bytes the
+ * chip's ECC might not cover.
+ */
+static inline uint16_t rec_check(const uint8_t *rec)
+{
+	return dhara_crc32(DHARA_CRC_INIT, rec, REC_CHECK_OFFSET);
+}
+
+static inline void rec_seal(uint8_t *rec)
+{
+	dhara_w16(rec + REC_CHECK_OFFSET, rec_check(rec));
+}
+
+static inline int rec_is_sealed(const uint8_t *rec)
+{
+	return dhara_r16(rec + REC_CHECK_OFFSET) == rec_check(rec);
+}
+
+/* Read a page's record, failing if it doesn't check out */
+static int rec_read(const struct dhara_nand *n, dhara_page_t p,
+		    uint8_t *rec, dhara_error_t *err)
+{
+	if (dhara_nand_read_oob(n, p, rec, DHARA_OOB_RECORD_SIZE, err) < 0)
+		return -1;
+
+	if (!rec_is_sealed(rec)) {
+		dhara_set_error(err, DHARA_E_ECC);
+		return -1;
+	}
+
+	return 0;
+}
+#endif
+
 /************************************************************************
  * Page geometry helpers
  */
@@ -113,7 +270,7 @@ static inline int align_eq(dhara_page_t a, dhara_page_t b,
 static dhara_block_t next_block(const struct dhara_nand *n, dhara_block_t blk)
 {
 	blk++;
-	if (blk >= n->num_blocks)
+	if (blk >= DHARA_NUM_BLOCKS(n))
 		blk = 0;
 
 	return blk;
@@ -123,22 +280,29 @@ static dhara_page_t next_upage(const struct dhara_journal *j,
 			       dhara_page_t p)
 {
 	p++;
-	if (is_aligned(p + 1, j->log2_ppc))
+#if !DHARA_OOB_META
+	if (is_aligned(p + 1, DHARA_LOG2_PPC(j)))
 		p++;
+#endif
 
-	if (p >= (j->nand->num_blocks << j->nand->log2_ppb))
+	if (p >= (DHARA_NUM_BLOCKS(j->nand) << DHARA_LOG2_PPB(j->nand)))
 		p = 0;
 
 	return p;
 }
 
+#if !DHARA_OOB_META
 /* Calculate a checkpoint period: the largest value of ppc such that
  * (2**ppc - 1) metadata blocks can fit on a page with one journal
- * header.
+ * header. If the page is programmed in several units, only the first
+ * unit is used.
  */
-static int choose_ppc(int log2_page_size, int max)
+static int choose_ppc(int log2_page_size, int log2_prog_size, int max)
 {
-	const int max_meta = (1 << log2_page_size) -
+	const int log2_space = (log2_prog_size &&
+				(log2_prog_size < log2_page_size)) ?
+		log2_prog_size : log2_page_size;
+	const int max_meta = (1 << log2_space) -
 		DHARA_HEADER_SIZE - DHARA_COOKIE_SIZE;
 	int total_meta = DHARA_META_SIZE;
 	int ppc = 1;
@@ -155,11 +319,40 @@ static int choose_ppc(int log2_page_size, int max)
 
 	return ppc;
 }
+#endif
 
 /************************************************************************
  * Journal setup/resume
  */
 
+/* Is a transaction holding on to the tail? */
+static inline int txn_open(const struct dhara_journal *j)
+{
+#if DHARA_TXN
+	return dhara_journal_in_txn(j);
+#else
+	return 0;
+#endif
+}
+
+/* Does the root lie outside the block (or checkpoint group) of a
+ * failed head? Only an aborted transaction leaves the root behind the
+ * last page written.
+ */
+static inline int root_behind(const struct dhara_journal *j,
+			      dhara_page_t old_head, uint8_t log2_size)
+{
+#if DHARA_TXN
+	return (j->root == DHARA_PAGE_NONE) ||
+		!align_eq(j->root, old_head, log2_size);
+#else
+	(void)j;
+	(void)old_head;
+	(void)log2_size;
+	return 0;
+#endif
+}
+
 /* Clear recovery status */
 static void clear_recovery(struct dhara_journal *j)
 {
@@ -178,7 +371,13 @@ static void reset_journal(struct dhara_journal *j)
 	 * conservative guess.
 	 */
 	j->epoch = 0;
-	j->bb_last = j->nand->num_blocks >> 6;
+#if DHARA_WRAP_COUNT
+	j->wraps = 0;
+#endif
+#if DHARA_PPC_SELECT
+	j->log2_ppc = j->format_log2_ppc;
+#endif
+	j->bb_last = DHARA_NUM_BLOCKS(j->nand) >> 6;
 	j->bb_current = 0;
 
 	j->flags = 0;
@@ -189,11 +388,16 @@ static void reset_journal(struct dhara_journal *j)
 	j->tail_sync = 0;
 	j->root = DHARA_PAGE_NONE;
 
+#if DHARA_TXN
+	j->txn_root = DHARA_PAGE_NONE;
+	j->txn_tail = DHARA_PAGE_NONE;
+#endif
+
 	/* No recovery required */
 	clear_recovery(j);
 
 	/* Empty metadata buffer */
-	memset(j->page_buf, 0xff, 1 << j->nand->log2_page_size);
+	memset(j->page_buf, 0xff, 1 << DHARA_LOG2_PAGE_SIZE(j->nand));
 }
 
 static void roll_stats(struct dhara_journal *j)
@@ -201,6 +405,9 @@ static void roll_stats(struct dhara_journal *j)
 	j->bb_last = j->bb_current;
 	j->bb_current = 0;
 	j->epoch++;
+#if DHARA_WRAP_COUNT
+	j->wraps++;
+#endif
 }
 
 void dhara_journal_init(struct dhara_journal *j,
@@ -210,11 +417,107 @@ void dhara_journal_init(struct dhara_journal *j,
 	/* Set fixed parameters */
 	j->nand = n;
 	j->page_buf = page_buf;
-	j->log2_ppc = choose_ppc(n->log2_page_size, n->log2_ppb);
+#if DHARA_OOB_META
+	j->log2_ppc = 0;
+#else
+	j->log2_ppc = choose_ppc(DHARA_LOG2_PAGE_SIZE(n),
+				 DHARA_LOG2_PROG_SIZE(n), DHARA_LOG2_PPB(n));
+#endif
+#if DHARA_PPC_SELECT
+	j->format_log2_ppc = j->log2_ppc;
+#endif
+#if DHARA_RESUME_PROFILE
+	memset(&j->profile, 0, sizeof(j->profile));
+	j->profile.current = DHARA_RESUME_PHASES;
+#endif
 
 	reset_journal(j);
 }
 
+#if DHARA_PPC_SELECT
+static uint8_t max_ppc(const struct dhara_journal *j)
+{
+	return choose_ppc(DHARA_LOG2_PAGE_SIZE(j->nand),
+			  DHARA_LOG2_PROG_SIZE(j->nand),
+			  DHARA_LOG2_PPB(j->nand));
+}
+
+void dhara_journal_select_ppc(struct dhara_journal *j, uint8_t log2_ppc)
+{
+	const uint8_t max = max_ppc(j);
+
+	if (!log2_ppc || (log2_ppc > max))
+		log2_ppc = max;
+
+	j->format_log2_ppc = log2_ppc;
+	j->log2_ppc = log2_ppc;
+}
+#endif
+
+#if DHARA_RESUME_PROFILE
+static void profile_reset(struct dhara_journal *j)
+{
+	memset(j->profile.phase, 0, sizeof(j->profile.phase));
+	j->profile.current = DHARA_RESUME_PHASES;
+}
+
+/* Close the phase in progress, and start the given one (or none, if
+ * given DHARA_RESUME_PHASES).
+ */
+static void profile_enter(struct dhara_journal *j, dhara_resume_phase_t phase)
+{
+	struct dhara_resume_profile *prof = &j->profile;
+	const uint32_t now = prof->clock ? prof->clock() : 0;
+
+	if (prof->current < DHARA_RESUME_PHASES)
+		prof->phase[prof->current].time += now - prof->started;
+
+	prof->current = phase;
+	prof->started = now;
+}
+
+static void profile_read(struct dhara_journal *j, size_t len)
+{
+	if (j->profile.current < DHARA_RESUME_PHASES) {
+		j->profile.phase[j->profile.current].reads++;
+		j->profile.phase[j->profile.current].bytes += len;
+	}
+}
+
+static void profile_probe(struct dhara_journal *j)
+{
+	if (j->profile.current < DHARA_RESUME_PHASES)
+		j->profile.phase[j->profile.current].probes++;
+}
+#else
+static inline void profile_reset(struct dhara_journal *j) { }
+static inline void profile_enter(struct dhara_journal *j,
+				 dhara_resume_phase_t phase) { }
+static inline void profile_read(struct dhara_journal *j, size_t len) { }
+static inline void profile_probe(struct dhara_journal *j) { }
+#endif
+
+/* Read the checkpoint header kept with the given page into the page
+ * buffer, followed by the cookie if with_cookie is set. Nothing else
+ * of a checkpoint page is needed on resume -- the metadata for its
+ * group is only ever read back a slice at a time -- so only the start
+ * of the page is fetched.
+ */
+static int read_header(struct dhara_journal *j, dhara_page_t p,
+		       int with_cookie, dhara_error_t *err)
+{
+#if DHARA_OOB_META
+	profile_read(j, DHARA_OOB_RECORD_SIZE);
+	return rec_read(j->nand, p, j->page_buf, err);
+#else
+	const size_t len = DHARA_HEADER_SIZE +
+		(with_cookie ? DHARA_COOKIE_SIZE : 0);
+
+	profile_read(j, len);
+	return dhara_nand_read(j->nand, p, 0, len, j->page_buf, err);
+#endif
+}
+
 /* Find the first checkpoint-containing block. If a block contains any
  * checkpoints at all, then it must contain one in the first checkpoint
  * location -- otherwise, we would have considered the block eraseable.
@@ -225,16 +528,14 @@ static int find_checkblock(struct dhara_journal *j,
 {
 	int i;
 
-	for (i = 0; (blk < j->nand->num_blocks) &&
+	for (i = 0; (blk < DHARA_NUM_BLOCKS(j->nand)) &&
 		    (i < DHARA_MAX_RETRIES); i++) {
 		const dhara_page_t p =
-			(blk << j->nand->log2_ppb) |
-			((1 << j->log2_ppc) - 1);
+			(blk << DHARA_LOG2_PPB(j->nand)) |
+			((1 << DHARA_LOG2_PPC(j)) - 1);
 
 		if (!(dhara_nand_is_bad(j->nand, blk) ||
-		      dhara_nand_read(j->nand, p,
-				      0, 1 << j->nand->log2_page_size,
-				      j->page_buf, err)) &&
+		      read_header(j, p, 0, err)) &&
 		    hdr_has_magic(j->page_buf)) {
 			*where = blk;
 			return 0;
@@ -247,11 +548,63 @@ static int find_checkblock(struct dhara_journal *j,
 	return -1;
 }
 
+#if DHARA_PPC_SELECT
+/* Take the checkpoint period from the header in the page buffer, if it
+ * holds a checkpoint written with a period that's possible here.
+ */
+static int take_ppc(struct dhara_journal *j)
+{
+	const uint8_t log2_ppc = hdr_get_ppc(j->page_buf);
+
+	if (!hdr_has_magic(j->page_buf) ||
+	    !log2_ppc || (log2_ppc > max_ppc(j)))
+		return -1;
+
+	j->log2_ppc = log2_ppc;
+	return 0;
+}
+
+/* Find the checkpoint period of the journal on the chip. The first
+ * checkpoint-containing block holds one at the end of its first group,
+ * so each possible period is tried there -- and only taken if that's
+ * the period the checkpoint records.
+ */
+static int find_ppc(struct dhara_journal *j, dhara_error_t *err)
+{
+	const uint8_t max = max_ppc(j);
+	dhara_block_t blk;
+	dhara_error_t my_err;
+	int i;
+
+	for (blk = 0, i = 0; (blk < DHARA_NUM_BLOCKS(j->nand)) &&
+			     (i < DHARA_MAX_RETRIES); blk++, i++) {
+		uint8_t k;
+
+		if (dhara_nand_is_bad(j->nand, blk))
+			continue;
+
+		for (k = max; k > 0; k--) {
+			const dhara_page_t p =
+				(blk << DHARA_LOG2_PPB(j->nand)) |
+				((1 << k) - 1);
+
+			if (!read_header(j, p, 0, &my_err) &&
+			    (hdr_get_ppc(j->page_buf) == k) &&
+			    !take_ppc(j))
+				return 0;
+		}
+	}
+
+	dhara_set_error(err, DHARA_E_TOO_BAD);
+	return -1;
+}
+#endif
+
 static dhara_block_t find_last_checkblock(struct dhara_journal *j,
 					  dhara_block_t first)
 {
 	dhara_block_t low = first;
-	dhara_block_t high = j->nand->num_blocks - 1;
+	dhara_block_t high = DHARA_NUM_BLOCKS(j->nand) - 1;
 
 	while (low <= high) {
 		const dhara_block_t mid = (low + high) >> 1;
@@ -266,7 +619,7 @@ static dhara_block_t find_last_checkblock(struct dhara_journal *j,
 		} else {
 			dhara_block_t nf;
 
-			if (((found + 1) >= j->nand->num_blocks) ||
+			if (((found + 1) >= DHARA_NUM_BLOCKS(j->nand)) ||
 			    (find_checkblock(j, found + 1,
 					     &nf, NULL) < 0) ||
 			    (hdr_get_epoch(j->page_buf) != j->epoch))
@@ -298,12 +651,14 @@ static dhara_block_t find_last_checkblock(struct dhara_journal *j,
  */
 static int cp_free(struct dhara_journal *j, dhara_page_t first_user)
 {
-	const int count = 1 << j->log2_ppc;
+	const int count = 1 << DHARA_LOG2_PPC(j);
 	int i;
 
-	for (i = 0; i < count; i++)
+	for (i = 0; i < count; i++) {
+		profile_probe(j);
 		if (!dhara_nand_is_free(j->nand, first_user + i))
 			return 0;
+	}
 
 	return 1;
 }
@@ -311,7 +666,8 @@ static int cp_free(struct dhara_journal *j, dhara_page_t first_user)
 static dhara_page_t find_last_group(struct dhara_journal *j,
 				    dhara_block_t blk)
 {
-	const int num_groups = 1 << (j->nand->log2_ppb - j->log2_ppc);
+	const int num_groups =
+		1 << (DHARA_LOG2_PPB(j->nand) - DHARA_LOG2_PPC(j));
 	int low = 0;
 	int high = num_groups - 1;
 
@@ -323,38 +679,41 @@ static dhara_page_t find_last_group(struct dhara_journal *j,
 	 */
 	while (low <= high) {
 		int mid = (low + high) >> 1;
-		const dhara_page_t p = (mid << j->log2_ppc) |
-				 (blk << j->nand->log2_ppb);
+		const dhara_page_t p = (mid << DHARA_LOG2_PPC(j)) |
+				 (blk << DHARA_LOG2_PPB(j->nand));
 
 		if (cp_free(j, p)) {
 			high = mid - 1;
 		} else if (((mid + 1) >= num_groups) ||
-			   cp_free(j, p + (1 << j->log2_ppc))) {
+			   cp_free(j, p + (1 << DHARA_LOG2_PPC(j)))) {
 			return p;
 		} else {
 			low = mid + 1;
 		}
 	}
 
-	return blk << j->nand->log2_ppb;
+	return blk << DHARA_LOG2_PPB(j->nand);
 }
 
 static int find_root(struct dhara_journal *j, dhara_page_t start,
 		     dhara_error_t *err)
 {
-	const dhara_block_t blk = start >> j->nand->log2_ppb;
-	int i = (start & ((1 << j->nand->log2_ppb) - 1)) >> j->log2_ppc;
+	const dhara_block_t blk = start >> DHARA_LOG2_PPB(j->nand);
+	int i = (start & ((1 << DHARA_LOG2_PPB(j->nand)) - 1)) >>
+		DHARA_LOG2_PPC(j);
 
 	while (i >= 0) {
-		const dhara_page_t p = (blk << j->nand->log2_ppb) +
-			((i + 1) << j->log2_ppc) - 1;
+		const dhara_page_t p = (blk << DHARA_LOG2_PPB(j->nand)) +
+			((i + 1) << DHARA_LOG2_PPC(j)) - 1;
 
-		if (!dhara_nand_read(j->nand, p,
-				     0, 1 << j->nand->log2_page_size,
-				     j->page_buf, err) &&
+		if (!read_header(j, p, 1, err) &&
 		    (hdr_has_magic(j->page_buf)) &&
 		    (hdr_get_epoch(j->page_buf) == j->epoch)) {
+#if DHARA_OOB_META
+			j->root = p;
+#else
 			j->root = p - 1;
+#endif
 			return 0;
 		}
 
@@ -385,12 +744,12 @@ static int find_head(struct dhara_journal *j, dhara_page_t start,
 			roll_stats(j);
 
 		/* If we hit the end of the block, we're done */
-		if (is_aligned(j->head, j->nand->log2_ppb)) {
+		if (is_aligned(j->head, DHARA_LOG2_PPB(j->nand))) {
 			/* Make sure we don't chase over the tail */
-			if (align_eq(j->head, j->tail, j->nand->log2_ppb))
+			if (align_eq(j->head, j->tail, DHARA_LOG2_PPB(j->nand)))
 				j->tail = next_block(j->nand,
-					j->tail >> j->nand->log2_ppb) <<
-						j->nand->log2_ppb;
+					j->tail >> DHARA_LOG2_PPB(j->nand)) <<
+						DHARA_LOG2_PPB(j->nand);
 			break;
 		}
 	} while (!cp_free(j, j->head));
@@ -398,51 +757,298 @@ static int find_head(struct dhara_journal *j, dhara_page_t start,
 	return 0;
 }
 
-int dhara_journal_resume(struct dhara_journal *j, dhara_error_t *err)
+/* Restore settings from the checkpoint header in the page buffer */
+static void restore_checkpoint(struct dhara_journal *j)
+{
+	j->tail = hdr_get_tail(j->page_buf);
+	j->bb_current = hdr_get_bb_current(j->page_buf);
+	j->bb_last = hdr_get_bb_last(j->page_buf);
+#if DHARA_WRAP_COUNT
+	j->wraps = hdr_get_wraps(j->page_buf);
+#endif
+#if DHARA_TXN
+	j->txn_root = hdr_get_txn_root(j->page_buf);
+	j->txn_tail = hdr_get_txn_tail(j->page_buf);
+#endif
+	hdr_clear_user(j->page_buf, DHARA_LOG2_PAGE_SIZE(j->nand));
+}
+
+/* Read the checkpoint at page p into the page buffer, and test that it
+ * belongs to the given epoch.
+ */
+static int checkpoint_valid(struct dhara_journal *j, dhara_page_t p,
+			    uint8_t epoch)
+{
+	dhara_error_t my_err;
+
+	return !read_header(j, p, 1, &my_err) &&
+		hdr_has_magic(j->page_buf) &&
+		(hdr_get_epoch(j->page_buf) == epoch);
+}
+
+/* Resume from a hint, without searching for the root. The hint is only
+ * taken if it names a good checkpoint of its epoch, followed by a free
+ * page -- or at the end of a block, by a block holding no checkpoint of
+ * the current epoch. Returns -1 if the hint is stale or unusable.
+ */
+static int follow_hint(struct dhara_journal *j,
+		       const struct dhara_journal_hint *hint)
+{
+	const dhara_page_t cp = hint->checkpoint;
+	dhara_block_t blk = cp >> DHARA_LOG2_PPB(j->nand);
+	dhara_page_t ppc_mask;
+	dhara_page_t next;
+	dhara_error_t my_err;
+	int skipped = 0;
+
+	if (blk >= DHARA_NUM_BLOCKS(j->nand))
+		return -1;
+
+#if DHARA_PPC_SELECT
+	/* The checkpoint tells the period it was written with */
+	if (read_header(j, cp, 0, &my_err) || take_ppc(j) < 0)
+		return -1;
+#endif
+	ppc_mask = (1 << DHARA_LOG2_PPC(j)) - 1;
+
+	if (((cp & ppc_mask) != ppc_mask) ||
+	    dhara_nand_is_bad(j->nand, blk) ||
+	    !checkpoint_valid(j, cp, hint->epoch))
+		return -1;
+
+	j->epoch = hint->epoch;
+#if DHARA_OOB_META
+	j->root = cp;
+#else
+	j->root = cp - 1;
+#endif
+	restore_checkpoint(j);
+
+	/* Pages are programmed in order, so a free page following the
+	 * checkpoint shows it's the last one. Only the first is tested:
+	 * telling a whole group apart from a partly programmed one takes a
+	 * test of every page (see cp_free()), which is what the hint is
+	 * there to avoid. At the end of a block, the next block is looked
+	 * at instead: if the hint were stale, it would hold checkpoints of
+	 * the (possibly rolled over) epoch.
+	 */
+	next = next_upage(j, cp);
+	if (!is_aligned(next, DHARA_LOG2_PPB(j->nand))) {
+		profile_probe(j);
+		if (!dhara_nand_is_free(j->nand, next))
+			return -1;
+
+		j->head = next;
+		return 0;
+	}
+
+	/* Let find_head() deal with the tail and the epoch */
+	find_head(j, cp, &my_err);
+
+	/* The head may be on a bad block, to be skipped by the next write */
+	blk = j->head >> DHARA_LOG2_PPB(j->nand);
+	while (dhara_nand_is_bad(j->nand, blk)) {
+		if (++skipped >= DHARA_MAX_RETRIES)
+			return -1;
+
+		blk = next_block(j->nand, blk);
+	}
+
+	if (!read_header(j, (blk << DHARA_LOG2_PPB(j->nand)) | ppc_mask,
+			 0, &my_err) &&
+	    hdr_has_magic(j->page_buf) &&
+	    (hdr_get_epoch(j->page_buf) == j->epoch))
+		return -1;
+
+	/* Reload the root's checkpoint, for its cookie */
+	if (!checkpoint_valid(j, cp, hint->epoch))
+		return -1;
+
+	hdr_clear_user(j->page_buf, DHARA_LOG2_PAGE_SIZE(j->nand));
+	return 0;
+}
+
+static int search(struct dhara_journal *j, int lazy, dhara_error_t *err)
 {
 	dhara_block_t first, last;
 	dhara_page_t last_group;
 
 	/* Find the first checkpoint-containing block */
-	if (find_checkblock(j, 0, &first, err) < 0) {
-		reset_journal(j);
+	profile_enter(j, DHARA_RESUME_FIRST_BLOCK);
+#if DHARA_PPC_SELECT
+	if (find_ppc(j, err) < 0)
+		return -1;
+#endif
+	if (find_checkblock(j, 0, &first, err) < 0)
 		return -1;
-	}
 
 	/* Find the last checkpoint-containing block in this epoch */
+	profile_enter(j, DHARA_RESUME_LAST_BLOCK);
 	j->epoch = hdr_get_epoch(j->page_buf);
 	last = find_last_checkblock(j, first);
 
 	/* Find the last programmed checkpoint group in the block */
+	profile_enter(j, DHARA_RESUME_LAST_GROUP);
 	last_group = find_last_group(j, last);
 
 	/* Perform a linear scan to find the last good checkpoint (and
 	 * therefore the root).
 	 */
-	if (find_root(j, last_group, err) < 0) {
-		reset_journal(j);
+	profile_enter(j, DHARA_RESUME_ROOT);
+	if (find_root(j, last_group, err) < 0)
 		return -1;
-	}
 
 	/* Restore settings from checkpoint */
-	j->tail = hdr_get_tail(j->page_buf);
-	j->bb_current = hdr_get_bb_current(j->page_buf);
-	j->bb_last = hdr_get_bb_last(j->page_buf);
-	hdr_clear_user(j->page_buf, j->nand->log2_page_size);
+	restore_checkpoint(j);
+
+#if DHARA_TXN
+	/* Rolling back takes the root away from the last group, which
+	 * is where a deferred scan for the head would start from.
+	 */
+	if (dhara_journal_in_txn(j))
+		lazy = 0;
+#endif
+
+	if (lazy) {
+		/* Reads don't need the head, so the scan for it is left
+		 * to the first write (see locate_head()). Until then, the
+		 * head is taken to be the page following the root's
+		 * checkpoint group -- which is where it is, unless power
+		 * was lost while a later group was being programmed.
+		 */
+		j->head = next_upage(j, j->root);
+		j->flags = DHARA_JOURNAL_F_HEAD_PENDING;
+		return 0;
+	}
+
+	/* Perform another linear scan to find the next free user page. */
+	profile_enter(j, DHARA_RESUME_HEAD);
+	return find_head(j, last_group, err);
+}
+
+#if DHARA_TXN
+/* The last checkpoint was written inside a transaction that was never
+ * committed: go back to the root and tail it began with. The head, the
+ * epoch and the bad-block counters stay as they are. Nothing that was
+ * in the journal when the transaction began has been erased since (see
+ * dhara_journal_txn_begin()), so the checkpoint of the root is still
+ * there to take the cookie from.
+ */
+static int roll_back(struct dhara_journal *j, dhara_error_t *err)
+{
+	j->root = j->txn_root;
+	j->tail = j->txn_tail;
+	j->txn_root = DHARA_PAGE_NONE;
+	j->txn_tail = DHARA_PAGE_NONE;
+
+	if (j->root != DHARA_PAGE_NONE) {
+		if (read_header(j, j->root | ((1 << DHARA_LOG2_PPC(j)) - 1),
+				1, err) < 0)
+			return -1;
+
+		if (!hdr_has_magic(j->page_buf)) {
+			dhara_set_error(err, DHARA_E_TOO_BAD);
+			return -1;
+		}
+	}
+
+	hdr_clear_user(j->page_buf, DHARA_LOG2_PAGE_SIZE(j->nand));
+	return 0;
+}
+#endif
+
+static int resume(struct dhara_journal *j, int lazy,
+		  const struct dhara_journal_hint *hint, dhara_error_t *err)
+{
+	int hinted = 0;
+
+	profile_reset(j);
+	j->flags = 0;
 
-	/* Perform another linear scan to find the next free user page */
-	if (find_head(j, last_group, err) < 0) {
+	if (hint) {
+		profile_enter(j, DHARA_RESUME_HINT);
+		hinted = !follow_hint(j, hint);
+	}
+
+	/* No hint, or a stale one: search for the root */
+	if (!hinted && (search(j, lazy, err) < 0)) {
+		profile_enter(j, DHARA_RESUME_PHASES);
 		reset_journal(j);
 		return -1;
 	}
+	profile_enter(j, DHARA_RESUME_PHASES);
+
+#if DHARA_TXN
+	if (dhara_journal_in_txn(j) && (roll_back(j, err) < 0)) {
+		reset_journal(j);
+		return -1;
+	}
+#endif
 
-	j->flags = 0;
 	j->tail_sync = j->tail;
 
 	clear_recovery(j);
 	return 0;
 }
 
+/* Finish a lazy resume: scan for the head, from the root's checkpoint
+ * group on. Every group between it and the last programmed group is
+ * programmed as well, so this ends up where find_head() would have
+ * from the last group.
+ */
+static int locate_head(struct dhara_journal *j, dhara_error_t *err)
+{
+	const dhara_page_t ppc_mask = (1 << DHARA_LOG2_PPC(j)) - 1;
+	int ret;
+
+	if (!(j->flags & DHARA_JOURNAL_F_HEAD_PENDING))
+		return 0;
+
+	j->flags &= ~DHARA_JOURNAL_F_HEAD_PENDING;
+
+	profile_enter(j, DHARA_RESUME_HEAD);
+	ret = find_head(j, j->root | ppc_mask, err);
+	profile_enter(j, DHARA_RESUME_PHASES);
+
+	return ret;
+}
+
+int dhara_journal_resume(struct dhara_journal *j, dhara_error_t *err)
+{
+	return resume(j, 0, NULL, err);
+}
+
+int dhara_journal_resume_lazy(struct dhara_journal *j, dhara_error_t *err)
+{
+	return resume(j, 1, NULL, err);
+}
+
+int dhara_journal_resume_hint(struct dhara_journal *j,
+			      const struct dhara_journal_hint *hint,
+			      dhara_error_t *err)
+{
+	return resume(j, 0, hint, err);
+}
+
+int dhara_journal_get_hint(const struct dhara_journal *j,
+			   struct dhara_journal_hint *hint)
+{
+	/* Only a checkpoint that's the last thing written will do */
+	if ((j->root == DHARA_PAGE_NONE) || txn_open(j) ||
+	    (j->flags & (DHARA_JOURNAL_F_DIRTY | DHARA_JOURNAL_F_RECOVERY |
+			 DHARA_JOURNAL_F_HEAD_PENDING)) ||
+	    !align_eq(j->root, j->head - 1, DHARA_LOG2_PPC(j)))
+		return -1;
+
+#if DHARA_OOB_META
+	hint->checkpoint = j->root;
+#else
+	hint->checkpoint = j->root | ((1 << DHARA_LOG2_PPC(j)) - 1);
+#endif
+	hint->epoch = j->epoch;
+	return 0;
+}
+
 /**************************************************************************
  * Public interface
  */
@@ -451,12 +1057,18 @@ dhara_page_t dhara_journal_capacity(const struct dhara_journal *j)
 {
 	const dhara_block_t max_bad = j->bb_last > j->bb_current ?
 		j->bb_last : j->bb_current;
-	const dhara_block_t good_blocks = j->nand->num_blocks - max_bad - 1;
-	const int log2_cpb = j->nand->log2_ppb - j->log2_ppc;
+	const dhara_block_t good_blocks =
+		DHARA_NUM_BLOCKS(j->nand) - max_bad - 1;
+#if DHARA_OOB_META
+	/* Every page is a user page */
+	return good_blocks << DHARA_LOG2_PPB(j->nand);
+#else
+	const int log2_cpb = DHARA_LOG2_PPB(j->nand) - DHARA_LOG2_PPC(j);
 	const dhara_page_t good_cps = good_blocks << log2_cpb;
 
 	/* Good checkpoints * (checkpoint period - 1) */
-	return (good_cps << j->log2_ppc) - good_cps;
+	return (good_cps << DHARA_LOG2_PPC(j)) - good_cps;
+#endif
 }
 
 dhara_page_t dhara_journal_size(const struct dhara_journal *j)
@@ -466,31 +1078,46 @@ dhara_page_t dhara_journal_size(const struct dhara_journal *j)
 	 * is the number of user pages (upper limit).
 	 */
 	dhara_page_t num_pages = j->head;
-	dhara_page_t num_cps = j->head >> j->log2_ppc;
+	dhara_page_t num_cps = j->head >> DHARA_LOG2_PPC(j);
 
 	if (j->head < j->tail_sync) {
 		const dhara_page_t total_pages =
-			j->nand->num_blocks << j->nand->log2_ppb;
+			DHARA_NUM_BLOCKS(j->nand) << DHARA_LOG2_PPB(j->nand);
 
 		num_pages += total_pages;
-		num_cps += total_pages >> j->log2_ppc;
+		num_cps += total_pages >> DHARA_LOG2_PPC(j);
 	}
 
 	num_pages -= j->tail_sync;
-	num_cps -= j->tail_sync >> j->log2_ppc;
+	num_cps -= j->tail_sync >> DHARA_LOG2_PPC(j);
 
+#if DHARA_OOB_META
+	/* No checkpoint pages */
+	return num_pages;
+#else
 	return num_pages - num_cps;
+#endif
 }
 
 int dhara_journal_read_meta(struct dhara_journal *j, dhara_page_t p,
 			    uint8_t *buf, dhara_error_t *err)
 {
+#if DHARA_OOB_META
+	/* Every written page carries its own metadata */
+	uint8_t rec[DHARA_OOB_RECORD_SIZE];
+
+	if (rec_read(j->nand, p, rec, err) < 0)
+		return -1;
+
+	rec_get_meta(rec, buf);
+	return 0;
+#else
 	/* Offset of metadata within the metadata page */
-	const dhara_page_t ppc_mask = (1 << j->log2_ppc) - 1;
+	const dhara_page_t ppc_mask = (1 << DHARA_LOG2_PPC(j)) - 1;
 	const size_t offset = hdr_user_offset(p & ppc_mask);
 
 	/* Special case: buffered metadata */
-	if (align_eq(p, j->head, j->log2_ppc)) {
+	if (align_eq(p, j->head, DHARA_LOG2_PPC(j))) {
 		memcpy(buf, j->page_buf + offset, DHARA_META_SIZE);
 		return 0;
 	}
@@ -499,7 +1126,7 @@ int dhara_journal_read_meta(struct dhara_journal *j, dhara_page_t p,
 	 * recovery.
 	 */
 	if ((j->recover_meta != DHARA_PAGE_NONE) &&
-	    align_eq(p, j->recover_root, j->log2_ppc))
+	    align_eq(p, j->recover_root, DHARA_LOG2_PPC(j)))
 		return dhara_nand_read(j->nand, j->recover_meta,
 				       offset, DHARA_META_SIZE,
 				       buf, err);
@@ -508,6 +1135,7 @@ int dhara_journal_read_meta(struct dhara_journal *j, dhara_page_t p,
 	return dhara_nand_read(j->nand, p | ppc_mask,
 			       offset, DHARA_META_SIZE,
 			       buf, err);
+#endif
 }
 
 dhara_page_t dhara_journal_peek(struct dhara_journal *j)
@@ -515,14 +1143,14 @@ dhara_page_t dhara_journal_peek(struct dhara_journal *j)
 	if (j->head == j->tail)
 		return DHARA_PAGE_NONE;
 
-	if (is_aligned(j->tail, j->nand->log2_ppb)) {
-		dhara_block_t blk = j->tail >> j->nand->log2_ppb;
+	if (is_aligned(j->tail, DHARA_LOG2_PPB(j->nand))) {
+		dhara_block_t blk = j->tail >> DHARA_LOG2_PPB(j->nand);
 		int i;
 
 		for (i = 0; i < DHARA_MAX_RETRIES; i++) {
-			if ((blk == (j->head >> j->nand->log2_ppb)) ||
+			if ((blk == (j->head >> DHARA_LOG2_PPB(j->nand))) ||
 			    !dhara_nand_is_bad(j->nand, blk)) {
-				j->tail = blk << j->nand->log2_ppb;
+				j->tail = blk << DHARA_LOG2_PPB(j->nand);
 
 				if (j->tail == j->head)
 					j->root = DHARA_PAGE_NONE;
@@ -537,6 +1165,29 @@ dhara_page_t dhara_journal_peek(struct dhara_journal *j)
 	return j->tail;
 }
 
+dhara_page_t dhara_journal_next(const struct dhara_journal *j,
+				dhara_page_t p)
+{
+	p = next_upage(j, p);
+
+	if (is_aligned(p, DHARA_LOG2_PPB(j->nand))) {
+		dhara_block_t blk = p >> DHARA_LOG2_PPB(j->nand);
+		int i;
+
+		for (i = 0; i < DHARA_MAX_RETRIES; i++) {
+			if ((blk == (j->head >> DHARA_LOG2_PPB(j->nand))) ||
+			    !dhara_nand_is_bad(j->nand, blk))
+				break;
+
+			blk = next_block(j->nand, blk);
+		}
+
+		p = blk << DHARA_LOG2_PPB(j->nand);
+	}
+
+	return (p == j->head) ? DHARA_PAGE_NONE : p;
+}
+
 void dhara_journal_dequeue(struct dhara_journal *j)
 {
 	if (j->head == j->tail)
@@ -545,9 +1196,11 @@ void dhara_journal_dequeue(struct dhara_journal *j)
 	j->tail = next_upage(j, j->tail);
 
 	/* If the journal is clean at the time of dequeue, then this
-	 * data was always obsolete, and can be reused immediately.
+	 * data was always obsolete, and can be reused immediately --
+	 * unless a transaction may yet roll back to it.
 	 */
-	if (!(j->flags & (DHARA_JOURNAL_F_DIRTY | DHARA_JOURNAL_F_RECOVERY)))
+	if (!(j->flags & (DHARA_JOURNAL_F_DIRTY | DHARA_JOURNAL_F_RECOVERY)) &&
+	    !txn_open(j))
 		j->tail_sync = j->tail;
 
 	if (j->head == j->tail)
@@ -556,25 +1209,27 @@ void dhara_journal_dequeue(struct dhara_journal *j)
 
 void dhara_journal_clear(struct dhara_journal *j)
 {
+	locate_head(j, NULL);
+
 	j->tail = j->head;
 	j->root = DHARA_PAGE_NONE;
 	j->flags |= DHARA_JOURNAL_F_DIRTY;
 
-	hdr_clear_user(j->page_buf, j->nand->log2_page_size);
+	hdr_clear_user(j->page_buf, DHARA_LOG2_PAGE_SIZE(j->nand));
 }
 
 static int skip_block(struct dhara_journal *j, dhara_error_t *err)
 {
 	const dhara_block_t next = next_block(j->nand,
-		j->head >> j->nand->log2_ppb);
+		j->head >> DHARA_LOG2_PPB(j->nand));
 
 	/* We can't roll onto the same block as the tail */
-	if ((j->tail_sync >> j->nand->log2_ppb) == next) {
+	if ((j->tail_sync >> DHARA_LOG2_PPB(j->nand)) == next) {
 		dhara_set_error(err, DHARA_E_JOURNAL_FULL);
 		return -1;
 	}
 
-	j->head = next << j->nand->log2_ppb;
+	j->head = next << DHARA_LOG2_PPB(j->nand);
 	if (!j->head)
 		roll_stats(j);
 
@@ -584,24 +1239,29 @@ static int skip_block(struct dhara_journal *j, dhara_error_t *err)
 /* Make sure the head pointer is on a ready-to-program page. */
 static int prepare_head(struct dhara_journal *j, dhara_error_t *err)
 {
-	const dhara_page_t next = next_upage(j, j->head);
+	dhara_page_t next;
 	int i;
 
+	if (locate_head(j, err) < 0)
+		return -1;
+
+	next = next_upage(j, j->head);
+
 	/* We can't write if doing so would cause the head pointer to
 	 * roll onto the same block as the last-synced tail.
 	 */
-	if (align_eq(next, j->tail_sync, j->nand->log2_ppb) &&
-	    !align_eq(next, j->head, j->nand->log2_ppb)) {
+	if (align_eq(next, j->tail_sync, DHARA_LOG2_PPB(j->nand)) &&
+	    !align_eq(next, j->head, DHARA_LOG2_PPB(j->nand))) {
 		dhara_set_error(err, DHARA_E_JOURNAL_FULL);
 		return -1;
 	}
 
 	j->flags |= DHARA_JOURNAL_F_DIRTY;
-	if (!is_aligned(j->head, j->nand->log2_ppb))
+	if (!is_aligned(j->head, DHARA_LOG2_PPB(j->nand)))
 		return 0;
 
 	for (i = 0; i < DHARA_MAX_RETRIES; i++) {
-		const dhara_block_t blk = j->head >> j->nand->log2_ppb;
+		const dhara_block_t blk = j->head >> DHARA_LOG2_PPB(j->nand);
 
 		if (!dhara_nand_is_bad(j->nand, blk))
 			return dhara_nand_erase(j->nand, blk, err);
@@ -622,8 +1282,9 @@ static void restart_recovery(struct dhara_journal *j, dhara_page_t old_head)
 	 * bad at the end of recovery).
 	 */
 	if ((j->recover_meta == DHARA_PAGE_NONE) ||
-	    !align_eq(j->recover_meta, old_head, j->nand->log2_ppb))
-		dhara_nand_mark_bad(j->nand, old_head >> j->nand->log2_ppb);
+	    !align_eq(j->recover_meta, old_head, DHARA_LOG2_PPB(j->nand)))
+		dhara_nand_mark_bad(j->nand,
+				    old_head >> DHARA_LOG2_PPB(j->nand));
 	else
 		j->flags |= DHARA_JOURNAL_F_BAD_META;
 
@@ -634,7 +1295,7 @@ static void restart_recovery(struct dhara_journal *j, dhara_page_t old_head)
 	 */
 	j->flags &= ~DHARA_JOURNAL_F_ENUM_DONE;
 	j->recover_next =
-		j->recover_root & ~((1 << j->nand->log2_ppb) - 1);
+		j->recover_root & ~((1 << DHARA_LOG2_PPB(j->nand)) - 1);
 
 	j->root = j->recover_root;
 }
@@ -657,7 +1318,8 @@ static int dump_meta(struct dhara_journal *j, dhara_error_t *err)
 			j->head = next_upage(j, j->head);
 			if (!j->head)
 				roll_stats(j);
-			hdr_clear_user(j->page_buf, j->nand->log2_page_size);
+			hdr_clear_user(j->page_buf,
+				       DHARA_LOG2_PAGE_SIZE(j->nand));
 			return 0;
 		}
 
@@ -668,7 +1330,8 @@ static int dump_meta(struct dhara_journal *j, dhara_error_t *err)
 		}
 
 		j->bb_current++;
-		dhara_nand_mark_bad(j->nand, j->head >> j->nand->log2_ppb);
+		dhara_nand_mark_bad(j->nand,
+				    j->head >> DHARA_LOG2_PPB(j->nand));
 
 		if (skip_block(j, err) < 0)
 			return -1;
@@ -702,19 +1365,38 @@ static int recover_from(struct dhara_journal *j,
 	}
 
 	/* Were we block aligned? No recovery required! */
-	if (is_aligned(old_head, j->nand->log2_ppb)) {
-		dhara_nand_mark_bad(j->nand, old_head >> j->nand->log2_ppb);
+	if (is_aligned(old_head, DHARA_LOG2_PPB(j->nand))) {
+		dhara_nand_mark_bad(j->nand,
+				    old_head >> DHARA_LOG2_PPB(j->nand));
+		return 0;
+	}
+
+	/* A rolled-back root may lie in an older block, so that every
+	 * page of the failed block belongs to the abandoned transaction.
+	 * Nothing in it needs recovery.
+	 */
+	if (root_behind(j, old_head, DHARA_LOG2_PPB(j->nand))) {
+		dhara_nand_mark_bad(j->nand,
+				    old_head >> DHARA_LOG2_PPB(j->nand));
+		hdr_clear_user(j->page_buf, DHARA_LOG2_PAGE_SIZE(j->nand));
 		return 0;
 	}
 
 	j->recover_root = j->root;
 	j->recover_next =
-		j->recover_root & ~((1 << j->nand->log2_ppb) - 1);
+		j->recover_root & ~((1 << DHARA_LOG2_PPB(j->nand)) - 1);
 
-	/* Are we holding buffered metadata? Dump it first. */
-	if (!is_aligned(old_head, j->log2_ppc) &&
-	    dump_meta(j, err) < 0)
-		return -1;
+	/* Are we holding buffered metadata? Dump it first -- unless the
+	 * root's group is already complete, and the buffer describes only
+	 * pages of an abandoned transaction.
+	 */
+	if (!is_aligned(old_head, DHARA_LOG2_PPC(j))) {
+		if (root_behind(j, old_head, DHARA_LOG2_PPC(j)))
+			hdr_clear_user(j->page_buf,
+				       DHARA_LOG2_PAGE_SIZE(j->nand));
+		else if (dump_meta(j, err) < 0)
+			return -1;
+	}
 
 	j->flags |= DHARA_JOURNAL_F_RECOVERY;
 	dhara_set_error(err, DHARA_E_RECOVER);
@@ -727,26 +1409,101 @@ static void finish_recovery(struct dhara_journal *j)
 	 * block as bad.
 	 */
 	dhara_nand_mark_bad(j->nand,
-		j->recover_root >> j->nand->log2_ppb);
+		j->recover_root >> DHARA_LOG2_PPB(j->nand));
 
 	/* If we had to dump metadata, and the page on which we
 	 * did this also went bad, mark it bad too.
 	 */
 	if (j->flags & DHARA_JOURNAL_F_BAD_META)
 		dhara_nand_mark_bad(j->nand,
-			j->recover_meta >> j->nand->log2_ppb);
+			j->recover_meta >> DHARA_LOG2_PPB(j->nand));
 
 	/* Was the tail on this page? Skip it forward */
 	clear_recovery(j);
 }
 
+#if DHARA_OOB_META
+/* Build the record for the page about to be written at the head: the
+ * header of a checkpoint taken just after it, and its own metadata.
+ */
+static void prepare_record(struct dhara_journal *j, const uint8_t *meta)
+{
+	hdr_put_magic(j->page_buf);
+	hdr_set_epoch(j->page_buf, j->epoch);
+	hdr_set_tail(j->page_buf, j->tail);
+	hdr_set_bb_current(j->page_buf, j->bb_current);
+	hdr_set_bb_last(j->page_buf, j->bb_last);
+#if DHARA_WRAP_COUNT
+	hdr_set_wraps(j->page_buf, j->wraps);
+#endif
+#if DHARA_PPC_SELECT
+	hdr_set_ppc(j->page_buf, j->log2_ppc);
+#endif
+	rec_put_meta(j->page_buf, meta);
+	rec_seal(j->page_buf);
+}
+
+static int prog_page(struct dhara_journal *j, const uint8_t *data,
+		     const uint8_t *meta, dhara_error_t *err)
+{
+	prepare_record(j, meta);
+	return dhara_nand_prog_oob(j->nand, j->head, data,
+				   j->page_buf, DHARA_OOB_RECORD_SIZE, err);
+}
+
+static int copy_page(struct dhara_journal *j, dhara_page_t p,
+		     const uint8_t *meta, dhara_error_t *err)
+{
+	prepare_record(j, meta);
+	return dhara_nand_copy_oob(j->nand, p, j->head,
+				   j->page_buf, DHARA_OOB_RECORD_SIZE, err);
+}
+
+/* The page just written carried its own checkpoint, so there's nothing
+ * to buffer.
+ */
+static int push_meta(struct dhara_journal *j, const uint8_t *meta,
+		     dhara_error_t *err)
+{
+	j->flags &= ~DHARA_JOURNAL_F_DIRTY;
+
+	j->root = j->head;
+	j->head = next_upage(j, j->head);
+
+	if (!j->head)
+		roll_stats(j);
+
+	if (j->flags & DHARA_JOURNAL_F_ENUM_DONE)
+		finish_recovery(j);
+
+	if (!(j->flags & DHARA_JOURNAL_F_RECOVERY) && !txn_open(j))
+		j->tail_sync = j->tail;
+
+	return 0;
+}
+#else
+static int prog_page(struct dhara_journal *j, const uint8_t *data,
+		     const uint8_t *meta, dhara_error_t *err)
+{
+	if (!data)
+		return 0;
+
+	return dhara_nand_prog(j->nand, j->head, data, err);
+}
+
+static int copy_page(struct dhara_journal *j, dhara_page_t p,
+		     const uint8_t *meta, dhara_error_t *err)
+{
+	return dhara_nand_copy(j->nand, p, j->head, err);
+}
+
 static int push_meta(struct dhara_journal *j, const uint8_t *meta,
 		     dhara_error_t *err)
 {
 	const dhara_page_t old_head = j->head;
 	dhara_error_t my_err;
 	const size_t offset =
-		hdr_user_offset(j->head & ((1 << j->log2_ppc) - 1));
+		hdr_user_offset(j->head & ((1 << DHARA_LOG2_PPC(j)) - 1));
 
 	/* We've just written a user page. Add the metadata to the
 	 * buffer.
@@ -757,7 +1514,7 @@ static int push_meta(struct dhara_journal *j, const uint8_t *meta,
 		memset(j->page_buf + offset, 0xff, DHARA_META_SIZE);
 
 	/* Unless we've filled the buffer, don't do any IO */
-	if (!is_aligned(j->head + 2, j->log2_ppc)) {
+	if (!is_aligned(j->head + 2, DHARA_LOG2_PPC(j))) {
 		j->root = j->head;
 		j->head++;
 		return 0;
@@ -771,6 +1528,16 @@ static int push_meta(struct dhara_journal *j, const uint8_t *meta,
 	hdr_set_tail(j->page_buf, j->tail);
 	hdr_set_bb_current(j->page_buf, j->bb_current);
 	hdr_set_bb_last(j->page_buf, j->bb_last);
+#if DHARA_WRAP_COUNT
+	hdr_set_wraps(j->page_buf, j->wraps);
+#endif
+#if DHARA_TXN
+	hdr_set_txn_root(j->page_buf, j->txn_root);
+	hdr_set_txn_tail(j->page_buf, j->txn_tail);
+#endif
+#if DHARA_PPC_SELECT
+	hdr_set_ppc(j->page_buf, j->log2_ppc);
+#endif
 
 	if (dhara_nand_prog(j->nand, j->head + 1, j->page_buf, &my_err) < 0)
 		return recover_from(j, my_err, err);
@@ -786,11 +1553,12 @@ static int push_meta(struct dhara_journal *j, const uint8_t *meta,
 	if (j->flags & DHARA_JOURNAL_F_ENUM_DONE)
 		finish_recovery(j);
 
-	if (!(j->flags & DHARA_JOURNAL_F_RECOVERY))
+	if (!(j->flags & DHARA_JOURNAL_F_RECOVERY) && !txn_open(j))
 		j->tail_sync = j->tail;
 
 	return 0;
 }
+#endif
 
 int dhara_journal_enqueue(struct dhara_journal *j,
 			  const uint8_t *data, const uint8_t *meta,
@@ -801,8 +1569,7 @@ int dhara_journal_enqueue(struct dhara_journal *j,
 
 	for (i = 0; i < DHARA_MAX_RETRIES; i++) {
 		if (!(prepare_head(j, &my_err) ||
-		      (data && dhara_nand_prog(j->nand, j->head, data,
-					       &my_err))))
+		      prog_page(j, data, meta, &my_err)))
 			return push_meta(j, meta, err);
 
 		if (recover_from(j, my_err, err) < 0)
@@ -822,7 +1589,7 @@ int dhara_journal_copy(struct dhara_journal *j,
 
 	for (i = 0; i < DHARA_MAX_RETRIES; i++) {
 		if (!(prepare_head(j, &my_err) ||
-		      dhara_nand_copy(j->nand, p, j->head, &my_err)))
+		      copy_page(j, p, meta, &my_err)))
 			return push_meta(j, meta, err);
 
 		if (recover_from(j, my_err, err) < 0)
@@ -850,3 +1617,33 @@ dhara_page_t dhara_journal_next_recoverable(struct dhara_journal *j)
 
 	return n;
 }
+
+#if DHARA_TXN
+void dhara_journal_txn_begin(struct dhara_journal *j)
+{
+	j->txn_root = j->root;
+	j->txn_tail = j->tail;
+}
+
+int dhara_journal_txn_end(struct dhara_journal *j)
+{
+	const int written = j->root != j->txn_root;
+
+	j->txn_root = DHARA_PAGE_NONE;
+	j->txn_tail = DHARA_PAGE_NONE;
+
+	return written;
+}
+
+void dhara_journal_txn_abort(struct dhara_journal *j)
+{
+	/* The tail hasn't been released since the transaction began, so
+	 * tail_sync is still where it was.
+	 */
+	j->root = j->txn_root;
+	j->tail = j->txn_tail;
+
+	j->txn_root = DHARA_PAGE_NONE;
+	j->txn_tail = DHARA_PAGE_NONE;
+}
+#endif
@@ -20,8 +20,43 @@
 #include <stdint.h>
 #include "nand.h"
 
+/* Wrap counting. If non-zero, the checkpoint header also carries a
+ * 32-bit count of the times the head has wrapped around the chip.
+ * Unlike the epoch, it doesn't roll over, so together with the head it
+ * tells how many times each block has been erased. This changes the
+ * on-flash format, and the checkpoint magic with it: a journal written
+ * with the other setting isn't found, and the chip reads as blank. The
+ * same goes for the other format options below, and for the radix
+ * depth of a fixed geometry.
+ */
+#ifndef DHARA_WRAP_COUNT
+#define DHARA_WRAP_COUNT		0
+#endif
+
+/* Selectable checkpoint period. If non-zero, the checkpoint period is
+ * a property of each journal rather than of the build: it's chosen when
+ * a blank chip is formatted (see dhara_journal_select_ppc()), recorded
+ * in every checkpoint header, and read back on resume. This changes the
+ * on-flash format and the checkpoint magic.
+ */
+#ifndef DHARA_PPC_SELECT
+#define DHARA_PPC_SELECT		0
+#endif
+
+/* Transactions. If non-zero, writes can be grouped so that a resume
+ * keeps either all of them or none (see dhara_journal_txn_begin()). The
+ * checkpoint header carries the root and tail the open transaction, if
+ * any, started from. This changes the on-flash format and the
+ * checkpoint magic.
+ */
+#ifndef DHARA_TXN
+#define DHARA_TXN			0
+#endif
+
 /* Number of bytes used by the journal checkpoint header. */
-#define DHARA_HEADER_SIZE		16
+#define DHARA_HEADER_SIZE		(16 + (DHARA_WRAP_COUNT ? 4 : 0) + \
+					 (DHARA_TXN ? 8 : 0) + \
+					 (DHARA_PPC_SELECT ? 1 : 0))
 
 /* Global metadata available for a higher layer. This metadata is
  * persistent once the journal reaches a checkpoint, and is restored on
@@ -30,9 +65,10 @@
 #define DHARA_COOKIE_SIZE		4
 
 /* This is the size of the metadata slice which accompanies each written
- * page. This is independent of the underlying page/OOB size.
+ * page. This is independent of the underlying page/OOB size. It holds
+ * the sector number and one alternate pointer per radix tree level.
  */
-#define DHARA_META_SIZE			132
+#define DHARA_META_SIZE			(4 + (DHARA_RADIX_DEPTH << 2))
 
 /* When a block fails, or garbage is encountered, we try again on the
  * next block/checkpoint. We can do this up to the given number of
@@ -45,11 +81,124 @@
  */
 #define DHARA_PAGE_NONE			((dhara_page_t)0xffffffff)
 
+/* Spare-area metadata format (see geometry.h). Each page's record holds
+ * the checkpoint header and cookie as they'd appear at the start of a
+ * checkpoint page, followed by the page's metadata -- each 32-bit word
+ * of it cut down to DHARA_OOB_PTR_SIZE bytes -- and a check value.
+ */
+#if DHARA_OOB_META
+#if !DHARA_FIXED_GEOMETRY
+#error "DHARA_OOB_META requires a fixed geometry (see geometry.h)"
+#endif
+#if DHARA_PPC_SELECT
+#error "DHARA_OOB_META has no checkpoint period to select"
+#endif
+#if DHARA_TXN
+#error "DHARA_OOB_META records don't carry transactions"
+#endif
+#if (DHARA_RADIX_DEPTH >= (8 * DHARA_OOB_PTR_SIZE)) || \
+    ((DHARA_FIXED_NUM_BLOCKS << DHARA_FIXED_LOG2_PPB) >= \
+     (1 << (8 * DHARA_OOB_PTR_SIZE)))
+#error "DHARA_OOB_PTR_SIZE is too small for this geometry"
+#endif
+
+#define DHARA_OOB_META_SIZE		((DHARA_META_SIZE >> 2) * \
+					 DHARA_OOB_PTR_SIZE)
+#define DHARA_OOB_RECORD_SIZE		(DHARA_HEADER_SIZE + \
+					 DHARA_COOKIE_SIZE + \
+					 DHARA_OOB_META_SIZE + 2)
+#endif
+
+/* Checkpoint period. With a fixed geometry (see geometry.h), this is
+ * the same choice dhara_journal_init() makes at runtime: the largest
+ * period whose metadata fits in a checkpoint page. In the spare-area
+ * format, every page is its own checkpoint. A selectable period is
+ * always taken from the journal.
+ */
+#if DHARA_OOB_META
+#define DHARA_LOG2_PPC(j)		0
+#elif DHARA_FIXED_GEOMETRY
+#if DHARA_FIXED_LOG2_PROG_SIZE && \
+    (DHARA_FIXED_LOG2_PROG_SIZE < DHARA_FIXED_LOG2_PAGE_SIZE)
+#define DHARA_CP_META_MAX		((1 << DHARA_FIXED_LOG2_PROG_SIZE) - \
+					 DHARA_HEADER_SIZE - DHARA_COOKIE_SIZE)
+#else
+#define DHARA_CP_META_MAX		((1 << DHARA_FIXED_LOG2_PAGE_SIZE) - \
+					 DHARA_HEADER_SIZE - DHARA_COOKIE_SIZE)
+#endif
+
+#define DHARA_CP_FITS(k)		(((k) <= DHARA_FIXED_LOG2_PPB) && \
+					 ((((1 << (k)) - 1) * DHARA_META_SIZE) <= \
+					  DHARA_CP_META_MAX))
+
+#define DHARA_FIXED_LOG2_PPC		(DHARA_CP_FITS(10) ? 10 : \
+					 DHARA_CP_FITS(9) ? 9 : \
+					 DHARA_CP_FITS(8) ? 8 : \
+					 DHARA_CP_FITS(7) ? 7 : \
+					 DHARA_CP_FITS(6) ? 6 : \
+					 DHARA_CP_FITS(5) ? 5 : \
+					 DHARA_CP_FITS(4) ? 4 : \
+					 DHARA_CP_FITS(3) ? 3 : \
+					 DHARA_CP_FITS(2) ? 2 : 1)
+
+#if DHARA_PPC_SELECT
+#define DHARA_LOG2_PPC(j)		((j)->log2_ppc)
+#else
+#define DHARA_LOG2_PPC(j)		DHARA_FIXED_LOG2_PPC
+#endif
+#else
+#define DHARA_LOG2_PPC(j)		((j)->log2_ppc)
+#endif
+
 /* State flags */
 #define DHARA_JOURNAL_F_DIRTY		0x01
 #define DHARA_JOURNAL_F_BAD_META	0x02
 #define DHARA_JOURNAL_F_RECOVERY	0x04
 #define DHARA_JOURNAL_F_ENUM_DONE	0x08
+#define DHARA_JOURNAL_F_HEAD_PENDING	0x10
+
+/* Resume profiling. If non-zero, dhara_journal_resume() keeps a count
+ * of the NAND accesses made by each of its search phases, and times
+ * each phase with the profile's clock, if one is set.
+ */
+#ifndef DHARA_RESUME_PROFILE
+#define DHARA_RESUME_PROFILE		0
+#endif
+
+typedef enum {
+	DHARA_RESUME_HINT,		/* checks of a resume hint */
+	DHARA_RESUME_FIRST_BLOCK,	/* first checkpoint block */
+	DHARA_RESUME_LAST_BLOCK,	/* last checkpoint block of the epoch */
+	DHARA_RESUME_LAST_GROUP,	/* last programmed group in it */
+	DHARA_RESUME_ROOT,		/* last good checkpoint */
+	DHARA_RESUME_HEAD,		/* next free user page */
+	DHARA_RESUME_PHASES
+} dhara_resume_phase_t;
+
+struct dhara_resume_phase {
+	/* Checkpoint headers read, and the bytes fetched for them */
+	uint32_t			reads;
+	uint32_t			bytes;
+
+	/* Pages tested with dhara_nand_is_free() */
+	uint32_t			probes;
+
+	/* Clock ticks spent in the phase */
+	uint32_t			time;
+};
+
+struct dhara_resume_profile {
+	/* Optional clock (in any unit), read at phase boundaries. Set it
+	 * after dhara_journal_init().
+	 */
+	uint32_t			(*clock)(void);
+
+	struct dhara_resume_phase	phase[DHARA_RESUME_PHASES];
+
+	/* Phase in progress, and the clock reading at its start */
+	uint8_t				current;
+	uint32_t			started;
+};
 
 /* The journal layer presents the NAND pages as a double-ended queue.
  * Pages, with associated metadata may be pushed onto the end of the
@@ -73,15 +222,26 @@ struct dhara_journal {
 	 *
 	 * The last page of each checkpoint contains the journal header
 	 * and the metadata for the other pages in the period (the user
-	 * pages).
+	 * pages). In the spare-area format, this is 0: there are no
+	 * checkpoint pages.
 	 */
 	uint8_t				log2_ppc;
 
+#if DHARA_PPC_SELECT
+	/* Checkpoint period given to a blank journal */
+	uint8_t				format_log2_ppc;
+#endif
+
 	/* Epoch counter. This is incremented whenever the journal head
 	 * passes the end of the chip and wraps around.
 	 */
 	uint8_t				epoch;
 
+#if DHARA_WRAP_COUNT
+	/* Wrap counter: as the epoch, but never rolls over */
+	uint32_t			wraps;
+#endif
+
 	/* General purpose flags field */
 	uint8_t				flags;
 
@@ -116,6 +276,19 @@ struct dhara_journal {
 	dhara_page_t			recover_next;
 	dhara_page_t			recover_root;
 	dhara_page_t			recover_meta;
+
+#if DHARA_TXN
+	/* Root and tail of the journal when the open transaction began.
+	 * The tail is DHARA_PAGE_NONE if there's no transaction open.
+	 */
+	dhara_page_t			txn_root;
+	dhara_page_t			txn_tail;
+#endif
+
+#if DHARA_RESUME_PROFILE
+	/* Work done by the last dhara_journal_resume() */
+	struct dhara_resume_profile	profile;
+#endif
 };
 
 /* Initialize a journal. You must supply a pointer to a NAND chip
@@ -129,6 +302,20 @@ void dhara_journal_init(struct dhara_journal *j,
 			const struct dhara_nand *n,
 			uint8_t *page_buf);
 
+#if DHARA_PPC_SELECT
+/* Choose the checkpoint period given to the journal if the chip turns
+ * out to be blank: 2**log2_ppc pages per checkpoint, capped at the
+ * largest period whose metadata fits in a checkpoint page (0 picks that
+ * one). Call between dhara_journal_init() and resuming -- a journal
+ * found on the chip keeps the period it was formatted with.
+ *
+ * Each sync pads the head out to the end of its checkpoint group, so
+ * short periods make syncs cheap, and long ones leave more room for
+ * data: there's one checkpoint page per period.
+ */
+void dhara_journal_select_ppc(struct dhara_journal *j, uint8_t log2_ppc);
+#endif
+
 /* Start up the journal -- search the NAND for the journal head, or
  * initialize a blank journal if one isn't found. Returns 0 on success
  * or -1 if a (fatal) error occurs.
@@ -140,6 +327,45 @@ void dhara_journal_init(struct dhara_journal *j,
  */
 int dhara_journal_resume(struct dhara_journal *j, dhara_error_t *err);
 
+/* As dhara_journal_resume(), but only the root is searched for: the
+ * scan for the head is put off until the first page is enqueued,
+ * copied or cleared. Everything that reads the journal works in the
+ * meantime, so a session that only reads never pays for the scan.
+ */
+int dhara_journal_resume_lazy(struct dhara_journal *j,
+			      dhara_error_t *err);
+
+/* A resume hint records where the last checkpoint was written, so that
+ * the next resume can go straight to it. Keeping hints is up to the
+ * user: they're meant to be saved somewhere outside the journal after
+ * a sync, and withdrawn before the journal is next written to.
+ */
+struct dhara_journal_hint {
+	/* Page holding the checkpoint, and the epoch it was written in */
+	dhara_page_t			checkpoint;
+	uint8_t				epoch;
+};
+
+/* Describe the last checkpoint written. This succeeds only if the
+ * journal is clean and nothing has been written since the checkpoint
+ * (as is the case right after dhara_map_sync()).
+ * Returns 0 on success, or -1 if there's no hint to give.
+ */
+int dhara_journal_get_hint(const struct dhara_journal *j,
+			   struct dhara_journal_hint *hint);
+
+/* As dhara_journal_resume(), but starting from a hint. The checkpoint it
+ * names is read, and the page following it tested to be free, and if
+ * either check fails, the usual search is run instead.
+ *
+ * The check can't tell a free page from one programmed with all-0xff
+ * data, if is_free() can't either. Hints that outlive later writes
+ * aren't safe to use with such a chip -- withdraw them first.
+ */
+int dhara_journal_resume_hint(struct dhara_journal *j,
+			      const struct dhara_journal_hint *hint,
+			      dhara_error_t *err);
+
 /* Obtain an upper bound on the number of user pages storable in the
  * journal.
  */
@@ -175,6 +401,15 @@ int dhara_journal_read_meta(struct dhara_journal *j, dhara_page_t p,
  */
 dhara_page_t dhara_journal_peek(struct dhara_journal *j);
 
+/* Return the user page following p (a page returned by
+ * dhara_journal_peek() or by this function), or DHARA_PAGE_NONE if p
+ * was the last page before the head. Bad blocks are skipped as they
+ * are by dhara_journal_peek(), so the pages queued behind the tail can
+ * be inspected before they're dequeued.
+ */
+dhara_page_t dhara_journal_next(const struct dhara_journal *j,
+				dhara_page_t p);
+
 /* Remove the last page from the journal. This doesn't take permanent
  * effect until the next checkpoint.
  */
@@ -253,4 +488,39 @@ static inline int dhara_journal_in_recovery(const struct dhara_journal *j)
 
 dhara_page_t dhara_journal_next_recoverable(struct dhara_journal *j);
 
+#if DHARA_TXN
+/* Transactions. Call dhara_journal_txn_begin() with the journal clean.
+ * Until the transaction ends, every checkpoint records the root and tail
+ * as they are at the start, and a resume from such a checkpoint rolls
+ * back to them: the pages enqueued since are dropped, and the cookie is
+ * taken from the checkpoint that was current at the start. So it's the
+ * first checkpoint after dhara_journal_txn_end() that commits the
+ * transaction.
+ *
+ * While a transaction is open, the tail isn't released for reuse (see
+ * dhara_journal_size()), so that nothing it may roll back to is erased.
+ * Pages dequeued in the meantime only become free once it ends.
+ */
+void dhara_journal_txn_begin(struct dhara_journal *j);
+
+/* Is a transaction open? */
+static inline int dhara_journal_in_txn(const struct dhara_journal *j)
+{
+	return j->txn_tail != DHARA_PAGE_NONE;
+}
+
+/* End the open transaction. Returns non-zero if anything was enqueued
+ * since it began -- in which case, if the journal is clean, the last
+ * checkpoint was written inside the transaction, and another page must
+ * be enqueued to reach the checkpoint that commits it.
+ */
+int dhara_journal_txn_end(struct dhara_journal *j);
+
+/* Abandon the open transaction, going back to the root and tail it
+ * began with. Pages enqueued since are left for garbage collection. Not
+ * to be used during a recovery.
+ */
+void dhara_journal_txn_abort(struct dhara_journal *j);
+#endif
+
 #endif
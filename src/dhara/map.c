@@ -16,10 +16,10 @@
 
 #include <string.h>
 #include "bytes.h"
+#include "crc.h"
 #include "map.h"
 
-#define DHARA_RADIX_DEPTH	(sizeof(dhara_sector_t) << 3)
-
+/* DHARA_RADIX_DEPTH comes from geometry.h */
 static inline dhara_sector_t d_bit(int depth)
 {
 	return ((dhara_sector_t)1) << (DHARA_RADIX_DEPTH - depth - 1);
@@ -64,6 +64,89 @@ static inline void meta_set_alt(uint8_t *meta, int level, dhara_page_t alt)
 	dhara_w32(meta + 4 + (level << 2), alt);
 }
 
+/************************************************************************
+ * Write deduplication
+ */
+
+#if DHARA_DEDUP_ENTRIES
+static inline struct dhara_dedup_entry *dedup_slot(struct dhara_map *m,
+						   dhara_sector_t s)
+{
+	return &m->dedup[s % DHARA_DEDUP_ENTRIES];
+}
+
+static inline uint32_t dedup_hash(const struct dhara_map *m,
+				  const uint8_t *data)
+{
+	return dhara_crc32(DHARA_CRC_INIT, data,
+			   1 << DHARA_LOG2_PAGE_SIZE(m->journal.nand));
+}
+
+static void dedup_reset(struct dhara_map *m)
+{
+	int i;
+
+	for (i = 0; i < DHARA_DEDUP_ENTRIES; i++)
+		m->dedup[i].sector = DHARA_SECTOR_NONE;
+}
+
+static void dedup_store(struct dhara_map *m, dhara_sector_t s,
+			uint32_t crc)
+{
+	struct dhara_dedup_entry *e = dedup_slot(m, s);
+
+	e->sector = s;
+	e->crc = crc;
+}
+
+static void dedup_forget(struct dhara_map *m, dhara_sector_t s)
+{
+	struct dhara_dedup_entry *e = dedup_slot(m, s);
+
+	if (e->sector == s)
+		e->sector = DHARA_SECTOR_NONE;
+}
+
+/* Is the sector known to hold exactly this data already? Entries are
+ * only ever created for mapped sectors, and are dropped whenever a
+ * sector changes by any route other than dhara_map_write(), or is
+ * moved by garbage collection.
+ */
+static int dedup_match(struct dhara_map *m, dhara_sector_t s,
+		       uint32_t crc, const uint8_t *data)
+{
+	const struct dhara_dedup_entry *e = dedup_slot(m, s);
+
+	if ((e->sector != s) || (e->crc != crc))
+		return 0;
+
+#if DHARA_DEDUP_VERIFY
+	{
+		const struct dhara_nand *n = m->journal.nand;
+		const size_t page_size = 1 << DHARA_LOG2_PAGE_SIZE(n);
+		uint8_t chunk[DHARA_DEDUP_VERIFY];
+		dhara_error_t my_err;
+		dhara_page_t p;
+		size_t offset;
+
+		if (dhara_map_find(m, s, &p, &my_err) < 0)
+			return 0;
+
+		for (offset = 0; offset < page_size; offset += sizeof(chunk))
+			if ((dhara_nand_read(n, p, offset, sizeof(chunk),
+					     chunk, &my_err) < 0) ||
+			    memcmp(chunk, data + offset, sizeof(chunk)))
+				return 0;
+	}
+#endif
+
+	return 1;
+}
+#else
+static inline void dedup_reset(struct dhara_map *m) { }
+static inline void dedup_forget(struct dhara_map *m, dhara_sector_t s) { }
+#endif
+
 /************************************************************************
  * Public interface
  */
@@ -76,25 +159,68 @@ void dhara_map_init(struct dhara_map *m, const struct dhara_nand *n,
 
 	dhara_journal_init(&m->journal, n, page_buf);
 	m->gc_ratio = gc_ratio;
+
+#if DHARA_DEDUP_ENTRIES
+	m->dedup_skipped = 0;
+#endif
+	dedup_reset(m);
 }
 
-int dhara_map_resume(struct dhara_map *m, dhara_error_t *err)
+static int resume(struct dhara_map *m, int lazy,
+		  const struct dhara_journal_hint *hint, dhara_error_t *err)
 {
-	if (dhara_journal_resume(&m->journal, err) < 0) {
+	int ret;
+
+	dedup_reset(m);
+
+	if (hint)
+		ret = dhara_journal_resume_hint(&m->journal, hint, err);
+	else if (lazy)
+		ret = dhara_journal_resume_lazy(&m->journal, err);
+	else
+		ret = dhara_journal_resume(&m->journal, err);
+
+	if (ret < 0) {
 		m->count = 0;
 		return -1;
 	}
 
-	m->count = ck_get_count(dhara_journal_cookie(&m->journal));
+	/* A rollback (see dhara_map_txn_begin()) may leave the journal
+	 * empty, with the cookie of a later checkpoint.
+	 */
+	if (dhara_journal_root(&m->journal) == DHARA_PAGE_NONE)
+		m->count = 0;
+	else
+		m->count = ck_get_count(dhara_journal_cookie(&m->journal));
+
 	return 0;
 }
 
+int dhara_map_resume(struct dhara_map *m, dhara_error_t *err)
+{
+	return resume(m, 0, NULL, err);
+}
+
+int dhara_map_resume_lazy(struct dhara_map *m, dhara_error_t *err)
+{
+	return resume(m, 1, NULL, err);
+}
+
+int dhara_map_resume_hint(struct dhara_map *m,
+			  const struct dhara_journal_hint *hint,
+			  dhara_error_t *err)
+{
+	return resume(m, 0, hint, err);
+}
+
 void dhara_map_clear(struct dhara_map *m)
 {
 	if (m->count) {
 		m->count = 0;
 		dhara_journal_clear(&m->journal);
 	}
+
+	dedup_reset(m);
 }
 
 dhara_sector_t dhara_map_capacity(const struct dhara_map *m)
@@ -102,7 +228,7 @@ dhara_sector_t dhara_map_capacity(const struct dhara_map *m)
 	const dhara_sector_t cap = dhara_journal_capacity(&m->journal);
 	const dhara_sector_t reserve = cap / (m->gc_ratio + 1);
 	const dhara_sector_t safety_margin =
-		DHARA_MAX_RETRIES << m->journal.nand->log2_ppb;
+		DHARA_MAX_RETRIES << DHARA_LOG2_PPB(m->journal.nand);
 
 	if (reserve + safety_margin >= cap)
 		return 0;
@@ -194,7 +320,7 @@ int dhara_map_read(struct dhara_map *m, dhara_sector_t s,
 
 	if (dhara_map_find(m, s, &p, &my_err) < 0) {
 		if (my_err == DHARA_E_NOT_FOUND) {
-			memset(data, 0xff, 1 << n->log2_page_size);
+			memset(data, 0xff, 1 << DHARA_LOG2_PAGE_SIZE(n));
 			return 0;
 		}
 
@@ -202,7 +328,96 @@ int dhara_map_read(struct dhara_map *m, dhara_sector_t s,
 		return -1;
 	}
 
-	return dhara_nand_read(n, p, 0, 1 << n->log2_page_size, data, err);
+	if (dhara_nand_read(n, p, 0, 1 << DHARA_LOG2_PAGE_SIZE(n),
+			    data, err) < 0)
+		return -1;
+
+#if DHARA_DEDUP_ENTRIES
+	dedup_store(m, s, dedup_hash(m, data));
+#endif
+	return 0;
+}
+
+/* Look up a sector for dhara_map_read_run(). Returns 1 if it's mapped,
+ * 0 if not, or -1 on error.
+ */
+static int find_mapped(struct dhara_map *m, dhara_sector_t s,
+		       dhara_page_t *loc, dhara_error_t *err)
+{
+	dhara_error_t my_err;
+
+	if (dhara_map_find(m, s, loc, &my_err) < 0) {
+		if (my_err == DHARA_E_NOT_FOUND)
+			return 0;
+
+		dhara_set_error(err, my_err);
+		return -1;
+	}
+
+	return 1;
+}
+
+int dhara_map_read_run(struct dhara_map *m, dhara_sector_t s,
+		       dhara_sector_t count, uint8_t *data,
+		       dhara_error_t *err)
+{
+	const struct dhara_nand *n = m->journal.nand;
+	const size_t page_size = 1 << DHARA_LOG2_PAGE_SIZE(n);
+	dhara_page_t p;
+	int mapped;
+
+	if (!count)
+		return 0;
+
+	mapped = find_mapped(m, s, &p, err);
+
+	while (count) {
+		dhara_page_t q = 0;
+		dhara_sector_t run = 1;
+		int next_mapped = 0;
+
+		if (mapped < 0)
+			return -1;
+
+		/* Extend the run over the following sectors for as long as
+		 * they sit in the following pages. All lookups are done
+		 * before the data is read, so that the run can be streamed
+		 * without being interrupted by metadata reads.
+		 */
+		while (run < count) {
+			next_mapped = find_mapped(m, s + run, &q, err);
+			if (!mapped || next_mapped <= 0 || q != p + run)
+				break;
+
+			run++;
+		}
+
+		if (!mapped) {
+			memset(data, 0xff, page_size);
+		} else {
+#if DHARA_DEDUP_ENTRIES
+			dhara_sector_t i;
+#endif
+
+			if (dhara_nand_read_pages(n, p, run, data, err) < 0)
+				return -1;
+
+#if DHARA_DEDUP_ENTRIES
+			for (i = 0; i < run; i++)
+				dedup_store(m, s + i,
+					    dedup_hash(m, data + i * page_size));
+#endif
+		}
+
+		s += run;
+		data += run * page_size;
+		count -= run;
+
+		p = q;
+		mapped = next_mapped;
+	}
+
+	return 0;
 }
 
 /* Check the given page. If it's garbage, do nothing. Otherwise, rewrite
@@ -242,6 +457,11 @@ static int raw_gc(struct dhara_map *m, dhara_page_t src,
 	if (current != src)
 		return 0;
 
+	/* The copy is made without the data passing through here, so
+	 * the remembered hash can't vouch for it.
+	 */
+	dedup_forget(m, target);
+
 	/* Rewrite it at the front of the journal with updated metadata */
 	ck_set_count(dhara_journal_cookie(&m->journal), m->count);
 	if (dhara_journal_copy(&m->journal, src, meta, err) < 0)
@@ -305,6 +525,23 @@ static int try_recover(struct dhara_map *m, dhara_error_t cause,
 	return 0;
 }
 
+#if DHARA_TXN
+/* Nothing is released for reuse while a transaction is open, so its
+ * pages come out of the reserve that keeps garbage collection going.
+ * Half of the reserve is left for collection to catch up with, should
+ * the transaction be abandoned.
+ */
+static int txn_full(const struct dhara_map *m)
+{
+	const dhara_sector_t reserve =
+		dhara_journal_capacity(&m->journal) / (m->gc_ratio + 1);
+
+	return dhara_journal_in_txn(&m->journal) &&
+		(dhara_journal_size(&m->journal) >=
+		 dhara_map_capacity(m) + (reserve >> 1));
+}
+#endif
+
 static int auto_gc(struct dhara_map *m, dhara_error_t *err)
 {
 	int i;
@@ -312,6 +549,13 @@ static int auto_gc(struct dhara_map *m, dhara_error_t *err)
 	if (dhara_journal_size(&m->journal) < dhara_map_capacity(m))
 		return 0;
 
+#if DHARA_TXN
+	if (txn_full(m)) {
+		dhara_set_error(err, DHARA_E_JOURNAL_FULL);
+		return -1;
+	}
+#endif
+
 	for (i = 0; i < m->gc_ratio; i++)
 		if (dhara_map_gc(m, err) < 0)
 			return -1;
@@ -348,6 +592,18 @@ static int prepare_write(struct dhara_map *m, dhara_sector_t dst,
 int dhara_map_write(struct dhara_map *m, dhara_sector_t dst,
 		    const uint8_t *data, dhara_error_t *err)
 {
+#if DHARA_DEDUP_ENTRIES
+	const uint32_t crc = dedup_hash(m, data);
+
+	if (dedup_match(m, dst, crc, data)) {
+		m->dedup_skipped++;
+		return 0;
+	}
+
+	/* Forget the old hash until the new data is safely enqueued */
+	dedup_forget(m, dst);
+#endif
+
 	for (;;) {
 		uint8_t meta[DHARA_META_SIZE];
 		dhara_error_t my_err;
@@ -365,12 +621,17 @@ int dhara_map_write(struct dhara_map *m, dhara_sector_t dst,
 			return -1;
 	}
 
+#if DHARA_DEDUP_ENTRIES
+	dedup_store(m, dst, crc);
+#endif
 	return 0;
 }
 
 int dhara_map_copy_page(struct dhara_map *m, dhara_page_t src,
 			dhara_sector_t dst, dhara_error_t *err)
 {
+	dedup_forget(m, dst);
+
 	for (;;) {
 		uint8_t meta[DHARA_META_SIZE];
 		dhara_error_t my_err;
@@ -467,6 +728,8 @@ static int try_delete(struct dhara_map *m, dhara_sector_t s,
 
 int dhara_map_trim(struct dhara_map *m, dhara_sector_t s, dhara_error_t *err)
 {
+	dedup_forget(m, s);
+
 	for (;;) {
 		dhara_error_t my_err;
 
@@ -493,8 +756,12 @@ int dhara_map_sync(struct dhara_map *m, dhara_error_t *err)
 		if (p == DHARA_PAGE_NONE) {
 			ret = pad_queue(m, &my_err);
 		} else {
+			/* A page whose copy failed stays at the tail, to
+			 * be copied again once the journal has recovered.
+			 */
 			ret = raw_gc(m, p, &my_err);
-			dhara_journal_dequeue(&m->journal);
+			if (!ret)
+				dhara_journal_dequeue(&m->journal);
 		}
 
 		if ((ret < 0) && (try_recover(m, my_err, err) < 0))
@@ -527,3 +794,52 @@ int dhara_map_gc(struct dhara_map *m, dhara_error_t *err)
 
 	return 0;
 }
+
+#if DHARA_TXN
+int dhara_map_txn_begin(struct dhara_map *m, dhara_error_t *err)
+{
+	if (dhara_journal_in_txn(&m->journal))
+		return 0;
+
+	if (dhara_map_sync(m, err) < 0)
+		return -1;
+
+	m->txn_count = m->count;
+	dhara_journal_txn_begin(&m->journal);
+	return 0;
+}
+
+int dhara_map_txn_commit(struct dhara_map *m, dhara_error_t *err)
+{
+	/* If the transaction ended on a checkpoint, that one doesn't
+	 * commit it -- pad the queue out to the next.
+	 */
+	if (dhara_journal_in_txn(&m->journal) &&
+	    dhara_journal_txn_end(&m->journal) &&
+	    dhara_journal_is_clean(&m->journal)) {
+		dhara_error_t my_err;
+
+		if ((pad_queue(m, &my_err) < 0) &&
+		    (try_recover(m, my_err, err) < 0))
+			return -1;
+	}
+
+	return dhara_map_sync(m, err);
+}
+
+int dhara_map_txn_abort(struct dhara_map *m, dhara_error_t *err)
+{
+	if (!dhara_journal_in_txn(&m->journal))
+		return 0;
+
+	dedup_reset(m);
+
+	/* The recovery would carry on with pages of the transaction */
+	if (dhara_journal_in_recovery(&m->journal))
+		return dhara_map_resume(m, err);
+
+	dhara_journal_txn_abort(&m->journal);
+	m->count = m->txn_count;
+	return 0;
+}
+#endif
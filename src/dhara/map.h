@@ -27,11 +27,50 @@ typedef uint32_t dhara_sector_t;
 /* This sector value is reserved */
 #define DHARA_SECTOR_NONE	0xffffffff
 
+/* Write deduplication. If non-zero, the map keeps a direct-mapped table
+ * of this many (sector, CRC-32) pairs, filled in by reads and writes of
+ * mapped sectors. A write whose data hashes to the value remembered for
+ * that sector is dropped instead of consuming a journal page. This
+ * catches the common case of a filesystem writing back unchanged
+ * FAT/FSInfo/directory sectors.
+ */
+#ifndef DHARA_DEDUP_ENTRIES
+#define DHARA_DEDUP_ENTRIES	0
+#endif
+
+/* If non-zero, a deduplication hit is confirmed by reading back the
+ * stored page and comparing it with the new data, in chunks of this many
+ * bytes (on the stack). This rules out hash collisions at the cost of
+ * (page size / chunk size) page reads.
+ */
+#ifndef DHARA_DEDUP_VERIFY
+#define DHARA_DEDUP_VERIFY	0
+#endif
+
+#if DHARA_DEDUP_ENTRIES
+struct dhara_dedup_entry {
+	dhara_sector_t		sector;
+	uint32_t		crc;
+};
+#endif
+
 struct dhara_map {
 	struct dhara_journal	journal;
 
 	uint8_t			gc_ratio;
 	dhara_sector_t		count;
+
+#if DHARA_DEDUP_ENTRIES
+	struct dhara_dedup_entry dedup[DHARA_DEDUP_ENTRIES];
+
+	/* Number of writes dropped because the data was unchanged */
+	uint32_t		dedup_skipped;
+#endif
+
+#if DHARA_TXN
+	/* Sector count when the open transaction began */
+	dhara_sector_t		txn_count;
+#endif
 };
 
 /* Initialize a map. You need to supply a buffer for page metadata, and
@@ -50,6 +89,20 @@ void dhara_map_init(struct dhara_map *m, const struct dhara_nand *n,
  */
 int dhara_map_resume(struct dhara_map *m, dhara_error_t *err);
 
+/* As dhara_map_resume(), but the journal's search for its head is left
+ * to the first write (see dhara_journal_resume_lazy()), so the map is
+ * readable as soon as the root has been found.
+ */
+int dhara_map_resume_lazy(struct dhara_map *m, dhara_error_t *err);
+
+/* As dhara_map_resume(), but starting from a hint taken with
+ * dhara_journal_get_hint() after the last sync (see
+ * dhara_journal_resume_hint()).
+ */
+int dhara_map_resume_hint(struct dhara_map *m,
+			  const struct dhara_journal_hint *hint,
+			  dhara_error_t *err);
+
 /* Clear the map (delete all sectors). */
 void dhara_map_clear(struct dhara_map *m);
 
@@ -75,7 +128,17 @@ int dhara_map_find(struct dhara_map *m, dhara_sector_t s,
 int dhara_map_read(struct dhara_map *m, dhara_sector_t s,
 		   uint8_t *data, dhara_error_t *err);
 
-/* Write data to a logical sector. */
+/* Read count consecutive logical sectors, as dhara_map_read() would.
+ * Sectors stored in consecutive pages are read with a single call to
+ * dhara_nand_read_pages().
+ */
+int dhara_map_read_run(struct dhara_map *m, dhara_sector_t s,
+		       dhara_sector_t count, uint8_t *data,
+		       dhara_error_t *err);
+
+/* Write data to a logical sector. If deduplication is enabled and the
+ * sector is known to already hold this data, nothing is written.
+ */
 int dhara_map_write(struct dhara_map *m, dhara_sector_t s,
 		    const uint8_t *data, dhara_error_t *err);
 
@@ -111,4 +174,37 @@ int dhara_map_sync(struct dhara_map *m, dhara_error_t *err);
  */
 int dhara_map_gc(struct dhara_map *m, dhara_error_t *err);
 
+#if DHARA_TXN
+/* Transactions. Every change made between dhara_map_txn_begin() and
+ * dhara_map_txn_commit() becomes persistent at the commit, all at once:
+ * a resume after a power loss in between finds the map as it was at the
+ * begin. A sync inside a transaction makes its changes durable, but not
+ * committed.
+ *
+ * The commit takes one checkpoint, as a sync does. Nothing is released
+ * for reuse until then, so a transaction may only grow into half of the
+ * space kept in reserve for garbage collection (see
+ * dhara_map_capacity()) -- writes beyond that fail with
+ * DHARA_E_JOURNAL_FULL. Each write also takes the pages garbage
+ * collection copies for it, so once the journal is full, a transaction
+ * may hold as few as reserve / 2 / (gc_ratio + 1) writes.
+ */
+
+/* Sync, and begin a transaction. Beginning a transaction while one is
+ * open has no effect.
+ */
+int dhara_map_txn_begin(struct dhara_map *m, dhara_error_t *err);
+
+/* Commit the open transaction, and sync. Without an open transaction,
+ * this is a sync.
+ */
+int dhara_map_txn_commit(struct dhara_map *m, dhara_error_t *err);
+
+/* Abandon the open transaction: the map goes back to the state it was
+ * in at the begin. If the journal was left in recovery by a failed
+ * write, it's resumed from the chip instead.
+ */
+int dhara_map_txn_abort(struct dhara_map *m, dhara_error_t *err);
+#endif
+
 #endif
@@ -31,12 +31,13 @@ typedef uint32_t dhara_page_t;
 /* Blocks are also indexed, starting at 0. */
 typedef uint32_t dhara_block_t;
 
-/* Each NAND chip must be represented by one of these structures. It's
- * intended that this structure be embedded in a larger structure for
- * context.
- *
- * The functions declared below are not implemented -- they must be
- * provided and satisfy the documented conditions.
+struct dhara_nand_ops;
+
+/* Each NAND chip must be represented by one of these structures. The
+ * chip is accessed through the functions of its backend (see struct
+ * dhara_nand_ops below), which get the structure itself and may keep
+ * their state behind the context pointer -- so several chips, of the
+ * same or different kinds, can be managed side by side.
  */
 struct dhara_nand {
 	/* Base-2 logarithm of the page size. If your device supports
@@ -51,15 +52,73 @@ struct dhara_nand {
 
 	/* Total number of eraseblocks */
 	unsigned int	num_blocks;
+
+	/* Base-2 logarithm of the largest unit the chip programs in one
+	 * operation, if pages are made of several such units (0
+	 * otherwise). Checkpoint metadata is kept within the first unit
+	 * of a page, so that a program interrupted part way through
+	 * can't leave a checkpoint header without its metadata.
+	 */
+	uint8_t		log2_prog_size;
+
+	/* Backend operations, and the backend's private state */
+	const struct dhara_nand_ops	*ops;
+	void				*ctx;
+};
+
+/* Compile-time overrides for the fields above */
+#include "geometry.h"
+
+/* Backend operations. Every function must be provided, and must
+ * satisfy the conditions documented with its wrapper below.
+ */
+struct dhara_nand_ops {
+	int (*is_bad)(const struct dhara_nand *n, dhara_block_t b);
+	void (*mark_bad)(const struct dhara_nand *n, dhara_block_t b);
+	int (*erase)(const struct dhara_nand *n, dhara_block_t b,
+		     dhara_error_t *err);
+	int (*prog)(const struct dhara_nand *n, dhara_page_t p,
+		    const uint8_t *data, dhara_error_t *err);
+	int (*is_free)(const struct dhara_nand *n, dhara_page_t p);
+	int (*read)(const struct dhara_nand *n, dhara_page_t p,
+		    size_t offset, size_t length, uint8_t *data,
+		    dhara_error_t *err);
+	int (*read_pages)(const struct dhara_nand *n, dhara_page_t p,
+			  dhara_page_t count, uint8_t *data,
+			  dhara_error_t *err);
+	int (*copy)(const struct dhara_nand *n,
+		    dhara_page_t src, dhara_page_t dst,
+		    dhara_error_t *err);
+#if DHARA_OOB_META
+	int (*prog_oob)(const struct dhara_nand *n, dhara_page_t p,
+			const uint8_t *data,
+			const uint8_t *oob, size_t oob_len,
+			dhara_error_t *err);
+	int (*read_oob)(const struct dhara_nand *n, dhara_page_t p,
+			uint8_t *oob, size_t oob_len,
+			dhara_error_t *err);
+	int (*copy_oob)(const struct dhara_nand *n,
+			dhara_page_t src, dhara_page_t dst,
+			const uint8_t *oob, size_t oob_len,
+			dhara_error_t *err);
+#endif
 };
 
 /* Is the given block bad? */
-int dhara_nand_is_bad(const struct dhara_nand *n, dhara_block_t b);
+static inline int dhara_nand_is_bad(const struct dhara_nand *n,
+				    dhara_block_t b)
+{
+	return n->ops->is_bad(n, b);
+}
 
 /* Mark bad the given block (or attempt to). No return value is
  * required, because there's nothing that can be done in response.
  */
-void dhara_nand_mark_bad(const struct dhara_nand *n, dhara_block_t b);
+static inline void dhara_nand_mark_bad(const struct dhara_nand *n,
+				       dhara_block_t b)
+{
+	n->ops->mark_bad(n, b);
+}
 
 /* Erase the given block. This function should return 0 on success or -1
  * on failure.
@@ -67,8 +126,11 @@ void dhara_nand_mark_bad(const struct dhara_nand *n, dhara_block_t b);
  * The status reported by the chip should be checked. If an erase
  * operation fails, return -1 and set err to E_BAD_BLOCK.
  */
-int dhara_nand_erase(const struct dhara_nand *n, dhara_block_t b,
-		     dhara_error_t *err);
+static inline int dhara_nand_erase(const struct dhara_nand *n,
+				   dhara_block_t b, dhara_error_t *err)
+{
+	return n->ops->erase(n, b, err);
+}
 
 /* Program the given page. The data pointer is a pointer to an entire
  * page ((1 << log2_page_size) bytes). The operation status should be
@@ -78,28 +140,95 @@ int dhara_nand_erase(const struct dhara_nand *n, dhara_block_t b,
  * Pages will be programmed sequentially within a block, and will not be
  * reprogrammed.
  */
-int dhara_nand_prog(const struct dhara_nand *n, dhara_page_t p,
-		    const uint8_t *data,
-		    dhara_error_t *err);
+static inline int dhara_nand_prog(const struct dhara_nand *n,
+				  dhara_page_t p, const uint8_t *data,
+				  dhara_error_t *err)
+{
+	return n->ops->prog(n, p, data, err);
+}
 
 /* Check that the given page is erased */
-int dhara_nand_is_free(const struct dhara_nand *n, dhara_page_t p);
+static inline int dhara_nand_is_free(const struct dhara_nand *n,
+				     dhara_page_t p)
+{
+	return n->ops->is_free(n, p);
+}
 
 /* Read a portion of a page. ECC must be handled by the NAND
  * implementation. Returns 0 on sucess or -1 if an error occurs. If an
  * uncorrectable ECC error occurs, return -1 and set err to E_ECC.
  */
-int dhara_nand_read(const struct dhara_nand *n, dhara_page_t p,
-		    size_t offset, size_t length,
-		    uint8_t *data,
-		    dhara_error_t *err);
+static inline int dhara_nand_read(const struct dhara_nand *n,
+				  dhara_page_t p,
+				  size_t offset, size_t length,
+				  uint8_t *data,
+				  dhara_error_t *err)
+{
+	return n->ops->read(n, p, offset, length, data, err);
+}
+
+/* Read count whole, consecutive pages starting at p. Errors are
+ * reported as for dhara_nand_read(). Consecutive pages may cross block
+ * boundaries, and the implementation may pipeline the array reads.
+ */
+static inline int dhara_nand_read_pages(const struct dhara_nand *n,
+					dhara_page_t p,
+					dhara_page_t count,
+					uint8_t *data,
+					dhara_error_t *err)
+{
+	return n->ops->read_pages(n, p, count, data, err);
+}
 
 /* Read a page from one location and reprogram it in another location.
  * This might be done using the chip's internal buffers, but it must use
  * ECC.
  */
-int dhara_nand_copy(const struct dhara_nand *n,
-		    dhara_page_t src, dhara_page_t dst,
-		    dhara_error_t *err);
+static inline int dhara_nand_copy(const struct dhara_nand *n,
+				  dhara_page_t src, dhara_page_t dst,
+				  dhara_error_t *err)
+{
+	return n->ops->copy(n, src, dst, err);
+}
+
+#if DHARA_OOB_META
+/* Spare-area metadata format (see geometry.h): each page carries a
+ * record of oob_len bytes in its spare area.
+ *
+ * Program a page along with its record, in a single operation. If data
+ * is NULL, the data area is left erased. Errors are reported as for
+ * dhara_nand_prog().
+ */
+static inline int dhara_nand_prog_oob(const struct dhara_nand *n,
+				      dhara_page_t p,
+				      const uint8_t *data,
+				      const uint8_t *oob, size_t oob_len,
+				      dhara_error_t *err)
+{
+	return n->ops->prog_oob(n, p, data, oob, oob_len, err);
+}
+
+/* Read back the record of a page. Errors are reported as for
+ * dhara_nand_read().
+ */
+static inline int dhara_nand_read_oob(const struct dhara_nand *n,
+				      dhara_page_t p,
+				      uint8_t *oob, size_t oob_len,
+				      dhara_error_t *err)
+{
+	return n->ops->read_oob(n, p, oob, oob_len, err);
+}
+
+/* Copy a page, giving the copy a new record. Errors are reported as for
+ * dhara_nand_copy().
+ */
+static inline int dhara_nand_copy_oob(const struct dhara_nand *n,
+				      dhara_page_t src, dhara_page_t dst,
+				      const uint8_t *oob, size_t oob_len,
+				      dhara_error_t *err)
+{
+	return n->ops->copy_oob(n, src, dst, oob, oob_len, err);
+}
+#endif
 
 #endif
@@ -0,0 +1,313 @@
+/**
+ * @file		nand_image.c
+ * @author		Andrew Loebs
+ * @brief		Implementation file of the RAM and file image dhara_nand backends
+ *
+ */
+
+#include "nand_image.h"
+
+#include <string.h>
+
+// defines
+// spare-area layout
+#define BAD_BLOCK_MARK_OFFSET  0
+#define PROGRAMMED_MARK_OFFSET 1
+#define RECORD_OFFSET          2
+#define RECORD_MAX_SIZE        (DHARA_NAND_IMAGE_SPARE_SIZE - RECORD_OFFSET)
+
+// bytes moved at a time by copies and by programs of file images
+#define CHUNK_SIZE 256
+
+// private function prototypes
+static int image_is_bad(const struct dhara_nand *n, dhara_block_t b);
+static void image_mark_bad(const struct dhara_nand *n, dhara_block_t b);
+static int image_erase(const struct dhara_nand *n, dhara_block_t b, dhara_error_t *err);
+static int image_prog(const struct dhara_nand *n, dhara_page_t p, const uint8_t *data,
+                      dhara_error_t *err);
+static int image_is_free(const struct dhara_nand *n, dhara_page_t p);
+static int image_read_page(const struct dhara_nand *n, dhara_page_t p, size_t offset,
+                           size_t length, uint8_t *data, dhara_error_t *err);
+static int image_read_pages(const struct dhara_nand *n, dhara_page_t p, dhara_page_t count,
+                            uint8_t *data, dhara_error_t *err);
+static int image_copy(const struct dhara_nand *n, dhara_page_t src, dhara_page_t dst,
+                      dhara_error_t *err);
+#if DHARA_OOB_META
+static int image_prog_oob(const struct dhara_nand *n, dhara_page_t p, const uint8_t *data,
+                          const uint8_t *oob, size_t oob_len, dhara_error_t *err);
+static int image_read_oob(const struct dhara_nand *n, dhara_page_t p, uint8_t *oob,
+                          size_t oob_len, dhara_error_t *err);
+static int image_copy_oob(const struct dhara_nand *n, dhara_page_t src, dhara_page_t dst,
+                          const uint8_t *oob, size_t oob_len, dhara_error_t *err);
+#endif
+
+static int io_ret(int ret, dhara_error_t *err);
+static size_t page_stride(const struct dhara_nand *n);
+static size_t page_offset(const struct dhara_nand *n, dhara_page_t p);
+static size_t spare_offset(const struct dhara_nand *n, dhara_page_t p);
+static int load(const struct dhara_nand *n, size_t offset, uint8_t *data, size_t len);
+static int store(const struct dhara_nand *n, size_t offset, const uint8_t *data, size_t len);
+static int program(const struct dhara_nand *n, size_t offset, const uint8_t *data, size_t len);
+static int fill(const struct dhara_nand *n, size_t offset, size_t len);
+static int mark_programmed(const struct dhara_nand *n, dhara_page_t p);
+
+// public constants
+const struct dhara_nand_ops dhara_nand_image_ops = {
+    .is_bad = image_is_bad,
+    .mark_bad = image_mark_bad,
+    .erase = image_erase,
+    .prog = image_prog,
+    .is_free = image_is_free,
+    .read = image_read_page,
+    .read_pages = image_read_pages,
+    .copy = image_copy,
+#if DHARA_OOB_META
+    .prog_oob = image_prog_oob,
+    .read_oob = image_read_oob,
+    .copy_oob = image_copy_oob,
+#endif
+};
+
+// public function definitions
+size_t dhara_nand_image_size(const struct dhara_nand *n)
+{
+    return ((size_t)DHARA_NUM_BLOCKS(n) << DHARA_LOG2_PPB(n)) * page_stride(n);
+}
+
+void dhara_nand_image_init_ram(struct dhara_nand *n, dhara_nand_image_t *image, uint8_t *buffer)
+{
+    image->ram = buffer;
+    image->file = NULL;
+    n->ops = &dhara_nand_image_ops;
+    n->ctx = image;
+}
+
+void dhara_nand_image_init_file(struct dhara_nand *n, dhara_nand_image_t *image, FILE *file)
+{
+    image->ram = NULL;
+    image->file = file;
+    n->ops = &dhara_nand_image_ops;
+    n->ctx = image;
+}
+
+int dhara_nand_image_format(const struct dhara_nand *n)
+{
+    return fill(n, 0, dhara_nand_image_size(n));
+}
+
+// private function definitions
+static int image_is_bad(const struct dhara_nand *n, dhara_block_t b)
+{
+    uint8_t mark;
+    const dhara_page_t p = b << DHARA_LOG2_PPB(n);
+    // if the mark can't be read, we'll just call this block bad
+    if (load(n, spare_offset(n, p) + BAD_BLOCK_MARK_OFFSET, &mark, 1)) return 1;
+
+    return 0xff != mark;
+}
+
+static void image_mark_bad(const struct dhara_nand *n, dhara_block_t b)
+{
+    static const uint8_t mark = 0x00;
+    const dhara_page_t p = b << DHARA_LOG2_PPB(n);
+    store(n, spare_offset(n, p) + BAD_BLOCK_MARK_OFFSET, &mark, 1); // ignore ret
+}
+
+static int image_erase(const struct dhara_nand *n, dhara_block_t b, dhara_error_t *err)
+{
+    return io_ret(fill(n, page_offset(n, b << DHARA_LOG2_PPB(n)),
+                       page_stride(n) << DHARA_LOG2_PPB(n)),
+                  err);
+}
+
+static int image_prog(const struct dhara_nand *n, dhara_page_t p, const uint8_t *data,
+                      dhara_error_t *err)
+{
+    if (program(n, page_offset(n, p), data, (size_t)1 << DHARA_LOG2_PAGE_SIZE(n))) {
+        return io_ret(-1, err);
+    }
+    return io_ret(mark_programmed(n, p), err);
+}
+
+static int image_is_free(const struct dhara_nand *n, dhara_page_t p)
+{
+    uint8_t mark;
+    // if the mark can't be read, we'll report the page as "not free"
+    if (load(n, spare_offset(n, p) + PROGRAMMED_MARK_OFFSET, &mark, 1)) return 0;
+
+    return 0xff == mark;
+}
+
+static int image_read_page(const struct dhara_nand *n, dhara_page_t p, size_t offset,
+                           size_t length, uint8_t *data, dhara_error_t *err)
+{
+    return io_ret(load(n, page_offset(n, p) + offset, data, length), err);
+}
+
+static int image_read_pages(const struct dhara_nand *n, dhara_page_t p, dhara_page_t count,
+                            uint8_t *data, dhara_error_t *err)
+{
+    // the spare bytes between pages are skipped
+    const size_t page_size = (size_t)1 << DHARA_LOG2_PAGE_SIZE(n);
+    for (dhara_page_t i = 0; i < count; i++) {
+        if (load(n, page_offset(n, p + i), data, page_size)) return io_ret(-1, err);
+        data += page_size;
+    }
+
+    return 0;
+}
+
+/* Read a page from one location and reprogram it in another location.
+ * This might be done using the chip's internal buffers, but it must use
+ * ECC.
+ */
+static int image_copy(const struct dhara_nand *n, dhara_page_t src, dhara_page_t dst,
+                      dhara_error_t *err)
+{
+    uint8_t chunk[CHUNK_SIZE];
+    const size_t page_size = (size_t)1 << DHARA_LOG2_PAGE_SIZE(n);
+    for (size_t i = 0; i < page_size; i += sizeof(chunk)) {
+        const size_t len = (page_size - i < sizeof(chunk)) ? page_size - i : sizeof(chunk);
+        if (load(n, page_offset(n, src) + i, chunk, len) ||
+            program(n, page_offset(n, dst) + i, chunk, len)) {
+            return io_ret(-1, err);
+        }
+    }
+
+    return io_ret(mark_programmed(n, dst), err);
+}
+
+#if DHARA_OOB_META
+static int image_prog_oob(const struct dhara_nand *n, dhara_page_t p, const uint8_t *data,
+                          const uint8_t *oob, size_t oob_len, dhara_error_t *err)
+{
+    if (oob_len > RECORD_MAX_SIZE) return io_ret(-1, err);
+
+    if (data && program(n, page_offset(n, p), data, (size_t)1 << DHARA_LOG2_PAGE_SIZE(n))) {
+        return io_ret(-1, err);
+    }
+    if (program(n, spare_offset(n, p) + RECORD_OFFSET, oob, oob_len)) return io_ret(-1, err);
+    return io_ret(mark_programmed(n, p), err);
+}
+
+static int image_read_oob(const struct dhara_nand *n, dhara_page_t p, uint8_t *oob,
+                          size_t oob_len, dhara_error_t *err)
+{
+    if (oob_len > RECORD_MAX_SIZE) return io_ret(-1, err);
+
+    return io_ret(load(n, spare_offset(n, p) + RECORD_OFFSET, oob, oob_len), err);
+}
+
+static int image_copy_oob(const struct dhara_nand *n, dhara_page_t src, dhara_page_t dst,
+                          const uint8_t *oob, size_t oob_len, dhara_error_t *err)
+{
+    if (oob_len > RECORD_MAX_SIZE) return io_ret(-1, err);
+
+    if (image_copy(n, src, dst, err)) return -1;
+    return io_ret(program(n, spare_offset(n, dst) + RECORD_OFFSET, oob, oob_len), err);
+}
+#endif // DHARA_OOB_META
+
+/// @brief Turns the result of an image access into a dhara return -- a failure is an I/O error
+static int io_ret(int ret, dhara_error_t *err)
+{
+    if (!ret) return 0;
+
+    dhara_set_error(err, DHARA_E_IO);
+    return -1;
+}
+
+/// @brief Returns the bytes taken by one page in the image, spare area included
+static size_t page_stride(const struct dhara_nand *n)
+{
+    return ((size_t)1 << DHARA_LOG2_PAGE_SIZE(n)) + DHARA_NAND_IMAGE_SPARE_SIZE;
+}
+
+static size_t page_offset(const struct dhara_nand *n, dhara_page_t p)
+{
+    return (size_t)p * page_stride(n);
+}
+
+static size_t spare_offset(const struct dhara_nand *n, dhara_page_t p)
+{
+    return page_offset(n, p) + ((size_t)1 << DHARA_LOG2_PAGE_SIZE(n));
+}
+
+static int load(const struct dhara_nand *n, size_t offset, uint8_t *data, size_t len)
+{
+    const dhara_nand_image_t *image = n->ctx;
+    if (image->ram) {
+        memcpy(data, &image->ram[offset], len);
+        return 0;
+    }
+
+    if (fseek(image->file, (long)offset, SEEK_SET)) return -1;
+    return (fread(data, 1, len, image->file) == len) ? 0 : -1;
+}
+
+static int store(const struct dhara_nand *n, size_t offset, const uint8_t *data, size_t len)
+{
+    const dhara_nand_image_t *image = n->ctx;
+    if (image->ram) {
+        memcpy(&image->ram[offset], data, len);
+        return 0;
+    }
+
+    if (fseek(image->file, (long)offset, SEEK_SET)) return -1;
+    return (fwrite(data, 1, len, image->file) == len) ? 0 : -1;
+}
+
+/// @brief Programs bytes the way flash does -- bits can only go from 1 to 0
+static int program(const struct dhara_nand *n, size_t offset, const uint8_t *data, size_t len)
+{
+    const dhara_nand_image_t *image = n->ctx;
+    if (image->ram) {
+        for (size_t i = 0; i < len; i++) {
+            image->ram[offset + i] &= data[i];
+        }
+        return 0;
+    }
+
+    // read-modify-write a chunk at a time
+    uint8_t chunk[CHUNK_SIZE];
+    while (len) {
+        const size_t run = (len < sizeof(chunk)) ? len : sizeof(chunk);
+        if (load(n, offset, chunk, run)) return -1;
+        for (size_t i = 0; i < run; i++) {
+            chunk[i] &= data[i];
+        }
+        if (store(n, offset, chunk, run)) return -1;
+        offset += run;
+        data += run;
+        len -= run;
+    }
+
+    return 0;
+}
+
+/// @brief Sets a range of the image to 0xff
+static int fill(const struct dhara_nand *n, size_t offset, size_t len)
+{
+    const dhara_nand_image_t *image = n->ctx;
+    if (image->ram) {
+        memset(&image->ram[offset], 0xff, len);
+        return 0;
+    }
+
+    uint8_t chunk[CHUNK_SIZE];
+    memset(chunk, 0xff, sizeof(chunk));
+    while (len) {
+        const size_t run = (len < sizeof(chunk)) ? len : sizeof(chunk);
+        if (store(n, offset, chunk, run)) return -1;
+        offset += run;
+        len -= run;
+    }
+
+    return 0;
+}
+
+static int mark_programmed(const struct dhara_nand *n, dhara_page_t p)
+{
+    static const uint8_t mark = 0x00;
+    return store(n, spare_offset(n, p) + PROGRAMMED_MARK_OFFSET, &mark, 1);
+}
@@ -0,0 +1,59 @@
+/**
+ * @file		nand_image.h
+ * @author		Andrew Loebs
+ * @brief		Header file of the RAM and file image dhara_nand backends
+ *
+ * Backends that keep a simulated NAND chip in a memory buffer or in an image file, for running
+ * dhara on a host: several maps side by side, tests against a known-good device, or comparing
+ * backends. They're not part of the firmware build.
+ *
+ * Both keep the same image layout, so a RAM image written out to a file opens with the file
+ * backend. Every page is stored as its data followed by DHARA_NAND_IMAGE_SPARE_SIZE spare bytes:
+ *
+ *   [bad block mark] [programmed mark] [spare-area record (DHARA_OOB_META)] ..
+ *
+ * As on the MT29F, a block is bad if the first spare byte of its first page isn't 0xff. The
+ * programmed mark is cleared by every program, so that pages programmed with all 0xff's aren't
+ * mistaken for free ones. Programs AND into the page like flash does; there are no bit errors.
+ *
+ */
+
+#ifndef DHARA_NAND_IMAGE_H_
+#define DHARA_NAND_IMAGE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "nand.h"
+
+/// @brief Spare bytes stored behind each page
+#ifndef DHARA_NAND_IMAGE_SPARE_SIZE
+#define DHARA_NAND_IMAGE_SPARE_SIZE 64
+#endif
+
+/// @brief State of an image backend, pointed to by the ctx field of struct dhara_nand
+typedef struct {
+    uint8_t *ram; // image buffer (RAM backend), NULL for the file backend
+    FILE *file;   // image file (file backend)
+} dhara_nand_image_t;
+
+/// @brief Backend operations for struct dhara_nand
+extern const struct dhara_nand_ops dhara_nand_image_ops;
+
+/// @brief Returns the size of the image of a chip, in bytes
+/// @note The geometry fields of n must be set.
+size_t dhara_nand_image_size(const struct dhara_nand *n);
+
+/// @brief Attaches n to a RAM image
+/// @param buffer dhara_nand_image_size(n) bytes -- a previous image, or use dhara_nand_image_format
+void dhara_nand_image_init_ram(struct dhara_nand *n, dhara_nand_image_t *image, uint8_t *buffer);
+
+/// @brief Attaches n to an image file
+/// @param file opened for reading and writing ("r+b" or "w+b"), and kept open while n is in use
+void dhara_nand_image_init_file(struct dhara_nand *n, dhara_nand_image_t *image, FILE *file);
+
+/// @brief Erases the whole image: every block good and every page free
+/// @return 0 on success, -1 if the image couldn't be written
+int dhara_nand_image_format(const struct dhara_nand *n);
+
+#endif // DHARA_NAND_IMAGE_H_
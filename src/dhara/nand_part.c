@@ -0,0 +1,156 @@
+/**
+ * @file		nand_part.c
+ * @author		Andrew Loebs
+ * @brief		Implementation file of the partition dhara_nand backend
+ *
+ */
+
+#include "nand_part.h"
+
+// private function prototypes
+static int part_is_bad(const struct dhara_nand *n, dhara_block_t b);
+static void part_mark_bad(const struct dhara_nand *n, dhara_block_t b);
+static int part_erase(const struct dhara_nand *n, dhara_block_t b, dhara_error_t *err);
+static int part_prog(const struct dhara_nand *n, dhara_page_t p, const uint8_t *data,
+                     dhara_error_t *err);
+static int part_is_free(const struct dhara_nand *n, dhara_page_t p);
+static int part_read(const struct dhara_nand *n, dhara_page_t p, size_t offset, size_t length,
+                     uint8_t *data, dhara_error_t *err);
+static int part_read_pages(const struct dhara_nand *n, dhara_page_t p, dhara_page_t count,
+                           uint8_t *data, dhara_error_t *err);
+static int part_copy(const struct dhara_nand *n, dhara_page_t src, dhara_page_t dst,
+                     dhara_error_t *err);
+#if DHARA_OOB_META
+static int part_prog_oob(const struct dhara_nand *n, dhara_page_t p, const uint8_t *data,
+                         const uint8_t *oob, size_t oob_len, dhara_error_t *err);
+static int part_read_oob(const struct dhara_nand *n, dhara_page_t p, uint8_t *oob,
+                         size_t oob_len, dhara_error_t *err);
+static int part_copy_oob(const struct dhara_nand *n, dhara_page_t src, dhara_page_t dst,
+                         const uint8_t *oob, size_t oob_len, dhara_error_t *err);
+#endif
+
+static const struct dhara_nand *parent(const struct dhara_nand *n);
+static dhara_block_t parent_block(const struct dhara_nand *n, dhara_block_t b);
+static dhara_page_t parent_page(const struct dhara_nand *n, dhara_page_t p);
+
+// public constants
+const struct dhara_nand_ops dhara_nand_part_ops = {
+    .is_bad = part_is_bad,
+    .mark_bad = part_mark_bad,
+    .erase = part_erase,
+    .prog = part_prog,
+    .is_free = part_is_free,
+    .read = part_read,
+    .read_pages = part_read_pages,
+    .copy = part_copy,
+#if DHARA_OOB_META
+    .prog_oob = part_prog_oob,
+    .read_oob = part_read_oob,
+    .copy_oob = part_copy_oob,
+#endif
+};
+
+// public function definitions
+void dhara_nand_part_init(struct dhara_nand *n, dhara_nand_part_t *part,
+                          const struct dhara_nand *parent, dhara_block_t first_block,
+                          unsigned int num_blocks)
+{
+    part->parent = parent;
+    part->first_block = first_block;
+
+    n->log2_page_size = parent->log2_page_size;
+    n->log2_ppb = parent->log2_ppb;
+    n->num_blocks = num_blocks;
+    n->log2_prog_size = parent->log2_prog_size;
+    n->ops = &dhara_nand_part_ops;
+    n->ctx = part;
+}
+
+// private function definitions
+static int part_is_bad(const struct dhara_nand *n, dhara_block_t b)
+{
+    return dhara_nand_is_bad(parent(n), parent_block(n, b));
+}
+
+static void part_mark_bad(const struct dhara_nand *n, dhara_block_t b)
+{
+    dhara_nand_mark_bad(parent(n), parent_block(n, b));
+}
+
+static int part_erase(const struct dhara_nand *n, dhara_block_t b, dhara_error_t *err)
+{
+    return dhara_nand_erase(parent(n), parent_block(n, b), err);
+}
+
+static int part_prog(const struct dhara_nand *n, dhara_page_t p, const uint8_t *data,
+                     dhara_error_t *err)
+{
+    return dhara_nand_prog(parent(n), parent_page(n, p), data, err);
+}
+
+static int part_is_free(const struct dhara_nand *n, dhara_page_t p)
+{
+    return dhara_nand_is_free(parent(n), parent_page(n, p));
+}
+
+static int part_read(const struct dhara_nand *n, dhara_page_t p, size_t offset, size_t length,
+                     uint8_t *data, dhara_error_t *err)
+{
+    return dhara_nand_read(parent(n), parent_page(n, p), offset, length, data, err);
+}
+
+static int part_read_pages(const struct dhara_nand *n, dhara_page_t p, dhara_page_t count,
+                           uint8_t *data, dhara_error_t *err)
+{
+    // the partition's last page is followed by the parent's next block, so runs wrapping around
+    // the end of the partition are split
+    const dhara_page_t total = (dhara_page_t)DHARA_NUM_BLOCKS(n) << DHARA_LOG2_PPB(n);
+    const dhara_page_t first = (count > total - p) ? total - p : count;
+    if (dhara_nand_read_pages(parent(n), parent_page(n, p), first, data, err)) return -1;
+    if (first == count) return 0;
+
+    return dhara_nand_read_pages(parent(n), parent_page(n, 0), count - first,
+                                 data + ((size_t)first << DHARA_LOG2_PAGE_SIZE(n)), err);
+}
+
+static int part_copy(const struct dhara_nand *n, dhara_page_t src, dhara_page_t dst,
+                     dhara_error_t *err)
+{
+    return dhara_nand_copy(parent(n), parent_page(n, src), parent_page(n, dst), err);
+}
+
+#if DHARA_OOB_META
+static int part_prog_oob(const struct dhara_nand *n, dhara_page_t p, const uint8_t *data,
+                         const uint8_t *oob, size_t oob_len, dhara_error_t *err)
+{
+    return dhara_nand_prog_oob(parent(n), parent_page(n, p), data, oob, oob_len, err);
+}
+
+static int part_read_oob(const struct dhara_nand *n, dhara_page_t p, uint8_t *oob,
+                         size_t oob_len, dhara_error_t *err)
+{
+    return dhara_nand_read_oob(parent(n), parent_page(n, p), oob, oob_len, err);
+}
+
+static int part_copy_oob(const struct dhara_nand *n, dhara_page_t src, dhara_page_t dst,
+                         const uint8_t *oob, size_t oob_len, dhara_error_t *err)
+{
+    return dhara_nand_copy_oob(parent(n), parent_page(n, src), parent_page(n, dst), oob, oob_len,
+                               err);
+}
+#endif // DHARA_OOB_META
+
+static const struct dhara_nand *parent(const struct dhara_nand *n)
+{
+    return ((const dhara_nand_part_t *)n->ctx)->parent;
+}
+
+static dhara_block_t parent_block(const struct dhara_nand *n, dhara_block_t b)
+{
+    return ((const dhara_nand_part_t *)n->ctx)->first_block + b;
+}
+
+static dhara_page_t parent_page(const struct dhara_nand *n, dhara_page_t p)
+{
+    return p + (((const dhara_nand_part_t *)n->ctx)->first_block << DHARA_LOG2_PPB(n));
+}
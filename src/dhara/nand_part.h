@@ -0,0 +1,34 @@
+/**
+ * @file		nand_part.h
+ * @author		Andrew Loebs
+ * @brief		Header file of the partition dhara_nand backend
+ *
+ * Presents a range of blocks of another dhara_nand as a chip of its own, so that several maps can
+ * share one device. The partition's struct dhara_nand takes the page geometry of the parent, and
+ * its own block count; every operation is passed on to the parent's backend with the page and
+ * block numbers moved up by the partition's first block.
+ *
+ * The block count differs between partitions, so they need the runtime geometry (see geometry.h).
+ *
+ */
+
+#ifndef DHARA_NAND_PART_H_
+#define DHARA_NAND_PART_H_
+
+#include "nand.h"
+
+/// @brief State of a partition, pointed to by the ctx field of struct dhara_nand
+typedef struct {
+    const struct dhara_nand *parent;
+    dhara_block_t first_block;
+} dhara_nand_part_t;
+
+/// @brief Backend operations for struct dhara_nand
+extern const struct dhara_nand_ops dhara_nand_part_ops;
+
+/// @brief Sets n up as the num_blocks blocks of parent starting at first_block
+void dhara_nand_part_init(struct dhara_nand *n, dhara_nand_part_t *part,
+                          const struct dhara_nand *parent, dhara_block_t first_block,
+                          unsigned int num_blocks);
+
+#endif // DHARA_NAND_PART_H_
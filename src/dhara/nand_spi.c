@@ -0,0 +1,400 @@
+/**
+ * @file		nand_spi.c
+ * @author		Andrew Loebs
+ * @brief		"Glue" layer between dhara and spi_nand module
+ *
+ */
+
+#include "nand_spi.h"
+
+#include <stdbool.h>
+
+#include "../modules/spi_nand.h"
+
+// defines
+// column address of the user bytes of the spare area, which sits right behind the main area
+#define OOB_USER_COLUMN (SPI_NAND_PAGE_SIZE + SPI_NAND_OOB_USER_OFFSET)
+// flash pages per dhara block -- one block of every die
+#define LOG2_STRIPE_PAGES (SPI_NAND_LOG2_PAGES_PER_BLOCK + SPI_NAND_LOG2_DIE_COUNT)
+// true after the i-th flash page of a run if every die has been handed a page since the last wait
+#define END_OF_BATCH(i, count) ((0 == (((i) + 1) % SPI_NAND_DIE_COUNT)) || (((i) + 1) == (count)))
+
+// private function prototypes
+static int nand_is_bad(const struct dhara_nand *n, dhara_block_t b);
+static void nand_mark_bad(const struct dhara_nand *n, dhara_block_t b);
+static int nand_erase(const struct dhara_nand *n, dhara_block_t b, dhara_error_t *err);
+static int nand_prog(const struct dhara_nand *n, dhara_page_t p, const uint8_t *data,
+                     dhara_error_t *err);
+static int nand_is_free(const struct dhara_nand *n, dhara_page_t p);
+static int nand_read(const struct dhara_nand *n, dhara_page_t p, size_t offset, size_t length,
+                     uint8_t *data, dhara_error_t *err);
+static int nand_read_pages(const struct dhara_nand *n, dhara_page_t p, dhara_page_t count,
+                           uint8_t *data, dhara_error_t *err);
+static int nand_copy(const struct dhara_nand *n, dhara_page_t src, dhara_page_t dst,
+                     dhara_error_t *err);
+#if DHARA_OOB_META
+static int nand_prog_oob(const struct dhara_nand *n, dhara_page_t p, const uint8_t *data,
+                         const uint8_t *oob, size_t oob_len, dhara_error_t *err);
+static int nand_read_oob(const struct dhara_nand *n, dhara_page_t p, uint8_t *oob,
+                         size_t oob_len, dhara_error_t *err);
+static int nand_copy_oob(const struct dhara_nand *n, dhara_page_t src, dhara_page_t dst,
+                         const uint8_t *oob, size_t oob_len, dhara_error_t *err);
+#endif
+
+static int log2_span(const struct dhara_nand *n);
+static row_address_t flash_row(const struct dhara_nand *n, dhara_page_t p, uint32_t i);
+static row_address_t die_block_row(dhara_block_t b, int die);
+static int wait_dies(int ret);
+static bool is_good_read(int ret);
+static int merge_read(int a, int b);
+static int read_ret(const struct dhara_nand *n, dhara_page_t p, dhara_page_t count, int ret,
+                    dhara_error_t *err);
+
+// public constants
+const struct dhara_nand_ops dhara_nand_spi_ops = {
+    .is_bad = nand_is_bad,
+    .mark_bad = nand_mark_bad,
+    .erase = nand_erase,
+    .prog = nand_prog,
+    .is_free = nand_is_free,
+    .read = nand_read,
+    .read_pages = nand_read_pages,
+    .copy = nand_copy,
+#if DHARA_OOB_META
+    .prog_oob = nand_prog_oob,
+    .read_oob = nand_read_oob,
+    .copy_oob = nand_copy_oob,
+#endif
+};
+
+// private function definitions
+static int nand_is_bad(const struct dhara_nand *n, dhara_block_t b)
+{
+    // a dhara block is the same block on every die, and is only usable if all of them are
+    for (int die = 0; die < SPI_NAND_DIE_COUNT; die++) {
+        // call spi_nand layer for block status
+        bool is_bad;
+        int ret = spi_nand_block_is_bad(die_block_row(b, die), &is_bad);
+        if (SPI_NAND_RET_OK != ret) {
+            // if we get a bad return, we'll just call this block bad
+            is_bad = true;
+        }
+        if (is_bad) return 1;
+    }
+
+    return 0;
+}
+
+static void nand_mark_bad(const struct dhara_nand *n, dhara_block_t b)
+{
+    // retire the block on every die, so the stripe reads as bad no matter which die is asked
+    for (int die = 0; die < SPI_NAND_DIE_COUNT; die++) {
+        spi_nand_block_mark_bad(die_block_row(b, die)); // ignore ret
+    }
+}
+
+static int nand_erase(const struct dhara_nand *n, dhara_block_t b, dhara_error_t *err)
+{
+    // start the erase on every die, then wait for all of them
+    int ret = SPI_NAND_RET_OK;
+    for (int die = 0; (die < SPI_NAND_DIE_COUNT) && (SPI_NAND_RET_OK == ret); die++) {
+        ret = spi_nand_block_erase_start(die_block_row(b, die));
+    }
+    ret = wait_dies(ret);
+    if (SPI_NAND_RET_OK == ret) { // success
+        return 0;
+    }
+    else if (SPI_NAND_RET_E_FAIL == ret) { // failed internally on nand
+        dhara_set_error(err, DHARA_E_BAD_BLOCK);
+        return -1;
+    }
+    else { // failed for some other reason
+        dhara_set_error(err, DHARA_E_IO);
+        return -1;
+    }
+}
+
+static int nand_prog(const struct dhara_nand *n, dhara_page_t p, const uint8_t *data,
+                     dhara_error_t *err)
+{
+    // program the flash pages of the dhara page in order, one per die at a time -- consecutive
+    // flash pages sit on different dies, so each batch programs in parallel
+    const uint32_t count = (uint32_t)1 << log2_span(n);
+    int ret = SPI_NAND_RET_OK;
+    for (uint32_t i = 0; i < count; i++) {
+        if (SPI_NAND_RET_OK == ret) {
+            ret = spi_nand_page_program_start(flash_row(n, p, i), 0,
+                                              data + (i * SPI_NAND_PAGE_SIZE), SPI_NAND_PAGE_SIZE);
+        }
+        if (END_OF_BATCH(i, count)) ret = wait_dies(ret);
+    }
+    if (SPI_NAND_RET_OK == ret) { // success
+        return 0;
+    }
+    else if (SPI_NAND_RET_P_FAIL == ret) { // failed internally on nand
+        dhara_set_error(err, DHARA_E_BAD_BLOCK);
+        return -1;
+    }
+    else { // failed for some other reason
+        dhara_set_error(err, DHARA_E_IO);
+        return -1;
+    }
+}
+
+static int nand_is_free(const struct dhara_nand *n, dhara_page_t p)
+{
+    // on a single die, the first flash page of a dhara page is programmed first, so it alone
+    // tells whether the dhara page has been touched. (A program interrupted between flash pages is
+    // harmless: user pages past the last checkpoint are discarded on resume anyway, and a
+    // checkpoint's header and metadata -- 16 + 4 + 15 * 132 bytes -- all land in its first flash
+    // page.) Across dies the flash pages are programmed in parallel and may complete in any order,
+    // so every one of them has to be checked.
+    const uint32_t count = (SPI_NAND_DIE_COUNT > 1) ? ((uint32_t)1 << log2_span(n)) : 1;
+    for (uint32_t i = 0; i < count; i++) {
+        // call spi_nand layer
+        bool is_free;
+        int ret = spi_nand_page_is_free(flash_row(n, p, i), &is_free);
+        if (SPI_NAND_RET_OK != ret) {
+            // if we get a bad return, we'll report the page as "not free"
+            is_free = false;
+        }
+        if (!is_free) return 0;
+    }
+
+    return 1;
+}
+
+static int nand_read(const struct dhara_nand *n, dhara_page_t p, size_t offset, size_t length,
+                     uint8_t *data, dhara_error_t *err)
+{
+    // whole dhara pages spanning several flash pages are streamed in one go
+    if (!offset && (length == ((size_t)1 << DHARA_LOG2_PAGE_SIZE(n))) && log2_span(n)) {
+        return nand_read_pages(n, p, 1, data, err);
+    }
+
+    // split the read at flash page boundaries
+    uint32_t i = offset >> SPI_NAND_LOG2_PAGE_SIZE;
+    offset &= SPI_NAND_PAGE_SIZE - 1;
+    int ret = SPI_NAND_RET_OK;
+    while (length && is_good_read(ret)) {
+        size_t chunk = SPI_NAND_PAGE_SIZE - offset;
+        if (chunk > length) chunk = length;
+        ret = merge_read(ret, spi_nand_page_read(flash_row(n, p, i++), offset, data, chunk));
+        offset = 0;
+        data += chunk;
+        length -= chunk;
+    }
+
+    return read_ret(n, p, 1, ret, err);
+}
+
+static int nand_read_pages(const struct dhara_nand *n, dhara_page_t p, dhara_page_t count,
+                           uint8_t *data, dhara_error_t *err)
+{
+#if SPI_NAND_DIE_COUNT > 1
+    // consecutive flash pages alternate between dies: read one from every die at a time, so
+    // their array reads overlap
+    const uint32_t total = count << log2_span(n);
+    int ret = SPI_NAND_RET_OK;
+    for (uint32_t i = 0; i < total; i++) {
+        if (is_good_read(ret)) {
+            ret = merge_read(ret, spi_nand_page_read_start(flash_row(n, p, i), 0,
+                                                           data + (i * SPI_NAND_PAGE_SIZE),
+                                                           SPI_NAND_PAGE_SIZE));
+        }
+        if (END_OF_BATCH(i, total)) ret = wait_dies(ret);
+    }
+#else
+    // consecutive dhara pages are consecutive rows, block boundaries included
+    int ret = spi_nand_read_pages(flash_row(n, p, 0), (size_t)count << log2_span(n), data);
+#endif
+
+    // the ECC result is the worst over the run, so a refresh is reported for all of its pages
+    return read_ret(n, p, count, ret, err);
+}
+
+/* Read a page from one location and reprogram it in another location.
+ * This might be done using the chip's internal buffers, but it must use
+ * ECC.
+ */
+static int nand_copy(const struct dhara_nand *n, dhara_page_t src, dhara_page_t dst,
+                     dhara_error_t *err)
+{
+    // call spi_nand layer for each flash page of the dhara page (pages landing on another die
+    // are moved through the host)
+    int ret = SPI_NAND_RET_OK;
+    for (uint32_t i = 0; (i < ((uint32_t)1 << log2_span(n))) && (SPI_NAND_RET_OK == ret); i++) {
+        ret = spi_nand_page_copy(flash_row(n, src, i), flash_row(n, dst, i));
+    }
+    if (SPI_NAND_RET_OK == ret) { // success
+        return 0;
+    }
+    else if (SPI_NAND_RET_ECC_ERR == ret) { // ECC failure on read
+        dhara_set_error(err, DHARA_E_ECC);
+        return -1;
+    }
+    else if (SPI_NAND_RET_P_FAIL == ret) { // program failure
+        dhara_set_error(err, DHARA_E_BAD_BLOCK);
+        return -1;
+    }
+    else { // failed for some other reason
+        dhara_set_error(err, DHARA_E_IO);
+        return -1;
+    }
+}
+
+#if DHARA_OOB_META
+static int nand_prog_oob(const struct dhara_nand *n, dhara_page_t p, const uint8_t *data,
+                         const uint8_t *oob, size_t oob_len, dhara_error_t *err)
+{
+    if (oob_len > (SPI_NAND_OOB_USER_SIZE << log2_span(n))) return -1;
+
+    // each flash page carries the next piece of the record in its user spare area (programmed
+    // one per die at a time, as in nand_prog)
+    const uint32_t count = (uint32_t)1 << log2_span(n);
+    int ret = SPI_NAND_RET_OK;
+    for (uint32_t i = 0; i < count; i++) {
+        size_t chunk = (oob_len < SPI_NAND_OOB_USER_SIZE) ? oob_len : SPI_NAND_OOB_USER_SIZE;
+        if (SPI_NAND_RET_OK == ret) {
+            ret = spi_nand_page_program_with_oob_start(
+                flash_row(n, p, i), data ? data + (i * SPI_NAND_PAGE_SIZE) : NULL,
+                OOB_USER_COLUMN, oob, chunk);
+        }
+        if (END_OF_BATCH(i, count)) ret = wait_dies(ret);
+        oob += chunk;
+        oob_len -= chunk;
+    }
+    if (SPI_NAND_RET_OK == ret) { // success
+        return 0;
+    }
+    else if (SPI_NAND_RET_P_FAIL == ret) { // failed internally on nand
+        dhara_set_error(err, DHARA_E_BAD_BLOCK);
+        return -1;
+    }
+    else { // failed for some other reason
+        dhara_set_error(err, DHARA_E_IO);
+        return -1;
+    }
+}
+
+static int nand_read_oob(const struct dhara_nand *n, dhara_page_t p, uint8_t *oob,
+                         size_t oob_len, dhara_error_t *err)
+{
+    if (oob_len > (SPI_NAND_OOB_USER_SIZE << log2_span(n))) return -1;
+
+    uint32_t i = 0;
+    int ret = SPI_NAND_RET_OK;
+    while (oob_len && is_good_read(ret)) {
+        size_t chunk = (oob_len < SPI_NAND_OOB_USER_SIZE) ? oob_len : SPI_NAND_OOB_USER_SIZE;
+        ret = merge_read(ret, spi_nand_page_read(flash_row(n, p, i++), OOB_USER_COLUMN, oob, chunk));
+        oob += chunk;
+        oob_len -= chunk;
+    }
+
+    return read_ret(n, p, 1, ret, err);
+}
+
+static int nand_copy_oob(const struct dhara_nand *n, dhara_page_t src, dhara_page_t dst,
+                         const uint8_t *oob, size_t oob_len, dhara_error_t *err)
+{
+    if (oob_len > (SPI_NAND_OOB_USER_SIZE << log2_span(n))) return -1;
+
+    int ret = SPI_NAND_RET_OK;
+    for (uint32_t i = 0; (i < ((uint32_t)1 << log2_span(n))) && (SPI_NAND_RET_OK == ret); i++) {
+        size_t chunk = (oob_len < SPI_NAND_OOB_USER_SIZE) ? oob_len : SPI_NAND_OOB_USER_SIZE;
+        ret = spi_nand_page_copy_with_oob(flash_row(n, src, i), flash_row(n, dst, i),
+                                          OOB_USER_COLUMN, oob, chunk);
+        oob += chunk;
+        oob_len -= chunk;
+    }
+    if (SPI_NAND_RET_OK == ret) { // success
+        return 0;
+    }
+    else if (SPI_NAND_RET_ECC_ERR == ret) { // ECC failure on read
+        dhara_set_error(err, DHARA_E_ECC);
+        return -1;
+    }
+    else if (SPI_NAND_RET_P_FAIL == ret) { // program failure
+        dhara_set_error(err, DHARA_E_BAD_BLOCK);
+        return -1;
+    }
+    else { // failed for some other reason
+        dhara_set_error(err, DHARA_E_IO);
+        return -1;
+    }
+}
+#endif // DHARA_OOB_META
+
+/// @brief Returns log2 of the number of flash pages making up one dhara page
+static int log2_span(const struct dhara_nand *n)
+{
+    return DHARA_LOG2_PAGE_SIZE(n) - SPI_NAND_LOG2_PAGE_SIZE;
+}
+
+/// @brief Returns the row of the i-th flash page of dhara page p (i may run past the dhara page)
+static row_address_t flash_row(const struct dhara_nand *n, dhara_page_t p, uint32_t i)
+{
+    // A dhara block is block b of every die, with its flash pages dealt out to the dies in turn.
+    // With a single die this reduces to the MT29F row address itself -- larger dhara pages just
+    // leave the low bits of the page field clear.
+    const uint32_t f = (p << log2_span(n)) + i;
+    const uint32_t local = f & ((1u << LOG2_STRIPE_PAGES) - 1);
+    row_address_t row = {
+        .block = ((local & (SPI_NAND_DIE_COUNT - 1)) * SPI_NAND_BLOCKS_PER_LUN) +
+                 (f >> LOG2_STRIPE_PAGES),
+        .page = local >> SPI_NAND_LOG2_DIE_COUNT,
+    };
+    return row;
+}
+
+static row_address_t die_block_row(dhara_block_t b, int die)
+{
+    row_address_t row = {.block = (die * SPI_NAND_BLOCKS_PER_LUN) + b, .page = 0};
+    return row;
+}
+
+/// @brief Waits for every started operation, returning ret if set, the first failure otherwise
+static int wait_dies(int ret)
+{
+    return merge_read(ret, spi_nand_wait());
+}
+
+/// @brief Returns true if a read delivered its data (possibly with a refresh advised)
+static bool is_good_read(int ret)
+{
+    return (SPI_NAND_RET_OK == ret) || (SPI_NAND_RET_ECC_REFRESH == ret);
+}
+
+/// @brief Returns the first failure of two results, or else a refresh if either advises one
+static int merge_read(int a, int b)
+{
+    if (!is_good_read(a)) return a;
+    if (!is_good_read(b)) return b;
+    return (SPI_NAND_RET_OK != a) ? a : b;
+}
+
+/// @brief Turns the result of reading count pages from p into a dhara return
+static int read_ret(const struct dhara_nand *n, dhara_page_t p, dhara_page_t count, int ret,
+                    dhara_error_t *err)
+{
+    if (SPI_NAND_RET_ECC_REFRESH == ret) { // corrected, but due for a rewrite
+        const dhara_nand_spi_t *spi = n->ctx;
+        if (spi && spi->refresh) {
+            for (dhara_page_t i = 0; i < count; i++) {
+                spi->refresh(n, p + i);
+            }
+        }
+        return 0;
+    }
+    else if (SPI_NAND_RET_OK == ret) { // success
+        return 0;
+    }
+    else if (SPI_NAND_RET_ECC_ERR == ret) { // ECC failure
+        dhara_set_error(err, DHARA_E_ECC);
+        return -1;
+    }
+    else { // failed for some other reason
+        dhara_set_error(err, DHARA_E_IO);
+        return -1;
+    }
+}
@@ -0,0 +1,31 @@
+/**
+ * @file		nand_spi.h
+ * @author		Andrew Loebs
+ * @brief		Header file of the dhara <-> spi_nand glue layer
+ *
+ * dhara_nand backend for the MT29F driven by the spi_nand module. Pages larger than a flash page
+ * span consecutive flash pages, and with several dies every dhara block is striped across the
+ * same block of each die (see SPI_NAND_DIE_COUNT).
+ *
+ * Reads that the chip's ECC corrected, but with enough bit errors to advise rewriting the page
+ * (SPI_NAND_RET_ECC_REFRESH), succeed -- the data is good. The page is passed to the refresh
+ * callback, if ctx points to a dhara_nand_spi_t that sets one, so that it can be rewritten before
+ * it degrades any further. The chip has no other per-instance state, so ctx may be NULL.
+ *
+ */
+
+#ifndef DHARA_NAND_SPI_H_
+#define DHARA_NAND_SPI_H_
+
+#include "nand.h"
+
+/// @brief Optional state of the backend, pointed to by the ctx field of struct dhara_nand
+typedef struct {
+    /// called with each page read back with a refresh advised (may be NULL)
+    void (*refresh)(const struct dhara_nand *n, dhara_page_t p);
+} dhara_nand_spi_t;
+
+/// @brief Backend operations for struct dhara_nand
+extern const struct dhara_nand_ops dhara_nand_spi_ops;
+
+#endif // DHARA_NAND_SPI_H_
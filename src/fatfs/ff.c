@@ -1300,6 +1300,9 @@ static FRESULT put_fat (	/* FR_OK(0):succeeded, !=0:error */
 			fs->wflag = 1;
 			break;
 		}
+#if FF_USE_FREEMAP
+		if (res == FR_OK) ff_freemap_put(fs, clst, val);	/* Keep the free cluster map up to date */
+#endif
 	}
 	return res;
 }
@@ -1600,6 +1603,13 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 				ncl = 0;
 			}
 		}
+#if FF_USE_FREEMAP
+		if (ncl == 0) {	/* Find another fragment in the free cluster map if available */
+			cs = ff_freemap_find(fs, scl);	/* Get a free cluster (0:no free cluster, 1:map not available) */
+			if (cs == 0) return 0;
+			if (cs >= 2) ncl = cs;
+		}
+#endif
 		if (ncl == 0) {	/* The new cluster cannot be contiguous and find another fragment */
 			ncl = scl;	/* Start cluster */
 			for (;;) {
@@ -4799,6 +4809,9 @@ FRESULT f_getfree (
 	res = mount_volume(&path, &fs, 0);
 	if (res == FR_OK) {
 		*fatfs = fs;				/* Return ptr to the fs object */
+#if FF_USE_FREEMAP
+		ff_freemap_build(fs);		/* Building the free cluster map validates free_clst */
+#endif
 		/* If free_clst is valid, return it without full FAT scan */
 		if (fs->free_clst <= fs->n_fatent - 2) {
 			*nclst = fs->free_clst;
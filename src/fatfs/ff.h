@@ -371,6 +371,13 @@ void* ff_memalloc (UINT msize);			/* Allocate memory block */
 void ff_memfree (void* mblock);			/* Free memory block */
 #endif
 
+/* Free cluster map functions */
+#if FF_USE_FREEMAP && !FF_FS_READONLY
+int ff_freemap_build (FATFS* fs);		/* Build the map if needed (1:map is valid, 0:not available) */
+DWORD ff_freemap_find (FATFS* fs, DWORD clst);	/* Find a free cluster after clst (0:none, 1:map not available) */
+void ff_freemap_put (FATFS* fs, DWORD clst, DWORD val);	/* Track a change of a FAT entry */
+#endif
+
 /* Sync functions */
 #if FF_FS_REENTRANT
 int ff_cre_syncobj (BYTE vol, FF_SYNC_t* sobj);	/* Create a sync object */
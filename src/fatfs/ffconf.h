@@ -37,12 +37,19 @@
 #define FF_USE_MKFS 1
 /* This option switches f_mkfs() function. (0:Disable or 1:Enable) */
 
-#define FF_USE_FASTSEEK 0
+#define FF_USE_FASTSEEK 1
 /* This option switches fast seek function. (0:Disable or 1:Enable) */
 
 #define FF_USE_EXPAND 0
 /* This option switches f_expand function. (0:Disable or 1:Enable) */
 
+#define FF_USE_FREEMAP 1
+/* This option switches free cluster map. (0:Disable or 1:Enable)
+/  When enable, user provided functions ff_freemap_build(), ff_freemap_find() and
+/  ff_freemap_put() need to be added to the project. They keep a map of free clusters
+/  in RAM, which is used instead of scanning the FAT to allocate clusters and to count
+/  them in f_getfree(). */
+
 #define FF_USE_CHMOD 0
 /* This option switches attribute manipulation functions, f_chmod() and f_utime().
 /  (0:Disable or 1:Enable) Also FF_FS_READONLY needs to be 0 to enable this option. */
@@ -171,8 +178,10 @@
 /  arbitrary physical drive and partition listed in the VolToPart[]. Also f_fdisk()
 /  funciton will be available. */
 
-#define FF_MIN_SS 2048
+#ifndef FF_MAX_SS
 #define FF_MAX_SS 2048
+#endif
+#define FF_MIN_SS FF_MAX_SS
 /* This set of options configures the range of sector size to be supported. (512,
 /  1024, 2048 or 4096) Always set both 512 for most systems, generic memory card and
 /  harddisk. But a larger value may be required for on-board flash memory and some
@@ -15,6 +15,7 @@
 
 #include "modules/led.h"
 #include "modules/mem.h"
+#include "modules/nand_ftl_diskio.h"
 #include "modules/shell.h"
 #include "modules/spi.h"
 #include "modules/sys_time.h"
@@ -90,6 +91,7 @@ int main(void)
 
     for (;;) {
         shell_tick();
+        nand_ftl_diskio_idle();
     }
 }
 
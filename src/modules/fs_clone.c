@@ -0,0 +1,115 @@
+/**
+ * @file		fs_clone.c
+ * @author		Andrew Loebs
+ * @brief		Implementation file of the file clone module
+ *
+ */
+
+#include "fs_clone.h"
+
+#include "mem.h"
+#include "nand_ftl_diskio.h"
+#include "spi_nand.h"
+
+// private function prototypes
+static FRESULT copy_data(FIL *src, FIL *dst);
+#if NAND_FTL_COPY
+static LBA_t cluster_sector(FIL *fp);
+#endif
+
+// public function definitions
+FRESULT fs_clone_file(const TCHAR *src_path, const TCHAR *dst_path)
+{
+    FIL src;
+    FRESULT res = f_open(&src, src_path, FA_OPEN_EXISTING | FA_READ);
+    if (FR_OK != res) return res;
+
+    FIL dst;
+    res = f_open(&dst, dst_path, FA_CREATE_ALWAYS | FA_WRITE);
+    if (FR_OK != res) {
+        f_close(&src);
+        return res;
+    }
+
+    res = copy_data(&src, &dst);
+    FRESULT close_res = f_close(&dst);
+    f_close(&src);
+    if (FR_OK == res) res = close_res;
+
+    // a partial copy isn't left behind
+    if (FR_OK != res) f_unlink(dst_path);
+    return res;
+}
+
+// private function definitions
+#if NAND_FTL_COPY
+static FRESULT copy_data(FIL *src, FIL *dst)
+{
+    const FSIZE_t size = f_size(src);
+    if (!size) return FR_OK;
+
+    // allocate the destination's clusters -- the seek stops short if the volume fills up
+    FRESULT res = f_lseek(dst, size);
+    if (FR_OK != res) return res;
+    if (f_tell(dst) != size) return FR_DENIED;
+
+    const FSIZE_t cluster_size = (FSIZE_t)src->obj.fs->csize * FF_MAX_SS;
+    LBA_t run_src = 0;
+    LBA_t run_dst = 0;
+    UINT run_count = 0;
+    for (FSIZE_t ofs = 0; ofs < size; ofs += cluster_size) {
+        // a seek to the end of a cluster leaves the file on that cluster
+        const FSIZE_t end = ((size - ofs) > cluster_size) ? (ofs + cluster_size) : size;
+        res = f_lseek(src, end);
+        if (FR_OK == res) res = f_lseek(dst, end);
+        if (FR_OK != res) return res;
+
+        const LBA_t src_sector = cluster_sector(src);
+        const LBA_t dst_sector = cluster_sector(dst);
+        const UINT count = (UINT)((end - ofs + FF_MAX_SS - 1) / FF_MAX_SS);
+
+        // clusters that follow on in both files join the run
+        if (run_count && (src_sector == run_src + run_count) &&
+            (dst_sector == run_dst + run_count)) {
+            run_count += count;
+            continue;
+        }
+        if (run_count && (RES_OK != nand_ftl_diskio_copy(run_src, run_dst, run_count))) {
+            return FR_DISK_ERR;
+        }
+        run_src = src_sector;
+        run_dst = dst_sector;
+        run_count = count;
+    }
+
+    if (RES_OK != nand_ftl_diskio_copy(run_src, run_dst, run_count)) return FR_DISK_ERR;
+    return FR_OK;
+}
+
+/// @brief Returns the first sector of the cluster a file is on
+static LBA_t cluster_sector(FIL *fp)
+{
+    const FATFS *fs = fp->obj.fs;
+    return fs->database + (LBA_t)fs->csize * (fp->clust - 2);
+}
+#else
+static FRESULT copy_data(FIL *src, FIL *dst)
+{
+    uint8_t *buffer = mem_alloc(SPI_NAND_PAGE_SIZE);
+    if (!buffer) return FR_NOT_ENOUGH_CORE;
+
+    FRESULT res;
+    UINT bytes_read = 0;
+    do {
+        res = f_read(src, buffer, SPI_NAND_PAGE_SIZE, &bytes_read);
+        if (FR_OK != res) break;
+
+        UINT bytes_written = 0;
+        res = f_write(dst, buffer, bytes_read, &bytes_written);
+        if ((FR_OK == res) && (bytes_written != bytes_read)) res = FR_DENIED;
+    } while ((FR_OK == res) && (SPI_NAND_PAGE_SIZE == bytes_read));
+
+    mem_free(buffer);
+    return res;
+}
+#endif
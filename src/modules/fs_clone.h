@@ -0,0 +1,32 @@
+/**
+ * @file		fs_clone.h
+ * @author		Andrew Loebs
+ * @brief		Header file of the file clone module
+ *
+ * Copies files without reading their data out of the flash.
+ *
+ * The destination's clusters are allocated through FatFs (a seek past the end of a file open for
+ * writing extends its cluster chain), and both chains are then walked cluster by cluster. Each
+ * run of sectors is handed to nand_ftl_diskio_copy(), which has the chip copy whole pages
+ * internally -- copying a large log file costs a page copy per flash page, with no page of data
+ * crossing the SPI bus in either direction. Runs of clusters that are contiguous in both files
+ * go down in one call.
+ *
+ * Builds that can't copy inside the flash translation layer (see NAND_FTL_COPY) copy through a
+ * page-sized RAM buffer with f_read() and f_write() instead.
+ *
+ */
+
+#ifndef __FS_CLONE_H
+#define __FS_CLONE_H
+
+#include "../fatfs/ff.h"
+
+/// @brief Copies the file at src_path to dst_path, replacing any file already there
+/// @note The two paths must name different files, and the source must not be open for writing.
+/// A copy that fails part way is deleted.
+/// @return FR_OK on success, FR_DENIED if the volume is too full for the copy, or the FatFs
+/// result of the operation that failed
+FRESULT fs_clone_file(const TCHAR *src_path, const TCHAR *dst_path);
+
+#endif // __FS_CLONE_H
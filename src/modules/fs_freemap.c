@@ -0,0 +1,167 @@
+/**
+ * @file		fs_freemap.c
+ * @author		Andrew Loebs
+ * @brief		Implementation file of the free cluster map module
+ *
+ */
+
+#include "fs_freemap.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../fatfs/diskio.h"
+#include "mem.h"
+#include "spi_nand.h"
+
+#if !FF_USE_FREEMAP
+#error "fs_freemap requires FF_USE_FREEMAP"
+#endif
+
+// defines
+#define MAP_WORDS          ((FS_FREEMAP_CLUSTERS + 31) / 32)
+#define SECTORS_PER_READ   (SPI_NAND_PAGE_SIZE / FF_MAX_SS)
+#define ENTRY_MASK_FAT32   0x0FFFFFFF
+
+// private function prototypes
+static bool is_valid(const FATFS *fs);
+static bool build(FATFS *fs);
+static DWORD find_free(DWORD start, DWORD end);
+
+// private variables
+// volume the map belongs to -- the mount ID tells a remount of the same object apart
+static FATFS *owner = NULL;
+static WORD owner_id;
+static DWORD free_count;
+// a bit per FAT entry, set if the cluster is free
+static uint32_t map[MAP_WORDS];
+
+// public function definitions
+int ff_freemap_build(FATFS *fs)
+{
+    return is_valid(fs) || build(fs);
+}
+
+DWORD ff_freemap_find(FATFS *fs, DWORD clst)
+{
+    if (!ff_freemap_build(fs)) return 1;
+    if (!free_count) return 0;
+
+    // look from the cluster after clst to the end of the FAT, then wrap around
+    DWORD start = clst + 1;
+    if (start >= fs->n_fatent) start = 2;
+
+    DWORD found = find_free(start, fs->n_fatent);
+    if (!found) found = find_free(2, start);
+    return found;
+}
+
+void ff_freemap_put(FATFS *fs, DWORD clst, DWORD val)
+{
+    if (!is_valid(fs)) return;
+
+    // the upper four bits of a FAT32 entry are reserved
+    const bool now_free = (0 == (val & ENTRY_MASK_FAT32));
+    const uint32_t bit = (uint32_t)1 << (clst % 32);
+    const bool was_free = (0 != (map[clst / 32] & bit));
+    if (now_free == was_free) return;
+
+    if (now_free) {
+        map[clst / 32] |= bit;
+        free_count++;
+    }
+    else {
+        map[clst / 32] &= ~bit;
+        free_count--;
+    }
+}
+
+// private function definitions
+/// @brief Returns true if the map describes the volume currently mounted on fs
+static bool is_valid(const FATFS *fs)
+{
+    return (fs == owner) && (fs->id == owner_id);
+}
+
+/// @brief Fills the map (and its free cluster count) in one streaming pass over the FAT
+/// @return true on success
+static bool build(FATFS *fs)
+{
+    // FAT12 entries straddle sectors, and exFAT keeps an allocation bitmap of its own
+    if ((FS_FAT16 != fs->fs_type) && (FS_FAT32 != fs->fs_type)) return false;
+    if (fs->n_fatent > FS_FREEMAP_CLUSTERS) return false;
+    // the FAT is read through the page buffer
+    if (!SECTORS_PER_READ) return false;
+
+    uint8_t *buffer = mem_alloc(SPI_NAND_PAGE_SIZE);
+    if (!buffer) return false;
+
+    owner = NULL;
+    memset(map, 0, sizeof(map));
+    free_count = 0;
+
+    const UINT entry_size = (FS_FAT16 == fs->fs_type) ? 2 : 4;
+    const DWORD entries_per_sector = FF_MAX_SS / entry_size;
+    LBA_t sector = fs->fatbase;
+    DWORD clst = 0;
+    bool success = true;
+    while (clst < fs->n_fatent) {
+        DWORD count = (fs->n_fatent - clst + entries_per_sector - 1) / entries_per_sector;
+        if (count > SECTORS_PER_READ) count = SECTORS_PER_READ;
+
+        if (RES_OK != disk_read(fs->pdrv, buffer, sector, (UINT)count)) {
+            success = false;
+            break;
+        }
+        // the window may hold a newer copy of one of these sectors, not yet written back
+        if ((fs->winsect >= sector) && (fs->winsect < sector + count)) {
+            memcpy(buffer + (size_t)(fs->winsect - sector) * FF_MAX_SS, fs->win, FF_MAX_SS);
+        }
+
+        DWORD end = clst + count * entries_per_sector;
+        if (end > fs->n_fatent) end = fs->n_fatent;
+        for (const uint8_t *p = buffer; clst < end; clst++, p += entry_size) {
+            DWORD entry = (DWORD)p[0] | ((DWORD)p[1] << 8);
+            if (4 == entry_size) entry |= (((DWORD)p[2] << 16) | ((DWORD)p[3] << 24));
+
+            // entries 0 and 1 are reserved
+            if ((clst >= 2) && (0 == (entry & ENTRY_MASK_FAT32))) {
+                map[clst / 32] |= (uint32_t)1 << (clst % 32);
+                free_count++;
+            }
+        }
+        sector += count;
+    }
+    mem_free(buffer);
+    if (!success) return false;
+
+    owner = fs;
+    owner_id = fs->id;
+
+    // the count is exact now -- an FSInfo count that disagrees gets rewritten on the next sync
+    if (fs->free_clst != free_count) {
+        fs->free_clst = free_count;
+        fs->fsi_flag |= 1;
+    }
+    return true;
+}
+
+/// @brief Returns the first free cluster in [start, end), or 0 if there is none
+static DWORD find_free(DWORD start, DWORD end)
+{
+    DWORD clst = start;
+    while (clst < end) {
+        const uint32_t word = map[clst / 32] >> (clst % 32);
+        if (!word) {
+            // nothing free in the rest of this word
+            clst = (clst | 31) + 1;
+            continue;
+        }
+
+        for (uint32_t bits = word; !(bits & 1); bits >>= 1) clst++;
+        return (clst < end) ? clst : 0;
+    }
+    return 0;
+}
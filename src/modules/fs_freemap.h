@@ -0,0 +1,38 @@
+/**
+ * @file		fs_freemap.h
+ * @author		Andrew Loebs
+ * @brief		Header file of the free cluster map module
+ *
+ * Keeps a bitmap of the volume's free clusters in RAM, so that FatFs never scans the FAT.
+ *
+ * FAT16 volumes carry no count of their free clusters, and FatFs doesn't know where the free ones
+ * start after a mount, so the first f_getfree() reads every FAT entry, and the first file to grow
+ * looks for free clusters with get_fat() one cluster at a time -- each FAT sector it crosses is a
+ * map read through the flash translation layer. With FF_USE_FREEMAP set in ffconf.h, FatFs asks
+ * this module instead (the ff_freemap_*() functions declared in ff.h):
+ *
+ * - The first allocation or f_getfree() after a mount builds the map in a single pass over the
+ *   FAT, a flash page of FAT sectors per disk_read().
+ * - put_fat() reports every entry it changes, which keeps the map and its free cluster count up
+ *   to date as chains are created and removed.
+ * - Free clusters are found with a bitmap search, and f_getfree() returns the counted value,
+ *   which also replaces a stale FSInfo count (written back with the next sync).
+ *
+ * The map has FS_FREEMAP_CLUSTERS bits. Volumes with more clusters than that, and FAT12 or exFAT
+ * volumes, fall back to FatFs' own FAT scans, as do builds with sectors larger than a flash page.
+ * So does a build that can't get the page buffer from mem_alloc(); the next allocation tries
+ * again.
+ *
+ */
+
+#ifndef __FS_FREEMAP_H
+#define __FS_FREEMAP_H
+
+#include "../fatfs/ff.h"
+
+/// @brief Clusters (FAT entries) the map can cover -- it takes FS_FREEMAP_CLUSTERS / 8 bytes
+#ifndef FS_FREEMAP_CLUSTERS
+#define FS_FREEMAP_CLUSTERS 32768
+#endif
+
+#endif // __FS_FREEMAP_H
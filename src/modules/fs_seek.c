@@ -0,0 +1,100 @@
+/**
+ * @file		fs_seek.c
+ * @author		Andrew Loebs
+ * @brief		Implementation file of the file seek module
+ *
+ */
+
+#include "fs_seek.h"
+
+#include <stddef.h>
+
+#if !FF_USE_FASTSEEK
+#error "fs_seek requires FF_USE_FASTSEEK"
+#endif
+
+// private function prototypes
+static int find_slot(const FIL *fp);
+static int find_free_slot(void);
+static bool is_held(int slot);
+static void attach(FIL *fp);
+
+// private variables
+// file holding each table (NULL if free), the open file it held when it got the table, and whether
+// its table was built
+static FIL *owners[FS_SEEK_TABLES];
+static FFOBJID owner_objs[FS_SEEK_TABLES];
+static bool built[FS_SEEK_TABLES];
+static DWORD tables[FS_SEEK_TABLES][FS_SEEK_TABLE_SIZE];
+
+// public function definitions
+FRESULT fs_seek_lseek(FIL *fp, FSIZE_t ofs)
+{
+    if (!fp->cltbl && !(fp->flag & FA_WRITE)) attach(fp);
+    return f_lseek(fp, ofs);
+}
+
+bool fs_seek_is_fast(const FIL *fp)
+{
+    return fp->cltbl != NULL;
+}
+
+FRESULT fs_seek_close(FIL *fp)
+{
+    const int slot = find_slot(fp);
+    if (slot >= 0) owners[slot] = NULL;
+
+    return f_close(fp);
+}
+
+// private function definitions
+/// @brief Returns the pool slot held by fp, or -1
+static int find_slot(const FIL *fp)
+{
+    for (int i = 0; i < FS_SEEK_TABLES; i++) {
+        if ((owners[i] == fp) && is_held(i)) return i;
+    }
+    return -1;
+}
+
+/// @brief Returns a slot no open file holds, or -1
+static int find_free_slot(void)
+{
+    for (int i = 0; i < FS_SEEK_TABLES; i++) {
+        if (!is_held(i)) return i;
+    }
+    return -1;
+}
+
+/// @brief Returns true if the slot's owner is still the file it was given to
+/// @note A file closed with plain f_close() has lost its volume (obj.fs), and a FIL reopened in
+/// the same place on another file has another start cluster or mount -- either way the slot is
+/// free again.
+static bool is_held(int slot)
+{
+    const FIL *fp = owners[slot];
+    return fp && fp->obj.fs && (fp->obj.fs == owner_objs[slot].fs) &&
+           (fp->obj.id == owner_objs[slot].id) && (fp->obj.sclust == owner_objs[slot].sclust);
+}
+
+/// @brief Gives fp a table and builds it, if a slot is free
+static void attach(FIL *fp)
+{
+    int slot = find_slot(fp);
+    if (slot >= 0) {
+        // too fragmented the last time
+        if (!built[slot]) return;
+    }
+    else {
+        slot = find_free_slot();
+        if (slot < 0) return;
+        owners[slot] = fp;
+        owner_objs[slot] = fp->obj;
+    }
+
+    // one pass over the chain fills the table (its first entry holds the size)
+    tables[slot][0] = FS_SEEK_TABLE_SIZE;
+    fp->cltbl = tables[slot];
+    built[slot] = (FR_OK == f_lseek(fp, CREATE_LINKMAP));
+    if (!built[slot]) fp->cltbl = NULL;
+}
@@ -0,0 +1,52 @@
+/**
+ * @file		fs_seek.h
+ * @author		Andrew Loebs
+ * @brief		Header file of the file seek module
+ *
+ * Seeks into large files without walking their cluster chains.
+ *
+ * A plain f_lseek() follows the FAT from the start of the file (or from the current cluster, if
+ * seeking forward) one cluster at a time, and every FAT sector it crosses is a map read with a
+ * full radix walk. FatFs' fast seek mode replaces that with a cluster link map table (CLMT): one
+ * entry pair per fragment of the file, built by a single pass over the chain, after which a seek
+ * anywhere in the file costs no FAT reads at all.
+ *
+ * This module keeps FS_SEEK_TABLES tables in a static pool and hands them out on demand: the
+ * first fs_seek_lseek() on a file builds its table, and fs_seek_close() gives it back. Fast seek
+ * mode can't grow a file, so only files open without FA_WRITE get a table; others, and files too
+ * fragmented for a table, seek the usual way.
+ *
+ */
+
+#ifndef __FS_SEEK_H
+#define __FS_SEEK_H
+
+#include <stdbool.h>
+
+#include "../fatfs/ff.h"
+
+/// @brief Tables in the pool -- files that can hold a table at the same time
+#ifndef FS_SEEK_TABLES
+#define FS_SEEK_TABLES 2
+#endif
+
+/// @brief Entries per table: two per fragment of the file, plus two
+#ifndef FS_SEEK_TABLE_SIZE
+#define FS_SEEK_TABLE_SIZE 66
+#endif
+
+/// @brief Moves the read pointer of a file, building its cluster link map table first if it has
+/// none yet and one is free
+/// @note A file too fragmented for a table keeps its pool slot, without a table, so that its
+/// chain isn't walked again by each seek.
+FRESULT fs_seek_lseek(FIL *fp, FSIZE_t ofs);
+
+/// @brief Returns true if seeks in the file go through a cluster link map table
+bool fs_seek_is_fast(const FIL *fp);
+
+/// @brief Gives the file's table back to the pool, and closes the file
+/// @note A file seeked with fs_seek_lseek() and closed with plain f_close() keeps its slot until
+/// another file needs one.
+FRESULT fs_seek_close(FIL *fp);
+
+#endif // __FS_SEEK_H
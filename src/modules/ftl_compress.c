@@ -0,0 +1,301 @@
+/**
+ * @file		ftl_compress.c
+ * @author		Andrew Loebs
+ * @brief		Implementation file of the ftl compression module
+ *
+ */
+
+#include "ftl_compress.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "../dhara/bytes.h"
+#include "lz.h"
+#include "spi_nand.h"
+
+// defines
+#define SECTOR_SIZE     SPI_NAND_PAGE_SIZE // logical sector size == pack page size
+#define SLOTS           FTL_COMPRESS_SECTORS_PER_PAGE
+#define SLOT_ENTRY_SIZE 4 // 16 bit offset + 16 bit length
+#define SLOT_TABLE_SIZE (SLOTS * SLOT_ENTRY_SIZE)
+
+// A raw slot reads as 0xffff -- which is also what an unmapped (never written) pack page reads
+// back as, so groups without a pack page need no special casing.
+#define SLOT_LEN_RAW 0xffff
+
+#define GROUP_NONE 0xffffffff
+
+// private function prototypes
+static uint32_t group_sector(uint32_t group);
+static int load_group(uint32_t group, dhara_error_t *err);
+static int store_group(uint32_t group, dhara_error_t *err);
+static int store_sector(uint32_t sector, const uint8_t *data, bool *trim_raw, bool *dirty,
+                        dhara_error_t *err);
+
+static uint16_t slot_offset(int slot);
+static uint16_t slot_len(int slot);
+static void slot_set(int slot, uint16_t offset, uint16_t len);
+static bool slot_is_packed(int slot);
+static bool slots_are_valid(void);
+static size_t payload_end(void);
+static void remove_blob(int slot);
+static bool is_erased(const uint8_t *data);
+
+// private variables
+static struct dhara_map *map;
+static ftl_compress_stats_t stats;
+// pack page of buffered_group -- kept across calls so that reads of neighbouring sectors don't
+// re-read the same page
+static uint8_t pack_buffer[SECTOR_SIZE];
+static uint32_t buffered_group = GROUP_NONE;
+
+// public function definitions
+void ftl_compress_init(struct dhara_map *m)
+{
+    map = m;
+    buffered_group = GROUP_NONE;
+    memset(&stats, 0, sizeof(stats));
+}
+
+uint32_t ftl_compress_sector_count(void)
+{
+    // pack pages are numbered from the end of the largest possible logical range, so the logical
+    // range can never reach into them
+    uint32_t count = dhara_map_capacity(map) * FTL_COMPRESS_OVERCOMMIT;
+    uint32_t limit = group_sector(0);
+    return (count < limit) ? count : limit;
+}
+
+int ftl_compress_read(uint32_t sector, uint8_t *data, dhara_error_t *err)
+{
+    const int slot = sector % SLOTS;
+    if (load_group(sector / SLOTS, err)) return -1;
+
+    // raw (or never written) sectors are read straight through
+    if (!slot_is_packed(slot)) return dhara_map_read(map, sector, data, err);
+
+    // unpack
+    size_t len = lz_decompress(&pack_buffer[slot_offset(slot)], slot_len(slot), data, SECTOR_SIZE);
+    if (SECTOR_SIZE != len) {
+        dhara_set_error(err, DHARA_E_CORRUPT_MAP);
+        return -1;
+    }
+
+    return 0;
+}
+
+int ftl_compress_write(uint32_t sector, const uint8_t *data, uint32_t count, dhara_error_t *err)
+{
+    while (count) {
+        const uint32_t group = sector / SLOTS;
+        bool trim_raw[SLOTS] = {false};
+        bool dirty = false;
+        uint32_t first = sector;
+
+        if (load_group(group, err)) return -1;
+
+        // apply every sector of this call that falls in the group, then commit the group once
+        do {
+            if (store_sector(sector, data, &trim_raw[sector % SLOTS], &dirty, err)) {
+                buffered_group = GROUP_NONE; // buffer no longer matches flash
+                return -1;
+            }
+            sector++;
+            data += SECTOR_SIZE;
+            count--;
+        } while (count && (sector % SLOTS));
+
+        // (raw rewrites of raw sectors leave the pack page untouched)
+        if (dirty && store_group(group, err)) return -1;
+
+        // raw copies superseded by the pack page go last, so the previous data stays readable
+        // until the pack page is in the journal
+        for (int i = 0; i < SLOTS; i++) {
+            if (trim_raw[i] && dhara_map_trim(map, (first - (first % SLOTS)) + i, err)) return -1;
+        }
+    }
+
+    return 0;
+}
+
+int ftl_compress_trim(uint32_t sector, dhara_error_t *err)
+{
+    const uint32_t group = sector / SLOTS;
+    const int slot = sector % SLOTS;
+    if (load_group(group, err)) return -1;
+
+    if (slot_is_packed(slot)) {
+        remove_blob(slot);
+        slot_set(slot, SLOT_LEN_RAW, SLOT_LEN_RAW);
+        if (store_group(group, err)) return -1;
+    }
+
+    // a raw slot with no raw sector behind it reads as blank
+    return dhara_map_trim(map, sector, err);
+}
+
+void ftl_compress_get_stats(ftl_compress_stats_t *stats_out)
+{
+    *stats_out = stats;
+}
+
+// private function definitions
+static uint32_t group_sector(uint32_t group)
+{
+    const uint32_t total_pages = (uint32_t)DHARA_NUM_BLOCKS(map->journal.nand)
+                                 << DHARA_LOG2_PPB(map->journal.nand);
+    return (total_pages * FTL_COMPRESS_OVERCOMMIT) + group;
+}
+
+static int load_group(uint32_t group, dhara_error_t *err)
+{
+    if (buffered_group == group) return 0;
+
+    // an unmapped pack page reads back as 0xff's: every slot raw
+    buffered_group = GROUP_NONE;
+    if (dhara_map_read(map, group_sector(group), pack_buffer, err)) return -1;
+
+    // a damaged slot table would send the decoder and remove_blob() outside the page -- the pack
+    // page is as good as unreadable
+    if (!slots_are_valid()) {
+        dhara_set_error(err, DHARA_E_ECC);
+        return -1;
+    }
+    buffered_group = group;
+
+    return 0;
+}
+
+static int store_group(uint32_t group, dhara_error_t *err)
+{
+    int ret;
+
+    // a group with nothing packed is equivalent to no pack page at all
+    bool any_packed = false;
+    for (int i = 0; i < SLOTS; i++) {
+        any_packed |= slot_is_packed(i);
+    }
+
+    if (any_packed) {
+        ret = dhara_map_write(map, group_sector(group), pack_buffer, err);
+    }
+    else {
+        ret = dhara_map_trim(map, group_sector(group), err);
+        memset(pack_buffer, 0xff, sizeof(pack_buffer));
+    }
+
+    if (ret) buffered_group = GROUP_NONE;
+    return ret;
+}
+
+static int store_sector(uint32_t sector, const uint8_t *data, bool *trim_raw, bool *dirty,
+                        dhara_error_t *err)
+{
+    const int slot = sector % SLOTS;
+    const bool was_raw = !slot_is_packed(slot);
+
+    if (!was_raw) {
+        // the old image is gone -- mark the slot raw so payload_end() stops counting it
+        remove_blob(slot);
+        slot_set(slot, SLOT_LEN_RAW, SLOT_LEN_RAW);
+        *dirty = true;
+    }
+
+    // blank sectors need no storage at all -- just make sure no raw copy is left behind
+    if (is_erased(data)) {
+        *trim_raw = was_raw;
+        return 0;
+    }
+
+    // try to fit the compressed image in the remaining space of the pack page
+    const size_t end = payload_end();
+    const size_t len = lz_compress(data, SECTOR_SIZE, &pack_buffer[end], SECTOR_SIZE - end);
+    if (len) {
+        slot_set(slot, end, len);
+        *trim_raw = was_raw;
+        *dirty = true;
+        stats.packed_writes++;
+        stats.bytes_in += SECTOR_SIZE;
+        stats.bytes_out += len;
+        return 0;
+    }
+
+    // incompressible, or the page is full: store it raw
+    *trim_raw = false;
+    stats.raw_writes++;
+    return dhara_map_write(map, sector, data, err);
+}
+
+static uint16_t slot_offset(int slot)
+{
+    return dhara_r16(&pack_buffer[slot * SLOT_ENTRY_SIZE]);
+}
+
+static uint16_t slot_len(int slot)
+{
+    return dhara_r16(&pack_buffer[(slot * SLOT_ENTRY_SIZE) + 2]);
+}
+
+static void slot_set(int slot, uint16_t offset, uint16_t len)
+{
+    dhara_w16(&pack_buffer[slot * SLOT_ENTRY_SIZE], offset);
+    dhara_w16(&pack_buffer[(slot * SLOT_ENTRY_SIZE) + 2], len);
+}
+
+static bool slot_is_packed(int slot)
+{
+    return SLOT_LEN_RAW != slot_len(slot);
+}
+
+/// @brief Returns true if every packed slot lies within the payload of the pack page
+static bool slots_are_valid(void)
+{
+    size_t total = SLOT_TABLE_SIZE;
+    for (int i = 0; i < SLOTS; i++) {
+        if (!slot_is_packed(i)) continue;
+        if ((slot_offset(i) < SLOT_TABLE_SIZE) || (slot_len(i) > SECTOR_SIZE - slot_offset(i))) {
+            return false;
+        }
+        total += slot_len(i);
+    }
+
+    return total <= SECTOR_SIZE;
+}
+
+/// @note Blobs are kept packed back to back behind the slot table.
+static size_t payload_end(void)
+{
+    size_t end = SLOT_TABLE_SIZE;
+    for (int i = 0; i < SLOTS; i++) {
+        if (slot_is_packed(i)) end += slot_len(i);
+    }
+
+    return end;
+}
+
+/// @note The slot's own entry still holds the removed blob afterwards, so payload_end() counts it
+///       until the caller resets the entry with slot_set().
+static void remove_blob(int slot)
+{
+    const uint16_t offset = slot_offset(slot);
+    const uint16_t len = slot_len(slot);
+    const size_t end = payload_end();
+
+    // close the gap and shift the blobs behind it
+    memmove(&pack_buffer[offset], &pack_buffer[offset + len], end - (offset + len));
+    for (int i = 0; i < SLOTS; i++) {
+        if ((i != slot) && slot_is_packed(i) && (slot_offset(i) > offset)) {
+            slot_set(i, slot_offset(i) - len, slot_len(i));
+        }
+    }
+}
+
+static bool is_erased(const uint8_t *data)
+{
+    for (int i = 0; i < SECTOR_SIZE; i++) {
+        if (0xff != data[i]) return false;
+    }
+
+    return true;
+}
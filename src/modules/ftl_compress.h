@@ -0,0 +1,72 @@
+/**
+ * @file		ftl_compress.h
+ * @author		Andrew Loebs
+ * @brief		Header file of the ftl compression module
+ *
+ * Transparent per-sector compression between the diskio glue and the dhara map.
+ *
+ * Logical sectors are grouped FTL_COMPRESS_SECTORS_PER_PAGE at a time. Each group may own a
+ * "pack" page (stored under its own dhara sector number, above the logical sector range) that
+ * holds the compressed images of its sectors back to back, with a small slot table in front:
+ *
+ *   [slot 0 offset|len] .. [slot N-1 offset|len] [compressed sector] [compressed sector] ..
+ *
+ * A slot is either empty (reads as 0xff), packed (data lives in the pack page), or raw (the
+ * sector didn't compress well enough to fit and lives uncompressed under its own dhara sector
+ * number, which is the same as its logical sector number). Groups that have never been packed
+ * have no pack page, and all of their sectors are looked up raw -- so a volume written without
+ * compression reads back fine with it enabled.
+ *
+ * Pack pages are numbered from FTL_COMPRESS_OVERCOMMIT times the page count of the chip, which
+ * takes about two more bits of sector space than the chip's page count alone -- with a fixed dhara
+ * geometry, DHARA_RADIX_DEPTH has to be raised to match.
+ *
+ */
+
+#ifndef __FTL_COMPRESS_H
+#define __FTL_COMPRESS_H
+
+#include <stdint.h>
+
+#include "../dhara/map.h"
+
+/// @brief Maximum number of logical sectors packed into one flash page
+#define FTL_COMPRESS_SECTORS_PER_PAGE 4
+
+/// @brief Logical sectors presented per sector of physical map capacity
+/// @note This is a bet on the compression ratio of the stored data. If the data turns out to be
+/// less compressible, writes start failing with DHARA_E_MAP_FULL before the file system is full.
+#ifndef FTL_COMPRESS_OVERCOMMIT
+#define FTL_COMPRESS_OVERCOMMIT 2
+#endif
+
+/// @brief Compression counters
+typedef struct {
+    /// logical sectors written in compressed form / written raw
+    uint32_t packed_writes;
+    uint32_t raw_writes;
+    /// uncompressed and compressed byte counts of the packed sectors
+    uint32_t bytes_in;
+    uint32_t bytes_out;
+} ftl_compress_stats_t;
+
+/// @brief Attaches the compression layer to an initialized (and resumed) map
+void ftl_compress_init(struct dhara_map *map);
+
+/// @brief Returns the number of logical sectors presented to the file system
+uint32_t ftl_compress_sector_count(void);
+
+/// @brief Reads one logical sector
+int ftl_compress_read(uint32_t sector, uint8_t *data, dhara_error_t *err);
+
+/// @brief Writes *count* consecutive logical sectors
+/// @note Sectors falling in the same group are combined into a single page program
+int ftl_compress_write(uint32_t sector, const uint8_t *data, uint32_t count, dhara_error_t *err);
+
+/// @brief Deletes one logical sector
+int ftl_compress_trim(uint32_t sector, dhara_error_t *err);
+
+/// @brief Copies out the compression counters
+void ftl_compress_get_stats(ftl_compress_stats_t *stats_out);
+
+#endif // __FTL_COMPRESS_H
@@ -0,0 +1,196 @@
+/**
+ * @file		ftl_hotcold.c
+ * @author		Andrew Loebs
+ * @brief		Implementation file of the ftl hot/cold separation module
+ *
+ */
+
+#include "ftl_hotcold.h"
+
+#include <stdbool.h>
+
+#include "../dhara/bytes.h"
+#include "spi_nand.h"
+
+// defines
+#define SECTOR_SIZE SPI_NAND_PAGE_SIZE // logical sector size == map page size
+
+// private function prototypes
+static bool needs_demote(void);
+static int demote(dhara_error_t *err);
+static int classify(dhara_page_t p, dhara_sector_t *sector_out, bool *live_out,
+                    dhara_error_t *err);
+static int move_batch(int count, uint32_t held, dhara_error_t *err);
+
+// private variables
+static struct dhara_map *hot;
+static struct dhara_map *cold;
+static ftl_hotcold_stats_t stats;
+// sectors (and their pages in the hot log) of the batch being moved to the cold log
+static dhara_sector_t batch_sectors[FTL_HOTCOLD_WALK_PAGES];
+static dhara_page_t batch_pages[FTL_HOTCOLD_WALK_PAGES];
+static uint8_t move_buffer[SECTOR_SIZE];
+
+// public function definitions
+void ftl_hotcold_init(struct dhara_map *h, struct dhara_map *c)
+{
+    hot = h;
+    cold = c;
+    stats.writes = 0;
+    stats.demoted = 0;
+}
+
+uint32_t ftl_hotcold_sector_count(void)
+{
+    // every sector may end up in the cold map
+    return dhara_map_capacity(cold);
+}
+
+int ftl_hotcold_read(uint32_t sector, uint8_t *data, dhara_error_t *err)
+{
+    // the hot copy, if any, is the most recent one
+    dhara_page_t p;
+    if (!dhara_map_find(hot, sector, &p, err)) {
+        return dhara_nand_read(hot->journal.nand, p, 0, SECTOR_SIZE, data, err);
+    }
+    if (DHARA_E_NOT_FOUND != *err) return -1;
+
+    return dhara_map_read(cold, sector, data, err);
+}
+
+int ftl_hotcold_write(uint32_t sector, const uint8_t *data, dhara_error_t *err)
+{
+    if (needs_demote() && demote(err)) return -1;
+
+    stats.writes++;
+    return dhara_map_write(hot, sector, data, err);
+}
+
+int ftl_hotcold_trim(uint32_t start, uint32_t end, dhara_error_t *err)
+{
+    // a stale cold copy must never outlive the hot one, or it would reappear -- the cold trims
+    // are made persistent before the hot ones are issued
+    for (uint32_t s = start; s <= end; s++) {
+        if (dhara_map_trim(cold, s, err)) return -1;
+    }
+    if (dhara_map_sync(cold, err)) return -1;
+
+    for (uint32_t s = start; s <= end; s++) {
+        if (dhara_map_trim(hot, s, err)) return -1;
+    }
+
+    return 0;
+}
+
+int ftl_hotcold_sync(dhara_error_t *err)
+{
+    if (dhara_map_sync(cold, err)) return -1;
+    return dhara_map_sync(hot, err);
+}
+
+void ftl_hotcold_get_stats(ftl_hotcold_stats_t *stats_out)
+{
+    *stats_out = stats;
+    stats_out->hot_sectors = dhara_map_size(hot);
+    stats_out->cold_sectors = dhara_map_size(cold);
+}
+
+// private function definitions
+/// @note Kicks in a little before the hot map's own garbage collection would, so that the tail
+/// of the hot log is cleared of live sectors by the time it gets there.
+static bool needs_demote(void)
+{
+    return (dhara_journal_size(&hot->journal) + FTL_HOTCOLD_WALK_PAGES) >=
+           dhara_map_capacity(hot);
+}
+
+/// @brief Advances the tail of the hot log, moving the live sectors found there to the cold log
+/// @note Superseded pages in front of the first live one are dropped right away. From there on,
+/// pages are only walked, so that a whole batch of live sectors can be moved with a single sync
+/// of the cold map -- one checkpoint group of it, which leaves nothing to pad.
+static int demote(dhara_error_t *err)
+{
+    struct dhara_journal *j = &hot->journal;
+    const uint32_t group = (1u << DHARA_LOG2_PPC(&cold->journal)) - 1;
+    const int batch_max = (group && (group < FTL_HOTCOLD_WALK_PAGES)) ? group
+                                                                      : FTL_HOTCOLD_WALK_PAGES;
+    int count = 0;     // live sectors in the batch
+    uint32_t held = 0; // pages walked, but not dropped yet
+    uint32_t dropped = 0;
+
+    dhara_page_t p = dhara_journal_peek(j);
+    while ((DHARA_PAGE_NONE != p) && ((held + dropped) < FTL_HOTCOLD_WALK_PAGES) &&
+           (count < batch_max)) {
+        dhara_sector_t sector;
+        bool live;
+        if (classify(p, &sector, &live, err)) return -1;
+
+        if (live) {
+            batch_sectors[count] = sector;
+            batch_pages[count] = p;
+            count++;
+        }
+
+        if (!count) {
+            // nothing held up -- the tail moves on straight away, as the map's own gc would
+            dhara_journal_dequeue(j);
+            dropped++;
+            if (dropped >= hot->gc_ratio) break;
+            p = dhara_journal_peek(j);
+        }
+        else {
+            held++;
+            p = dhara_journal_next(j, p);
+        }
+    }
+
+    return count ? move_batch(count, held, err) : 0;
+}
+
+/// @brief Finds out whether page p of the hot log is the current copy of its sector
+static int classify(dhara_page_t p, dhara_sector_t *sector_out, bool *live_out,
+                    dhara_error_t *err)
+{
+    uint8_t meta[DHARA_META_SIZE];
+    if (dhara_journal_read_meta(&hot->journal, p, meta, err)) return -1;
+
+    // the metadata of a page starts with its sector number (filler pages have none)
+    *sector_out = dhara_r32(meta);
+    *live_out = false;
+    if (DHARA_SECTOR_NONE == *sector_out) return 0;
+
+    dhara_page_t current;
+    if (dhara_map_find(hot, *sector_out, &current, err)) {
+        return (DHARA_E_NOT_FOUND == *err) ? 0 : -1;
+    }
+    *live_out = (current == p);
+
+    return 0;
+}
+
+static int move_batch(int count, uint32_t held, dhara_error_t *err)
+{
+    // copy the batch to the cold log, and make it persistent there...
+    for (int i = 0; i < count; i++) {
+        if (dhara_nand_read(hot->journal.nand, batch_pages[i], 0, SECTOR_SIZE, move_buffer,
+                            err)) {
+            return -1;
+        }
+        if (dhara_map_write(cold, batch_sectors[i], move_buffer, err)) return -1;
+    }
+    if (dhara_map_sync(cold, err)) return -1;
+    stats.demoted += count;
+
+    // ...before removing it from the hot log. (If power is lost in between, the hot copies just
+    // shadow identical cold ones.)
+    for (int i = 0; i < count; i++) {
+        if (dhara_map_trim(hot, batch_sectors[i], err)) return -1;
+    }
+
+    // every page walked is superseded now -- let the map's gc drop them
+    for (uint32_t i = 0; i < held; i++) {
+        if (dhara_map_gc(hot, err)) return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,67 @@
+/**
+ * @file		ftl_hotcold.h
+ * @author		Andrew Loebs
+ * @brief		Header file of the ftl hot/cold separation module
+ *
+ * Keeps frequently rewritten and static sectors in separate logs, between the diskio glue and two
+ * dhara maps on separate partitions of the chip: a small "hot" one that takes every write, and a
+ * large "cold" one that holds everything else.
+ *
+ * In a single log, static data is copied forward by garbage collection every time the tail
+ * passes it. Here, sectors still live when they reach the tail of the hot log are moved to the
+ * cold log instead, so the hot log's own garbage collection mostly finds superseded pages, and
+ * the cold log is only written at the (low) rate at which data goes cold.
+ *
+ * Lookups try the hot map first -- a sector rewritten since it was moved leaves a stale copy in
+ * the cold map until it's moved again. The cold map has to hold every sector, so its capacity is
+ * the capacity of the volume. Moves are crash safe: a batch of moved sectors is synced to the
+ * cold map before it's trimmed from the hot one, and trims go to the cold map first.
+ *
+ */
+
+#ifndef __FTL_HOTCOLD_H
+#define __FTL_HOTCOLD_H
+
+#include <stdint.h>
+
+#include "../dhara/map.h"
+
+/// @brief Most pages of the hot log walked at a time when moving sectors to the cold log
+#ifndef FTL_HOTCOLD_WALK_PAGES
+#define FTL_HOTCOLD_WALK_PAGES 64
+#endif
+
+/// @brief Hot/cold counters
+typedef struct {
+    /// sectors written by the file system
+    uint32_t writes;
+    /// sectors moved from the hot log to the cold log
+    uint32_t demoted;
+    /// sectors currently mapped in the hot and cold maps
+    uint32_t hot_sectors;
+    uint32_t cold_sectors;
+} ftl_hotcold_stats_t;
+
+/// @brief Attaches the layer to two initialized (and resumed) maps
+void ftl_hotcold_init(struct dhara_map *hot, struct dhara_map *cold);
+
+/// @brief Returns the number of logical sectors presented to the file system
+uint32_t ftl_hotcold_sector_count(void);
+
+/// @brief Reads one logical sector
+int ftl_hotcold_read(uint32_t sector, uint8_t *data, dhara_error_t *err);
+
+/// @brief Writes one logical sector
+/// @note May first move the oldest live sectors of the hot log to the cold log.
+int ftl_hotcold_write(uint32_t sector, const uint8_t *data, dhara_error_t *err);
+
+/// @brief Deletes the logical sectors start to end (inclusive)
+int ftl_hotcold_trim(uint32_t start, uint32_t end, dhara_error_t *err);
+
+/// @brief Makes every write so far persistent
+int ftl_hotcold_sync(dhara_error_t *err);
+
+/// @brief Copies out the hot/cold counters
+void ftl_hotcold_get_stats(ftl_hotcold_stats_t *stats_out);
+
+#endif // __FTL_HOTCOLD_H
@@ -0,0 +1,197 @@
+/**
+ * @file		ftl_scrub.c
+ * @author		Andrew Loebs
+ * @brief		Implementation file of the ftl scrub module
+ *
+ */
+
+#include "ftl_scrub.h"
+
+#include "../dhara/bytes.h"
+#include "spi_nand.h"
+#include "sys_time.h"
+
+// defines
+// bytes read from each flash page by the patrol -- the chip checks the whole page regardless
+#define PATROL_READ_SIZE 4
+
+// private function prototypes
+static bool in_journal(dhara_page_t p);
+static bool is_queued(dhara_page_t p);
+static int relocate_page(dhara_page_t p, dhara_error_t *err);
+static int patrol_read(dhara_page_t p, dhara_error_t *err);
+
+// private variables
+static struct dhara_map *map;
+static ftl_scrub_stats_t stats;
+// ring of pages waiting to be relocated
+static dhara_page_t queue[FTL_SCRUB_QUEUE_SIZE];
+static uint32_t queue_first;
+static uint32_t queue_count;
+// page being relocated -- the reads made to move it report it again
+static dhara_page_t relocating = DHARA_PAGE_NONE;
+// next page for the patrol to read, and when it last ran
+static dhara_page_t patrol_next = DHARA_PAGE_NONE;
+static uint32_t patrol_time;
+
+// public function definitions
+void ftl_scrub_init(struct dhara_map *m)
+{
+    map = m;
+    queue_first = 0;
+    queue_count = 0;
+    relocating = DHARA_PAGE_NONE;
+    patrol_next = DHARA_PAGE_NONE;
+    patrol_time = sys_time_get_ms();
+}
+
+void ftl_scrub_report(const struct dhara_nand *n, dhara_page_t p)
+{
+    // pages read before init (by the resume), or outside the journal (hint store), aren't ours
+    if (!map || (n != map->journal.nand) || !in_journal(p)) return;
+    if ((p == relocating) || is_queued(p)) return;
+
+    stats.reported++;
+    if (queue_count >= FTL_SCRUB_QUEUE_SIZE) {
+        stats.dropped++;
+        return;
+    }
+    queue[(queue_first + queue_count) % FTL_SCRUB_QUEUE_SIZE] = p;
+    queue_count++;
+}
+
+bool ftl_scrub_pending(void)
+{
+    return queue_count > 0;
+}
+
+int ftl_scrub_relocate(dhara_error_t *err)
+{
+    if (!queue_count) return 0;
+
+    // taken off the queue first -- a page that fails to move isn't retried until reported again
+    relocating = queue[queue_first];
+    queue_first = (queue_first + 1) % FTL_SCRUB_QUEUE_SIZE;
+    queue_count--;
+
+    // a checkpoint page (non-OOB journals only) holds the metadata of its whole group
+    const dhara_page_t ppc_mask = (1u << DHARA_LOG2_PPC(&map->journal)) - 1;
+    int ret = 0;
+    if (ppc_mask && ((relocating & ppc_mask) == ppc_mask)) {
+        for (dhara_page_t p = relocating - ppc_mask; !ret && (p < relocating); p++) {
+            ret = relocate_page(p, err);
+        }
+    }
+    else {
+        ret = relocate_page(relocating, err);
+    }
+
+    relocating = DHARA_PAGE_NONE;
+    return ret;
+}
+
+int ftl_scrub_patrol(dhara_error_t *err)
+{
+    if (!FTL_SCRUB_PATROL_PAGES) return 0;
+    if (!sys_time_is_elapsed(patrol_time, FTL_SCRUB_PATROL_INTERVAL_MS)) return 0;
+    patrol_time = sys_time_get_ms();
+
+    for (int i = 0; i < FTL_SCRUB_PATROL_PAGES; i++) {
+        // the tail may have passed the patrol since the last step -- start again from it
+        if (!in_journal(patrol_next)) {
+            patrol_next = dhara_journal_peek(&map->journal);
+            if (DHARA_PAGE_NONE == patrol_next) return 0; // empty journal
+        }
+
+        if (patrol_read(patrol_next, err)) return -1;
+        stats.patrolled++;
+
+        patrol_next = dhara_journal_next(&map->journal, patrol_next);
+        if (DHARA_PAGE_NONE == patrol_next) {
+            stats.passes++;
+            break;
+        }
+    }
+
+    return 0;
+}
+
+void ftl_scrub_get_stats(ftl_scrub_stats_t *stats_out)
+{
+    *stats_out = stats;
+}
+
+// private function definitions
+/// @brief Returns true if p lies between the tail and the head of the journal
+static bool in_journal(dhara_page_t p)
+{
+    const struct dhara_journal *j = &map->journal;
+    const dhara_page_t total = DHARA_NUM_BLOCKS(j->nand) << DHARA_LOG2_PPB(j->nand);
+    if (p >= total) return false;
+
+    // distances from the tail, round the end of the chip
+    const dhara_page_t offset = (p + total - j->tail) % total;
+    const dhara_page_t size = (j->head + total - j->tail) % total;
+    return offset < size;
+}
+
+static bool is_queued(dhara_page_t p)
+{
+    for (uint32_t i = 0; i < queue_count; i++) {
+        if (queue[(queue_first + i) % FTL_SCRUB_QUEUE_SIZE] == p) return true;
+    }
+    return false;
+}
+
+/// @brief Copies the sector held by user page p to the head of the journal, if p is its current
+/// copy
+static int relocate_page(dhara_page_t p, dhara_error_t *err)
+{
+    uint8_t meta[DHARA_META_SIZE];
+    if (dhara_journal_read_meta(&map->journal, p, meta, err)) return -1;
+
+    // the metadata of a page starts with its sector number (filler pages have none)
+    const dhara_sector_t sector = dhara_r32(meta);
+    if (DHARA_SECTOR_NONE == sector) return 0;
+
+    // superseded (or trimmed) since it was reported -- gc will drop it
+    dhara_page_t current;
+    dhara_error_t my_err;
+    if (dhara_map_find(map, sector, &current, &my_err)) {
+        if (DHARA_E_NOT_FOUND == my_err) return 0;
+        dhara_set_error(err, my_err);
+        return -1;
+    }
+    if (current != p) return 0;
+
+    // the copy goes through the chip's cache, so the corrected data is what's programmed
+    if (dhara_map_copy_page(map, p, sector, err)) return -1;
+    stats.relocated++;
+    return 0;
+}
+
+/// @brief Reads the start of each flash page of p, and of its checkpoint page if p ends a group
+/// @note Pages that need a refresh are reported through the backend's hook. An uncorrectable
+/// page is lost either way, so it doesn't stop the patrol.
+static int patrol_read(dhara_page_t p, dhara_error_t *err)
+{
+    const struct dhara_nand *n = map->journal.nand;
+    const dhara_page_t ppc_mask = (1u << DHARA_LOG2_PPC(&map->journal)) - 1;
+    const size_t flash_pages = (size_t)1 << (DHARA_LOG2_PAGE_SIZE(n) - SPI_NAND_LOG2_PAGE_SIZE);
+    uint8_t buf[PATROL_READ_SIZE];
+
+    const dhara_page_t last = (ppc_mask && (((p + 1) & ppc_mask) == ppc_mask)) ? p + 1 : p;
+    for (dhara_page_t q = p; q <= last; q++) {
+        for (size_t i = 0; i < flash_pages; i++) {
+            const size_t offset = i << SPI_NAND_LOG2_PAGE_SIZE;
+            dhara_error_t my_err;
+            if (dhara_nand_read(n, q, offset, sizeof(buf), buf, &my_err) &&
+                (DHARA_E_ECC != my_err)) {
+                dhara_set_error(err, my_err);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+/**
+ * @file		ftl_scrub.h
+ * @author		Andrew Loebs
+ * @brief		Header file of the ftl scrub module
+ *
+ * Rewrites pages that the chip reports as wearing out before they become unreadable.
+ *
+ * A read whose page needed so many bit corrections that the chip advises a refresh
+ * (SPI_NAND_RET_ECC_REFRESH) still returns good data. The nand_spi backend passes such pages to
+ * ftl_scrub_report() (its refresh hook), which queues them. ftl_scrub_relocate() moves one queued
+ * page at a time when the file system is idle: the sector a user page holds is copied to the head
+ * of the journal with dhara_map_copy_page(), and the worn copy is left to garbage collection. A
+ * checkpoint page holds the metadata of its whole group, so every live page of the group is
+ * moved instead.
+ *
+ * Pages that are seldom read would only be found once it's too late, so ftl_scrub_patrol() can
+ * also walk the journal from tail to head, FTL_SCRUB_PATROL_PAGES pages at most every
+ * FTL_SCRUB_PATROL_INTERVAL_MS. The chip corrects the whole flash page on every array read, so
+ * a few bytes of each are enough.
+ *
+ */
+
+#ifndef __FTL_SCRUB_H
+#define __FTL_SCRUB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../dhara/map.h"
+
+/// @brief Pages waiting to be relocated -- further reports are dropped (the patrol finds them
+/// again)
+#ifndef FTL_SCRUB_QUEUE_SIZE
+#define FTL_SCRUB_QUEUE_SIZE 8
+#endif
+
+/// @brief Journal pages read per patrol step, 0 disables the patrol
+#ifndef FTL_SCRUB_PATROL_PAGES
+#define FTL_SCRUB_PATROL_PAGES 4
+#endif
+
+/// @brief Shortest time between two patrol steps
+#ifndef FTL_SCRUB_PATROL_INTERVAL_MS
+#define FTL_SCRUB_PATROL_INTERVAL_MS 100
+#endif
+
+/// @brief Scrub counters
+typedef struct {
+    /// pages reported with a refresh advised, and reports dropped because the queue was full
+    uint32_t reported;
+    uint32_t dropped;
+    /// sectors copied to the head of the journal
+    uint32_t relocated;
+    /// journal pages read by the patrol, and complete passes of it over the journal
+    uint32_t patrolled;
+    uint32_t passes;
+} ftl_scrub_stats_t;
+
+/// @brief Attaches the module to an initialized (and resumed) map
+void ftl_scrub_init(struct dhara_map *map);
+
+/// @brief Queues page p of n for relocation (the refresh hook of dhara_nand_spi_t)
+void ftl_scrub_report(const struct dhara_nand *n, dhara_page_t p);
+
+/// @brief Returns true if pages are waiting to be relocated
+bool ftl_scrub_pending(void);
+
+/// @brief Relocates the oldest queued page, if any
+/// @note Writes to the journal -- a resume hint must be withdrawn first.
+int ftl_scrub_relocate(dhara_error_t *err);
+
+/// @brief Reads the next few pages of the journal, if a patrol step is due
+/// @note Only reads, but may queue pages for relocation.
+int ftl_scrub_patrol(dhara_error_t *err);
+
+/// @brief Copies out the scrub counters
+void ftl_scrub_get_stats(ftl_scrub_stats_t *stats_out);
+
+#endif // __FTL_SCRUB_H
@@ -0,0 +1,109 @@
+/**
+ * @file		ftl_wear.c
+ * @author		Andrew Loebs
+ * @brief		Implementation file of the ftl wear telemetry module
+ *
+ */
+
+#include "ftl_wear.h"
+
+#include <stdbool.h>
+
+#include "spi_nand.h"
+#include "sys_time.h"
+
+// defines
+#define MS_PER_DAY (24ull * 60 * 60 * 1000)
+
+// private function prototypes
+static bool is_known(void);
+static uint32_t erases(dhara_block_t b);
+
+// private variables
+static struct dhara_map *map;
+
+// public function definitions
+void ftl_wear_init(struct dhara_map *m)
+{
+    map = m;
+}
+
+int ftl_wear_get_stats(ftl_wear_stats_t *stats_out)
+{
+    if (!is_known()) return -1;
+
+    const struct dhara_journal *j = &map->journal;
+    stats_out->good_blocks = 0;
+    stats_out->bad_blocks = 0;
+    stats_out->min_erases = UINT32_MAX;
+    stats_out->max_erases = 0;
+    for (dhara_block_t b = 0; b < DHARA_NUM_BLOCKS(j->nand); b++) {
+        if (dhara_nand_is_bad(j->nand, b)) {
+            stats_out->bad_blocks++;
+            continue;
+        }
+        const uint32_t count = erases(b);
+        stats_out->good_blocks++;
+        if (count < stats_out->min_erases) stats_out->min_erases = count;
+        if (count > stats_out->max_erases) stats_out->max_erases = count;
+    }
+    if (!stats_out->good_blocks) stats_out->min_erases = 0;
+
+#if DHARA_WRAP_COUNT
+    stats_out->wraps = j->wraps;
+#endif
+    const dhara_page_t ppb_mask = (1u << DHARA_LOG2_PPB(j->nand)) - 1;
+    stats_out->wrap_progress =
+        (j->head >> DHARA_LOG2_PPB(j->nand)) + ((j->head & ppb_mask) ? 1 : 0);
+
+    // rates since power up
+    spi_nand_stats_t nand_stats;
+    spi_nand_get_stats(&nand_stats);
+    const uint32_t uptime_ms = sys_time_get_ms();
+    stats_out->erases_since_boot = nand_stats.block_erases;
+    stats_out->uptime_s = uptime_ms / 1000;
+    stats_out->erases_per_day =
+        uptime_ms ? (uint32_t)((uint64_t)nand_stats.block_erases * MS_PER_DAY / uptime_ms) : 0;
+    // each wrap takes one cycle of every good block
+    stats_out->wraps_per_day_x100 =
+        stats_out->good_blocks ? stats_out->erases_per_day * 100 / stats_out->good_blocks : 0;
+
+    return 0;
+}
+
+int ftl_wear_block_erases(dhara_block_t b, uint32_t *erases_out)
+{
+    if (!is_known()) return -1;
+    if ((b >= DHARA_NUM_BLOCKS(map->journal.nand)) || dhara_nand_is_bad(map->journal.nand, b)) {
+        return -1;
+    }
+
+    *erases_out = erases(b);
+    return 0;
+}
+
+// private function definitions
+static bool is_known(void)
+{
+#if DHARA_WRAP_COUNT
+    // a lazy resume leaves the head to be found by the first write
+    return map && !(map->journal.flags & DHARA_JOURNAL_F_HEAD_PENDING);
+#else
+    return false;
+#endif
+}
+
+/// @brief Returns the erase count of good block b of the journal, since it was formatted
+static uint32_t erases(dhara_block_t b)
+{
+    uint32_t count = 0;
+#if DHARA_WRAP_COUNT
+    // the head block has been erased once the head moves past its first page
+    const struct dhara_journal *j = &map->journal;
+    const dhara_page_t ppb_mask = (1u << DHARA_LOG2_PPB(j->nand)) - 1;
+    const dhara_block_t head_block = j->head >> DHARA_LOG2_PPB(j->nand);
+    const bool passed = (b < head_block) || ((b == head_block) && (j->head & ppb_mask));
+    count = j->wraps + (passed ? 1 : 0);
+#endif
+    return count;
+}
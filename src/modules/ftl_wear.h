@@ -0,0 +1,62 @@
+/**
+ * @file		ftl_wear.h
+ * @author		Andrew Loebs
+ * @brief		Header file of the ftl wear telemetry module
+ *
+ * Reports how much the blocks of the journal have been erased since the volume was formatted, and
+ * how fast they're being erased.
+ *
+ * Dhara levels wear by cycling through the whole chip: a block is erased when the journal head
+ * enters it, and at no other time. So a block has been erased once per wrap of the head around
+ * the chip, plus once more if the head has passed it in the current wrap. The erase count of
+ * every block therefore follows from the wrap counter kept in the checkpoint headers
+ * (DHARA_WRAP_COUNT) and the position of the head, with no per-block table to keep in RAM or to
+ * persist.
+ *
+ * The wrap counter starts from zero whenever a journal is formatted, so the counts only cover the
+ * current volume: erases before it (earlier volumes, factory testing) aren't known, and a block's
+ * count is a lower bound on the cycles it has been through. That's why no lifetime is projected
+ * from them. Rates are measured since power up, from the erases counted by the spi_nand driver.
+ *
+ */
+
+#ifndef __FTL_WEAR_H
+#define __FTL_WEAR_H
+
+#include <stdint.h>
+
+#include "../dhara/map.h"
+
+/// @brief Wear counters
+typedef struct {
+    /// times the journal head has wrapped around the chip since it was formatted
+    uint32_t wraps;
+    /// blocks erased in the current wrap (those below the head block, and the head block itself)
+    uint32_t wrap_progress;
+    /// good and bad blocks of the journal
+    uint32_t good_blocks;
+    uint32_t bad_blocks;
+    /// erase counts of the least and most worn good blocks, since the volume was formatted
+    uint32_t min_erases;
+    uint32_t max_erases;
+    /// block erases since power up, over how long, and the rates they make
+    uint32_t erases_since_boot;
+    uint32_t uptime_s;
+    uint32_t erases_per_day;
+    uint32_t wraps_per_day_x100;
+} ftl_wear_stats_t;
+
+/// @brief Attaches the module to an initialized (and resumed) map
+void ftl_wear_init(struct dhara_map *map);
+
+/// @brief Works out the wear counters
+/// @note Reads the bad block mark of every block of the journal.
+/// @return 0 on success, -1 if no map is attached, its head isn't known yet, or wraps aren't
+/// counted (DHARA_WRAP_COUNT)
+int ftl_wear_get_stats(ftl_wear_stats_t *stats_out);
+
+/// @brief Returns the number of times the journal has erased block b since it was formatted
+/// @return 0 on success, -1 if b is bad or its count can't be known (see ftl_wear_get_stats)
+int ftl_wear_block_erases(dhara_block_t b, uint32_t *erases_out);
+
+#endif // __FTL_WEAR_H
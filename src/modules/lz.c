@@ -0,0 +1,138 @@
+/**
+ * @file		lz.c
+ * @author		Andrew Loebs
+ * @brief		Implementation file of the lz compression module
+ *
+ */
+
+#include "lz.h"
+
+#include <string.h>
+
+// defines
+#define HASH_LOG  9
+#define HASH_SIZE (1 << HASH_LOG)
+
+#define MAX_LITERAL_RUN 32
+#define MIN_MATCH       3
+#define MAX_OFFSET      (1 << 13)         // 5 bits in the control byte + 8 bits in the operand
+#define MAX_MATCH       (7 + 255 + 2)     // longest length the two length fields can express
+#define SHORT_MATCH_MAX (7 - 1)           // longest (length - 2) that fits in the control byte
+
+// private variables
+// positions (+ 1, so that 0 means empty) of the last occurrence of each hashed 3-byte prefix;
+// kept off the stack since it's the biggest piece of state in the codec
+static uint16_t hash_table[HASH_SIZE];
+
+// private function prototypes
+static inline uint32_t hash3(const uint8_t *p);
+
+// public function definitions
+size_t lz_compress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_max)
+{
+    const uint8_t *ip = in;
+    const uint8_t *const in_end = in + in_len;
+    uint8_t *op = out;
+    uint8_t *const out_end = out + out_max;
+    uint8_t *literal_ctrl = NULL; // control byte of the literal run being built (if any)
+
+    memset(hash_table, 0, sizeof(hash_table));
+
+    while (ip < in_end) {
+        // look for a back reference (needs at least MIN_MATCH bytes left to hash)
+        if ((in_end - ip) >= MIN_MATCH) {
+            const uint32_t h = hash3(ip);
+            const size_t ref_pos = hash_table[h];
+            hash_table[h] = (ip - in) + 1;
+
+            if (ref_pos) {
+                const uint8_t *ref = in + ref_pos - 1;
+                const size_t offset = ip - ref - 1;
+                if ((offset < MAX_OFFSET) && (0 == memcmp(ref, ip, MIN_MATCH))) {
+                    // extend the match as far as possible
+                    size_t max_len = in_end - ip;
+                    if (max_len > MAX_MATCH) max_len = MAX_MATCH;
+                    size_t len = MIN_MATCH;
+                    while ((len < max_len) && (ref[len] == ip[len]))
+                        len++;
+
+                    // emit the reference
+                    const size_t coded_len = len - 2;
+                    const size_t needed = (coded_len > SHORT_MATCH_MAX) ? 3 : 2;
+                    if ((size_t)(out_end - op) < needed) return 0;
+                    if (coded_len > SHORT_MATCH_MAX) {
+                        *op++ = (7 << 5) | (offset >> 8);
+                        *op++ = coded_len - 7;
+                    }
+                    else {
+                        *op++ = (coded_len << 5) | (offset >> 8);
+                    }
+                    *op++ = offset;
+
+                    literal_ctrl = NULL;
+                    ip += len;
+                    continue;
+                }
+            }
+        }
+
+        // no match -- append to the current literal run, starting a new one if needed
+        if (!literal_ctrl || (MAX_LITERAL_RUN - 1) == *literal_ctrl) {
+            if ((out_end - op) < 2) return 0;
+            literal_ctrl = op++;
+            *literal_ctrl = 0xff; // incremented to 0 (a run of one) below
+        }
+        else if (op >= out_end) {
+            return 0;
+        }
+        (*literal_ctrl)++;
+        *op++ = *ip++;
+    }
+
+    return op - out;
+}
+
+size_t lz_decompress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_max)
+{
+    const uint8_t *ip = in;
+    const uint8_t *const in_end = in + in_len;
+    uint8_t *op = out;
+    uint8_t *const out_end = out + out_max;
+
+    while (ip < in_end) {
+        const uint8_t ctrl = *ip++;
+
+        if (ctrl < MAX_LITERAL_RUN) { // literal run
+            const size_t len = ctrl + 1;
+            if (((size_t)(in_end - ip) < len) || ((size_t)(out_end - op) < len)) return 0;
+            memcpy(op, ip, len);
+            op += len;
+            ip += len;
+        }
+        else { // back reference
+            size_t len = ctrl >> 5;
+            if (7 == len) {
+                if (ip >= in_end) return 0;
+                len += *ip++;
+            }
+            if (ip >= in_end) return 0;
+            const size_t offset = (((ctrl & 0x1f) << 8) | *ip++) + 1;
+            len += 2;
+            if (((size_t)(op - out) < offset) || ((size_t)(out_end - op) < len)) return 0;
+
+            // byte-wise on purpose: references may overlap the bytes they produce
+            const uint8_t *ref = op - offset;
+            while (len--)
+                *op++ = *ref++;
+        }
+    }
+
+    return op - out;
+}
+
+// private function definitions
+static inline uint32_t hash3(const uint8_t *p)
+{
+    const uint32_t v = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+    return ((v * 2654435761u) >> (32 - HASH_LOG)) & (HASH_SIZE - 1);
+}
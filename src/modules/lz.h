@@ -0,0 +1,30 @@
+/**
+ * @file		lz.h
+ * @author		Andrew Loebs
+ * @brief		Header file of the lz compression module
+ *
+ * Small LZ77 byte codec (LZF-style stream) sized for compressing single flash pages on a
+ * Cortex-M4: no allocations, a 1 KB match table, and a decompressor that's a plain copy loop.
+ *
+ * Stream format -- a sequence of control bytes, each followed by its operands:
+ *   0b000LLLLL                  literal run of L + 1 bytes (1-32), bytes follow
+ *   0bLLLOOOOO [L2] OOOOOOOO    back reference of (L + 2) bytes (L2 is added to L when L == 7)
+ *                               starting (O + 1) bytes behind the output cursor
+ *
+ */
+
+#ifndef __LZ_H
+#define __LZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief Compresses a block of data
+/// @return Compressed length, or 0 if the output would not fit in out_max bytes
+size_t lz_compress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_max);
+
+/// @brief Decompresses a block of data
+/// @return Decompressed length, or 0 if the stream is malformed or would overflow out_max bytes
+size_t lz_decompress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_max);
+
+#endif // __LZ_H
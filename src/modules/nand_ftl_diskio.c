@@ -7,20 +7,146 @@
 
 #include "nand_ftl_diskio.h"
 
+#include <string.h>
+
+#include "../dhara/hint_store.h"
 #include "../dhara/map.h"
-#include "../dhara/nand.h"
+#include "../dhara/nand_spi.h"
+#include "../dhara/nand_part.h"
+#include "ftl_compress.h"
+#include "ftl_hotcold.h"
+#include "ftl_scrub.h"
+#include "ftl_wear.h"
 #include "shell.h"
 #include "spi_nand.h"
+#include "sys_time.h"
+
+// defines
+// sectors larger than a flash page make dhara pages span several flash pages (see dhara/nand_spi.c)
+#if NAND_FTL_SECTOR_SIZE == (2 * SPI_NAND_PAGE_SIZE)
+#define LOG2_PAGES_PER_MAP_PAGE 1
+#elif NAND_FTL_SECTOR_SIZE <= SPI_NAND_PAGE_SIZE
+#define LOG2_PAGES_PER_MAP_PAGE 0
+#else
+#error "NAND_FTL_SECTOR_SIZE may be at most two flash pages"
+#endif
+// a dhara block spans the same block of every die (see dhara/nand_spi.c)
+#define LOG2_PAGES_PER_STRIPE (SPI_NAND_LOG2_PAGES_PER_BLOCK + SPI_NAND_LOG2_DIE_COUNT)
+#define MAP_PAGE_SIZE         (SPI_NAND_PAGE_SIZE << LOG2_PAGES_PER_MAP_PAGE)
+#define SECTORS_PER_PAGE      (MAP_PAGE_SIZE / NAND_FTL_SECTOR_SIZE)
+#define PAGE_NONE             0xffffffff
+// blocks of the chip given to the journal -- the resume hints, if kept, take the rest
+#if NAND_FTL_RESUME_HINT
+#define JOURNAL_BLOCKS (SPI_NAND_BLOCKS_PER_LUN - NAND_FTL_HINT_BLOCKS)
+#else
+#define JOURNAL_BLOCKS SPI_NAND_BLOCKS_PER_LUN
+#endif
+
+#if FF_MIN_SS != FF_MAX_SS
+#error "nand_ftl_diskio requires a fixed sector size (FF_MIN_SS == FF_MAX_SS)"
+#endif
+#if MAP_PAGE_SIZE % NAND_FTL_SECTOR_SIZE
+#error "NAND_FTL_SECTOR_SIZE must evenly divide the flash page size"
+#endif
+#if NAND_FTL_COMPRESSION && (NAND_FTL_SECTOR_SIZE != SPI_NAND_PAGE_SIZE)
+#error "NAND_FTL_COMPRESSION requires sectors the size of a flash page"
+#endif
+#if DHARA_FIXED_GEOMETRY &&                                                                     \
+    ((DHARA_FIXED_LOG2_PAGE_SIZE != SPI_NAND_LOG2_PAGE_SIZE + LOG2_PAGES_PER_MAP_PAGE) ||       \
+     (DHARA_FIXED_LOG2_PPB != LOG2_PAGES_PER_STRIPE - LOG2_PAGES_PER_MAP_PAGE) ||                \
+     (DHARA_FIXED_NUM_BLOCKS != JOURNAL_BLOCKS) ||                                               \
+     (LOG2_PAGES_PER_MAP_PAGE && (DHARA_FIXED_LOG2_PROG_SIZE != SPI_NAND_LOG2_PAGE_SIZE)))
+#error "DHARA_FIXED_* geometry doesn't match the chip and sector size"
+#endif
+#if NAND_FTL_COMPRESSION && DHARA_FIXED_GEOMETRY &&                                             \
+    (DHARA_RADIX_DEPTH < DHARA_CEIL_LOG2((DHARA_FIXED_NUM_BLOCKS << DHARA_FIXED_LOG2_PPB) *      \
+                                         (FTL_COMPRESS_OVERCOMMIT + 1)))
+#error "DHARA_RADIX_DEPTH is too shallow for the sector numbers used by ftl_compress"
+#endif
+#if NAND_FTL_HOT_COLD && (DHARA_FIXED_GEOMETRY || NAND_FTL_COMPRESSION ||                     \
+                          (NAND_FTL_SECTOR_SIZE != SPI_NAND_PAGE_SIZE))
+#error "NAND_FTL_HOT_COLD requires the runtime geometry, no compression and page-sized sectors"
+#endif
+#if NAND_FTL_RESUME_HINT && (NAND_FTL_HOT_COLD || NAND_FTL_LAZY_RESUME)
+#error "NAND_FTL_RESUME_HINT can't be combined with NAND_FTL_HOT_COLD or NAND_FTL_LAZY_RESUME"
+#endif
+#if NAND_FTL_LOG2_PPC && !DHARA_PPC_SELECT
+#error "NAND_FTL_LOG2_PPC requires DHARA_PPC_SELECT"
+#endif
+#if NAND_FTL_SCRUB && NAND_FTL_HOT_COLD
+#error "NAND_FTL_SCRUB can't be combined with NAND_FTL_HOT_COLD"
+#endif
+#if NAND_FTL_TXN && (!DHARA_TXN || NAND_FTL_COMPRESSION || NAND_FTL_HOT_COLD)
+#error "NAND_FTL_TXN requires DHARA_TXN, and can't be combined with compression or hot/cold logs"
+#endif
+#if DHARA_OOB_META && (DHARA_OOB_RECORD_SIZE > (SPI_NAND_OOB_USER_SIZE << LOG2_PAGES_PER_MAP_PAGE))
+#error "DHARA_OOB_META records don't fit the spare area of a map page at this sector size"
+#endif
+
+// private function prototypes
+static dhara_sector_t sector_count(void);
+static int read_sectors(dhara_sector_t sector, uint8_t *data, uint32_t count, dhara_error_t *err);
+static int write_sectors(dhara_sector_t sector, const uint8_t *data, uint32_t count,
+                         dhara_error_t *err);
+static int trim_sectors(dhara_sector_t start, dhara_sector_t end, dhara_error_t *err);
+#if NAND_FTL_COPY
+static int copy_sectors(dhara_sector_t src, dhara_sector_t dst, uint32_t count,
+                        dhara_error_t *err);
+#endif
+static int sync(dhara_error_t *err);
+static int resume(struct dhara_map *m, dhara_error_t *err);
+#if NAND_FTL_RESUME_HINT
+static void save_hint(void);
+static void withdraw_hint(void);
+#endif
+#if DHARA_RESUME_PROFILE
+static void print_resume_profile(const struct dhara_journal *j);
+#endif
+#if SECTORS_PER_PAGE > 1
+static int combine_load(dhara_sector_t page, dhara_error_t *err);
+static int combine_flush(dhara_error_t *err);
+#endif
 
 // private variables
 static bool initialized = false;
 static struct dhara_map map;
-static uint8_t page_buffer[SPI_NAND_PAGE_SIZE];
+static uint8_t page_buffer[MAP_PAGE_SIZE];
+#if NAND_FTL_SCRUB
+// pages read back with a refresh advised are queued for the scrubber
+static dhara_nand_spi_t nand_spi = {.refresh = ftl_scrub_report};
+#endif
 static struct dhara_nand nand = {
-    .log2_page_size = SPI_NAND_LOG2_PAGE_SIZE,
-    .log2_ppb = SPI_NAND_LOG2_PAGES_PER_BLOCK,
-    .num_blocks = SPI_NAND_BLOCKS_PER_LUN,
+    .log2_page_size = SPI_NAND_LOG2_PAGE_SIZE + LOG2_PAGES_PER_MAP_PAGE,
+    .log2_ppb = LOG2_PAGES_PER_STRIPE - LOG2_PAGES_PER_MAP_PAGE,
+    .num_blocks = JOURNAL_BLOCKS,
+    .log2_prog_size = SPI_NAND_LOG2_PAGE_SIZE,
+    .ops = &dhara_nand_spi_ops,
+#if NAND_FTL_SCRUB
+    .ctx = &nand_spi,
+#endif
 };
+#if NAND_FTL_HOT_COLD
+// the hot log (map, above) and the cold log each run on their own partition of the chip
+static struct dhara_nand hot_nand;
+static struct dhara_nand cold_nand;
+static dhara_nand_part_t hot_part;
+static dhara_nand_part_t cold_part;
+static struct dhara_map cold_map;
+static uint8_t cold_page_buffer[MAP_PAGE_SIZE];
+#endif
+#if NAND_FTL_RESUME_HINT
+// the hints live in the blocks following the journal
+static dhara_hint_store_t hint_store;
+static uint8_t hint_page_buffer[MAP_PAGE_SIZE];
+#endif
+#if SECTORS_PER_PAGE > 1
+// write-combining stage: the flash page holding the most recently written sectors. Partial page
+// writes are gathered here and programmed as a whole once the file system moves on to another
+// page (or syncs).
+static uint8_t combine_buffer[MAP_PAGE_SIZE];
+static dhara_sector_t combine_page = PAGE_NONE;
+static bool combine_dirty = false;
+#endif
 
 // public function definitions
 DSTATUS nand_ftl_diskio_initialize(void)
@@ -32,14 +158,57 @@ DSTATUS nand_ftl_diskio_initialize(void)
         return STA_NOINIT;
     }
     // init flash translation layer
-    dhara_map_init(&map, &nand, page_buffer, 4);
     dhara_error_t err = DHARA_E_NONE;
-    ret = dhara_map_resume(&map, &err);
+#if NAND_FTL_HOT_COLD
+    dhara_nand_part_init(&hot_nand, &hot_part, &nand, 0, NAND_FTL_HOT_BLOCKS);
+    dhara_nand_part_init(&cold_nand, &cold_part, &nand, NAND_FTL_HOT_BLOCKS,
+                         JOURNAL_BLOCKS - NAND_FTL_HOT_BLOCKS);
+    dhara_map_init(&cold_map, &cold_nand, cold_page_buffer, 4);
+#if DHARA_RESUME_PROFILE
+    cold_map.journal.profile.clock = sys_time_get_us;
+#endif
+    ret = resume(&cold_map, &err);
+    shell_printf_line("dhara cold resume return: %d, error: %d", ret, err);
+#if DHARA_RESUME_PROFILE
+    print_resume_profile(&cold_map.journal);
+#endif
+    dhara_map_init(&map, &hot_nand, page_buffer, 4);
+#else
+    dhara_map_init(&map, &nand, page_buffer, 4);
+#endif
+#if DHARA_RESUME_PROFILE
+    map.journal.profile.clock = sys_time_get_us;
+#endif
+    ret = resume(&map, &err);
     shell_printf_line("dhara resume return: %d, error: %d", ret, err);
+#if DHARA_RESUME_PROFILE
+    print_resume_profile(&map.journal);
+#endif
+#if NAND_FTL_RESUME_HINT
+    // if the hint was stale, replace it now rather than at the next sync
+    save_hint();
+#endif
     // map_resume will return a bad status in the case of an empty map, however this just
     // means that the file system is empty
 
     // TODO: Flag statuses from dhara that do not indicate an empty map
+#if NAND_FTL_COMPRESSION
+    ftl_compress_init(&map);
+#endif
+#if NAND_FTL_HOT_COLD
+    ftl_hotcold_init(&map, &cold_map);
+#endif
+#if NAND_FTL_SCRUB
+    ftl_scrub_init(&map);
+#endif
+#if !NAND_FTL_HOT_COLD
+    // block numbers of a partition aren't the chip's -- hot/cold logs report no wear
+    ftl_wear_init(&map);
+#endif
+#if SECTORS_PER_PAGE > 1
+    combine_page = PAGE_NONE;
+    combine_dirty = false;
+#endif
     initialized = true;
     return 0;
 }
@@ -58,14 +227,10 @@ DRESULT nand_ftl_diskio_read(BYTE *buff, LBA_t sector, UINT count)
 {
     dhara_error_t err;
     // read *count* consecutive sectors
-    for (int i = 0; i < count; i++) {
-        int ret = dhara_map_read(&map, sector, buff, &err);
-        if (ret) {
-            shell_printf_line("dhara read failed: %d, error: %d", ret, err);
-            return RES_ERROR;
-        }
-        buff += SPI_NAND_PAGE_SIZE; // sector size == page size
-        sector++;
+    int ret = read_sectors(sector, buff, count, &err);
+    if (ret) {
+        shell_printf_line("dhara read failed: %d, error: %d", ret, err);
+        return RES_ERROR;
     }
 
     return RES_OK;
@@ -75,14 +240,10 @@ DRESULT nand_ftl_diskio_write(const BYTE *buff, LBA_t sector, UINT count)
 {
     dhara_error_t err;
     // write *count* consecutive sectors
-    for (int i = 0; i < count; i++) {
-        int ret = dhara_map_write(&map, sector, buff, &err);
-        if (ret) {
-            shell_printf_line("dhara write failed: %d, error: %d", ret, err);
-            return RES_ERROR;
-        }
-        buff += SPI_NAND_PAGE_SIZE; // sector size == page size
-        sector++;
+    int ret = write_sectors(sector, buff, count, &err);
+    if (ret) {
+        shell_printf_line("dhara write failed: %d, error: %d", ret, err);
+        return RES_ERROR;
     }
 
     return RES_OK;
@@ -95,7 +256,7 @@ DRESULT nand_ftl_diskio_ioctl(BYTE cmd, void *buff)
     switch (cmd) {
         case CTRL_SYNC:;
             ;
-            int ret = dhara_map_sync(&map, &err);
+            int ret = sync(&err);
             if (ret) {
                 shell_printf_line("dhara sync failed: %d, error: %d", ret, err);
                 return RES_ERROR;
@@ -103,33 +264,29 @@ DRESULT nand_ftl_diskio_ioctl(BYTE cmd, void *buff)
             break;
         case GET_SECTOR_COUNT:;
             ;
-            dhara_sector_t sector_count = dhara_map_capacity(&map);
-            shell_printf_line("dhara capacity: %d", sector_count);
+            dhara_sector_t count = sector_count();
+            shell_printf_line("dhara capacity: %d", count);
             LBA_t *sector_count_out = (LBA_t *)buff;
-            *sector_count_out = sector_count;
+            *sector_count_out = count;
             break;
         case GET_SECTOR_SIZE:
             ;
             WORD *sector_size_out = (WORD *)buff;
-            *sector_size_out = SPI_NAND_PAGE_SIZE;
+            *sector_size_out = NAND_FTL_SECTOR_SIZE;
             break;
         case GET_BLOCK_SIZE:
             ;
             DWORD *block_size_out = (DWORD *)buff;
-            *block_size_out = SPI_NAND_PAGES_PER_BLOCK;
+            *block_size_out =
+                ((1 << LOG2_PAGES_PER_STRIPE) >> LOG2_PAGES_PER_MAP_PAGE) * SECTORS_PER_PAGE;
             break;
         case CTRL_TRIM:
             ;
             LBA_t *args = (LBA_t *)buff;
-            LBA_t start = args[0];
-            LBA_t end = args[1];
-            while (start <= end) {
-                int ret = dhara_map_trim(&map, start, &err);
-                if (ret) {
-                    shell_printf_line("dhara trim failed: %d, error: %d", ret, err);
-                    return RES_ERROR;
-                }
-                start++;
+            ret = trim_sectors(args[0], args[1], &err);
+            if (ret) {
+                shell_printf_line("dhara trim failed: %d, error: %d", ret, err);
+                return RES_ERROR;
             }
             break;
         default:
@@ -138,3 +295,464 @@ DRESULT nand_ftl_diskio_ioctl(BYTE cmd, void *buff)
 
     return RES_OK;
 }
+
+#if NAND_FTL_COPY
+DRESULT nand_ftl_diskio_copy(LBA_t src, LBA_t dst, UINT count)
+{
+    dhara_error_t err;
+    // copy *count* consecutive sectors
+    int ret = copy_sectors(src, dst, count, &err);
+    if (ret) {
+        shell_printf_line("dhara copy failed: %d, error: %d", ret, err);
+        return RES_ERROR;
+    }
+
+    return RES_OK;
+}
+#endif
+
+void nand_ftl_diskio_idle(void)
+{
+    if (!initialized) return;
+
+#if NAND_FTL_SCRUB
+    dhara_error_t err = DHARA_E_NONE;
+    if (ftl_scrub_patrol(&err)) {
+        shell_printf_line("dhara scrub patrol failed, error: %d", err);
+    }
+    if (!ftl_scrub_pending()) return;
+#if NAND_FTL_TXN
+    // a relocation would be made part of the update, and undone with it
+    if (dhara_journal_in_txn(&map.journal)) return;
+#endif
+
+#if NAND_FTL_RESUME_HINT
+    withdraw_hint();
+#endif
+    if (ftl_scrub_relocate(&err)) {
+        shell_printf_line("dhara scrub relocate failed, error: %d", err);
+        return;
+    }
+    // once the queue is drained, make the moves persistent (the worn copies stay valid until then)
+    if (!ftl_scrub_pending() && sync(&err)) {
+        shell_printf_line("dhara sync failed, error: %d", err);
+    }
+#endif
+}
+
+#if NAND_FTL_TXN
+DRESULT nand_ftl_diskio_txn_begin(void)
+{
+    // changes made before the update aren't part of it
+    dhara_error_t err;
+    int ret = sync(&err);
+    if (!ret) ret = dhara_map_txn_begin(&map, &err);
+    if (ret) {
+        shell_printf_line("dhara txn begin failed: %d, error: %d", ret, err);
+        return RES_ERROR;
+    }
+
+    return RES_OK;
+}
+
+DRESULT nand_ftl_diskio_txn_commit(void)
+{
+    dhara_error_t err;
+    int ret = 0;
+#if SECTORS_PER_PAGE > 1
+    ret = combine_flush(&err);
+#endif
+    if (!ret) ret = dhara_map_txn_commit(&map, &err);
+    if (ret) {
+        shell_printf_line("dhara txn commit failed: %d, error: %d", ret, err);
+        return RES_ERROR;
+    }
+#if NAND_FTL_RESUME_HINT
+    save_hint();
+#endif
+
+    return RES_OK;
+}
+
+DRESULT nand_ftl_diskio_txn_abort(void)
+{
+#if SECTORS_PER_PAGE > 1
+    // the staged page may hold sectors of the update
+    combine_page = PAGE_NONE;
+    combine_dirty = false;
+#endif
+    dhara_error_t err;
+    int ret = dhara_map_txn_abort(&map, &err);
+    if (ret) {
+        shell_printf_line("dhara txn abort failed: %d, error: %d", ret, err);
+        return RES_ERROR;
+    }
+
+    return RES_OK;
+}
+#endif
+
+void nand_ftl_diskio_get_stats(nand_ftl_diskio_stats_t *stats_out)
+{
+#if NAND_FTL_HOT_COLD
+    // a sector rewritten since it was moved is counted in both logs
+    ftl_hotcold_stats_t hotcold_stats;
+    ftl_hotcold_get_stats(&hotcold_stats);
+    stats_out->sectors_used = hotcold_stats.cold_sectors;
+    stats_out->sectors_capacity = ftl_hotcold_sector_count();
+    stats_out->hot_sectors = hotcold_stats.hot_sectors;
+    stats_out->demoted_sectors = hotcold_stats.demoted;
+#else
+    stats_out->sectors_used = dhara_map_size(&map);
+    stats_out->sectors_capacity = dhara_map_capacity(&map);
+    stats_out->hot_sectors = 0;
+    stats_out->demoted_sectors = 0;
+#endif
+#if NAND_FTL_SCRUB
+    ftl_scrub_stats_t scrub_stats;
+    ftl_scrub_get_stats(&scrub_stats);
+    stats_out->refresh_reported = scrub_stats.reported;
+    stats_out->refresh_relocated = scrub_stats.relocated;
+    stats_out->patrolled_pages = scrub_stats.patrolled;
+#else
+    stats_out->refresh_reported = 0;
+    stats_out->refresh_relocated = 0;
+    stats_out->patrolled_pages = 0;
+#endif
+#if DHARA_DEDUP_ENTRIES
+    stats_out->dedup_skipped = map.dedup_skipped;
+#else
+    stats_out->dedup_skipped = 0;
+#endif
+#if NAND_FTL_COMPRESSION
+    ftl_compress_stats_t compress_stats;
+    ftl_compress_get_stats(&compress_stats);
+    stats_out->compressed_writes = compress_stats.packed_writes;
+    stats_out->uncompressed_writes = compress_stats.raw_writes;
+    stats_out->compressed_bytes_in = compress_stats.bytes_in;
+    stats_out->compressed_bytes_out = compress_stats.bytes_out;
+#else
+    stats_out->compressed_writes = 0;
+    stats_out->uncompressed_writes = 0;
+    stats_out->compressed_bytes_in = 0;
+    stats_out->compressed_bytes_out = 0;
+#endif
+    spi_nand_stats_t nand_stats;
+    spi_nand_get_stats(&nand_stats);
+    stats_out->page_reads = nand_stats.page_reads;
+    stats_out->page_programs = nand_stats.page_programs;
+    stats_out->block_erases = nand_stats.block_erases;
+    stats_out->status_polls = nand_stats.status_polls;
+    stats_out->t_read_us = nand_stats.t_read_us;
+    stats_out->t_program_us = nand_stats.t_program_us;
+    stats_out->t_erase_us = nand_stats.t_erase_us;
+}
+
+// private function definitions
+static dhara_sector_t sector_count(void)
+{
+#if NAND_FTL_COMPRESSION
+    return ftl_compress_sector_count();
+#elif NAND_FTL_HOT_COLD
+    return ftl_hotcold_sector_count();
+#else
+    return dhara_map_capacity(&map) * SECTORS_PER_PAGE;
+#endif
+}
+
+static int read_sectors(dhara_sector_t sector, uint8_t *data, uint32_t count, dhara_error_t *err)
+{
+#if SECTORS_PER_PAGE > 1
+    while (count) {
+        const dhara_sector_t page = sector / SECTORS_PER_PAGE;
+        const uint32_t slot = sector % SECTORS_PER_PAGE;
+        uint32_t n = SECTORS_PER_PAGE - slot;
+        if (n > count) n = count;
+        const size_t len = n * NAND_FTL_SECTOR_SIZE;
+
+        if (page == combine_page) {
+            // the staged copy is always the most recent
+            memcpy(data, &combine_buffer[slot * NAND_FTL_SECTOR_SIZE], len);
+        }
+        else if (SECTORS_PER_PAGE == n) {
+            // whole pages are streamed, up to the next partial or staged page
+            uint32_t pages = 1;
+            while (((pages + 1) * SECTORS_PER_PAGE <= count) && (page + pages != combine_page))
+                pages++;
+            if (dhara_map_read_run(&map, page, pages, data, err)) return -1;
+            n = pages * SECTORS_PER_PAGE;
+        }
+        else {
+            // only the requested slots are transferred out of the chip's cache
+            dhara_page_t p;
+            if (dhara_map_find(&map, page, &p, err)) {
+                if (DHARA_E_NOT_FOUND != *err) return -1;
+                memset(data, 0xff, len);
+            }
+            else if (dhara_nand_read(&nand, p, slot * NAND_FTL_SECTOR_SIZE, len, data, err)) {
+                return -1;
+            }
+        }
+
+        sector += n;
+        data += n * NAND_FTL_SECTOR_SIZE;
+        count -= n;
+    }
+#elif NAND_FTL_COMPRESSION
+    for (uint32_t i = 0; i < count; i++) {
+        int ret = ftl_compress_read(sector, data, err);
+        if (ret) return ret;
+        data += NAND_FTL_SECTOR_SIZE;
+        sector++;
+    }
+#elif NAND_FTL_HOT_COLD
+    for (uint32_t i = 0; i < count; i++) {
+        int ret = ftl_hotcold_read(sector, data, err);
+        if (ret) return ret;
+        data += NAND_FTL_SECTOR_SIZE;
+        sector++;
+    }
+#else
+    // sectors written together usually sit in consecutive pages, and are streamed as such
+    if (dhara_map_read_run(&map, sector, count, data, err)) return -1;
+#endif
+
+    return 0;
+}
+
+static int write_sectors(dhara_sector_t sector, const uint8_t *data, uint32_t count,
+                         dhara_error_t *err)
+{
+#if NAND_FTL_RESUME_HINT
+    withdraw_hint();
+#endif
+#if SECTORS_PER_PAGE > 1
+    while (count) {
+        const dhara_sector_t page = sector / SECTORS_PER_PAGE;
+        const uint32_t slot = sector % SECTORS_PER_PAGE;
+        uint32_t n = SECTORS_PER_PAGE - slot;
+        if (n > count) n = count;
+        const size_t len = n * NAND_FTL_SECTOR_SIZE;
+
+        if (SECTORS_PER_PAGE == n) {
+            // whole page: program it straight from the caller's buffer, dropping any staged copy
+            if (page == combine_page) {
+                combine_page = PAGE_NONE;
+                combine_dirty = false;
+            }
+            if (dhara_map_write(&map, page, data, err)) return -1;
+        }
+        else {
+            if (combine_load(page, err)) return -1;
+            memcpy(&combine_buffer[slot * NAND_FTL_SECTOR_SIZE], data, len);
+            combine_dirty = true;
+        }
+
+        sector += n;
+        data += len;
+        count -= n;
+    }
+
+    return 0;
+#elif NAND_FTL_COMPRESSION
+    // the compression layer takes the whole run so it can pack neighbouring sectors together
+    return ftl_compress_write(sector, data, count, err);
+#else
+    for (uint32_t i = 0; i < count; i++) {
+#if NAND_FTL_HOT_COLD
+        int ret = ftl_hotcold_write(sector, data, err);
+#else
+        int ret = dhara_map_write(&map, sector, data, err);
+#endif
+        if (ret) return ret;
+        data += NAND_FTL_SECTOR_SIZE;
+        sector++;
+    }
+
+    return 0;
+#endif
+}
+
+static int trim_sectors(dhara_sector_t start, dhara_sector_t end, dhara_error_t *err)
+{
+#if NAND_FTL_RESUME_HINT
+    withdraw_hint();
+#endif
+#if SECTORS_PER_PAGE > 1
+    // only pages trimmed in full are released -- rewriting a page to blank out some of its
+    // sectors would cost a program to free nothing
+    dhara_sector_t page = (start + SECTORS_PER_PAGE - 1) / SECTORS_PER_PAGE;
+    for (; ((page + 1) * SECTORS_PER_PAGE) - 1 <= end; page++) {
+        if (page == combine_page) {
+            combine_page = PAGE_NONE;
+            combine_dirty = false;
+        }
+        if (dhara_map_trim(&map, page, err)) return -1;
+    }
+#elif NAND_FTL_HOT_COLD
+    // the range goes through both logs in one pass, with one sync of the cold log
+    return ftl_hotcold_trim(start, end, err);
+#else
+    for (; start <= end; start++) {
+#if NAND_FTL_COMPRESSION
+        int ret = ftl_compress_trim(start, err);
+#else
+        int ret = dhara_map_trim(&map, start, err);
+#endif
+        if (ret) return ret;
+    }
+#endif
+
+    return 0;
+}
+
+#if NAND_FTL_COPY
+static int copy_sectors(dhara_sector_t src, dhara_sector_t dst, uint32_t count,
+                        dhara_error_t *err)
+{
+#if NAND_FTL_RESUME_HINT
+    withdraw_hint();
+#endif
+#if SECTORS_PER_PAGE > 1
+    while (count) {
+        const dhara_sector_t page = dst / SECTORS_PER_PAGE;
+        const uint32_t slot = dst % SECTORS_PER_PAGE;
+        uint32_t n = SECTORS_PER_PAGE - slot;
+        if (n > count) n = count;
+
+        if ((SECTORS_PER_PAGE == n) && !(src % SECTORS_PER_PAGE)) {
+            // whole page in step with the source: the chip copies it, once the map holds the
+            // latest copy of every page, and any staged copy of the destination is dropped
+            if (combine_flush(err)) return -1;
+            if (page == combine_page) combine_page = PAGE_NONE;
+            if (dhara_map_copy_sector(&map, src / SECTORS_PER_PAGE, page, err)) return -1;
+        }
+        else {
+            // anything else is staged like a partial write
+            if (combine_load(page, err)) return -1;
+            if (read_sectors(src, &combine_buffer[slot * NAND_FTL_SECTOR_SIZE], n, err)) return -1;
+            combine_dirty = true;
+        }
+
+        src += n;
+        dst += n;
+        count -= n;
+    }
+#else
+    for (uint32_t i = 0; i < count; i++) {
+        if (dhara_map_copy_sector(&map, src + i, dst + i, err)) return -1;
+    }
+#endif
+
+    return 0;
+}
+#endif
+
+static int sync(dhara_error_t *err)
+{
+#if SECTORS_PER_PAGE > 1
+    if (combine_flush(err)) return -1;
+#endif
+#if NAND_FTL_TXN
+    // inside an update, only the commit checkpoints
+    if (dhara_journal_in_txn(&map.journal)) return 0;
+#endif
+#if NAND_FTL_HOT_COLD
+    return ftl_hotcold_sync(err);
+#elif NAND_FTL_RESUME_HINT
+    if (dhara_map_sync(&map, err)) return -1;
+    save_hint();
+    return 0;
+#else
+    return dhara_map_sync(&map, err);
+#endif
+}
+
+static int resume(struct dhara_map *m, dhara_error_t *err)
+{
+#if DHARA_PPC_SELECT
+    // only used if no volume is found
+    dhara_journal_select_ppc(&m->journal, NAND_FTL_LOG2_PPC);
+#endif
+#if NAND_FTL_RESUME_HINT
+    dhara_hint_store_init(&hint_store, &nand, JOURNAL_BLOCKS, NAND_FTL_HINT_BLOCKS,
+                          hint_page_buffer);
+    struct dhara_journal_hint hint;
+    if (!dhara_hint_store_load(&hint_store, &hint)) return dhara_map_resume_hint(m, &hint, err);
+#endif
+#if NAND_FTL_LAZY_RESUME
+    return dhara_map_resume_lazy(m, err);
+#else
+    return dhara_map_resume(m, err);
+#endif
+}
+
+#if NAND_FTL_RESUME_HINT
+/// @note A hint that can't be saved only costs the next mount a full search, so failures are
+/// just reported.
+static void save_hint(void)
+{
+    struct dhara_journal_hint hint;
+    if (dhara_journal_get_hint(&map.journal, &hint)) return;
+
+    dhara_error_t err = DHARA_E_NONE;
+    if (dhara_hint_store_save(&hint_store, &hint, &err)) {
+        shell_printf_line("dhara hint save failed, error: %d", err);
+    }
+}
+
+/// @note A hint that can't be withdrawn is left to the checks the journal makes of it, which
+/// only miss a stale hint followed by an all-0xff page -- not worth failing the write over.
+static void withdraw_hint(void)
+{
+    dhara_error_t err = DHARA_E_NONE;
+    if (dhara_hint_store_withdraw(&hint_store, &err)) {
+        shell_printf_line("dhara hint withdraw failed, error: %d", err);
+    }
+}
+#endif
+
+#if DHARA_RESUME_PROFILE
+static void print_resume_profile(const struct dhara_journal *j)
+{
+    static const char *const names[DHARA_RESUME_PHASES] = {
+        [DHARA_RESUME_HINT] = "hint",
+        [DHARA_RESUME_FIRST_BLOCK] = "first block",
+        [DHARA_RESUME_LAST_BLOCK] = "last block",
+        [DHARA_RESUME_LAST_GROUP] = "last group",
+        [DHARA_RESUME_ROOT] = "root",
+        [DHARA_RESUME_HEAD] = "head",
+    };
+
+    for (int i = 0; i < DHARA_RESUME_PHASES; i++) {
+        const struct dhara_resume_phase *phase = &j->profile.phase[i];
+        shell_printf_line("  %s: %lu reads (%lu bytes), %lu free probes, %lu us", names[i],
+                          (unsigned long)phase->reads, (unsigned long)phase->bytes,
+                          (unsigned long)phase->probes, (unsigned long)phase->time);
+    }
+}
+#endif
+
+#if SECTORS_PER_PAGE > 1
+static int combine_load(dhara_sector_t page, dhara_error_t *err)
+{
+    if (page == combine_page) return 0;
+    if (combine_flush(err)) return -1;
+
+    // an unmapped page reads back as 0xff's
+    combine_page = PAGE_NONE;
+    if (dhara_map_read(&map, page, combine_buffer, err)) return -1;
+    combine_page = page;
+
+    return 0;
+}
+
+static int combine_flush(dhara_error_t *err)
+{
+    if (!combine_dirty) return 0;
+    if (dhara_map_write(&map, combine_page, combine_buffer, err)) return -1;
+    combine_dirty = false;
+
+    return 0;
+}
+#endif
@@ -10,13 +10,142 @@
 #ifndef __NAND_FTL_DISKIO_H
 #define __NAND_FTL_DISKIO_H
 
+#include <stdint.h>
+
 #include "../fatfs/diskio.h" // types from the diskio driver
 #include "../fatfs/ff.h"     // BYTE type
 
+/// @brief Size of the sectors presented to the file system, set through FF_MAX_SS in ffconf.h
+/// @note Sectors smaller than a flash page are packed several to a page, with partial page writes
+/// gathered in a RAM stage until the file system moves on to another page or syncs. 4096 byte
+/// sectors span two flash pages, so each map entry (and lookup) covers twice the data.
+#define NAND_FTL_SECTOR_SIZE FF_MAX_SS
+
+/// @brief Enables transparent per-sector compression (see ftl_compress.h)
+#ifndef NAND_FTL_COMPRESSION
+#define NAND_FTL_COMPRESSION 0
+#endif
+
+/// @brief Mounts without searching for the journal heads: the volume is readable as soon as the
+/// last checkpoint is found, and the search runs on the first write (see dhara_map_resume_lazy)
+#ifndef NAND_FTL_LAZY_RESUME
+#define NAND_FTL_LAZY_RESUME 0
+#endif
+
+/// @brief Saves the location of the last checkpoint at each sync, so that a mount after a clean
+/// shutdown goes straight to it (see dhara/hint_store.h)
+/// @note Takes NAND_FTL_HINT_BLOCKS blocks at the end of the chip away from the journal, so it
+/// changes the layout of the volume -- and DHARA_FIXED_NUM_BLOCKS, if the geometry is fixed.
+#ifndef NAND_FTL_RESUME_HINT
+#define NAND_FTL_RESUME_HINT 0
+#endif
+
+/// @brief Blocks reserved for the resume hints when NAND_FTL_RESUME_HINT is set
+#ifndef NAND_FTL_HINT_BLOCKS
+#define NAND_FTL_HINT_BLOCKS 2
+#endif
+
+/// @brief Checkpoint period given to a newly formatted volume: 2^NAND_FTL_LOG2_PPC pages per
+/// checkpoint group, 0 for the largest that fits (see dhara_journal_select_ppc)
+/// @note Needs DHARA_PPC_SELECT. Small groups make each sync pad fewer pages, large ones leave
+/// more of the chip for data. An existing volume keeps the period it was formatted with.
+#ifndef NAND_FTL_LOG2_PPC
+#define NAND_FTL_LOG2_PPC 0
+#endif
+
+/// @brief Keeps frequently rewritten and static sectors in separate logs (see ftl_hotcold.h)
+/// @note Needs the runtime dhara geometry, and sectors the size of a flash page.
+#ifndef NAND_FTL_HOT_COLD
+#define NAND_FTL_HOT_COLD 0
+#endif
+
+/// @brief Blocks given to the hot log when NAND_FTL_HOT_COLD is set -- the rest hold the cold log
+#ifndef NAND_FTL_HOT_BLOCKS
+#define NAND_FTL_HOT_BLOCKS (SPI_NAND_BLOCKS_PER_LUN / 8)
+#endif
+
+/// @brief Rewrites pages the chip advises refreshing, and patrols the journal for them, from
+/// nand_ftl_diskio_idle() (see ftl_scrub.h)
+#ifndef NAND_FTL_SCRUB
+#define NAND_FTL_SCRUB 0
+#endif
+
+/// @brief Enables atomic updates: nand_ftl_diskio_txn_begin/commit/abort (see dhara_map_txn_begin)
+/// @note Needs DHARA_TXN, which changes the on-flash format. Can't be combined with compression or
+/// hot/cold logs.
+#ifndef NAND_FTL_TXN
+#define NAND_FTL_TXN 0
+#endif
+
+/// @brief Non-zero if sectors can be copied inside the flash translation layer (see
+/// nand_ftl_diskio_copy) -- compressed sectors and hot/cold logs don't keep one sector to a page of
+/// one map, so those builds can't
+#define NAND_FTL_COPY (!NAND_FTL_COMPRESSION && !NAND_FTL_HOT_COLD)
+
+/// @brief Counters describing the work done by the flash translation layer
+typedef struct {
+    /// sectors currently mapped / maximum number of sectors
+    uint32_t sectors_used;
+    uint32_t sectors_capacity;
+    /// sector writes dropped because the sector already held the same data
+    uint32_t dedup_skipped;
+    /// sectors stored compressed / stored raw, and the byte counts of the compressed ones
+    uint32_t compressed_writes;
+    uint32_t uncompressed_writes;
+    uint32_t compressed_bytes_in;
+    uint32_t compressed_bytes_out;
+    /// sectors currently in the hot log, and sectors moved from it to the cold log (hot/cold)
+    uint32_t hot_sectors;
+    uint32_t demoted_sectors;
+    /// pages read back with a refresh advised, sectors rewritten because of it, and journal pages
+    /// read by the patrol (scrub)
+    uint32_t refresh_reported;
+    uint32_t refresh_relocated;
+    uint32_t patrolled_pages;
+    /// flash array operations issued since power up
+    uint32_t page_reads;
+    uint32_t page_programs;
+    uint32_t block_erases;
+    /// status register reads made while waiting on the chip, and the learned operation durations
+    uint32_t status_polls;
+    uint32_t t_read_us;
+    uint32_t t_program_us;
+    uint32_t t_erase_us;
+} nand_ftl_diskio_stats_t;
+
 DSTATUS nand_ftl_diskio_initialize(void);
 DSTATUS nand_ftl_diskio_status(void);
 DRESULT nand_ftl_diskio_read(BYTE *buff, LBA_t sector, UINT count);
 DRESULT nand_ftl_diskio_write(const BYTE *buff, LBA_t sector, UINT count);
 DRESULT nand_ftl_diskio_ioctl(BYTE cmd, void *buff);
 
+/// @brief Runs background maintenance -- call whenever the file system isn't in use
+void nand_ftl_diskio_idle(void);
+
+#if NAND_FTL_COPY
+/// @brief Copies count consecutive sectors from src to dst without moving their data through RAM
+/// @note Each whole flash page is copied by the chip itself (see dhara_map_copy_sector), so no
+/// data crosses the SPI bus. Sectors sharing a page with others that aren't copied, at 512 or 1024
+/// byte sectors, go through the write-combining stage instead. Unwritten source sectors are
+/// copied as such (their copies read back blank). The two ranges must not overlap.
+DRESULT nand_ftl_diskio_copy(LBA_t src, LBA_t dst, UINT count);
+#endif
+
+#if NAND_FTL_TXN
+/// @brief Starts an atomic update: the sectors written from now on reach the volume all together
+/// at nand_ftl_diskio_txn_commit(), or not at all if power is lost first
+/// @note Syncs made by the file system inside the update don't checkpoint -- the commit does, once.
+DRESULT nand_ftl_diskio_txn_begin(void);
+
+/// @brief Commits the update, and syncs
+DRESULT nand_ftl_diskio_txn_commit(void);
+
+/// @brief Abandons the update, returning the volume to its state at the begin
+/// @note The file system's caches still hold the abandoned changes: remount it afterwards.
+DRESULT nand_ftl_diskio_txn_abort(void);
+#endif
+
+/// @brief Copies out the current flash translation layer statistics
+void nand_ftl_diskio_get_stats(nand_ftl_diskio_stats_t *stats_out);
+
 #endif // __NAND_FTL_DISKIO_H
@@ -11,9 +11,14 @@
 #include <string.h>
 
 #include "../fatfs/ff.h"
+#include "fs_clone.h"
+#include "fs_seek.h"
 #include "mem.h"
+#include "ftl_wear.h"
+#include "nand_ftl_diskio.h"
 #include "shell.h"
 #include "spi_nand.h"
+#include "sys_time.h"
 
 // defines
 #define MAX_ARGS          8
@@ -43,6 +48,16 @@ static void command_write_file(int argc, char *argv[]);
 static void command_read_file(int argc, char *argv[]);
 static void command_list_dir(int argc, char *argv[]);
 static void command_file_size(int argc, char *argv[]);
+static void command_ftl_stats(int argc, char *argv[]);
+static void command_bench_file(int argc, char *argv[]);
+static void command_wear(int argc, char *argv[]);
+static void command_clone_file(int argc, char *argv[]);
+static void command_seek_read(int argc, char *argv[]);
+static void command_free_space(int argc, char *argv[]);
+#if NAND_FTL_TXN
+static void command_append_file(int argc, char *argv[]);
+static void abandon_update(FATFS *fs);
+#endif
 
 static const shell_command_t *find_command(const char *name);
 static void print_bytes(uint8_t *data, size_t len);
@@ -74,6 +89,26 @@ static const shell_command_t shell_commands[] = {
     {"list_dir", command_list_dir, "Lists files and subdirectories within a given directory.",
      "list_dir <path>"},
     {"file_size", command_file_size, "Prints the size of the given file.", "file_size <filename>"},
+    {"ftl_stats", command_ftl_stats, "Prints flash translation layer statistics.", "ftl_stats"},
+    {"bench_file", command_bench_file,
+     "Times writing then reading back a file of text (or random) data.",
+     "bench_file <filename> <kilobytes> [random]"},
+    {"wear", command_wear,
+     "Prints block erases since the volume was formatted, optionally for each block.",
+     "wear [blocks]"},
+    {"clone_file", command_clone_file,
+     "Copies a file, having the flash copy its pages internally where the build allows.",
+     "clone_file <src filename> <dest filename>"},
+    {"seek_read", command_seek_read,
+     "Reads *length* bytes of a file from the given offset, seeking with a cluster link map.",
+     "seek_read <filename> <offset> <length>"},
+    {"free_space", command_free_space, "Prints the free space on the file system volume.",
+     "free_space"},
+#if NAND_FTL_TXN
+    {"append_file", command_append_file,
+     "Appends a line of text to a file as one atomic update: all of it lands, or none does.",
+     "append_file <filename> <text>"},
+#endif
 };
 
 // public function definitions
@@ -220,25 +255,29 @@ static void command_get_bad_block_table(int argc, char *argv[])
         shell_printf_line("Unable to allocate nand page buffer.");
         return;
     }
-    // read block status into page buffer
+    // one table per die -- a whole die's block status fits in the page buffer
     bool success = true;
-    for (int i = 0; i < SPI_NAND_BLOCKS_PER_LUN; i++) {
-        bool is_bad;
-        row_address_t row = {.block = i, .page = 0};
-        int ret = spi_nand_block_is_bad(row, &is_bad);
-        if (SPI_NAND_RET_OK != ret) {
-            shell_printf_line("Error when checking block %d status: %d.", i, ret);
-            success = false;
-            break;
-        }
-        else {
-            page_buffer[i] = is_bad;
+    for (int die = 0; (die < SPI_NAND_DIE_COUNT) && success; die++) {
+        // read block status into page buffer
+        for (int i = 0; i < SPI_NAND_BLOCKS_PER_LUN; i++) {
+            bool is_bad;
+            row_address_t row = {.block = (die * SPI_NAND_BLOCKS_PER_LUN) + i, .page = 0};
+            int ret = spi_nand_block_is_bad(row, &is_bad);
+            if (SPI_NAND_RET_OK != ret) {
+                shell_printf_line("Error when checking block %d status: %d.", row.block, ret);
+                success = false;
+                break;
+            }
+            else {
+                page_buffer[i] = is_bad;
+            }
         }
-    }
 
-    // print bad block table
-    if (success) {
-        print_bytes(page_buffer, SPI_NAND_BLOCKS_PER_LUN);
+        // print bad block table
+        if (success) {
+            if (SPI_NAND_DIE_COUNT > 1) shell_printf_line("die %d:", die);
+            print_bytes(page_buffer, SPI_NAND_BLOCKS_PER_LUN);
+        }
     }
     mem_free(page_buffer);
 }
@@ -495,6 +534,360 @@ static void command_file_size(int argc, char *argv[])
     }
 }
 
+static void command_ftl_stats(int argc, char *argv[])
+{
+    nand_ftl_diskio_stats_t stats;
+    nand_ftl_diskio_get_stats(&stats);
+
+    shell_printf_line("Sectors used: %lu / %lu", (unsigned long)stats.sectors_used,
+                      (unsigned long)stats.sectors_capacity);
+    shell_printf_line("Unchanged writes skipped: %lu", (unsigned long)stats.dedup_skipped);
+    shell_printf_line("Sectors compressed: %lu, stored raw: %lu",
+                      (unsigned long)stats.compressed_writes,
+                      (unsigned long)stats.uncompressed_writes);
+    if (stats.hot_sectors || stats.demoted_sectors) {
+        shell_printf_line("Sectors in the hot log: %lu, moved to the cold log: %lu",
+                          (unsigned long)stats.hot_sectors, (unsigned long)stats.demoted_sectors);
+    }
+    if (stats.refresh_reported || stats.patrolled_pages) {
+        shell_printf_line("Pages due a refresh: %lu, sectors rewritten: %lu, pages patrolled: %lu",
+                          (unsigned long)stats.refresh_reported,
+                          (unsigned long)stats.refresh_relocated,
+                          (unsigned long)stats.patrolled_pages);
+    }
+    if (stats.compressed_bytes_out) {
+        shell_printf_line("Compression ratio: %lu.%02lu", // no float printf with nano specs
+                          (unsigned long)(stats.compressed_bytes_in / stats.compressed_bytes_out),
+                          (unsigned long)((stats.compressed_bytes_in % stats.compressed_bytes_out) *
+                                          100 / stats.compressed_bytes_out));
+    }
+    shell_printf_line("Flash page reads: %lu, page programs: %lu, block erases: %lu",
+                      (unsigned long)stats.page_reads, (unsigned long)stats.page_programs,
+                      (unsigned long)stats.block_erases);
+    shell_printf_line("Status polls: %lu, learned tR: %lu us, tPROG: %lu us, tBERS: %lu us",
+                      (unsigned long)stats.status_polls, (unsigned long)stats.t_read_us,
+                      (unsigned long)stats.t_program_us, (unsigned long)stats.t_erase_us);
+}
+
+static void command_bench_file(int argc, char *argv[])
+{
+    if (argc != 3 && argc != 4) {
+        shell_printf_line("bench_file requires filename and kilobytes arguments. Type \"help\" "
+                          "for more info.");
+        return;
+    }
+
+    // parse arguments
+    char *filename = argv[1];
+    unsigned int kilobytes;
+    sscanf(argv[2], "%u", &kilobytes);
+    bool random = (4 == argc) && (0 == strcmp(argv[3], "random"));
+
+    // attempt to allocate a page buffer
+    uint8_t *buffer = mem_alloc(SPI_NAND_PAGE_SIZE);
+    if (!buffer) {
+        shell_printf_line("Unable to allocate nand page buffer.");
+        return;
+    }
+
+    // attempt to create file
+    FIL file;
+    FRESULT res = f_open(&file, filename, FA_CREATE_ALWAYS | FA_WRITE | FA_READ);
+    if (FR_OK != res) {
+        shell_printf_line("f_open failed with res: %d.", res);
+        mem_free(buffer);
+        return;
+    }
+
+    // write -- text looks like a sensor log, random is a xorshift stream (incompressible)
+    uint32_t state = 0x2545f491;
+    uint32_t total = kilobytes * 1024;
+    uint32_t start = sys_time_get_ms();
+    for (uint32_t done = 0; (FR_OK == res) && (done < total); done += SPI_NAND_PAGE_SIZE) {
+        size_t len = 0;
+        while (len < SPI_NAND_PAGE_SIZE) {
+            if (random) {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                buffer[len++] = state;
+            }
+            else {
+                char line[24];
+                int line_len = snprintf(line, sizeof(line), "%08lu,temp=%lu\r\n",
+                                        (unsigned long)(done + len), (unsigned long)(len % 40));
+                for (int i = 0; (i < line_len) && (len < SPI_NAND_PAGE_SIZE); i++) {
+                    buffer[len++] = line[i];
+                }
+            }
+        }
+        unsigned int bytes_written;
+        size_t write_len = ((total - done) < len) ? (total - done) : len;
+        res = f_write(&file, buffer, write_len, &bytes_written);
+    }
+    if (FR_OK == res) res = f_sync(&file);
+    uint32_t write_ms = sys_time_get_elapsed(start);
+    if (FR_OK != res) {
+        shell_printf_line("write failed with res: %d.", res);
+        f_close(&file);
+        mem_free(buffer);
+        return;
+    }
+
+    // read back
+    res = f_lseek(&file, 0);
+    start = sys_time_get_ms();
+    unsigned int bytes_read = SPI_NAND_PAGE_SIZE;
+    while ((FR_OK == res) && (SPI_NAND_PAGE_SIZE == bytes_read)) {
+        res = f_read(&file, buffer, SPI_NAND_PAGE_SIZE, &bytes_read);
+    }
+    uint32_t read_ms = sys_time_get_elapsed(start);
+    f_close(&file);
+    mem_free(buffer);
+    if (FR_OK != res) {
+        shell_printf_line("read failed with res: %d.", res);
+        return;
+    }
+
+    // report (+1 ms keeps tiny runs from dividing by zero)
+    shell_printf_line("Wrote %u KB in %lu ms (%lu KB/s).", kilobytes, (unsigned long)write_ms,
+                      (unsigned long)(kilobytes * 1000 / (write_ms + 1)));
+    shell_printf_line("Read %u KB in %lu ms (%lu KB/s).", kilobytes, (unsigned long)read_ms,
+                      (unsigned long)(kilobytes * 1000 / (read_ms + 1)));
+}
+
+static void command_wear(int argc, char *argv[])
+{
+    ftl_wear_stats_t stats;
+    if (ftl_wear_get_stats(&stats)) {
+        shell_printf_line("Wear isn't known (needs DHARA_WRAP_COUNT, and a journal head).");
+        return;
+    }
+
+    shell_printf_line("Since format -- journal wraps: %lu, blocks erased in this wrap: %lu / %lu",
+                      (unsigned long)stats.wraps, (unsigned long)stats.wrap_progress,
+                      (unsigned long)(stats.good_blocks + stats.bad_blocks));
+    shell_printf_line("Good blocks: %lu, bad blocks: %lu, erases per block since format: %lu - %lu",
+                      (unsigned long)stats.good_blocks, (unsigned long)stats.bad_blocks,
+                      (unsigned long)stats.min_erases, (unsigned long)stats.max_erases);
+    shell_printf_line("Erases since power up: %lu in %lu s (%lu per day, %lu.%02lu wraps per day)",
+                      (unsigned long)stats.erases_since_boot, (unsigned long)stats.uptime_s,
+                      (unsigned long)stats.erases_per_day,
+                      (unsigned long)(stats.wraps_per_day_x100 / 100),
+                      (unsigned long)(stats.wraps_per_day_x100 % 100));
+
+    if ((argc < 2) || strcmp(argv[1], "blocks")) return;
+
+    // one line per run of blocks with the same count
+    const dhara_block_t blocks = stats.good_blocks + stats.bad_blocks;
+    dhara_block_t first = 0;
+    uint32_t first_erases;
+    int first_ret = ftl_wear_block_erases(0, &first_erases);
+    for (dhara_block_t b = 1; b <= blocks; b++) {
+        uint32_t erases = 0;
+        const int ret = (b < blocks) ? ftl_wear_block_erases(b, &erases) : -2;
+        if ((ret == first_ret) && (ret || (erases == first_erases))) continue;
+
+        if (first_ret) {
+            shell_printf_line("blocks %lu - %lu: bad", (unsigned long)first,
+                              (unsigned long)(b - 1));
+        }
+        else {
+            shell_printf_line("blocks %lu - %lu: %lu erases since format", (unsigned long)first,
+                              (unsigned long)(b - 1), (unsigned long)first_erases);
+        }
+        first = b;
+        first_ret = ret;
+        first_erases = erases;
+    }
+}
+
+static void command_clone_file(int argc, char *argv[])
+{
+    if (argc != 3) {
+        shell_printf_line("clone_file requires src and dest filename arguments. Type \"help\" for "
+                          "more info.");
+        return;
+    }
+
+    // parse arguments
+    char *src_filename = argv[1];
+    char *dest_filename = argv[2];
+
+    uint32_t start = sys_time_get_ms();
+    FRESULT res = fs_clone_file(src_filename, dest_filename);
+    uint32_t elapsed = sys_time_get_ms() - start;
+    if (FR_OK != res) {
+        shell_printf_line("clone_file failed with res: %d.", res);
+        return;
+    }
+
+    // if we made it here, it was successful
+    shell_printf_line("clone_file from \"%s\" to \"%s\" succeeded in %lu ms!", src_filename,
+                      dest_filename, (unsigned long)elapsed);
+}
+
+static void command_seek_read(int argc, char *argv[])
+{
+    if (argc != 4) {
+        shell_printf_line("seek_read requires filename, offset, and length arguments. Type "
+                          "\"help\" for more info.");
+        return;
+    }
+
+    // parse arguments
+    char *filename = argv[1];
+    unsigned long offset = 0;
+    unsigned long length = 0;
+    sscanf(argv[2], "%lu", &offset);
+    sscanf(argv[3], "%lu", &length);
+
+    // attempt to open file
+    FIL file;
+    FRESULT res = f_open(&file, filename, FA_OPEN_EXISTING | FA_READ);
+    if (FR_OK != res) {
+        shell_printf_line("f_open failed with res: %d.", res);
+        return;
+    }
+
+    // the first seek builds the file's link map
+    uint32_t start = sys_time_get_ms();
+    res = fs_seek_lseek(&file, offset);
+    uint32_t elapsed = sys_time_get_ms() - start;
+    if (FR_OK != res) {
+        shell_printf_line("f_lseek failed with res: %d.", res);
+        fs_seek_close(&file);
+        return;
+    }
+    shell_printf_line("Seeked to %lu in %lu ms (%s).", (unsigned long)f_tell(&file),
+                      (unsigned long)elapsed, fs_seek_is_fast(&file) ? "fast seek" : "chain walk");
+
+    // attempt to read from the file
+    char read_buffer[16];
+    unsigned int bytes_read = 0;
+    while (length) {
+        unsigned int len = (length < sizeof(read_buffer)) ? length : sizeof(read_buffer);
+        res = f_read(&file, read_buffer, len, &bytes_read);
+        if (FR_OK != res) {
+            shell_put_newline(); // put extra newline to separate from read data
+            shell_printf_line("f_read failed with res: %d.", res);
+            break;
+        }
+        shell_print(read_buffer, bytes_read);
+        if (bytes_read < len) break; // end of file
+        length -= len;
+    }
+
+    // attempt to close the file
+    FRESULT close_res = fs_seek_close(&file);
+    shell_put_newline(); // put extra newline to separate from read data
+    if (FR_OK != close_res) {
+        shell_printf_line("f_close failed with res: %d.", close_res);
+        return;
+    }
+    if (FR_OK != res) return;
+
+    // if we made it here, it was successful
+    shell_printf_line("seek_read from \"%s\" succeeded!", filename);
+}
+
+static void command_free_space(int argc, char *argv[])
+{
+    // the first call after a mount counts the free clusters
+    FATFS *fs;
+    DWORD free_clusters = 0;
+    uint32_t start = sys_time_get_ms();
+    FRESULT res = f_getfree("", &free_clusters, &fs);
+    uint32_t elapsed = sys_time_get_ms() - start;
+    if (FR_OK != res) {
+        shell_printf_line("f_getfree failed with res: %d.", res);
+        return;
+    }
+
+    const unsigned long cluster_size = (unsigned long)fs->csize * FF_MAX_SS;
+    shell_printf_line("Free: %lu of %lu clusters, %lu bytes (%lu ms).",
+                      (unsigned long)free_clusters, (unsigned long)(fs->n_fatent - 2),
+                      (unsigned long)free_clusters * cluster_size, (unsigned long)elapsed);
+}
+
+#if NAND_FTL_TXN
+static void command_append_file(int argc, char *argv[])
+{
+    if (argc != 3) {
+        shell_printf_line("append_file requires filename and text arguments. Type \"help\" for "
+                          "more info.");
+        return;
+    }
+
+    // parse arguments
+    char *filename = argv[1];
+    char *text = argv[2];
+
+    // the file system object, to remount should the update be abandoned (this also makes sure the
+    // volume is mounted; the free count is kept after the first call)
+    FATFS *fs;
+    DWORD free_clusters;
+    FRESULT res = f_getfree("", &free_clusters, &fs);
+    if (FR_OK != res) {
+        shell_printf_line("f_getfree failed with res: %d.", res);
+        return;
+    }
+
+    // the data, the FAT entries and the directory entry land together
+    if (RES_OK != nand_ftl_diskio_txn_begin()) {
+        shell_printf_line("append_file failed to begin the update.");
+        return;
+    }
+
+    // attempt to open file (this creates it if it doesn't exist)
+    FIL file;
+    res = f_open(&file, filename, FA_OPEN_APPEND | FA_WRITE);
+    if (FR_OK != res) {
+        shell_printf_line("f_open failed with res: %d.", res);
+        abandon_update(fs);
+        return;
+    }
+
+    // attempt to write the line, then close (the sync inside the update doesn't checkpoint)
+    size_t text_len = strlen(text);
+    unsigned int bytes_written = 0;
+    res = f_write(&file, text, text_len, &bytes_written);
+    bool ok = (FR_OK == res) && (text_len == bytes_written);
+    if (ok) {
+        res = f_write(&file, "\r\n", 2, &bytes_written);
+        ok = (FR_OK == res) && (2 == bytes_written);
+    }
+    FRESULT close_res = f_close(&file);
+    if (!ok || (FR_OK != close_res)) {
+        shell_printf_line("append_file failed with res: %d, rolling back.",
+                          (FR_OK != res) ? res : close_res);
+        abandon_update(fs);
+        return;
+    }
+
+    if (RES_OK != nand_ftl_diskio_txn_commit()) {
+        shell_printf_line("append_file failed to commit the update.");
+        abandon_update(fs);
+        return;
+    }
+
+    // if we made it here, it was successful
+    shell_printf_line("append_file to \"%s\" succeeded!", filename);
+}
+#endif
+
+#if NAND_FTL_TXN
+/// @brief Abandons the open update and remounts, as the file system's caches still hold its changes
+static void abandon_update(FATFS *fs)
+{
+    if (RES_OK != nand_ftl_diskio_txn_abort()) {
+        shell_printf_line("append_file failed to abandon the update.");
+    }
+    FRESULT res = f_mount(fs, "", 1);
+    if (FR_OK != res) shell_printf_line("f_mount failed, result: %d.", res);
+}
+#endif
+
 static const shell_command_t *find_command(const char *name)
 {
     for (int i = 0; i < NUM_COMMANDS; i++) {
@@ -7,6 +7,8 @@
 
 #include "spi.h"
 
+#include <stdbool.h>
+
 #include "../st/ll/stm32l4xx_ll_bus.h"
 #include "../st/ll/stm32l4xx_ll_gpio.h"
 #include "../st/ll/stm32l4xx_ll_spi.h"
@@ -14,6 +16,31 @@
 #include "sys_time.h"
 
 // defines
+#if SPI_USE_QUADSPI
+#define QSPI_PRESCALER 1  // 80 MHz / 2 -- the same bus clock SPI1 runs at
+#define QSPI_FSIZE     31 // addresses are only sent, never decoded -- allow the full 32 bits
+#define QSPI_AF        LL_GPIO_AF_10
+
+#define CLK_PORT GPIOA
+#define CLK_PIN  LL_GPIO_PIN_3
+#define IO0_PORT GPIOB
+#define IO0_PIN  LL_GPIO_PIN_1
+#define IO1_PORT GPIOB
+#define IO1_PIN  LL_GPIO_PIN_0
+#define IO2_PORT GPIOA
+#define IO2_PIN  LL_GPIO_PIN_7
+#define IO3_PORT GPIOA
+#define IO3_PIN  LL_GPIO_PIN_6
+
+#define CCR_MODE_SINGLE 1
+#define CCR_MODE_DUAL   2
+#define CCR_MODE_QUAD   3
+#define CCR_FMODE_WRITE 0
+#define CCR_FMODE_READ  1
+
+#define MAX_DUMMY_CYCLES   31
+#define QSPI_ASYNC_TIMEOUT 100 // ms
+#else
 #define SPI_INSTANCE SPI1
 
 #define MOSI_PORT GPIOA
@@ -28,7 +55,169 @@
 #define SCK_PIN  LL_GPIO_PIN_1
 #define SCK_AF   LL_GPIO_AF_5
 
+#define MAX_DUMMY_BYTES        4
+#define COMMAND_HEADER_MAX_LEN (1 + 4 + MAX_DUMMY_BYTES) // instruction + address + dummy bytes
+
+#if SPI_USE_DMA
+// SPI1 request lines are fixed to these channels (request 1 on each)
+#define DMA_RX_CHANNEL  DMA1_Channel2
+#define DMA_TX_CHANNEL  DMA1_Channel3
+#define DMA_CSELR_MASK  (DMA_CSELR_C2S | DMA_CSELR_C3S)
+#define DMA_CSELR_SPI1  ((1 << DMA_CSELR_C2S_Pos) | (1 << DMA_CSELR_C3S_Pos))
+#define DMA_MAX_LEN     0xFFFF
+#define DMA_IRQ         DMA1_Channel2_IRQn
+
+#define DMA_PREEMPT_PRIORITY 5 // above the uart
+#define DMA_SUB_PRIORITY     0
+
+#define SYNC_HEADER_TIMEOUT 10 // ms
+#else
+#define SYNC_DATA_TIMEOUT 100 // ms -- the data phase of the _start functions, run in place
+#endif
+
+#if SPI_USE_FIFO_PACKING
+// bytes written ahead of those read back -- the rx fifo holds four, so it can never overrun
+#define FIFO_DEPTH 4
+// polled transfers only look at the clock every this many passes of their loop
+#define TIMEOUT_CHECK_INTERVAL 64
+#endif
+#endif
+
+// private function prototypes
+#if SPI_USE_QUADSPI
+static void pin_setup(GPIO_TypeDef *port, uint32_t pin);
+static int command_ccr(const spi_command_t *cmd, bool has_data, uint32_t *ccr_out);
+static int transfer(uint32_t ccr, bool has_address, uint32_t address, uint8_t *data, size_t len,
+                    uint32_t timeout_ms);
+#else
+static int fifo_transfer(const uint8_t *write_buff, uint8_t *read_buff, size_t len,
+                         uint32_t timeout_ms);
+static int build_header(const spi_command_t *cmd, uint8_t *header_out);
+#if SPI_USE_DMA
+static int dma_start(const uint8_t *write_buff, uint8_t *read_buff, size_t len,
+                     spi_callback_t callback, void *context);
+static void dma_stop(void);
+#endif
+#endif
+
+// private variables
+static volatile int async_ret = SPI_RET_OK; // SPI_RET_BUSY while an async command runs
+#if !SPI_USE_QUADSPI && SPI_USE_DMA
+static spi_callback_t async_callback;
+static void *async_context;
+static uint8_t dma_dummy; // 0x00 source for reads, sink for the bytes clocked in by writes
+#endif
+
 // public function definitions
+#if SPI_USE_QUADSPI
+void spi_init(void)
+{
+    // enable peripheral clocks
+    LL_AHB3_GRP1_EnableClock(LL_AHB3_GRP1_PERIPH_QSPI);
+    if (!LL_AHB2_GRP1_IsEnabledClock(LL_AHB2_GRP1_PERIPH_GPIOA))
+        LL_AHB2_GRP1_EnableClock(LL_AHB2_GRP1_PERIPH_GPIOA);
+    if (!LL_AHB2_GRP1_IsEnabledClock(LL_AHB2_GRP1_PERIPH_GPIOB))
+        LL_AHB2_GRP1_EnableClock(LL_AHB2_GRP1_PERIPH_GPIOB);
+
+    // configure pins
+    pin_setup(CLK_PORT, CLK_PIN);
+    pin_setup(IO0_PORT, IO0_PIN);
+    pin_setup(IO1_PORT, IO1_PIN);
+    pin_setup(IO2_PORT, IO2_PIN);
+    pin_setup(IO3_PORT, IO3_PIN);
+
+    // configure QUADSPI module: indirect mode, clock mode 0, FIFO threshold of one byte, sampling
+    // shifted by half a cycle to leave room for the flash's output delay
+    QUADSPI->CR = (QSPI_PRESCALER << QUADSPI_CR_PRESCALER_Pos) | QUADSPI_CR_SSHIFT;
+    QUADSPI->DCR = (QSPI_FSIZE << QUADSPI_DCR_FSIZE_Pos);
+    QUADSPI->CR |= QUADSPI_CR_EN;
+}
+
+int spi_write(const uint8_t *write_buff, size_t write_len, uint32_t timeout_ms)
+{
+    // validate input
+    if (!write_buff) return SPI_RET_NULL_PTR;
+    if (!write_len) return SPI_RET_OK;
+
+    // raw bytes: a data phase only, on a single line
+    uint32_t ccr = (CCR_MODE_SINGLE << QUADSPI_CCR_DMODE_Pos) |
+                   (CCR_FMODE_WRITE << QUADSPI_CCR_FMODE_Pos);
+    return transfer(ccr, false, 0, (uint8_t *)write_buff, write_len, timeout_ms);
+}
+
+int spi_read(uint8_t *read_buff, size_t read_len, uint32_t timeout_ms)
+{
+    // validate input
+    if (!read_buff) return SPI_RET_NULL_PTR;
+    if (!read_len) return SPI_RET_OK;
+
+    uint32_t ccr = (CCR_MODE_SINGLE << QUADSPI_CCR_DMODE_Pos) |
+                   (CCR_FMODE_READ << QUADSPI_CCR_FMODE_Pos);
+    return transfer(ccr, false, 0, read_buff, read_len, timeout_ms);
+}
+
+int spi_command_write(const spi_command_t *cmd, const uint8_t *write_buff, size_t write_len,
+                      uint32_t timeout_ms)
+{
+    // validate input
+    if (write_len && !write_buff) return SPI_RET_NULL_PTR;
+    uint32_t ccr;
+    if (SPI_RET_OK != command_ccr(cmd, write_len > 0, &ccr)) return SPI_RET_BAD_CMD;
+
+    ccr |= (CCR_FMODE_WRITE << QUADSPI_CCR_FMODE_Pos);
+    return transfer(ccr, cmd->address_len > 0, cmd->address, (uint8_t *)write_buff, write_len,
+                    timeout_ms);
+}
+
+int spi_command_read(const spi_command_t *cmd, uint8_t *read_buff, size_t read_len,
+                     uint32_t timeout_ms)
+{
+    // validate input
+    if (!read_buff) return SPI_RET_NULL_PTR;
+    uint32_t ccr;
+    if (SPI_RET_OK != command_ccr(cmd, read_len > 0, &ccr)) return SPI_RET_BAD_CMD;
+
+    // (a command without data is started like a write, see transfer())
+    ccr |= ((read_len ? CCR_FMODE_READ : CCR_FMODE_WRITE) << QUADSPI_CCR_FMODE_Pos);
+    return transfer(ccr, cmd->address_len > 0, cmd->address, read_buff, read_len, timeout_ms);
+}
+
+// QUADSPI commands run synchronously -- at x4 the data phase is short, and the asynchronous calls
+// complete before returning
+int spi_command_write_start(const spi_command_t *cmd, const uint8_t *write_buff, size_t write_len,
+                            spi_callback_t callback, void *context)
+{
+    async_ret = spi_command_write(cmd, write_buff, write_len, QSPI_ASYNC_TIMEOUT);
+    if (callback) callback(async_ret, context);
+    return SPI_RET_OK;
+}
+
+int spi_command_read_start(const spi_command_t *cmd, uint8_t *read_buff, size_t read_len,
+                           spi_callback_t callback, void *context)
+{
+    async_ret = spi_command_read(cmd, read_buff, read_len, QSPI_ASYNC_TIMEOUT);
+    if (callback) callback(async_ret, context);
+    return SPI_RET_OK;
+}
+
+int spi_poll(void)
+{
+    return async_ret;
+}
+
+int spi_wait(uint32_t timeout_ms)
+{
+    return async_ret;
+}
+
+void spi_abort(void)
+{
+}
+
+void _spi_dma_isr(void)
+{
+}
+#else
 void spi_init(void)
 {
     // enable peripheral clocks
@@ -64,6 +253,16 @@ void spi_init(void)
 
     LL_SPI_SetMode(SPI_INSTANCE, LL_SPI_MODE_MASTER);
     LL_SPI_Enable(SPI_INSTANCE);
+
+#if SPI_USE_DMA
+    // route SPI1's requests to the dma channels used for asynchronous commands
+    if (!LL_AHB1_GRP1_IsEnabledClock(LL_AHB1_GRP1_PERIPH_DMA1))
+        LL_AHB1_GRP1_EnableClock(LL_AHB1_GRP1_PERIPH_DMA1);
+    DMA1_CSELR->CSELR = (DMA1_CSELR->CSELR & ~DMA_CSELR_MASK) | DMA_CSELR_SPI1;
+    NVIC_SetPriority(DMA_IRQ, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), DMA_PREEMPT_PRIORITY,
+                                                  DMA_SUB_PRIORITY));
+    NVIC_EnableIRQ(DMA_IRQ);
+#endif
 }
 
 int spi_write(const uint8_t *write_buff, size_t write_len, uint32_t timeout_ms)
@@ -72,67 +271,317 @@ int spi_write(const uint8_t *write_buff, size_t write_len, uint32_t timeout_ms)
     if (!write_buff) return SPI_RET_NULL_PTR;
 
     // perform transfer
+    return fifo_transfer(write_buff, NULL, write_len, timeout_ms);
+}
+
+int spi_read(uint8_t *read_buff, size_t read_len, uint32_t timeout_ms)
+{
+    // validate input
+    if (!read_buff) return SPI_RET_NULL_PTR;
+
+    // perform transfer
+    return fifo_transfer(NULL, read_buff, read_len, timeout_ms);
+}
+
+int spi_write_read(const uint8_t *write_buff, uint8_t *read_buff, size_t transfer_len,
+                   uint32_t timeout_ms)
+{
+    // validate input
+    if (!write_buff || !read_buff) return SPI_RET_NULL_PTR;
+
+    // perform transfer
+    return fifo_transfer(write_buff, read_buff, transfer_len, timeout_ms);
+}
+
+int spi_command_write(const spi_command_t *cmd, const uint8_t *write_buff, size_t write_len,
+                      uint32_t timeout_ms)
+{
+    // validate input
+    if (write_len && !write_buff) return SPI_RET_NULL_PTR;
+    uint8_t header[COMMAND_HEADER_MAX_LEN];
+    int header_len = build_header(cmd, header);
+    if (header_len < 0) return SPI_RET_BAD_CMD;
+
+    // instruction, address and dummy bytes, then the data
     uint32_t start_time = sys_time_get_ms();
-    for (int i = 0; i < write_len; i++) {
-        // block until tx empty or timeout
-        while (!LL_SPI_IsActiveFlag_TXE(SPI_INSTANCE)) {
-            if (sys_time_is_elapsed(start_time, timeout_ms)) {
-                return SPI_RET_TIMEOUT;
-            }
-        }
-        // transmit data
-        LL_SPI_TransmitData8(SPI_INSTANCE, write_buff[i]);
-        // block until rx not empty
-        while (!LL_SPI_IsActiveFlag_RXNE(SPI_INSTANCE)) {
-            if (sys_time_is_elapsed(start_time, timeout_ms)) {
-                return SPI_RET_TIMEOUT;
-            }
+    int ret = spi_write(header, header_len, timeout_ms);
+    if ((SPI_RET_OK != ret) || !write_len) return ret;
+    return spi_write(write_buff, write_len, timeout_ms - sys_time_get_elapsed(start_time));
+}
+
+int spi_command_read(const spi_command_t *cmd, uint8_t *read_buff, size_t read_len,
+                     uint32_t timeout_ms)
+{
+    // validate input
+    if (!read_buff) return SPI_RET_NULL_PTR;
+    uint8_t header[COMMAND_HEADER_MAX_LEN];
+    int header_len = build_header(cmd, header);
+    if (header_len < 0) return SPI_RET_BAD_CMD;
+
+    uint32_t start_time = sys_time_get_ms();
+    int ret = spi_write(header, header_len, timeout_ms);
+    if ((SPI_RET_OK != ret) || !read_len) return ret;
+    return spi_read(read_buff, read_len, timeout_ms - sys_time_get_elapsed(start_time));
+}
+
+#if SPI_USE_DMA
+int spi_command_write_start(const spi_command_t *cmd, const uint8_t *write_buff, size_t write_len,
+                            spi_callback_t callback, void *context)
+{
+    // validate input
+    if (write_len && !write_buff) return SPI_RET_NULL_PTR;
+    if (SPI_RET_BUSY == async_ret) return SPI_RET_BUSY;
+    uint8_t header[COMMAND_HEADER_MAX_LEN];
+    int header_len = build_header(cmd, header);
+    if (header_len < 0) return SPI_RET_BAD_CMD;
+
+    // the header is a handful of bytes -- not worth a DMA setup
+    int ret = spi_write(header, header_len, SYNC_HEADER_TIMEOUT);
+    if (SPI_RET_OK != ret) return ret;
+    return dma_start(write_buff, NULL, write_len, callback, context);
+}
+
+int spi_command_read_start(const spi_command_t *cmd, uint8_t *read_buff, size_t read_len,
+                           spi_callback_t callback, void *context)
+{
+    // validate input
+    if (!read_buff) return SPI_RET_NULL_PTR;
+    if (SPI_RET_BUSY == async_ret) return SPI_RET_BUSY;
+    uint8_t header[COMMAND_HEADER_MAX_LEN];
+    int header_len = build_header(cmd, header);
+    if (header_len < 0) return SPI_RET_BAD_CMD;
+
+    int ret = spi_write(header, header_len, SYNC_HEADER_TIMEOUT);
+    if (SPI_RET_OK != ret) return ret;
+    return dma_start(NULL, read_buff, read_len, callback, context);
+}
+#else
+// without dma, the asynchronous commands run in place and complete before returning
+int spi_command_write_start(const spi_command_t *cmd, const uint8_t *write_buff, size_t write_len,
+                            spi_callback_t callback, void *context)
+{
+    async_ret = spi_command_write(cmd, write_buff, write_len, SYNC_DATA_TIMEOUT);
+    if (callback) callback(async_ret, context);
+    return SPI_RET_OK;
+}
+
+int spi_command_read_start(const spi_command_t *cmd, uint8_t *read_buff, size_t read_len,
+                           spi_callback_t callback, void *context)
+{
+    async_ret = spi_command_read(cmd, read_buff, read_len, SYNC_DATA_TIMEOUT);
+    if (callback) callback(async_ret, context);
+    return SPI_RET_OK;
+}
+#endif
+
+int spi_poll(void)
+{
+    return async_ret;
+}
+
+int spi_wait(uint32_t timeout_ms)
+{
+    uint32_t start_time = sys_time_get_ms();
+    while (SPI_RET_BUSY == async_ret) {
+        if (sys_time_is_elapsed(start_time, timeout_ms)) {
+            spi_abort();
+            return SPI_RET_TIMEOUT;
         }
-        // read data to clear buffer
+    }
+
+    return async_ret;
+}
+
+void spi_abort(void)
+{
+#if SPI_USE_DMA
+    if (SPI_RET_BUSY != async_ret) return;
+    dma_stop();
+
+    // let the byte on the wire finish, and drop whatever was clocked in
+    while (LL_SPI_IsActiveFlag_BSY(SPI_INSTANCE))
+        ;
+    while (LL_SPI_IsActiveFlag_RXNE(SPI_INSTANCE))
         LL_SPI_ReceiveData8(SPI_INSTANCE);
+    LL_SPI_ClearFlag_OVR(SPI_INSTANCE);
+
+    async_ret = SPI_RET_ABORTED;
+#endif
+}
+
+void _spi_dma_isr(void)
+{
+#if SPI_USE_DMA
+    // the rx channel finishes last: every byte has been clocked both ways
+    const uint32_t isr = DMA1->ISR;
+    DMA1->IFCR = DMA_IFCR_CGIF2 | DMA_IFCR_CGIF3;
+    if (SPI_RET_BUSY != async_ret) return;
+    if (!(isr & (DMA_ISR_TCIF2 | DMA_ISR_TEIF2 | DMA_ISR_TEIF3))) return;
+
+    dma_stop();
+    async_ret = (isr & (DMA_ISR_TEIF2 | DMA_ISR_TEIF3)) ? SPI_RET_DMA_ERR : SPI_RET_OK;
+    if (async_callback) async_callback(async_ret, async_context);
+#endif
+}
+#endif
+
+// private function definitions
+#if SPI_USE_QUADSPI
+static void pin_setup(GPIO_TypeDef *port, uint32_t pin)
+{
+    LL_GPIO_SetPinMode(port, pin, LL_GPIO_MODE_ALTERNATE);
+    LL_GPIO_SetAFPin_0_7(port, pin, QSPI_AF);
+    LL_GPIO_SetPinSpeed(port, pin, LL_GPIO_SPEED_FREQ_VERY_HIGH);
+    LL_GPIO_SetPinPull(port, pin, LL_GPIO_PULL_NO);
+}
+
+/// @brief Builds the communication configuration for a command (minus the functional mode)
+static int command_ccr(const spi_command_t *cmd, bool has_data, uint32_t *ccr_out)
+{
+    if ((cmd->address_len > 4) || (cmd->dummy_cycles > MAX_DUMMY_CYCLES)) return SPI_RET_BAD_CMD;
+
+    uint32_t data_mode;
+    switch (cmd->data_lines) {
+        case 1:
+            data_mode = CCR_MODE_SINGLE;
+            break;
+        case 2:
+            data_mode = CCR_MODE_DUAL;
+            break;
+        case 4:
+            data_mode = CCR_MODE_QUAD;
+            break;
+        default:
+            return SPI_RET_BAD_CMD;
+    }
+
+    uint32_t ccr = (cmd->instruction << QUADSPI_CCR_INSTRUCTION_Pos) |
+                   (CCR_MODE_SINGLE << QUADSPI_CCR_IMODE_Pos) |
+                   (cmd->dummy_cycles << QUADSPI_CCR_DCYC_Pos);
+    if (cmd->address_len) {
+        ccr |= (CCR_MODE_SINGLE << QUADSPI_CCR_ADMODE_Pos) |
+               ((cmd->address_len - 1) << QUADSPI_CCR_ADSIZE_Pos);
     }
+    if (has_data) ccr |= (data_mode << QUADSPI_CCR_DMODE_Pos);
 
+    *ccr_out = ccr;
     return SPI_RET_OK;
 }
 
-int spi_read(uint8_t *read_buff, size_t read_len, uint32_t timeout_ms)
+/// @brief Runs one indirect mode transaction
+/// @note The peripheral starts the transaction on the last register write it needs: CCR if there
+/// is neither an address nor data to write, AR if there's an address but no data to write, and
+/// the first byte written to DR otherwise.
+static int transfer(uint32_t ccr, bool has_address, uint32_t address, uint8_t *data, size_t len,
+                    uint32_t timeout_ms)
 {
-    // validate input
-    if (!read_buff) return SPI_RET_NULL_PTR;
+    const bool read = (CCR_FMODE_READ << QUADSPI_CCR_FMODE_Pos) == (ccr & QUADSPI_CCR_FMODE);
+    volatile uint8_t *dr = (volatile uint8_t *)&QUADSPI->DR;
 
-    // perform transfer
     uint32_t start_time = sys_time_get_ms();
-    for (int i = 0; i < read_len; i++) {
-        // block until tx empty or timeout
-        while (!LL_SPI_IsActiveFlag_TXE(SPI_INSTANCE)) {
-            if (sys_time_is_elapsed(start_time, timeout_ms)) {
-                return SPI_RET_TIMEOUT;
+    // the previous transaction may still be draining
+    while (QUADSPI->SR & QUADSPI_SR_BUSY) {
+        if (sys_time_is_elapsed(start_time, timeout_ms)) return SPI_RET_TIMEOUT;
+    }
+
+    QUADSPI->FCR = QUADSPI_FCR_CTCF | QUADSPI_FCR_CTEF;
+    if (len) QUADSPI->DLR = len - 1;
+    QUADSPI->CCR = ccr;
+    if (has_address) QUADSPI->AR = address;
+
+    // move the data through the FIFO (the threshold flag means at least one byte / free slot)
+    for (size_t i = 0; i < len; i++) {
+        while (!(QUADSPI->SR & QUADSPI_SR_FTF)) {
+            if (sys_time_is_elapsed(start_time, timeout_ms)) return SPI_RET_TIMEOUT;
+        }
+        if (read) {
+            data[i] = *dr;
+        }
+        else {
+            *dr = data[i];
+        }
+    }
+
+    // wait for the last clock edge, so that the caller can release chip select
+    while (!(QUADSPI->SR & QUADSPI_SR_TCF) || (QUADSPI->SR & QUADSPI_SR_BUSY)) {
+        if (sys_time_is_elapsed(start_time, timeout_ms)) return SPI_RET_TIMEOUT;
+    }
+    QUADSPI->FCR = QUADSPI_FCR_CTCF;
+
+    return SPI_RET_OK;
+}
+#else
+#if SPI_USE_FIFO_PACKING
+/// @brief Polled full duplex transfer (either buffer may be NULL: 0x00 is sent / data is dropped)
+/// @note Keeps the tx fifo topped up so that bytes go out back to back, and moves two bytes per
+/// data register access (data packing) wherever two are available.
+static int fifo_transfer(const uint8_t *write_buff, uint8_t *read_buff, size_t len,
+                         uint32_t timeout_ms)
+{
+    size_t tx_count = 0;
+    size_t rx_count = 0;
+    uint32_t start_time = sys_time_get_ms();
+    uint32_t passes = 0;
+
+    // rxne on two bytes, while at least two are still expected
+    LL_SPI_SetRxFIFOThreshold(SPI_INSTANCE, LL_SPI_RX_FIFO_TH_HALF);
+    while (rx_count < len) {
+        // fill
+        if ((tx_count < len) && LL_SPI_IsActiveFlag_TXE(SPI_INSTANCE)) {
+            size_t ahead = tx_count - rx_count;
+            if (((len - tx_count) >= 2) && (ahead + 2 <= FIFO_DEPTH)) {
+                // packed: the low byte goes out first
+                uint16_t frame = write_buff ? (write_buff[tx_count] |
+                                               (write_buff[tx_count + 1] << 8))
+                                            : 0;
+                LL_SPI_TransmitData16(SPI_INSTANCE, frame);
+                tx_count += 2;
+            }
+            else if (ahead + 1 <= FIFO_DEPTH) {
+                LL_SPI_TransmitData8(SPI_INSTANCE, write_buff ? write_buff[tx_count] : 0);
+                tx_count++;
             }
         }
-        // transmit data
-        LL_SPI_TransmitData8(SPI_INSTANCE, 0);
-        // block until rx not empty
-        while (!LL_SPI_IsActiveFlag_RXNE(SPI_INSTANCE)) {
-            if (sys_time_is_elapsed(start_time, timeout_ms)) {
-                return SPI_RET_TIMEOUT;
+
+        // drain
+        if ((len - rx_count) == 1) {
+            LL_SPI_SetRxFIFOThreshold(SPI_INSTANCE, LL_SPI_RX_FIFO_TH_QUARTER);
+        }
+        if (LL_SPI_IsActiveFlag_RXNE(SPI_INSTANCE)) {
+            if ((len - rx_count) >= 2) {
+                uint16_t frame = LL_SPI_ReceiveData16(SPI_INSTANCE);
+                if (read_buff) {
+                    read_buff[rx_count] = frame;
+                    read_buff[rx_count + 1] = frame >> 8;
+                }
+                rx_count += 2;
+            }
+            else {
+                uint8_t data = LL_SPI_ReceiveData8(SPI_INSTANCE);
+                if (read_buff) read_buff[rx_count] = data;
+                rx_count++;
             }
         }
-        // read data from buffer
-        read_buff[i] = LL_SPI_ReceiveData8(SPI_INSTANCE);
+
+        // timeout bookkeeping stays out of the per-byte path
+        if ((0 == (++passes % TIMEOUT_CHECK_INTERVAL)) &&
+            sys_time_is_elapsed(start_time, timeout_ms)) {
+            LL_SPI_SetRxFIFOThreshold(SPI_INSTANCE, LL_SPI_RX_FIFO_TH_QUARTER);
+            return SPI_RET_TIMEOUT;
+        }
     }
+    LL_SPI_SetRxFIFOThreshold(SPI_INSTANCE, LL_SPI_RX_FIFO_TH_QUARTER);
 
     return SPI_RET_OK;
 }
-
-int spi_write_read(const uint8_t *write_buff, uint8_t *read_buff, size_t transfer_len,
-                   uint32_t timeout_ms)
+#else
+/// @brief Polled full duplex transfer (either buffer may be NULL: 0x00 is sent / data is dropped)
+/// @note One byte at a time: each byte is read back before the next one goes out.
+static int fifo_transfer(const uint8_t *write_buff, uint8_t *read_buff, size_t len,
+                         uint32_t timeout_ms)
 {
-    // validate input
-    if (!read_buff) return SPI_RET_NULL_PTR;
-
-    // perform transfer
     uint32_t start_time = sys_time_get_ms();
-    for (int i = 0; i < transfer_len; i++) {
+    for (size_t i = 0; i < len; i++) {
         // block until tx empty or timeout
         while (!LL_SPI_IsActiveFlag_TXE(SPI_INSTANCE)) {
             if (sys_time_is_elapsed(start_time, timeout_ms)) {
@@ -140,16 +589,89 @@ int spi_write_read(const uint8_t *write_buff, uint8_t *read_buff, size_t transfe
             }
         }
         // transmit data
-        LL_SPI_TransmitData8(SPI_INSTANCE, write_buff[i]);
+        LL_SPI_TransmitData8(SPI_INSTANCE, write_buff ? write_buff[i] : 0);
         // block until rx not empty
         while (!LL_SPI_IsActiveFlag_RXNE(SPI_INSTANCE)) {
             if (sys_time_is_elapsed(start_time, timeout_ms)) {
                 return SPI_RET_TIMEOUT;
             }
         }
-        // read data from buffer
-        read_buff[i] = LL_SPI_ReceiveData8(SPI_INSTANCE);
+        // read data from buffer (this also clears it)
+        uint8_t data = LL_SPI_ReceiveData8(SPI_INSTANCE);
+        if (read_buff) read_buff[i] = data;
+    }
+
+    return SPI_RET_OK;
+}
+#endif
+
+/// @brief Serializes the instruction, address and dummy phases of a command
+/// @return Number of header bytes, or -1 if the command can't be run on SPI1
+static int build_header(const spi_command_t *cmd, uint8_t *header_out)
+{
+    if ((cmd->address_len > 4) || (cmd->dummy_cycles % 8) ||
+        (cmd->dummy_cycles > (8 * MAX_DUMMY_BYTES)) || (1 != cmd->data_lines)) {
+        return -1;
+    }
+
+    int len = 0;
+    header_out[len++] = cmd->instruction;
+    for (int i = cmd->address_len - 1; i >= 0; i--) {
+        header_out[len++] = cmd->address >> (8 * i);
+    }
+    for (int i = 0; i < cmd->dummy_cycles / 8; i++) {
+        header_out[len++] = 0;
     }
 
+    return len;
+}
+
+#if SPI_USE_DMA
+/// @note Both channels always run: SPI1 is full duplex, and whichever side the caller doesn't
+/// need is pointed at dma_dummy without memory increment.
+static int dma_start(const uint8_t *write_buff, uint8_t *read_buff, size_t len,
+                     spi_callback_t callback, void *context)
+{
+    if (len > DMA_MAX_LEN) return SPI_RET_BAD_CMD;
+
+    async_callback = callback;
+    async_context = context;
+    if (!len) {
+        async_ret = SPI_RET_OK;
+        if (callback) callback(SPI_RET_OK, context);
+        return SPI_RET_OK;
+    }
+    async_ret = SPI_RET_BUSY;
+    dma_dummy = 0;
+
+    DMA1->IFCR = DMA_IFCR_CGIF2 | DMA_IFCR_CGIF3;
+    // rx: data register -> memory, interrupts on completion / error
+    DMA_RX_CHANNEL->CPAR = (uint32_t)&SPI_INSTANCE->DR;
+    DMA_RX_CHANNEL->CMAR = (uint32_t)(read_buff ? read_buff : &dma_dummy);
+    DMA_RX_CHANNEL->CNDTR = len;
+    DMA_RX_CHANNEL->CCR =
+        (read_buff ? DMA_CCR_MINC : 0) | DMA_CCR_PL_1 | DMA_CCR_TCIE | DMA_CCR_TEIE;
+    // tx: memory -> data register
+    DMA_TX_CHANNEL->CPAR = (uint32_t)&SPI_INSTANCE->DR;
+    DMA_TX_CHANNEL->CMAR = (uint32_t)(write_buff ? write_buff : &dma_dummy);
+    DMA_TX_CHANNEL->CNDTR = len;
+    DMA_TX_CHANNEL->CCR = (write_buff ? DMA_CCR_MINC : 0) | DMA_CCR_DIR | DMA_CCR_TEIE;
+
+    // enable order per the reference manual: rx request, channels, then tx request
+    LL_SPI_EnableDMAReq_RX(SPI_INSTANCE);
+    DMA_RX_CHANNEL->CCR |= DMA_CCR_EN;
+    DMA_TX_CHANNEL->CCR |= DMA_CCR_EN;
+    LL_SPI_EnableDMAReq_TX(SPI_INSTANCE);
+
     return SPI_RET_OK;
 }
+
+static void dma_stop(void)
+{
+    LL_SPI_DisableDMAReq_TX(SPI_INSTANCE);
+    DMA_TX_CHANNEL->CCR &= ~DMA_CCR_EN;
+    DMA_RX_CHANNEL->CCR &= ~DMA_CCR_EN;
+    LL_SPI_DisableDMAReq_RX(SPI_INSTANCE);
+}
+#endif
+#endif
@@ -5,6 +5,11 @@
  *
  * SPI1 master driver (interfaces SPI NAND flash chip)
  *
+ * With SPI_USE_QUADSPI set, the same interface is served by the QUADSPI peripheral instead, which
+ * can run the data phase of a command on two or four lines. This needs the flash wired to the
+ * QUADSPI pins: CLK PA3, IO0 (SI) PB1, IO1 (SO) PB0, IO2 (WP#) PA7, IO3 (HOLD#) PA6. Chip select
+ * stays a GPIO driven by the caller in both cases.
+ *
  */
 
 #ifndef __SPI_H
@@ -17,6 +22,56 @@
 #define SPI_RET_OK       0
 #define SPI_RET_TIMEOUT  -1
 #define SPI_RET_NULL_PTR -2
+#define SPI_RET_BAD_CMD  -3
+#define SPI_RET_BUSY     -4
+#define SPI_RET_ABORTED  -5
+#define SPI_RET_DMA_ERR  -6
+
+/// @brief Selects the QUADSPI backend (see above)
+/// @note Off by default. The x4 command set spi_nand uses with it is covered by the host tests
+/// (test/), but the peripheral code below the interface only runs on hardware wired for it.
+#ifndef SPI_USE_QUADSPI
+#define SPI_USE_QUADSPI 0
+#endif
+
+/// @brief Runs the data phase of the asynchronous SPI1 commands on DMA1 (channels 2 and 3)
+/// @note Off by default: the _start functions then move the data with the polled transfers and
+/// complete before returning, as on QUADSPI. The DMA path hasn't been brought up on hardware yet.
+#ifndef SPI_USE_DMA
+#define SPI_USE_DMA 0
+#endif
+
+/// @brief Polled SPI1 transfers keep the tx fifo topped up and move two bytes per data register
+/// access, instead of sending each byte once the previous one is back
+/// @note Off by default, until it has been brought up on hardware.
+#ifndef SPI_USE_FIFO_PACKING
+#define SPI_USE_FIFO_PACKING 0
+#endif
+
+/// @brief Widest data phase the selected backend supports
+#if SPI_USE_QUADSPI
+#define SPI_MAX_DATA_LINES 4
+#else
+#define SPI_MAX_DATA_LINES 1
+#endif
+
+/// @brief Framing of a command transaction: instruction, address, dummy cycles, then data
+/// @note The instruction, address and dummy phases always run on a single line
+typedef struct {
+    uint8_t instruction;
+    /// number of address bytes (0-4), sent MSB first
+    uint8_t address_len;
+    uint32_t address;
+    /// clock cycles between the address and the data (a multiple of 8 on SPI1)
+    uint8_t dummy_cycles;
+    /// lines carrying the data phase (1, 2 or 4 -- up to SPI_MAX_DATA_LINES)
+    uint8_t data_lines;
+} spi_command_t;
+
+/// @brief Completion callback of an asynchronous command, handed the command's result
+/// @note Called from interrupt context (or before the start function returns, if the data phase
+/// completed synchronously)
+typedef void (*spi_callback_t)(int ret, void *context);
 
 /// @brief Initializes the spi driver
 void spi_init(void);
@@ -30,9 +85,48 @@ int spi_write(const uint8_t *write_buff, size_t write_len, uint32_t timeout_ms);
 /// @note Transmits 0x00 on the MOSI line during the transaction
 int spi_read(uint8_t *read_buff, size_t read_len, uint32_t timeout_ms);
 
+#if !SPI_USE_QUADSPI
 /// @brief Writes/reads data to/from to the bus
 /// @note Caller is expected to drive the chip select line for the relevant device
+/// @note Only available on SPI1 -- QUADSPI is half duplex
 int spi_write_read(const uint8_t *write_buff, uint8_t *read_buff, size_t transfer_len,
                    uint32_t timeout_ms);
+#endif
+
+/// @brief Performs a command transaction, writing write_len bytes (if any) in the data phase
+/// @note Caller is expected to drive the chip select line for the relevant device
+int spi_command_write(const spi_command_t *cmd, const uint8_t *write_buff, size_t write_len,
+                      uint32_t timeout_ms);
+
+/// @brief Performs a command transaction, reading read_len bytes in the data phase
+/// @note Caller is expected to drive the chip select line for the relevant device
+int spi_command_read(const spi_command_t *cmd, uint8_t *read_buff, size_t read_len,
+                     uint32_t timeout_ms);
+
+/// @brief Starts a command transaction whose data phase writes write_len bytes in the background
+/// @note The instruction, address and dummy phases are sent before returning; the data phase runs
+/// on DMA (with SPI_USE_DMA -- otherwise it completes before returning too). Caller keeps chip
+/// select asserted and write_buff alive until the command completes (see spi_poll / spi_wait).
+/// callback may be NULL.
+int spi_command_write_start(const spi_command_t *cmd, const uint8_t *write_buff, size_t write_len,
+                            spi_callback_t callback, void *context);
+
+/// @brief Starts a command transaction whose data phase reads read_len bytes in the background
+/// @note Same rules as spi_command_write_start
+int spi_command_read_start(const spi_command_t *cmd, uint8_t *read_buff, size_t read_len,
+                           spi_callback_t callback, void *context);
+
+/// @brief Returns SPI_RET_BUSY while an asynchronous command is running, and its result after
+int spi_poll(void);
+
+/// @brief Blocks until the asynchronous command completes, aborting it after timeout_ms
+int spi_wait(uint32_t timeout_ms);
+
+/// @brief Stops the asynchronous command in progress -- its callback is not made
+void spi_abort(void);
+
+/// @brief Handles the DMA interrupt of an asynchronous command
+/// @note Called by DMA1_Channel2_IRQHandler
+void _spi_dma_isr(void);
 
 #endif // __SPI_H
@@ -18,8 +18,20 @@
 #include "sys_time.h"
 
 // defines
-#define CSEL_PORT GPIOB
-#define CSEL_PIN  LL_GPIO_PIN_0
+#if SPI_USE_QUADSPI
+// PB0 becomes IO1 of the quad bus (see spi.h)
+#define CSEL_PORT       GPIOA
+#define CSEL_PIN        LL_GPIO_PIN_4
+#define CSEL_PORT_CLOCK LL_AHB2_GRP1_PERIPH_GPIOA
+#else
+#define CSEL_PORT       GPIOB
+#define CSEL_PIN        LL_GPIO_PIN_0
+#define CSEL_PORT_CLOCK LL_AHB2_GRP1_PERIPH_GPIOB
+#endif
+// chip selects of dies 1-3 (all on GPIOA)
+#define CSEL_DIE1_PIN LL_GPIO_PIN_8
+#define CSEL_DIE2_PIN LL_GPIO_PIN_11
+#define CSEL_DIE3_PIN LL_GPIO_PIN_12
 
 #define RESET_DELAY 2    // ms
 #define OP_TIMEOUT  3000 // ms
@@ -30,15 +42,21 @@
 #define CMD_GET_FEATURE              0x0F
 #define CMD_PAGE_READ                0x13
 #define CMD_READ_FROM_CACHE          0x03
+#define CMD_PAGE_READ_CACHE_SEQ      0x31
+#define CMD_PAGE_READ_CACHE_LAST     0x3F
 #define CMD_WRITE_ENABLE             0x06
 #define CMD_PROGRAM_LOAD             0x02
 #define CMD_PROGRAM_LOAD_RANDOM_DATA 0x84
+#define CMD_READ_FROM_CACHE_X4       0x6B
+#define CMD_PROGRAM_LOAD_X4          0x32
+#define CMD_PROGRAM_LOAD_RANDOM_X4   0x34
 #define CMD_PROGRAM_EXECUTE          0x10
 #define CMD_BLOCK_ERASE              0xD8
 
-#define READ_ID_TRANS_LEN    4
-#define READ_ID_MFR_INDEX    2
-#define READ_ID_DEVICE_INDEX 3
+#define READ_ID_DUMMY_CYCLES 8
+#define READ_ID_LEN          2
+#define READ_ID_MFR_INDEX    0
+#define READ_ID_DEVICE_INDEX 1
 #define MFR_ID_MICRON        0x2C
 #define DEVICE_ID_1G_3V3     0x14
 
@@ -46,12 +64,43 @@
 #define FEATURE_REG_INDEX  1
 #define FEATURE_DATA_INDEX 2
 
-#define PAGE_READ_TRANS_LEN                4
-#define READ_FROM_CACHE_TRANS_LEN          4
-#define PROGRAM_LOAD_TRANS_LEN             3
-#define PROGRAM_LOAD_RANDOM_DATA_TRANS_LEN 3
-#define PROGRAM_EXECUTE_TRANS_LEN          4
-#define BLOCK_ERASE_TRANS_LEN              4
+#define ROW_COMMAND_TRANS_LEN 4
+
+// status polling -- the first status read of an array operation is put off until just before its
+// expected duration (learned from the completions seen so far), later ones follow at a fraction of
+// it
+#define T_READ_INITIAL_US       45 // starting estimates
+#define T_READ_CACHE_INITIAL_US 45
+#define T_PROGRAM_INITIAL_US    220
+#define T_ERASE_INITIAL_US      2000
+#define POLL_FIRST_SHIFT        3 // first read at expected - (expected / 8)
+#define POLL_INTERVAL_SHIFT     5 // then every expected / 32
+#define POLL_INTERVAL_MIN_US    2
+#define LEARN_SHIFT             3 // each completion moves the estimate 1/8 of the way
+
+// estimates are kept with LEARN_SHIFT fractional bits, so small corrections aren't lost
+#define EXPECTED_US(timing) (expected_scaled[timing] >> LEARN_SHIFT)
+
+#define MAX_CACHE_LOADS 2
+
+// bytes checked by spi_nand_page_is_free before the rest of the page is transferred
+#define IS_FREE_PROBE_SIZE 32
+
+#define COLUMN_ADDRESS_LEN           2
+#define READ_FROM_CACHE_DUMMY_CYCLES 8
+
+// cache transfers (the bulk of every page operation) use the widest data phase the bus offers
+#if SPI_MAX_DATA_LINES >= 4
+#define CACHE_DATA_LINES      4
+#define CMD_CACHE_READ        CMD_READ_FROM_CACHE_X4
+#define CMD_CACHE_LOAD        CMD_PROGRAM_LOAD_X4
+#define CMD_CACHE_LOAD_RANDOM CMD_PROGRAM_LOAD_RANDOM_X4
+#else
+#define CACHE_DATA_LINES      1
+#define CMD_CACHE_READ        CMD_READ_FROM_CACHE
+#define CMD_CACHE_LOAD        CMD_PROGRAM_LOAD
+#define CMD_CACHE_LOAD_RANDOM CMD_PROGRAM_LOAD_RANDOM_DATA
+#endif
 
 #define FEATURE_REG_STATUS        0xC0
 #define FEATURE_REG_BLOCK_LOCK    0xA0
@@ -66,6 +115,9 @@
 
 #define ROW_ADDRESS_BLOCK_SHIFT 6
 
+// row address within its die, as sent to the chip
+#define CHIP_ROW(row) ((row).whole & ((SPI_NAND_BLOCKS_PER_LUN << ROW_ADDRESS_BLOCK_SHIFT) - 1))
+
 #define BAD_BLOCK_MARK 0
 
 // private types
@@ -117,68 +169,186 @@ typedef union {
     };
 } feature_reg_die_select_t;
 
+/// @brief Array operations with separately learned durations
+typedef enum {
+    TIMING_READ,
+    TIMING_READ_CACHE,
+    TIMING_PROGRAM,
+    TIMING_ERASE,
+    TIMING_COUNT,
+    TIMING_NONE = TIMING_COUNT, // polled right away, nothing learned
+} timing_t;
+
+/// @brief Status polling schedule of an array operation
+typedef struct {
+    timing_t timing;
+    uint32_t reads;
+    uint32_t start_us;
+    uint32_t next_poll_us;
+} poll_schedule_t;
+
+/// @brief Phase of the operation run by spi_nand_poll
+typedef enum {
+    OP_STATE_IDLE,
+    OP_STATE_ARRAY_READ, // page read from the array into the cache
+    OP_STATE_CACHE_READ, // cache -> host transfer (dma)
+    OP_STATE_CACHE_LOAD, // host -> cache transfer (dma)
+    OP_STATE_PROGRAM,    // program execute from the cache into the array
+    OP_STATE_ERASE,      // block erase
+} op_state_t;
+
+/// @brief Cache load issued ahead of a program execute
+typedef struct {
+    uint8_t cmd;
+    column_address_t column;
+    const uint8_t *data_in;
+    size_t len;
+} cache_load_t;
+
+/// @brief Operation in progress on a die
+typedef struct {
+    uint8_t die;
+    op_state_t state;
+    uint32_t start;
+    poll_schedule_t schedule;
+    // page read: cache read issued once the page is in the cache
+    column_address_t column;
+    uint8_t *data_out;
+    size_t read_len;
+    int ecc_ret; // ECC result of the array read, reported once the data is out
+    // program / copy: cache loads, then the program execute of program_row
+    bool program; // (for a copy, the array read is followed by the program)
+    row_address_t program_row;
+    cache_load_t loads[MAX_CACHE_LOADS];
+    int load_count;
+    int next_load;
+    // result of the last operation, and whether spi_nand_poll has yet to report it
+    int ret;
+    bool ret_pending;
+} op_t;
+
+/// @brief Chip select pin of a die
+typedef struct {
+    GPIO_TypeDef *port;
+    uint32_t pin;
+} csel_pin_t;
+
 // private function prototypes
 static void csel_setup(void);
 static void csel_deselect(void);
 static void csel_select(void);
+static void select_die(uint8_t die);
+static op_t *row_op(row_address_t row);
+static int copy_between_dies(row_address_t src, row_address_t dest, column_address_t oob_column,
+                             const uint8_t *oob_in, size_t oob_len);
 
 static int reset(void);
 static int read_id(void);
 static int set_feature(uint8_t reg, uint8_t data, uint32_t timeout);
 static int get_feature(uint8_t reg, uint8_t *data_out, uint32_t timeout);
 static int write_enable(uint32_t timeout);
+static int row_command(uint8_t cmd, row_address_t row, uint32_t timeout);
 static int page_read(row_address_t row, uint32_t timeout);
+static int page_read_cache(uint8_t cmd, uint32_t timeout);
 static int read_from_cache(column_address_t column, uint8_t *data_out, size_t read_len,
                            uint32_t timeout);
-static int program_load(column_address_t column, const uint8_t *data_in, size_t write_len,
-                        uint32_t timeout);
-static int program_load_random_data(column_address_t column, uint8_t *data_in, size_t write_len,
-                                    uint32_t timeout);
-static int program_execute(row_address_t row, uint32_t timeout);
-static int block_erase(row_address_t row, uint32_t timeout);
+static int start_cache_read(column_address_t column, uint8_t *data_out, size_t read_len);
+static int start_cache_load(uint8_t cmd, column_address_t column, const uint8_t *data_in,
+                            size_t write_len);
+
+static void op_setup(op_t *op);
+static void op_add_load(op_t *op, uint8_t cmd, column_address_t column, const uint8_t *data_in,
+                        size_t len);
+static int op_start_program(op_t *op);
+static int op_advance_program(op_t *op);
+static int op_advance(op_t *op);
+static int op_poll_array(op_t *op);
+static int op_poll_cache_transfer(op_t *op);
+static int op_finish(op_t *op, int ret);
+static int op_wait(op_t *op);
+static bool op_is_transferring(const op_t *op);
+static void ops_sleep(void);
+static void bus_wait(void);
 
 static int unlock_all_blocks(void);
 static int enable_ecc(void);
-static int poll_for_oip_clear(feature_reg_status_t *status_out, uint32_t timeout);
+static int poll_for_oip_clear(timing_t timing, feature_reg_status_t *status_out,
+                              uint32_t timeout);
+static void schedule_start(poll_schedule_t *schedule, timing_t timing);
+static bool schedule_is_due(const poll_schedule_t *schedule);
+static void schedule_wait(const poll_schedule_t *schedule);
+static void schedule_update(poll_schedule_t *schedule, feature_reg_status_t status);
 
 static bool validate_row_address(row_address_t row);
 static bool validate_column_address(column_address_t address);
 static int get_ret_from_ecc_status(feature_reg_status_t status);
+static bool is_ecc_ret(int ret);
+static int merge_ecc_ret(int a, int b);
+static bool is_erased(const uint8_t *data, size_t len);
 
 // private variables
 // this buffer is needed for is_free, we don't want to allocate this on the stack
 uint8_t page_main_and_oob_buffer[SPI_NAND_PAGE_SIZE + SPI_NAND_OOB_SIZE];
+static spi_nand_stats_t stats;
+static op_t ops[SPI_NAND_DIE_COUNT];
+static const csel_pin_t csel_pins[] = {
+    {CSEL_PORT, CSEL_PIN},
+    {GPIOA, CSEL_DIE1_PIN},
+    {GPIOA, CSEL_DIE2_PIN},
+    {GPIOA, CSEL_DIE3_PIN},
+};
+static uint8_t active_die; // die addressed by the chip level functions below
+static uint32_t expected_scaled[TIMING_COUNT] = {
+    [TIMING_READ] = T_READ_INITIAL_US << LEARN_SHIFT,
+    [TIMING_READ_CACHE] = T_READ_CACHE_INITIAL_US << LEARN_SHIFT,
+    [TIMING_PROGRAM] = T_PROGRAM_INITIAL_US << LEARN_SHIFT,
+    [TIMING_ERASE] = T_ERASE_INITIAL_US << LEARN_SHIFT,
+};
 
 // public function definitions
 int spi_nand_init(void)
 {
-    // initialize chip select
-    csel_deselect();
+    // initialize chip selects
     csel_setup();
 
-    // reset
-    sys_time_delay(RESET_DELAY);
-    int ret = reset();
-    if (SPI_NAND_RET_OK != ret) return ret;
-    sys_time_delay(RESET_DELAY);
+    int ret = SPI_NAND_RET_OK;
+    for (int i = 0; i < SPI_NAND_DIE_COUNT; i++) {
+        ops[i].die = i;
+        ops[i].state = OP_STATE_IDLE;
+        ops[i].ret_pending = false;
+        select_die(i);
 
-    // read id
-    ret = read_id();
-    if (SPI_NAND_RET_OK != ret) return ret;
+        // reset
+        sys_time_delay(RESET_DELAY);
+        ret = reset();
+        if (SPI_NAND_RET_OK != ret) return ret;
+        sys_time_delay(RESET_DELAY);
 
-    // unlock all blocks
-    ret = unlock_all_blocks();
-    if (SPI_NAND_RET_OK != ret) return ret;
+        // read id
+        ret = read_id();
+        if (SPI_NAND_RET_OK != ret) return ret;
 
-    // enable ecc
-    ret = enable_ecc();
-    if (SPI_NAND_RET_OK != ret) return ret;
+        // unlock all blocks
+        ret = unlock_all_blocks();
+        if (SPI_NAND_RET_OK != ret) return ret;
+
+        // enable ecc
+        ret = enable_ecc();
+        if (SPI_NAND_RET_OK != ret) return ret;
+    }
 
     return ret;
 }
 
 int spi_nand_page_read(row_address_t row, column_address_t column, uint8_t *data_out,
                        size_t read_len)
+{
+    int ret = spi_nand_page_read_start(row, column, data_out, read_len);
+    return (SPI_NAND_RET_OK == ret) ? op_wait(row_op(row)) : ret;
+}
+
+int spi_nand_page_read_start(row_address_t row, column_address_t column, uint8_t *data_out,
+                             size_t read_len)
 {
     // input validation
     if (!validate_row_address(row) || !validate_column_address(column)) {
@@ -186,21 +356,83 @@ int spi_nand_page_read(row_address_t row, column_address_t column, uint8_t *data
     }
     uint16_t max_read_len = (SPI_NAND_PAGE_SIZE + SPI_NAND_OOB_SIZE) - column;
     if (read_len > max_read_len) return SPI_NAND_RET_INVALID_LEN;
+    op_t *op = row_op(row);
+    if (OP_STATE_IDLE != op->state) return SPI_NAND_RET_BUSY;
+
+    // read page into flash's internal cache -- the cache read follows once it's there
+    op_setup(op);
+    op->column = column;
+    op->data_out = data_out;
+    op->read_len = read_len;
+    int ret = row_command(CMD_PAGE_READ, row, OP_TIMEOUT);
+    if (SPI_NAND_RET_OK != ret) return ret;
 
-    // setup timeout tracking
-    uint32_t start = sys_time_get_ms();
+    schedule_start(&op->schedule, TIMING_READ);
+    op->state = OP_STATE_ARRAY_READ;
+    return SPI_NAND_RET_OK;
+}
 
-    // read page into flash's internal cache
-    int ret = page_read(row, OP_TIMEOUT);
-    if (SPI_NAND_RET_OK != ret) return ret;
+int spi_nand_read_pages(row_address_t row, size_t page_count, uint8_t *data_out)
+{
+    // input validation
+    if (!validate_row_address(row)) return SPI_NAND_RET_BAD_ADDRESS;
+    if (!page_count || ((row.whole + page_count - 1) >> ROW_ADDRESS_BLOCK_SHIFT) >
+                           SPI_NAND_MAX_BLOCK_ADDRESS) {
+        return SPI_NAND_RET_INVALID_LEN;
+    }
+    row_address_t last = {.whole = row.whole + page_count - 1};
+    for (int i = SPI_NAND_ROW_DIE(row); i <= SPI_NAND_ROW_DIE(last); i++) {
+        if (OP_STATE_IDLE != ops[i].state) return SPI_NAND_RET_BUSY;
+    }
+    bus_wait();
+
+    int ecc_ret = SPI_NAND_RET_OK;
+    while (page_count) {
+        // cache reads can't cross a block boundary, so each block's share of the run is read
+        // separately
+        size_t run = SPI_NAND_PAGES_PER_BLOCK - row.page;
+        if (run > page_count) run = page_count;
+        select_die(SPI_NAND_ROW_DIE(row));
+
+        // read the first page into flash's internal cache
+        int ret = page_read(row, OP_TIMEOUT);
+        if (!is_ecc_ret(ret)) return ret;
+        ecc_ret = merge_ecc_ret(ecc_ret, ret);
+
+        for (size_t i = 0; i < run; i++) {
+            // for runs of several pages, move each page to the cache while the next one is read
+            // from the array -- tR overlaps with clocking out the previous page. The last page
+            // is moved without starting another read.
+            if (run > 1) {
+                ret = page_read_cache((i < run - 1) ? CMD_PAGE_READ_CACHE_SEQ
+                                                    : CMD_PAGE_READ_CACHE_LAST,
+                                      OP_TIMEOUT);
+                if (!is_ecc_ret(ret)) return ret;
+                ecc_ret = merge_ecc_ret(ecc_ret, ret);
+            }
+
+            ret = read_from_cache(0, data_out, SPI_NAND_PAGE_SIZE, OP_TIMEOUT);
+            if (SPI_NAND_RET_OK != ret) return ret;
+            data_out += SPI_NAND_PAGE_SIZE;
+        }
+
+        row.whole += run;
+        page_count -= run;
+    }
 
-    // read from cache
-    uint32_t timeout = OP_TIMEOUT - sys_time_get_elapsed(start);
-    return read_from_cache(column, data_out, read_len, timeout);
+    // every page was transferred -- report the worst ECC outcome among them
+    return ecc_ret;
 }
 
 int spi_nand_page_program(row_address_t row, column_address_t column, const uint8_t *data_in,
                           size_t write_len)
+{
+    int ret = spi_nand_page_program_start(row, column, data_in, write_len);
+    return (SPI_NAND_RET_OK == ret) ? op_wait(row_op(row)) : ret;
+}
+
+int spi_nand_page_program_start(row_address_t row, column_address_t column,
+                                const uint8_t *data_in, size_t write_len)
 {
     // input validation
     if (!validate_row_address(row) || !validate_column_address(column)) {
@@ -208,72 +440,163 @@ int spi_nand_page_program(row_address_t row, column_address_t column, const uint
     }
     uint16_t max_write_len = (SPI_NAND_PAGE_SIZE + SPI_NAND_OOB_SIZE) - column;
     if (write_len > max_write_len) return SPI_NAND_RET_INVALID_LEN;
+    op_t *op = row_op(row);
+    if (OP_STATE_IDLE != op->state) return SPI_NAND_RET_BUSY;
+
+    // load data into nand's internal cache, then write it to the cell array
+    op_setup(op);
+    op->program_row = row;
+    op_add_load(op, CMD_CACHE_LOAD, column, data_in, write_len);
+    return op_start_program(op);
+}
 
-    // setup timeout tracking
-    uint32_t start = sys_time_get_ms();
-
-    // write enable
-    int ret = write_enable(OP_TIMEOUT);
-    if (SPI_NAND_RET_OK != ret) return ret;
-
-    // load data into nand's internal cache
-    uint32_t timeout = OP_TIMEOUT - sys_time_get_elapsed(start);
-    ret = program_load(column, data_in, write_len, timeout);
-    if (SPI_NAND_RET_OK != ret) return ret;
-
-    // write to cell array from nand's internal cache
-    timeout = OP_TIMEOUT - sys_time_get_elapsed(start);
-    return program_execute(row, timeout);
+int spi_nand_page_program_with_oob(row_address_t row, const uint8_t *data_in,
+                                   column_address_t oob_column, const uint8_t *oob_in,
+                                   size_t oob_len)
+{
+    int ret = spi_nand_page_program_with_oob_start(row, data_in, oob_column, oob_in, oob_len);
+    return (SPI_NAND_RET_OK == ret) ? op_wait(row_op(row)) : ret;
 }
 
-int spi_nand_page_copy(row_address_t src, row_address_t dest)
+int spi_nand_page_program_with_oob_start(row_address_t row, const uint8_t *data_in,
+                                         column_address_t oob_column, const uint8_t *oob_in,
+                                         size_t oob_len)
 {
     // input validation
-    if (!validate_row_address(src) || !validate_row_address(src)) {
+    if (!validate_row_address(row) || !validate_column_address(oob_column) ||
+        (oob_column < SPI_NAND_PAGE_SIZE)) {
         return SPI_NAND_RET_BAD_ADDRESS;
     }
+    uint16_t max_write_len = (SPI_NAND_PAGE_SIZE + SPI_NAND_OOB_SIZE) - oob_column;
+    if (oob_len > max_write_len) return SPI_NAND_RET_INVALID_LEN;
+    op_t *op = row_op(row);
+    if (OP_STATE_IDLE != op->state) return SPI_NAND_RET_BUSY;
+
+    // load data into nand's internal cache -- program load resets the rest of the cache to 0xff's,
+    // so the spare area goes in with random data load behind it (or on its own)
+    op_setup(op);
+    op->program_row = row;
+    if (data_in) {
+        op_add_load(op, CMD_CACHE_LOAD, 0, data_in, SPI_NAND_PAGE_SIZE);
+        op_add_load(op, CMD_CACHE_LOAD_RANDOM, oob_column, oob_in, oob_len);
+    }
+    else {
+        op_add_load(op, CMD_CACHE_LOAD, oob_column, oob_in, oob_len);
+    }
+    return op_start_program(op);
+}
 
-    // setup timeout tracking
-    uint32_t start = sys_time_get_ms();
+int spi_nand_page_copy(row_address_t src, row_address_t dest)
+{
+    uint8_t dummy_byte = 0; // avoid a null pointer
+    return spi_nand_page_copy_with_oob(src, dest, SPI_NAND_PAGE_SIZE, &dummy_byte, 0);
+}
 
-    // read page into flash's internal cache
-    int ret = page_read(src, OP_TIMEOUT);
-    if (SPI_NAND_RET_OK != ret) return ret;
+int spi_nand_page_copy_with_oob(row_address_t src, row_address_t dest,
+                                column_address_t oob_column, const uint8_t *oob_in,
+                                size_t oob_len)
+{
+    // the chip's internal data move stays within a die -- copies to another die go through the
+    // host
+    if (validate_row_address(src) && validate_row_address(dest) &&
+        (SPI_NAND_ROW_DIE(src) != SPI_NAND_ROW_DIE(dest))) {
+        return copy_between_dies(src, dest, oob_column, oob_in, oob_len);
+    }
 
-    // write enable
-    uint32_t timeout = OP_TIMEOUT - sys_time_get_elapsed(start);
-    ret = write_enable(timeout);
-    if (SPI_NAND_RET_OK != ret) return ret;
+    int ret = spi_nand_page_copy_with_oob_start(src, dest, oob_column, oob_in, oob_len);
+    return (SPI_NAND_RET_OK == ret) ? op_wait(row_op(src)) : ret;
+}
 
-    // empty program load random data
-    timeout = OP_TIMEOUT - sys_time_get_elapsed(start);
-    uint8_t dummy_byte = 0; // avoid a null pointer
-    ret = program_load_random_data(0, &dummy_byte, 0, timeout);
+int spi_nand_page_copy_with_oob_start(row_address_t src, row_address_t dest,
+                                      column_address_t oob_column, const uint8_t *oob_in,
+                                      size_t oob_len)
+{
+    // input validation
+    if (!validate_row_address(src) || !validate_row_address(dest) ||
+        (SPI_NAND_ROW_DIE(src) != SPI_NAND_ROW_DIE(dest)) ||
+        !validate_column_address(oob_column) || (oob_column < SPI_NAND_PAGE_SIZE)) {
+        return SPI_NAND_RET_BAD_ADDRESS;
+    }
+    uint16_t max_write_len = (SPI_NAND_PAGE_SIZE + SPI_NAND_OOB_SIZE) - oob_column;
+    if (oob_len > max_write_len) return SPI_NAND_RET_INVALID_LEN;
+    op_t *op = row_op(src);
+    if (OP_STATE_IDLE != op->state) return SPI_NAND_RET_BUSY;
+
+    // read page into flash's internal cache -- once it's there, program load random data (may be
+    // empty) replaces part of the spare area and the cache is written to dest
+    op_setup(op);
+    op->program = true;
+    op->program_row = dest;
+    op_add_load(op, CMD_CACHE_LOAD_RANDOM, oob_column, oob_in, oob_len);
+    int ret = row_command(CMD_PAGE_READ, src, OP_TIMEOUT);
     if (SPI_NAND_RET_OK != ret) return ret;
 
-    // write to cell array from nand's internal cache
-    timeout = OP_TIMEOUT - sys_time_get_elapsed(start);
-    return program_execute(dest, timeout);
+    schedule_start(&op->schedule, TIMING_READ);
+    op->state = OP_STATE_ARRAY_READ;
+    return SPI_NAND_RET_OK;
 }
 
 int spi_nand_block_erase(row_address_t row)
+{
+    int ret = spi_nand_block_erase_start(row);
+    return (SPI_NAND_RET_OK == ret) ? op_wait(row_op(row)) : ret;
+}
+
+int spi_nand_block_erase_start(row_address_t row)
 {
     row.page = 0; // make sure page address is zero
     // input validation
     if (!validate_row_address(row)) {
         return SPI_NAND_RET_BAD_ADDRESS;
     }
-
-    // setup timeout tracking
-    uint32_t start = sys_time_get_ms();
+    op_t *op = row_op(row);
+    if (OP_STATE_IDLE != op->state) return SPI_NAND_RET_BUSY;
 
     // write enable
-    int ret = write_enable(OP_TIMEOUT); // ignore the time elapsed since start since its negligible
+    op_setup(op);
+    int ret = write_enable(OP_TIMEOUT);
     if (SPI_NAND_RET_OK != ret) return ret;
 
     // block erase
-    uint32_t timeout = OP_TIMEOUT - sys_time_get_elapsed(start);
-    return block_erase(row, timeout);
+    ret = row_command(CMD_BLOCK_ERASE, row, OP_TIMEOUT);
+    if (SPI_NAND_RET_OK != ret) return ret;
+
+    schedule_start(&op->schedule, TIMING_ERASE);
+    op->state = OP_STATE_ERASE;
+    return SPI_NAND_RET_OK;
+}
+
+int spi_nand_poll(void)
+{
+    // advance every die
+    bool busy = false;
+    for (int i = 0; i < SPI_NAND_DIE_COUNT; i++) {
+        if (SPI_NAND_RET_BUSY == op_advance(&ops[i])) busy = true;
+    }
+    if (busy) return SPI_NAND_RET_BUSY;
+
+    // once all of them are idle, report the results not reported yet -- the first failure if any
+    // (a refresh advised by one read doesn't hide a failure on another die)
+    int ret = SPI_NAND_RET_OK;
+    for (int i = 0; i < SPI_NAND_DIE_COUNT; i++) {
+        if (ops[i].ret_pending && (SPI_NAND_RET_OK != ops[i].ret) &&
+            ((SPI_NAND_RET_OK == ret) || (SPI_NAND_RET_ECC_REFRESH == ret))) {
+            ret = ops[i].ret;
+        }
+        ops[i].ret_pending = false;
+    }
+
+    return ret;
+}
+
+int spi_nand_wait(void)
+{
+    int ret;
+    while (SPI_NAND_RET_BUSY == (ret = spi_nand_poll())) {
+        ops_sleep();
+    }
+
+    return ret;
 }
 
 int spi_nand_block_is_bad(row_address_t row, bool *is_bad)
@@ -281,7 +604,8 @@ int spi_nand_block_is_bad(row_address_t row, bool *is_bad)
     uint8_t bad_block_mark[2];
     // page read will validate the block address
     int ret = spi_nand_page_read(row, SPI_NAND_PAGE_SIZE, bad_block_mark, sizeof(bad_block_mark));
-    if (SPI_NAND_RET_OK != ret) return ret;
+    // (corrected bit errors don't make the mark any less valid)
+    if ((SPI_NAND_RET_OK != ret) && (SPI_NAND_RET_ECC_REFRESH != ret)) return ret;
 
     // check marker
     if (BAD_BLOCK_MARK == bad_block_mark[0] || BAD_BLOCK_MARK == bad_block_mark[1]) {
@@ -303,28 +627,32 @@ int spi_nand_block_mark_bad(row_address_t row)
 
 int spi_nand_page_is_free(row_address_t row, bool *is_free)
 {
-    // page read will validate block & page address
-    int ret =
-        spi_nand_page_read(row, 0, page_main_and_oob_buffer, sizeof(page_main_and_oob_buffer));
+    // a programmed page nearly always gives itself away in its first bytes -- those are clocked
+    // out first, and the rest of the page only if they're all 0xff's
+    // (page read will validate block & page address)
+    int ret = spi_nand_page_read(row, 0, page_main_and_oob_buffer, IS_FREE_PROBE_SIZE);
+    if ((SPI_NAND_RET_OK != ret) && (SPI_NAND_RET_ECC_REFRESH != ret)) return ret;
+
+    *is_free = is_erased(page_main_and_oob_buffer, IS_FREE_PROBE_SIZE);
+    if (!*is_free) return SPI_NAND_RET_OK;
+
+    // the page is still in the chip's cache, so the remainder needs no second array read
+    bus_wait();
+    select_die(SPI_NAND_ROW_DIE(row));
+    ret = read_from_cache(IS_FREE_PROBE_SIZE, &page_main_and_oob_buffer[IS_FREE_PROBE_SIZE],
+                          sizeof(page_main_and_oob_buffer) - IS_FREE_PROBE_SIZE, OP_TIMEOUT);
     if (SPI_NAND_RET_OK != ret) return ret;
 
-    *is_free = true; // innocent until proven guilty
     // iterate through page & oob to make sure its 0xff's all the way down
-    uint32_t comp_word = 0xffffffff;
-    for (int i = 0; i < sizeof(page_main_and_oob_buffer); i += sizeof(comp_word)) {
-        if (0 != memcmp(&comp_word, &page_main_and_oob_buffer[i], sizeof(comp_word))) {
-            *is_free = false;
-            break;
-        }
-    }
-
+    *is_free = is_erased(&page_main_and_oob_buffer[IS_FREE_PROBE_SIZE],
+                         sizeof(page_main_and_oob_buffer) - IS_FREE_PROBE_SIZE);
     return SPI_NAND_RET_OK;
 }
 
 int spi_nand_clear(void)
 {
     bool is_bad;
-    for (int i = 0; i < SPI_NAND_BLOCKS_PER_LUN; i++) {
+    for (int i = 0; i < SPI_NAND_BLOCK_COUNT; i++) {
         // get bad block flag
         row_address_t row = {.block = i, .page = 0};
         int ret = spi_nand_block_is_bad(row, &is_bad);
@@ -341,28 +669,79 @@ int spi_nand_clear(void)
     return SPI_NAND_RET_OK;
 }
 
+void spi_nand_get_stats(spi_nand_stats_t *stats_out)
+{
+    *stats_out = stats;
+    stats_out->t_read_us = EXPECTED_US(TIMING_READ);
+    stats_out->t_read_cache_us = EXPECTED_US(TIMING_READ_CACHE);
+    stats_out->t_program_us = EXPECTED_US(TIMING_PROGRAM);
+    stats_out->t_erase_us = EXPECTED_US(TIMING_ERASE);
+}
+
 // private function definitions
 static void csel_setup(void)
 {
-    // enable peripheral clock
-    if (!LL_AHB2_GRP1_IsEnabledClock(LL_AHB2_GRP1_PERIPH_GPIOB))
-        LL_AHB2_GRP1_EnableClock(LL_AHB2_GRP1_PERIPH_GPIOB);
+    // enable peripheral clocks
+    if (!LL_AHB2_GRP1_IsEnabledClock(CSEL_PORT_CLOCK)) LL_AHB2_GRP1_EnableClock(CSEL_PORT_CLOCK);
+    if ((SPI_NAND_DIE_COUNT > 1) && !LL_AHB2_GRP1_IsEnabledClock(LL_AHB2_GRP1_PERIPH_GPIOA)) {
+        LL_AHB2_GRP1_EnableClock(LL_AHB2_GRP1_PERIPH_GPIOA);
+    }
 
-    // setup pin as output
-    LL_GPIO_SetPinMode(CSEL_PORT, CSEL_PIN, LL_GPIO_MODE_OUTPUT);
-    LL_GPIO_SetPinOutputType(CSEL_PORT, CSEL_PIN, LL_GPIO_OUTPUT_PUSHPULL);
-    LL_GPIO_SetPinSpeed(CSEL_PORT, CSEL_PIN, LL_GPIO_SPEED_FREQ_VERY_HIGH);
-    LL_GPIO_SetPinPull(CSEL_PORT, CSEL_PIN, LL_GPIO_PULL_NO);
+    // setup pins as outputs, deselected
+    for (int i = 0; i < SPI_NAND_DIE_COUNT; i++) {
+        GPIO_TypeDef *port = csel_pins[i].port;
+        const uint32_t pin = csel_pins[i].pin;
+        LL_GPIO_SetOutputPin(port, pin);
+        LL_GPIO_SetPinMode(port, pin, LL_GPIO_MODE_OUTPUT);
+        LL_GPIO_SetPinOutputType(port, pin, LL_GPIO_OUTPUT_PUSHPULL);
+        LL_GPIO_SetPinSpeed(port, pin, LL_GPIO_SPEED_FREQ_VERY_HIGH);
+        LL_GPIO_SetPinPull(port, pin, LL_GPIO_PULL_NO);
+    }
 }
 
 static void csel_deselect(void)
 {
-    LL_GPIO_SetOutputPin(CSEL_PORT, CSEL_PIN);
+    LL_GPIO_SetOutputPin(csel_pins[active_die].port, csel_pins[active_die].pin);
 }
 
 static void csel_select(void)
 {
-    LL_GPIO_ResetOutputPin(CSEL_PORT, CSEL_PIN);
+    LL_GPIO_ResetOutputPin(csel_pins[active_die].port, csel_pins[active_die].pin);
+}
+
+static void select_die(uint8_t die)
+{
+    active_die = die;
+}
+
+/// @note Row is expected to be valid.
+static op_t *row_op(row_address_t row)
+{
+    return &ops[SPI_NAND_ROW_DIE(row)];
+}
+
+/// @note Row addresses are expected to be valid.
+static int copy_between_dies(row_address_t src, row_address_t dest, column_address_t oob_column,
+                             const uint8_t *oob_in, size_t oob_len)
+{
+    // input validation
+    if (!validate_column_address(oob_column) || (oob_column < SPI_NAND_PAGE_SIZE)) {
+        return SPI_NAND_RET_BAD_ADDRESS;
+    }
+    uint16_t max_write_len = (SPI_NAND_PAGE_SIZE + SPI_NAND_OOB_SIZE) - oob_column;
+    if (oob_len > max_write_len) return SPI_NAND_RET_INVALID_LEN;
+
+    // read the page out, replace the spare area run, and program main and user spare area to the
+    // other die (the ECC bytes are the destination chip's business)
+    int ret =
+        spi_nand_page_read(src, 0, page_main_and_oob_buffer, sizeof(page_main_and_oob_buffer));
+    if ((SPI_NAND_RET_OK != ret) && (SPI_NAND_RET_ECC_REFRESH != ret)) return ret;
+    memcpy(&page_main_and_oob_buffer[oob_column], oob_in, oob_len);
+
+    const column_address_t user_column = SPI_NAND_PAGE_SIZE + SPI_NAND_OOB_USER_OFFSET;
+    return spi_nand_page_program_with_oob(dest, page_main_and_oob_buffer, user_column,
+                                          &page_main_and_oob_buffer[user_column],
+                                          SPI_NAND_OOB_USER_SIZE);
 }
 
 static int reset(void)
@@ -377,18 +756,18 @@ static int reset(void)
 
     // wait until op is done or we timeout
     feature_reg_status_t status;
-    return poll_for_oip_clear(&status, OP_TIMEOUT);
+    return poll_for_oip_clear(TIMING_NONE, &status, OP_TIMEOUT);
 }
 
 static int read_id(void)
 {
-    // setup data
-    uint8_t tx_data[READ_ID_TRANS_LEN] = {0};
-    uint8_t rx_data[READ_ID_TRANS_LEN] = {0};
-    tx_data[0] = CMD_READ_ID;
+    // setup data (the id follows a dummy byte)
+    const spi_command_t cmd = {
+        .instruction = CMD_READ_ID, .dummy_cycles = READ_ID_DUMMY_CYCLES, .data_lines = 1};
+    uint8_t rx_data[READ_ID_LEN] = {0};
     // perform transaction
     csel_select();
-    int ret = spi_write_read(tx_data, rx_data, READ_ID_TRANS_LEN, OP_TIMEOUT);
+    int ret = spi_command_read(&cmd, rx_data, READ_ID_LEN, OP_TIMEOUT);
     csel_deselect();
 
     // check spi return
@@ -426,19 +805,16 @@ static int set_feature(uint8_t reg, uint8_t data, uint32_t timeout)
 
 static int get_feature(uint8_t reg, uint8_t *data_out, uint32_t timeout)
 {
-    // setup data
-    uint8_t tx_data[FEATURE_TRANS_LEN] = {0};
-    uint8_t rx_data[FEATURE_TRANS_LEN] = {0};
-    tx_data[0] = CMD_GET_FEATURE;
-    tx_data[FEATURE_REG_INDEX] = reg;
+    // setup data (register address in the address phase)
+    const spi_command_t cmd = {
+        .instruction = CMD_GET_FEATURE, .address_len = 1, .address = reg, .data_lines = 1};
     // perform transaction
     csel_select();
-    int ret = spi_write_read(tx_data, rx_data, FEATURE_TRANS_LEN, timeout);
+    int ret = spi_command_read(&cmd, data_out, 1, timeout);
     csel_deselect();
 
-    // if good return, write data out
+    // if good return, data was written out
     if (SPI_RET_OK == ret) {
-        *data_out = rx_data[FEATURE_DATA_INDEX];
         return SPI_NAND_RET_OK;
     }
     else {
@@ -458,28 +834,74 @@ static int write_enable(uint32_t timeout)
     return (SPI_RET_OK == ret) ? SPI_NAND_RET_OK : SPI_NAND_RET_BAD_SPI;
 }
 
+/// @note Input validation is expected to be performed by caller. Issues a page read, program
+/// execute or block erase of row (on the active die) without waiting for it to finish.
+static int row_command(uint8_t cmd, row_address_t row, uint32_t timeout)
+{
+    // setup data (need to go from LSB -> MSB first on address)
+    uint8_t tx_data[ROW_COMMAND_TRANS_LEN];
+    tx_data[0] = cmd;
+    tx_data[1] = CHIP_ROW(row) >> 16;
+    tx_data[2] = CHIP_ROW(row) >> 8;
+    tx_data[3] = CHIP_ROW(row);
+    // perform transaction
+    csel_select();
+    int ret = spi_write(tx_data, ROW_COMMAND_TRANS_LEN, timeout);
+    csel_deselect();
+    if (SPI_RET_OK != ret) return SPI_NAND_RET_BAD_SPI;
+
+    // count the cell array operation
+    if (CMD_PAGE_READ == cmd) {
+        stats.page_reads++;
+    }
+    else if (CMD_PROGRAM_EXECUTE == cmd) {
+        stats.page_programs++;
+    }
+    else {
+        stats.block_erases++;
+    }
+
+    return SPI_NAND_RET_OK;
+}
+
 /// @note Input validation is expected to be performed by caller.
 static int page_read(row_address_t row, uint32_t timeout)
 {
     // setup timeout tracking for second operation
     uint32_t start = sys_time_get_ms();
 
-    // setup data for page read command (need to go from LSB -> MSB first on address)
-    uint8_t tx_data[PAGE_READ_TRANS_LEN];
-    tx_data[0] = CMD_PAGE_READ;
-    tx_data[1] = row.whole >> 16;
-    tx_data[2] = row.whole >> 8;
-    tx_data[3] = row.whole;
-    // perform transaction
+    // read page into flash's internal cache
+    int ret = row_command(CMD_PAGE_READ, row, timeout);
+    if (SPI_NAND_RET_OK != ret) return ret;
+
+    // wait until that operation finishes
+    feature_reg_status_t status;
+    timeout -= sys_time_get_elapsed(start);
+    ret = poll_for_oip_clear(TIMING_READ, &status, timeout);
+    if (SPI_RET_OK != ret) return ret;
+
+    // check ecc
+    return get_ret_from_ecc_status(status);
+}
+
+/// @note Only valid while a cache read is in progress (after a page read). Returns the ECC result
+/// of the page moved into the cache.
+static int page_read_cache(uint8_t cmd, uint32_t timeout)
+{
+    // setup timeout tracking for second operation
+    uint32_t start = sys_time_get_ms();
+
+    // perform transaction (single byte command -- the chip tracks the row itself)
     csel_select();
-    int ret = spi_write(tx_data, PAGE_READ_TRANS_LEN, timeout);
+    int ret = spi_write(&cmd, sizeof(cmd), timeout);
     csel_deselect();
     if (SPI_RET_OK != ret) return SPI_NAND_RET_BAD_SPI;
+    if (CMD_PAGE_READ_CACHE_SEQ == cmd) stats.page_reads++;
 
-    // wait until that operation finishes
+    // wait until the page is in the cache (the array read of the next one may still be running)
     feature_reg_status_t status;
     timeout -= sys_time_get_elapsed(start);
-    ret = poll_for_oip_clear(&status, timeout);
+    ret = poll_for_oip_clear(TIMING_READ_CACHE, &status, timeout);
     if (SPI_RET_OK != ret) return ret;
 
     // check ecc
@@ -490,144 +912,247 @@ static int page_read(row_address_t row, uint32_t timeout)
 static int read_from_cache(column_address_t column, uint8_t *data_out, size_t read_len,
                            uint32_t timeout)
 {
-    // setup timeout tracking for second operation
-    uint32_t start = sys_time_get_ms();
+    int ret = start_cache_read(column, data_out, read_len);
+    if (SPI_NAND_RET_OK != ret) return ret;
 
-    // setup data for read from cache command (need to go from LSB -> MSB first on address)
-    uint8_t tx_data[READ_FROM_CACHE_TRANS_LEN];
-    tx_data[0] = CMD_READ_FROM_CACHE;
-    tx_data[1] = column >> 8;
-    tx_data[2] = column;
-    tx_data[3] = 0;
-    // perform transaction
-    csel_select();
-    int ret = spi_write(tx_data, READ_FROM_CACHE_TRANS_LEN, timeout);
-    if (SPI_RET_OK == ret) {
-        timeout -= sys_time_get_elapsed(start);
-        ret = spi_read(data_out, read_len, timeout);
-    }
+    ret = spi_wait(timeout);
     csel_deselect();
 
     return (SPI_RET_OK == ret) ? SPI_NAND_RET_OK : SPI_NAND_RET_BAD_SPI;
 }
 
-/// @note Input validation is expected to be performed by caller.
-static int program_load(column_address_t column, const uint8_t *data_in, size_t write_len,
-                        uint32_t timeout)
+/// @note Leaves chip select asserted while the data phase runs on dma -- the caller deselects once
+/// it's done.
+static int start_cache_read(column_address_t column, uint8_t *data_out, size_t read_len)
 {
-    // setup timeout tracking for second operation
-    uint32_t start = sys_time_get_ms();
+    // setup command (column address, then a dummy byte ahead of the data)
+    const spi_command_t cmd = {.instruction = CMD_CACHE_READ,
+                               .address_len = COLUMN_ADDRESS_LEN,
+                               .address = column,
+                               .dummy_cycles = READ_FROM_CACHE_DUMMY_CYCLES,
+                               .data_lines = CACHE_DATA_LINES};
+    // start transaction
+    csel_select();
+    int ret = spi_command_read_start(&cmd, data_out, read_len, NULL, NULL);
+    if (SPI_RET_OK == ret) return SPI_NAND_RET_OK;
 
-    // setup data for program load (need to go from LSB -> MSB first on address)
-    uint8_t tx_data[PROGRAM_LOAD_TRANS_LEN];
-    tx_data[0] = CMD_PROGRAM_LOAD;
-    tx_data[1] = column >> 8;
-    tx_data[2] = column;
-    // perform transaction
+    csel_deselect();
+    return SPI_NAND_RET_BAD_SPI;
+}
+
+/// @note Leaves chip select asserted while the data phase runs on dma -- the caller deselects once
+/// it's done.
+static int start_cache_load(uint8_t cmd, column_address_t column, const uint8_t *data_in,
+                            size_t write_len)
+{
+    // setup command (program load or program load random data)
+    const spi_command_t command = {.instruction = cmd,
+                                   .address_len = COLUMN_ADDRESS_LEN,
+                                   .address = column,
+                                   .data_lines = CACHE_DATA_LINES};
+    // start transaction
     csel_select();
-    int ret = spi_write(tx_data, PROGRAM_LOAD_TRANS_LEN, timeout);
-    if (SPI_RET_OK == ret) {
-        timeout -= sys_time_get_elapsed(start);
-        ret = spi_write(data_in, write_len, timeout);
-    }
+    int ret = spi_command_write_start(&command, data_in, write_len, NULL, NULL);
+    if (SPI_RET_OK == ret) return SPI_NAND_RET_OK;
+
     csel_deselect();
+    return SPI_NAND_RET_BAD_SPI;
+}
 
-    return (SPI_RET_OK == ret) ? SPI_NAND_RET_OK : SPI_NAND_RET_BAD_SPI;
+/// @note Waits for the bus, and leaves the op's die active.
+static void op_setup(op_t *op)
+{
+    bus_wait();
+    select_die(op->die);
+    op->start = sys_time_get_ms();
+    op->program = false;
+    op->ecc_ret = SPI_NAND_RET_OK;
+    op->load_count = 0;
+    op->next_load = 0;
+    op->ret_pending = false;
 }
 
-static int program_load_random_data(column_address_t column, uint8_t *data_in, size_t write_len,
-                                    uint32_t timeout)
+static void op_add_load(op_t *op, uint8_t cmd, column_address_t column, const uint8_t *data_in,
+                        size_t len)
 {
-    // setup timeout tracking for second operation
-    uint32_t start = sys_time_get_ms();
+    cache_load_t *load = &op->loads[op->load_count++];
+    load->cmd = cmd;
+    load->column = column;
+    load->data_in = data_in;
+    load->len = len;
+}
 
-    // setup data for program load (need to go from LSB -> MSB first on address)
-    uint8_t tx_data[PROGRAM_LOAD_RANDOM_DATA_TRANS_LEN];
-    tx_data[0] = CMD_PROGRAM_LOAD_RANDOM_DATA;
-    tx_data[1] = column >> 8;
-    tx_data[2] = column;
-    // perform transaction
-    csel_select();
-    int ret = spi_write(tx_data, PROGRAM_LOAD_TRANS_LEN, timeout);
-    if (SPI_RET_OK == ret) {
-        timeout -= sys_time_get_elapsed(start);
-        ret = spi_write(data_in, write_len, timeout);
+/// @brief Write enable, then the loads and program execute set up in op
+static int op_start_program(op_t *op)
+{
+    int ret = write_enable(OP_TIMEOUT);
+    if (SPI_NAND_RET_OK != ret) return ret;
+
+    ret = op_advance_program(op);
+    if (SPI_NAND_RET_BUSY == ret) return SPI_NAND_RET_OK;
+
+    op->ret_pending = false; // reported by the return value instead
+    return ret;
+}
+
+/// @brief Starts the next cache load, or the program execute once every load is done
+/// @note Expects the op's die to be active and the bus to be free.
+static int op_advance_program(op_t *op)
+{
+    int ret;
+    if (op->next_load < op->load_count) {
+        const cache_load_t *load = &op->loads[op->next_load++];
+        ret = start_cache_load(load->cmd, load->column, load->data_in, load->len);
+        op->state = OP_STATE_CACHE_LOAD;
+    }
+    else {
+        ret = row_command(CMD_PROGRAM_EXECUTE, op->program_row, OP_TIMEOUT);
+        schedule_start(&op->schedule, TIMING_PROGRAM);
+        op->state = OP_STATE_PROGRAM;
     }
-    csel_deselect();
 
-    return (SPI_RET_OK == ret) ? SPI_NAND_RET_OK : SPI_NAND_RET_BAD_SPI;
+    return (SPI_NAND_RET_OK == ret) ? SPI_NAND_RET_BUSY : op_finish(op, ret);
 }
 
-/// @note Input validation is expected to be performed by caller.
-static int program_execute(row_address_t row, uint32_t timeout)
+/// @brief Takes the operation of a die one step further
+static int op_advance(op_t *op)
 {
-    // setup timeout tracking for second operation
-    uint32_t start = sys_time_get_ms();
+    switch (op->state) {
+        case OP_STATE_IDLE:
+            return op->ret;
+        case OP_STATE_CACHE_READ:
+        case OP_STATE_CACHE_LOAD:
+            return op_poll_cache_transfer(op);
+        default:
+            return op_poll_array(op);
+    }
+}
 
-    // setup data for program execute (need to go from LSB -> MSB first on address)
-    uint8_t tx_data[PROGRAM_EXECUTE_TRANS_LEN];
-    tx_data[0] = CMD_PROGRAM_EXECUTE;
-    tx_data[1] = row.whole >> 16;
-    tx_data[2] = row.whole >> 8;
-    tx_data[3] = row.whole;
-    // perform transaction
-    csel_select();
-    int ret = spi_write(tx_data, PAGE_READ_TRANS_LEN, timeout);
-    csel_deselect();
-    if (SPI_RET_OK != ret) return SPI_NAND_RET_BAD_SPI;
+/// @brief Reads the status register once, and moves on if the array operation is done
+static int op_poll_array(op_t *op)
+{
+    // leave the bus alone until the next status read is due
+    if (!schedule_is_due(&op->schedule)) return SPI_NAND_RET_BUSY;
 
-    // wait until that operation finishes
+    bus_wait();
+    select_die(op->die);
     feature_reg_status_t status;
-    timeout -= sys_time_get_elapsed(start);
-    ret = poll_for_oip_clear(&status, timeout);
+    int ret = get_feature(FEATURE_REG_STATUS, &status.whole, OP_TIMEOUT);
+    if (SPI_NAND_RET_OK != ret) return op_finish(op, ret);
+    schedule_update(&op->schedule, status);
 
-    if (SPI_NAND_RET_OK != ret) { // if polling failed, return that status
-        return ret;
-    }
-    else if (status.P_FAIL) { // otherwise, check for P_FAIL
-        return SPI_NAND_RET_P_FAIL;
+    if (status.OIP) {
+        if (sys_time_is_elapsed(op->start, OP_TIMEOUT)) {
+            return op_finish(op, SPI_NAND_RET_TIMEOUT);
+        }
+        return SPI_NAND_RET_BUSY;
     }
-    else {
-        return SPI_NAND_RET_OK;
+
+    switch (op->state) {
+        case OP_STATE_ARRAY_READ:
+            // page is in the cache -- check ecc. (If a refresh is advised, the data in the cache
+            // has still been corrected.)
+            ret = get_ret_from_ecc_status(status);
+            if (SPI_NAND_RET_ECC_ERR == ret) return op_finish(op, ret);
+            op->ecc_ret = ret;
+
+            // page copy: program the cache to the destination -- a fresh page, which is all a
+            // refresh asks for
+            if (op->program) {
+                ret = write_enable(OP_TIMEOUT);
+                return (SPI_NAND_RET_OK == ret) ? op_advance_program(op) : op_finish(op, ret);
+            }
+
+            // page read: transfer it out
+            ret = start_cache_read(op->column, op->data_out, op->read_len);
+            if (SPI_NAND_RET_OK != ret) return op_finish(op, ret);
+            op->state = OP_STATE_CACHE_READ;
+            return SPI_NAND_RET_BUSY;
+        case OP_STATE_PROGRAM:
+            return op_finish(op, status.P_FAIL ? SPI_NAND_RET_P_FAIL : SPI_NAND_RET_OK);
+        case OP_STATE_ERASE:
+        default:
+            return op_finish(op, status.E_FAIL ? SPI_NAND_RET_E_FAIL : SPI_NAND_RET_OK);
     }
 }
 
-static int block_erase(row_address_t row, uint32_t timeout)
+/// @brief Checks on the dma transfer in progress, and moves on if it's done
+/// @note Only the die holding the bus can be in a transfer.
+static int op_poll_cache_transfer(op_t *op)
 {
-    // setup timeout tracking for second operation
-    uint32_t start = sys_time_get_ms();
+    select_die(op->die);
+    int ret = spi_poll();
+    if (SPI_RET_BUSY == ret) {
+        if (!sys_time_is_elapsed(op->start, OP_TIMEOUT)) return SPI_NAND_RET_BUSY;
+        spi_abort();
+        csel_deselect();
+        return op_finish(op, SPI_NAND_RET_TIMEOUT);
+    }
 
-    // setup data for block erase command (need to go from LSB -> MSB first on address)
-    uint8_t tx_data[BLOCK_ERASE_TRANS_LEN];
-    tx_data[0] = CMD_BLOCK_ERASE;
-    tx_data[1] = row.whole >> 16;
-    tx_data[2] = row.whole >> 8;
-    tx_data[3] = row.whole;
-    // perform transaction
-    csel_select();
-    int ret = spi_write(tx_data, BLOCK_ERASE_TRANS_LEN, timeout);
     csel_deselect();
-    if (SPI_RET_OK != ret) return SPI_NAND_RET_BAD_SPI;
+    if (SPI_RET_OK != ret) return op_finish(op, SPI_NAND_RET_BAD_SPI);
 
-    // wait until that operation finishes
-    feature_reg_status_t status;
-    timeout -= sys_time_get_elapsed(start);
-    ret = poll_for_oip_clear(&status, timeout);
+    // a page read is done once its data is out, a program moves on to its next step
+    if (OP_STATE_CACHE_READ == op->state) return op_finish(op, op->ecc_ret);
+    return op_advance_program(op);
+}
+
+static int op_finish(op_t *op, int ret)
+{
+    op->state = OP_STATE_IDLE;
+    op->ret = ret;
+    op->ret_pending = true;
+    return ret;
+}
 
-    if (SPI_NAND_RET_OK != ret) { // if polling failed, return that status
-        return ret;
+/// @brief Runs the operation of a die to completion
+static int op_wait(op_t *op)
+{
+    while (SPI_NAND_RET_BUSY == op_advance(op)) {
+        ops_sleep();
     }
-    else if (status.E_FAIL) { // otherwise, check for E_FAIL
-        return SPI_NAND_RET_E_FAIL;
+
+    op->ret_pending = false; // reported by the return value instead
+    return op->ret;
+}
+
+static bool op_is_transferring(const op_t *op)
+{
+    return (OP_STATE_CACHE_READ == op->state) || (OP_STATE_CACHE_LOAD == op->state);
+}
+
+/// @brief Sleeps until the next status read of any die is due
+/// @note Doesn't sleep while a dma transfer is running -- those are checked on every pass.
+static void ops_sleep(void)
+{
+    const poll_schedule_t *next = NULL;
+    for (int i = 0; i < SPI_NAND_DIE_COUNT; i++) {
+        const op_t *op = &ops[i];
+        if (op_is_transferring(op)) return;
+        if ((OP_STATE_IDLE != op->state) &&
+            (!next || ((int32_t)(op->schedule.next_poll_us - next->next_poll_us) < 0))) {
+            next = &op->schedule;
+        }
     }
-    else {
-        return SPI_NAND_RET_OK;
+
+    if (next) schedule_wait(next);
+}
+
+/// @brief Finishes the dma transfers of the die holding the bus, so that it can be used again
+static void bus_wait(void)
+{
+    for (int i = 0; i < SPI_NAND_DIE_COUNT; i++) {
+        while (op_is_transferring(&ops[i])) {
+            op_poll_cache_transfer(&ops[i]);
+        }
     }
 }
 
 static int unlock_all_blocks(void)
 {
     feature_reg_block_lock_t unlock_all = {.whole = 0};
+    // IO2 / IO3 double as WP# / HOLD#, which must not act while they carry x4 data
+    unlock_all.WP_HOLD_DISABLE = (CACHE_DATA_LINES > 1);
     return set_feature(FEATURE_REG_BLOCK_LOCK, unlock_all.whole, OP_TIMEOUT);
 }
 
@@ -638,16 +1163,23 @@ static int enable_ecc(void)
     return set_feature(FEATURE_REG_CONFIGURATION, ecc_enable.whole, OP_TIMEOUT);
 }
 
-static int poll_for_oip_clear(feature_reg_status_t *status_out, uint32_t timeout)
+static int poll_for_oip_clear(timing_t timing, feature_reg_status_t *status_out,
+                              uint32_t timeout)
 {
     uint32_t start_time = sys_time_get_ms();
+    poll_schedule_t schedule;
+    schedule_start(&schedule, timing);
     for (;;) {
+        // sleep until the next status read is due
+        schedule_wait(&schedule);
+
         uint32_t get_feature_timeout = OP_TIMEOUT - sys_time_get_elapsed(start_time);
         int ret = get_feature(FEATURE_REG_STATUS, &status_out->whole, get_feature_timeout);
         // break on bad return
         if (SPI_NAND_RET_OK != ret) {
             return ret;
         }
+        schedule_update(&schedule, *status_out);
         // check for OIP clear
         if (0 == status_out->OIP) {
             return SPI_NAND_RET_OK;
@@ -659,6 +1191,59 @@ static int poll_for_oip_clear(feature_reg_status_t *status_out, uint32_t timeout
     }
 }
 
+/// @note Called right after the command of the operation is issued.
+static void schedule_start(poll_schedule_t *schedule, timing_t timing)
+{
+    schedule->timing = timing;
+    schedule->reads = 0;
+    schedule->start_us = sys_time_get_us();
+    schedule->next_poll_us = schedule->start_us;
+    if (TIMING_NONE != timing) {
+        const uint32_t expected = EXPECTED_US(timing);
+        schedule->next_poll_us += expected - (expected >> POLL_FIRST_SHIFT);
+    }
+}
+
+static bool schedule_is_due(const poll_schedule_t *schedule)
+{
+    return (int32_t)(sys_time_get_us() - schedule->next_poll_us) >= 0;
+}
+
+static void schedule_wait(const poll_schedule_t *schedule)
+{
+    const int32_t remaining = schedule->next_poll_us - sys_time_get_us();
+    if (remaining > 0) sys_time_delay_us(remaining);
+}
+
+/// @note Called with every status read of the operation.
+static void schedule_update(poll_schedule_t *schedule, feature_reg_status_t status)
+{
+    stats.status_polls++;
+    schedule->reads++;
+    if (TIMING_NONE == schedule->timing) return;
+
+    const uint32_t now = sys_time_get_us();
+    const uint32_t lead = EXPECTED_US(schedule->timing) >> POLL_FIRST_SHIFT;
+    // reads held up past their slot (e.g. by another die's transfer on the bus) only bound the
+    // duration from above
+    const bool late = (int32_t)(now - schedule->next_poll_us) > (int32_t)lead;
+    if (status.OIP) {
+        // still busy -- read again in a bit
+        uint32_t interval = EXPECTED_US(schedule->timing) >> POLL_INTERVAL_SHIFT;
+        if (interval < POLL_INTERVAL_MIN_US) interval = POLL_INTERVAL_MIN_US;
+        schedule->next_poll_us = now + interval;
+    }
+    else {
+        // done -- the operation took at most this long. If it was already done at the first read,
+        // it's taken to have finished a lead time earlier, so that an estimate that's too long
+        // shrinks quickly.
+        uint32_t taken = now - schedule->start_us;
+        if (1 == schedule->reads) taken -= lead;
+        if (late && (taken > EXPECTED_US(schedule->timing))) return;
+        expected_scaled[schedule->timing] += taken - EXPECTED_US(schedule->timing);
+    }
+}
+
 static bool validate_row_address(row_address_t row)
 {
     if ((row.block > SPI_NAND_MAX_BLOCK_ADDRESS) || (row.page > SPI_NAND_MAX_PAGE_ADDRESS)) {
@@ -701,3 +1286,30 @@ static int get_ret_from_ecc_status(feature_reg_status_t status)
 
     return ret;
 }
+
+static bool is_ecc_ret(int ret)
+{
+    return (SPI_NAND_RET_OK == ret) || (SPI_NAND_RET_ECC_REFRESH == ret) ||
+           (SPI_NAND_RET_ECC_ERR == ret);
+}
+
+/// @brief Returns the worse of two ECC results
+static int merge_ecc_ret(int a, int b)
+{
+    if ((SPI_NAND_RET_ECC_ERR == a) || (SPI_NAND_RET_ECC_ERR == b)) return SPI_NAND_RET_ECC_ERR;
+    if ((SPI_NAND_RET_ECC_REFRESH == a) || (SPI_NAND_RET_ECC_REFRESH == b)) {
+        return SPI_NAND_RET_ECC_REFRESH;
+    }
+    return SPI_NAND_RET_OK;
+}
+
+/// @note len is expected to be a multiple of 4.
+static bool is_erased(const uint8_t *data, size_t len)
+{
+    const uint32_t comp_word = 0xffffffff;
+    for (size_t i = 0; i < len; i += sizeof(comp_word)) {
+        if (0 != memcmp(&comp_word, &data[i], sizeof(comp_word))) return false;
+    }
+
+    return true;
+}
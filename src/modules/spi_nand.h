@@ -5,6 +5,27 @@
  *
  * SPI NAND flash chip driver for the Micron MT29F1G01ABAFDWB.
  *
+ * Page reads, programs, copies and block erases can also run without blocking: the _start
+ * functions validate their arguments and issue the first step of the operation, and spi_nand_poll
+ * advances it one step at a time (one status register read while the chip is busy, a check on the
+ * dma transfer while a cache read or load runs) until it returns its result. Only one operation
+ * runs at a time on a die -- every other call for that die made meanwhile returns
+ * SPI_NAND_RET_BUSY. The blocking functions start the operation and poll it to completion.
+ *
+ * Up to four chips (SPI_NAND_DIE_COUNT) can share the bus, each on its own chip select. Their
+ * blocks follow one another in the row address space (the block address of a row selects the
+ * die), and each die runs its own operation: while one is busy programming or erasing, others can
+ * be started and polled. Only the cache transfers share the bus, one at a time.
+ *
+ * While the chip is busy, the status register isn't read back to back: the first read waits for
+ * most of the operation's expected duration (tR, tPROG or tBERS, learned from the completions seen
+ * so far), and later ones follow at a fraction of it. spi_nand_poll returns SPI_NAND_RET_BUSY
+ * without touching the bus until a read is due, and the blocking functions sleep in between.
+ *
+ * Reads return SPI_NAND_RET_ECC_REFRESH when the chip's ECC had to correct enough bits to advise
+ * rewriting the page. The data has been transferred, and is good; copies go ahead and return
+ * SPI_NAND_RET_OK, as the destination page is the rewrite.
+ *
  */
 
 #ifndef __SPI_NAND_H
@@ -26,6 +47,7 @@ enum {
     SPI_NAND_RET_ECC_ERR = -7,
     SPI_NAND_RET_P_FAIL = -8,
     SPI_NAND_RET_E_FAIL = -9,
+    SPI_NAND_RET_BUSY = -10,
 };
 
 #define SPI_NAND_PAGE_SIZE       2048
@@ -36,8 +58,31 @@ enum {
 #define SPI_NAND_LOG2_PAGE_SIZE       11
 #define SPI_NAND_LOG2_PAGES_PER_BLOCK 6
 
+/// @brief Spare area bytes left to the user: after the bad block mark, ahead of the on-die ECC bytes
+#define SPI_NAND_OOB_USER_OFFSET 2
+#define SPI_NAND_OOB_USER_SIZE   30
+
+/// @brief Number of chips on the bus (1, 2 or 4) -- die 0 uses the usual chip select, dies 1-3 PA8,
+/// PA11 and PA12
+#ifndef SPI_NAND_DIE_COUNT
+#define SPI_NAND_DIE_COUNT 1
+#endif
+#if SPI_NAND_DIE_COUNT == 1
+#define SPI_NAND_LOG2_DIE_COUNT 0
+#elif SPI_NAND_DIE_COUNT == 2
+#define SPI_NAND_LOG2_DIE_COUNT 1
+#elif SPI_NAND_DIE_COUNT == 4
+#define SPI_NAND_LOG2_DIE_COUNT 2
+#else
+#error "SPI_NAND_DIE_COUNT must be 1, 2 or 4"
+#endif
+#define SPI_NAND_BLOCK_COUNT (SPI_NAND_BLOCKS_PER_LUN * SPI_NAND_DIE_COUNT)
+
 #define SPI_NAND_MAX_PAGE_ADDRESS  (SPI_NAND_PAGES_PER_BLOCK - 1) // zero-indexed
-#define SPI_NAND_MAX_BLOCK_ADDRESS (SPI_NAND_BLOCKS_PER_LUN - 1)  // zero-indexed
+#define SPI_NAND_MAX_BLOCK_ADDRESS (SPI_NAND_BLOCK_COUNT - 1)     // zero-indexed
+
+/// @brief Die holding a (valid) row
+#define SPI_NAND_ROW_DIE(row) ((row).block / SPI_NAND_BLOCKS_PER_LUN)
 
 /// @brief Nand row address
 typedef union {
@@ -45,13 +90,28 @@ typedef union {
     struct {
         /// valid range 0-63
         uint32_t page : 6;
-        /// valid range 0-1023
+        /// valid range 0-1023, plus 1024 for each further die
         uint32_t block : 26;
     };
 } row_address_t;
 /// @brief Nand column address (valid range 0-2175)
 typedef uint16_t column_address_t;
 
+/// @brief Counts of the cell array operations issued to the chip, and how they were waited on
+typedef struct {
+    uint32_t page_reads;
+    uint32_t page_programs;
+    uint32_t block_erases;
+    /// status register reads made while waiting on the chip
+    uint32_t status_polls;
+    /// learned durations of page reads (array -> cache), sequential cache reads, page programs and
+    /// block erases
+    uint32_t t_read_us;
+    uint32_t t_read_cache_us;
+    uint32_t t_program_us;
+    uint32_t t_erase_us;
+} spi_nand_stats_t;
+
 /// @brief Initializes the spi nand driver
 int spi_nand_init(void);
 
@@ -59,17 +119,69 @@ int spi_nand_init(void);
 int spi_nand_page_read(row_address_t row, column_address_t column, uint8_t *data_out,
                        size_t read_len);
 
+/// @brief Starts a read page operation (see spi_nand_poll)
+/// @note data_out must stay valid until the operation completes
+int spi_nand_page_read_start(row_address_t row, column_address_t column, uint8_t *data_out,
+                             size_t read_len);
+
+/// @brief Reads the main area of page_count consecutive pages, starting at row
+/// @note Uses the chip's sequential cache read within each block, so the array read of each page
+/// overlaps with the transfer of the previous one. Runs may cross block boundaries. Every page is
+/// transferred even if some fail ECC -- the worst ECC result is returned.
+int spi_nand_read_pages(row_address_t row, size_t page_count, uint8_t *data_out);
+
 /// @brief Performs a page program operation
 int spi_nand_page_program(row_address_t row, column_address_t column, const uint8_t *data_in,
                           size_t write_len);
 
+/// @brief Starts a page program operation (see spi_nand_poll)
+/// @note data_in must stay valid until the operation completes
+int spi_nand_page_program_start(row_address_t row, column_address_t column,
+                                const uint8_t *data_in, size_t write_len);
+
+/// @brief Programs a page's main area and a run of its spare area in a single program operation
+/// @note A NULL data_in leaves the main area erased. oob_column is a column address
+/// (SPI_NAND_PAGE_SIZE or above).
+int spi_nand_page_program_with_oob(row_address_t row, const uint8_t *data_in,
+                                   column_address_t oob_column, const uint8_t *oob_in,
+                                   size_t oob_len);
+
+/// @brief Starts a page program operation with spare area (see spi_nand_poll)
+int spi_nand_page_program_with_oob_start(row_address_t row, const uint8_t *data_in,
+                                         column_address_t oob_column, const uint8_t *oob_in,
+                                         size_t oob_len);
+
 /// @brief Copies the source page to the destination page using nand's internal cache
 int spi_nand_page_copy(row_address_t src, row_address_t dest);
 
+/// @brief Copies the source page to the destination page, replacing a run of its spare area
+/// @note Copies between dies are read out and programmed back (main and user spare area only)
+int spi_nand_page_copy_with_oob(row_address_t src, row_address_t dest,
+                                column_address_t oob_column, const uint8_t *oob_in,
+                                size_t oob_len);
+
+/// @brief Starts a page copy operation with spare area (see spi_nand_poll)
+/// @note Source and destination must be on the same die
+int spi_nand_page_copy_with_oob_start(row_address_t src, row_address_t dest,
+                                      column_address_t oob_column, const uint8_t *oob_in,
+                                      size_t oob_len);
+
 /// @brief Performs a block erase operation
 /// @note Block operation -- page component of row address is ignored
 int spi_nand_block_erase(row_address_t row);
 
+/// @brief Starts a block erase operation (see spi_nand_poll)
+int spi_nand_block_erase_start(row_address_t row);
+
+/// @brief Advances the operations started by the _start functions, on every die
+/// @return SPI_NAND_RET_BUSY while any of them runs. Once all are done, their results (the first
+/// failure, if any) -- each result is reported once, and SPI_NAND_RET_OK when there's none left.
+int spi_nand_poll(void);
+
+/// @brief Polls until every die is idle, sleeping in between
+/// @return As spi_nand_poll
+int spi_nand_wait(void);
+
 /// @brief Checks if a given block is bad
 /// @note Block operation -- page component of row address is ignored
 /// @return SPI_NAND_RET_OK if good block, SPI_NAND_RET_BAD_BLOCK if bad, other returns if error is
@@ -86,4 +198,7 @@ int spi_nand_page_is_free(row_address_t row, bool *is_free);
 /// @brief Erases all blocks from the device, ignoring those marked as bad
 int spi_nand_clear(void);
 
+/// @brief Copies out the operation counters
+void spi_nand_get_stats(spi_nand_stats_t *stats_out);
+
 #endif // __SPI_NAND_H
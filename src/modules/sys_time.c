@@ -61,4 +61,33 @@ void sys_time_delay(uint32_t duration_ms)
     uint32_t start = sys_time_ms;
     while (!sys_time_is_elapsed(start, duration_ms))
         ;
+}
+
+uint32_t sys_time_get_us(void)
+{
+    uint32_t ms, val;
+    // systick counts down from LOAD once per ms -- read again if it wrapped in between
+    do {
+        ms = sys_time_ms;
+        val = SysTick->VAL;
+    } while (ms != sys_time_ms);
+
+    return (ms * 1000) + (((SysTick->LOAD - val) * 1000) / (SysTick->LOAD + 1));
+}
+
+uint32_t sys_time_get_elapsed_us(uint32_t start)
+{
+    return sys_time_get_us() - start;
+}
+
+void sys_time_delay_us(uint32_t duration_us)
+{
+    uint32_t start = sys_time_get_us();
+    // the sys tick wakes the core at least once per ms, so sleeping never overshoots while more
+    // than a ms is left
+    while ((sys_time_get_elapsed_us(start) + 1000) < duration_us) {
+        __WFI();
+    }
+    while (sys_time_get_elapsed_us(start) < duration_us)
+        ;
 }
\ No newline at end of file
@@ -4,7 +4,8 @@
  * @brief		Header file of the sys time module
  *
  * Exposes a millisecond time to the system (driven by systick) and provides
- * functions for comparing times (with wrap-around) and blocking delays.
+ * functions for comparing times (with wrap-around) and blocking delays. A microsecond time is
+ * derived from the systick counter for timing short operations.
  *
  */
 
@@ -32,4 +33,14 @@ bool sys_time_is_elapsed(uint32_t start, uint32_t duration_ms);
 /// @brief Blocking delay for a given duration
 void sys_time_delay(uint32_t duration_ms);
 
+/// @brief Returns system time in microseconds (wraps around every ~71 minutes)
+uint32_t sys_time_get_us(void);
+
+/// @brief Returns the number of microseconds elapsed since the start value
+uint32_t sys_time_get_elapsed_us(uint32_t start);
+
+/// @brief Blocking delay for a given duration in microseconds
+/// @note Sleeps (WFI) through whole sys ticks, and spins for the rest
+void sys_time_delay_us(uint32_t duration_us);
+
 #endif // __SYS_TIME_H
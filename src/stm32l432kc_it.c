@@ -9,6 +9,7 @@
  */
 
 #include "modules/led.h"
+#include "modules/spi.h"
 #include "modules/sys_time.h"
 #include "modules/uart.h"
 
@@ -51,3 +52,5 @@ void UsageFault_Handler(void)
 void SysTick_Handler(void) { _sys_time_increment(); }
 
 void USART2_IRQHandler(void) { _uart_isr(); }
+
+void DMA1_Channel2_IRQHandler(void) { _spi_dma_isr(); }
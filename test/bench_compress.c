@@ -0,0 +1,212 @@
+/**
+ * @file		bench_compress.c
+ * @author		Andrew Loebs
+ * @brief		Compression ratio and throughput of the ftl compression layer
+ *
+ * Writes SECTORS logical sectors of log-like text, and then of random data, in runs of RUN_LEN
+ * sectors through ftl_compress to a RAM image of the whole chip (nand_image.c), syncs and reads
+ * them all back. Prints for each the compression ratio, the flash pages programmed and read per
+ * logical sector -- what the SPI bus and the chip's program time scale with -- and the host
+ * wall-clock throughput of the writes and the reads. The same workload without the layer,
+ * straight on the map, is the baseline.
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/dhara/map.h"
+#include "../src/dhara/nand_image.h"
+#include "../src/modules/ftl_compress.h"
+#include "spi_nand.h"
+
+// defines
+#define GC_RATIO 4
+#define SECTORS  8192 // 16 MB of logical data
+#define RUN_LEN  16   // sectors per write call, as a 32 KB f_write hands them to diskio
+
+// private function prototypes
+static int run(const char *name, bool compress, bool text);
+static int write_run(bool compress, uint32_t sector, const uint8_t *pages, dhara_error_t *err);
+static int read_sector(bool compress, uint32_t sector, uint8_t *page, dhara_error_t *err);
+static void fill(uint8_t *page, uint32_t sector, bool text);
+static double now_s(void);
+static int count_prog(const struct dhara_nand *n, dhara_page_t p, const uint8_t *page,
+                      dhara_error_t *err);
+static int count_copy(const struct dhara_nand *n, dhara_page_t src, dhara_page_t dst,
+                      dhara_error_t *err);
+static int count_read(const struct dhara_nand *n, dhara_page_t p, size_t offset, size_t length,
+                      uint8_t *page, dhara_error_t *err);
+
+// private variables
+// the image's ops, with programs (copies included) and page reads counted
+static struct dhara_nand_ops counting_ops;
+static uint32_t programs;
+static uint32_t reads;
+static struct dhara_nand nand = {
+    .log2_page_size = SPI_NAND_LOG2_PAGE_SIZE,
+    .log2_ppb = SPI_NAND_LOG2_PAGES_PER_BLOCK,
+    .num_blocks = SPI_NAND_BLOCKS_PER_LUN,
+};
+static dhara_nand_image_t image;
+static struct dhara_map map;
+static uint8_t page_buffer[SPI_NAND_PAGE_SIZE];
+static uint8_t data[RUN_LEN * SPI_NAND_PAGE_SIZE];
+static uint8_t readback[SPI_NAND_PAGE_SIZE];
+
+// public function definitions
+int main(void)
+{
+    uint8_t *image_buffer = malloc(dhara_nand_image_size(&nand));
+    if (!image_buffer) return 1;
+    dhara_nand_image_init_ram(&nand, &image, image_buffer);
+    counting_ops = *nand.ops;
+    counting_ops.prog = count_prog;
+    counting_ops.copy = count_copy;
+    counting_ops.read = count_read;
+    nand.ops = &counting_ops;
+
+    printf("%-16s %7s %14s %14s %12s %12s\n", "workload", "ratio", "progs/sector",
+           "reads/sector", "write MB/s", "read MB/s");
+    if (run("text, raw", false, true) || run("text, packed", true, true) ||
+        run("random, raw", false, false) || run("random, packed", true, false)) {
+        return 1;
+    }
+
+    free(image_buffer);
+    return 0;
+}
+
+// private function definitions
+/// @brief Writes, syncs and reads back the workload on a freshly formatted chip, and prints a row
+static int run(const char *name, bool compress, bool text)
+{
+    dhara_error_t err;
+    if (0 != dhara_nand_image_format(&nand)) return 1;
+    dhara_map_init(&map, &nand, page_buffer, GC_RATIO);
+    dhara_map_resume(&map, &err);
+    ftl_compress_init(&map);
+
+    const uint32_t write_programs = programs;
+    double elapsed = 0;
+    for (uint32_t sector = 0; sector < SECTORS; sector += RUN_LEN) {
+        for (uint32_t i = 0; i < RUN_LEN; i++) {
+            fill(&data[i * SPI_NAND_PAGE_SIZE], sector + i, text);
+        }
+        const double start = now_s();
+        if (0 != write_run(compress, sector, data, &err)) return 1;
+        elapsed += now_s() - start;
+    }
+    const double start = now_s();
+    if (0 != dhara_map_sync(&map, &err)) return 1;
+    const double write_s = elapsed + now_s() - start;
+    const double progs = (double)(programs - write_programs) / SECTORS;
+
+    // reads of neighbouring sectors share the buffered pack page, as sequential reads would
+    const uint32_t read_count = reads;
+    elapsed = 0;
+    for (uint32_t sector = 0; sector < SECTORS; sector++) {
+        const double start = now_s();
+        if (0 != read_sector(compress, sector, readback, &err)) return 1;
+        elapsed += now_s() - start;
+        fill(data, sector, text);
+        if (0 != memcmp(data, readback, sizeof(readback))) {
+            printf("%s: sector %lu read back wrong\n", name, (unsigned long)sector);
+            return 1;
+        }
+    }
+    const double page_reads = (double)(reads - read_count) / SECTORS;
+
+    ftl_compress_stats_t stats;
+    ftl_compress_get_stats(&stats);
+    const double ratio = stats.bytes_out ? (double)stats.bytes_in / stats.bytes_out : 1.0;
+    const double mb = (double)SECTORS * SPI_NAND_PAGE_SIZE / (1024 * 1024);
+    printf("%-16s %7.2f %14.2f %14.2f %12.1f %12.1f\n", name, ratio, progs, page_reads,
+           mb / write_s, mb / elapsed);
+    return 0;
+}
+
+/// @brief Writes RUN_LEN sectors -- in one call to the compression layer, which combines each
+/// group's sectors into one program, or one by one to the map as nand_ftl_diskio does
+static int write_run(bool compress, uint32_t sector, const uint8_t *pages, dhara_error_t *err)
+{
+    if (compress) return ftl_compress_write(sector, pages, RUN_LEN, err);
+    for (uint32_t i = 0; i < RUN_LEN; i++) {
+        if (dhara_map_write(&map, sector + i, &pages[i * SPI_NAND_PAGE_SIZE], err)) return -1;
+    }
+
+    return 0;
+}
+
+static int read_sector(bool compress, uint32_t sector, uint8_t *page, dhara_error_t *err)
+{
+    if (compress) return ftl_compress_read(sector, page, err);
+    return dhara_map_read(&map, sector, page, err);
+}
+
+/// @brief Fills a page with log lines (timestamped sensor records), or with random bytes
+static void fill(uint8_t *page, uint32_t sector, bool text)
+{
+    uint32_t state = sector * 7919 + 1;
+    if (!text) {
+        for (size_t i = 0; i < SPI_NAND_PAGE_SIZE; i++) {
+            state = state * 1103515245 + 12345;
+            page[i] = (uint8_t)(state >> 16);
+        }
+        return;
+    }
+
+    static const char *const levels[] = {"INFO", "INFO", "INFO", "WARN"};
+    char line[96];
+    size_t used = 0;
+    uint32_t ms = sector * 20000;
+    while (used < SPI_NAND_PAGE_SIZE) {
+        state = state * 1103515245 + 12345;
+        const uint32_t r = state >> 16;
+        ms += 250 + r % 50;
+        const int len =
+            snprintf(line, sizeof(line), "%02lu:%02lu:%02lu.%03lu %s sensor %lu temp=%lu.%lu "
+                     "hum=%lu.%lu\r\n", (unsigned long)(ms / 3600000 % 24),
+                     (unsigned long)(ms / 60000 % 60), (unsigned long)(ms / 1000 % 60),
+                     (unsigned long)(ms % 1000), levels[r % 4], (unsigned long)(r % 8),
+                     (unsigned long)(20 + r % 5), (unsigned long)(r / 8 % 10),
+                     (unsigned long)(40 + r / 16 % 20), (unsigned long)(r / 32 % 10));
+        const size_t n = ((size_t)len < SPI_NAND_PAGE_SIZE - used) ? (size_t)len
+                                                                   : SPI_NAND_PAGE_SIZE - used;
+        memcpy(&page[used], line, n);
+        used += n;
+    }
+}
+
+static double now_s(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + (t.tv_nsec / 1e9);
+}
+
+static int count_prog(const struct dhara_nand *n, dhara_page_t p, const uint8_t *page,
+                      dhara_error_t *err)
+{
+    programs++;
+    return dhara_nand_image_ops.prog(n, p, page, err);
+}
+
+static int count_copy(const struct dhara_nand *n, dhara_page_t src, dhara_page_t dst,
+                      dhara_error_t *err)
+{
+    programs++;
+    return dhara_nand_image_ops.copy(n, src, dst, err);
+}
+
+static int count_read(const struct dhara_nand *n, dhara_page_t p, size_t offset, size_t length,
+                      uint8_t *page, dhara_error_t *err)
+{
+    // whole pages only -- the map's lookups read metadata in small pieces
+    if (length == ((size_t)1 << n->log2_page_size)) reads++;
+    return dhara_nand_image_ops.read(n, p, offset, length, page, err);
+}
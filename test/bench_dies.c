@@ -0,0 +1,92 @@
+/**
+ * @file		bench_dies.c
+ * @author		Andrew Loebs
+ * @brief		Erase, program and read throughput of the dhara backend over SPI_NAND_DIE_COUNT dies
+ *
+ * Drives nand_spi.c on the MT29F model (sim/sim_mt29f.c) with dhara pages of one, two and four
+ * flash pages, and prints the virtual time per KB of erasing, programming and streaming back
+ * whole dhara blocks. Built once per die count by the Makefile.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/dhara/nand_spi.h"
+#include "sim_mt29f.h"
+#include "spi_nand.h"
+
+// defines
+#define ERASE_BLOCKS 8
+#define PROG_BLOCKS  4
+#define NUM_BLOCKS   16
+#define READ_PAGES   64 // flash pages per dhara_nand_read_pages call
+
+// private function prototypes
+static int run(uint8_t log2_page_size);
+
+// private variables
+static uint8_t buffer[READ_PAGES * SPI_NAND_PAGE_SIZE];
+
+// public function definitions
+int main(void)
+{
+    sim_mt29f_reset();
+    if (SPI_NAND_RET_OK != spi_nand_init()) return 1;
+
+    printf("%d die(s), us per KB\n", SPI_NAND_DIE_COUNT);
+    printf("%-10s %10s %10s %10s\n", "page size", "erase", "program", "read");
+    for (uint8_t log2_page_size = SPI_NAND_LOG2_PAGE_SIZE; log2_page_size <= 13; log2_page_size++) {
+        if (0 != run(log2_page_size)) return 1;
+    }
+
+    return 0;
+}
+
+// private function definitions
+static int run(uint8_t log2_page_size)
+{
+    // a dhara block is one block of every die, whatever the page size
+    const struct dhara_nand n = {
+        .log2_page_size = log2_page_size,
+        .log2_ppb = SPI_NAND_LOG2_PAGES_PER_BLOCK + SPI_NAND_LOG2_DIE_COUNT -
+                    (log2_page_size - SPI_NAND_LOG2_PAGE_SIZE),
+        .num_blocks = NUM_BLOCKS,
+        .ops = &dhara_nand_spi_ops,
+    };
+    const size_t page_size = (size_t)1 << n.log2_page_size;
+    const dhara_page_t ppb = (dhara_page_t)1 << n.log2_ppb;
+    const double kb = page_size * ppb / 1024.0; // per dhara block
+    dhara_error_t err;
+
+    double start = sim_mt29f_now_us();
+    for (dhara_block_t b = 0; b < ERASE_BLOCKS; b++) {
+        if (0 != dhara_nand_erase(&n, b, &err)) return -1;
+    }
+    const double erase_us = (sim_mt29f_now_us() - start) / (ERASE_BLOCKS * kb);
+
+    start = sim_mt29f_now_us();
+    for (dhara_page_t p = 0; p < PROG_BLOCKS * ppb; p++) {
+        memset(buffer, (uint8_t)p, page_size);
+        if (0 != dhara_nand_prog(&n, p, buffer, &err)) return -1;
+    }
+    const double prog_us = (sim_mt29f_now_us() - start) / (PROG_BLOCKS * kb);
+
+    const dhara_page_t run_pages = (READ_PAGES * SPI_NAND_PAGE_SIZE) / page_size;
+    start = sim_mt29f_now_us();
+    for (dhara_page_t p = 0; p < PROG_BLOCKS * ppb; p += run_pages) {
+        if (0 != dhara_nand_read_pages(&n, p, run_pages, buffer, &err)) return -1;
+        for (dhara_page_t i = 0; i < run_pages; i++) {
+            const uint8_t *page = buffer + (i * page_size);
+            if ((page[0] != (uint8_t)(p + i)) || (page[page_size - 1] != (uint8_t)(p + i))) {
+                printf("page %u read back wrong\n", (unsigned)(p + i));
+                return -1;
+            }
+        }
+    }
+    const double read_us = (sim_mt29f_now_us() - start) / (PROG_BLOCKS * kb);
+
+    printf("%-10zu %10.1f %10.1f %10.1f\n", page_size, erase_us, prog_us, read_us);
+    return 0;
+}
@@ -0,0 +1,90 @@
+/**
+ * @file		bench_dispatch.c
+ * @author		Andrew Loebs
+ * @brief		Host cost of calling a dhara backend through its ops table
+ *
+ * Calls the same is_free function on a RAM image (nand_image.c) directly, as before struct
+ * dhara_nand carried its ops, and through dhara_nand_is_free and the device's ops table, and
+ * prints the wall-clock time per call of each.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/dhara/nand_image.h"
+
+// defines
+#define LOG2_PAGE_SIZE 9
+#define LOG2_PPB       4
+#define NUM_BLOCKS     64
+#define CALLS          100000000
+#define ROUNDS         3
+
+#define PAGE_COUNT     (NUM_BLOCKS << LOG2_PPB)
+#define IMAGE_SIZE     (PAGE_COUNT * ((1 << LOG2_PAGE_SIZE) + DHARA_NAND_IMAGE_SPARE_SIZE))
+
+// private function prototypes
+static int direct_is_free(const struct dhara_nand *n, dhara_page_t p) __attribute__((noinline));
+static double now_ns(void);
+
+// private variables
+static uint8_t image_buffer[IMAGE_SIZE];
+static struct dhara_nand_ops ops; // the image's, with is_free replaced by direct_is_free
+
+// public function definitions
+int main(void)
+{
+    struct dhara_nand n = {
+        .log2_page_size = LOG2_PAGE_SIZE,
+        .log2_ppb = LOG2_PPB,
+        .num_blocks = NUM_BLOCKS,
+    };
+    dhara_nand_image_t image;
+    dhara_nand_image_init_ram(&n, &image, image_buffer);
+    if (0 != dhara_nand_image_format(&n)) return 1;
+    ops = *n.ops;
+    ops.is_free = direct_is_free;
+    n.ops = &ops;
+
+    volatile int free_pages = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        const double start = now_ns();
+        for (int i = 0; i < CALLS; i++) {
+            free_pages += direct_is_free(&n, i & (PAGE_COUNT - 1));
+        }
+        const double direct = now_ns();
+        for (int i = 0; i < CALLS; i++) {
+            free_pages += dhara_nand_is_free(&n, i & (PAGE_COUNT - 1));
+        }
+        const double table = now_ns();
+
+        printf("direct call %.2f ns, ops table %.2f ns\n", (direct - start) / CALLS,
+               (table - direct) / CALLS);
+    }
+
+    return 0;
+}
+
+// private function definitions
+/// @brief The work of nand_image.c's is_free on a RAM image, reached with a direct call
+static int direct_is_free(const struct dhara_nand *n, dhara_page_t p)
+{
+    const dhara_nand_image_t *image = n->ctx;
+    const size_t page_size = (size_t)1 << n->log2_page_size;
+    const size_t offset = ((size_t)p * (page_size + DHARA_NAND_IMAGE_SPARE_SIZE)) + page_size + 1;
+    uint8_t mark;
+    if (!image->ram) return 0;
+    memcpy(&mark, &image->ram[offset], 1);
+
+    return 0xff == mark;
+}
+
+static double now_ns(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (t.tv_sec * 1e9) + t.tv_nsec;
+}
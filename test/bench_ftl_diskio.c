@@ -0,0 +1,138 @@
+/**
+ * @file		bench_ftl_diskio.c
+ * @author		Andrew Loebs
+ * @brief		File system workloads at the sector size of the build (FF_MAX_SS)
+ *
+ * Runs FatFs on the disk io glue, on dhara's spi backend and the MT29F model, from a freshly
+ * formatted chip, and prints for each workload the model's virtual time and the flash pages it
+ * programmed and read. Built once per sector size by the Makefile, so the rows of the builds can
+ * be set side by side: the 512 byte build packs four sectors to a flash page through the
+ * write-combining stage.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/fatfs/ff.h"
+#include "sim_mt29f.h"
+
+// defines
+#define FILE_SIZE   (4 * 1024 * 1024)
+#define CHUNK       (32 * 1024) // bytes per f_write / f_read of the sequential workloads
+#define RECORDS     2048        // appended to a log file...
+#define RECORD_SIZE 64
+#define SYNC_EVERY  16          // ...syncing every so many
+#define SMALL_FILES 64
+#define SMALL_SIZE  1000
+
+// private function prototypes
+static int sequential_write(uint32_t *bytes);
+static int sequential_read(uint32_t *bytes);
+static int log_append(uint32_t *bytes);
+static int small_files(uint32_t *bytes);
+static int run(const char *name, int (*workload)(uint32_t *bytes));
+
+// private variables
+static FATFS fs;
+static FIL file;
+static BYTE work[FF_MAX_SS];
+static uint8_t buffer[CHUNK];
+
+// public function definitions
+int main(void)
+{
+    sim_mt29f_reset();
+    if (FR_NO_FILESYSTEM != f_mount(&fs, "", 1)) return 1;
+    if (FR_OK != f_mkfs("", NULL, work, sizeof(work))) return 1;
+    if (FR_OK != f_mount(&fs, "", 1)) return 1;
+
+    printf("%d byte sectors, %lu byte clusters\n", FF_MAX_SS,
+           (unsigned long)fs.csize * FF_MAX_SS);
+    printf("%-12s %10s %10s %10s %10s\n", "workload", "ms", "KB/s", "programs", "reads");
+    if (run("seq write", sequential_write) || run("seq read", sequential_read) ||
+        run("log append", log_append) || run("small files", small_files)) {
+        return 1;
+    }
+
+    return 0;
+}
+
+// private function definitions
+static int sequential_write(uint32_t *bytes)
+{
+    UINT bw;
+    if (FR_OK != f_open(&file, "seq.bin", FA_WRITE | FA_CREATE_ALWAYS)) return -1;
+    for (uint32_t done = 0; done < FILE_SIZE; done += CHUNK) {
+        memset(buffer, (uint8_t)(done / CHUNK), sizeof(buffer));
+        if ((FR_OK != f_write(&file, buffer, CHUNK, &bw)) || (CHUNK != bw)) return -1;
+    }
+    *bytes = FILE_SIZE;
+    return (FR_OK == f_close(&file)) ? 0 : -1;
+}
+
+static int sequential_read(uint32_t *bytes)
+{
+    UINT br;
+    if (FR_OK != f_open(&file, "seq.bin", FA_READ)) return -1;
+    for (uint32_t done = 0; done < FILE_SIZE; done += CHUNK) {
+        if ((FR_OK != f_read(&file, buffer, CHUNK, &br)) || (CHUNK != br)) return -1;
+        if (buffer[CHUNK - 1] != (uint8_t)(done / CHUNK)) return -1;
+    }
+    *bytes = FILE_SIZE;
+    return (FR_OK == f_close(&file)) ? 0 : -1;
+}
+
+/// @brief Short records appended to one file and synced now and then, as a data logger would
+static int log_append(uint32_t *bytes)
+{
+    UINT bw;
+    if (FR_OK != f_open(&file, "log.txt", FA_WRITE | FA_CREATE_ALWAYS)) return -1;
+    for (uint32_t i = 0; i < RECORDS; i++) {
+        const int len = snprintf((char *)buffer, RECORD_SIZE + 1, "%08lu %-53s\r\n",
+                                 (unsigned long)i, "sensor 3 temp=21.4 hum=48.2");
+        if ((RECORD_SIZE != len) || (FR_OK != f_write(&file, buffer, len, &bw)) || (len != bw))
+            return -1;
+        if ((0 == ((i + 1) % SYNC_EVERY)) && (FR_OK != f_sync(&file))) return -1;
+    }
+    *bytes = RECORDS * RECORD_SIZE;
+    return (FR_OK == f_close(&file)) ? 0 : -1;
+}
+
+/// @brief Files under a cluster each, written and closed one after the other
+static int small_files(uint32_t *bytes)
+{
+    UINT bw;
+    char name[16];
+    memset(buffer, 'x', SMALL_SIZE);
+    for (uint32_t i = 0; i < SMALL_FILES; i++) {
+        snprintf(name, sizeof(name), "f%03lu.txt", (unsigned long)i);
+        if (FR_OK != f_open(&file, name, FA_WRITE | FA_CREATE_ALWAYS)) return -1;
+        if ((FR_OK != f_write(&file, buffer, SMALL_SIZE, &bw)) || (SMALL_SIZE != bw)) return -1;
+        if (FR_OK != f_close(&file)) return -1;
+    }
+    *bytes = SMALL_FILES * SMALL_SIZE;
+    return 0;
+}
+
+/// @brief Runs a workload and prints its row
+static int run(const char *name, int (*workload)(uint32_t *bytes))
+{
+    sim_mt29f_stats_t before, after;
+    sim_mt29f_get_stats(&before);
+    const double start = sim_mt29f_now_us();
+
+    uint32_t bytes = 0;
+    if (workload(&bytes)) {
+        printf("%s failed\n", name);
+        return 1;
+    }
+
+    const double ms = (sim_mt29f_now_us() - start) / 1000;
+    sim_mt29f_get_stats(&after);
+    printf("%-12s %10.1f %10.1f %10lu %10lu\n", name, ms, bytes / 1024.0 / (ms / 1000),
+           (unsigned long)(after.page_programs - before.page_programs),
+           (unsigned long)(after.page_reads - before.page_reads));
+    return 0;
+}
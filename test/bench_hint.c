@@ -0,0 +1,112 @@
+/**
+ * @file		bench_hint.c
+ * @author		Andrew Loebs
+ * @brief		Cost of a mount after a clean shutdown, with and without a resume hint
+ *
+ * Runs dhara on the MT29F model (nand_spi.c and spi_nand.c on sim/sim_mt29f.c) with a hint store
+ * in the last HINT_BLOCKS blocks, as nand_ftl_diskio does with NAND_FTL_RESUME_HINT. The journal
+ * is grown with random writes, syncing every SYNC_PERIOD of them, and at a few points a hint is
+ * saved after the last sync and the volume remounted: once with the full search, and once by
+ * loading the hint and resuming from it. Prints the virtual time of each.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../src/dhara/hint_store.h"
+#include "../src/dhara/map.h"
+#include "../src/dhara/nand_spi.h"
+#include "sim_mt29f.h"
+#include "spi_nand.h"
+
+// defines
+#define HINT_BLOCKS    2 // NAND_FTL_HINT_BLOCKS
+#define JOURNAL_BLOCKS (SPI_NAND_BLOCKS_PER_LUN - HINT_BLOCKS)
+#define GC_RATIO       4
+#define SECTORS        30000 // sectors touched by the writes
+#define SYNC_PERIOD    50
+
+// private function prototypes
+static int write_until(uint32_t target, dhara_error_t *err);
+
+// private variables
+static const uint32_t targets[] = {1000, 20000, 45000, 120000, 300000};
+static struct dhara_nand nand = {
+    .log2_page_size = SPI_NAND_LOG2_PAGE_SIZE,
+    .log2_ppb = SPI_NAND_LOG2_PAGES_PER_BLOCK,
+    .num_blocks = JOURNAL_BLOCKS,
+    .ops = &dhara_nand_spi_ops,
+};
+static struct dhara_map map;
+static dhara_hint_store_t hint_store;
+static uint8_t page_buffer[SPI_NAND_PAGE_SIZE];
+static uint8_t hint_page_buffer[SPI_NAND_PAGE_SIZE];
+static uint8_t data[SPI_NAND_PAGE_SIZE];
+static uint32_t writes;
+
+// public function definitions
+int main(void)
+{
+    dhara_error_t err;
+    sim_mt29f_reset();
+    if (SPI_NAND_RET_OK != spi_nand_init()) return 1;
+    dhara_map_init(&map, &nand, page_buffer, GC_RATIO);
+    dhara_map_resume(&map, &err);
+    dhara_hint_store_init(&hint_store, &nand, JOURNAL_BLOCKS, HINT_BLOCKS, hint_page_buffer);
+
+    printf("%-8s %6s %10s %10s %12s\n", "writes", "head", "full (ms)", "load (ms)", "hinted (ms)");
+    srand(1);
+    for (size_t i = 0; i < sizeof(targets) / sizeof(targets[0]); i++) {
+        struct dhara_journal_hint hint;
+        if ((0 != dhara_hint_store_withdraw(&hint_store, &err)) ||
+            (0 != write_until(targets[i], &err)) ||
+            (0 != dhara_journal_get_hint(&map.journal, &hint)) ||
+            (0 != dhara_hint_store_save(&hint_store, &hint, &err))) {
+            printf("writes up to %lu failed\n", (unsigned long)targets[i]);
+            return 1;
+        }
+
+        dhara_map_init(&map, &nand, page_buffer, GC_RATIO);
+        double start = sim_mt29f_now_us();
+        if (0 != dhara_map_resume(&map, &err)) return 1;
+        const double full_ms = (sim_mt29f_now_us() - start) / 1000.0;
+        const dhara_page_t root = map.journal.root;
+        const dhara_page_t head = map.journal.head;
+
+        // as a reboot: the store knows nothing until it's loaded
+        dhara_hint_store_init(&hint_store, &nand, JOURNAL_BLOCKS, HINT_BLOCKS, hint_page_buffer);
+        start = sim_mt29f_now_us();
+        if (0 != dhara_hint_store_load(&hint_store, &hint)) return 1;
+        const double load_ms = (sim_mt29f_now_us() - start) / 1000.0;
+        dhara_map_init(&map, &nand, page_buffer, GC_RATIO);
+        start = sim_mt29f_now_us();
+        if (0 != dhara_map_resume_hint(&map, &hint, &err)) return 1;
+        const double hinted_ms = (sim_mt29f_now_us() - start) / 1000.0;
+        if ((map.journal.root != root) || (map.journal.head != head)) {
+            printf("hinted resume after %lu writes disagrees\n", (unsigned long)writes);
+            return 1;
+        }
+
+        printf("%-8lu %6lu %10.2f %10.2f %12.2f\n", (unsigned long)writes,
+               (unsigned long)(head >> nand.log2_ppb), full_ms, load_ms, hinted_ms);
+    }
+
+    return 0;
+}
+
+// private function definitions
+/// @brief Writes up to target and syncs
+static int write_until(uint32_t target, dhara_error_t *err)
+{
+    for (; writes < target; writes++) {
+        data[0] = (uint8_t)writes;
+        if (0 != dhara_map_write(&map, (uint32_t)rand() % SECTORS, data, err)) return -1;
+        if (0 == ((writes + 1) % SYNC_PERIOD)) {
+            if (0 != dhara_map_sync(&map, err)) return -1;
+        }
+    }
+
+    return dhara_map_sync(&map, err);
+}
@@ -0,0 +1,160 @@
+/**
+ * @file		bench_hotcold.c
+ * @author		Andrew Loebs
+ * @brief		Write amplification of a single log against the hot/cold logs of ftl_hotcold
+ *
+ * Runs a skewed workload on a RAM image of the whole chip (nand_image.c), once on a single dhara
+ * map as nand_ftl_diskio does by default, and once through ftl_hotcold on a hot and a cold
+ * partition (nand_part.c) as with NAND_FTL_HOT_COLD. The volume is first filled to a given number
+ * of sectors, then takes WRITES single-sector writes, 90% of them to the first 10% of the
+ * sectors, with a sync every SYNC_PERIOD writes. Prints the flash pages programmed per write.
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/dhara/map.h"
+#include "../src/dhara/nand_image.h"
+#include "../src/dhara/nand_part.h"
+#include "../src/modules/ftl_hotcold.h"
+#include "spi_nand.h"
+
+// defines
+#define NUM_BLOCKS  SPI_NAND_BLOCKS_PER_LUN
+#define HOT_BLOCKS  (NUM_BLOCKS / 8) // NAND_FTL_HOT_BLOCKS
+#define GC_RATIO    4
+#define WRITES      400000
+#define SYNC_PERIOD 64
+
+// private function prototypes
+static int run(uint32_t sectors, bool hot_cold, double *wa_out);
+static int write_sector(bool hot_cold, uint32_t sector, const uint8_t *page, dhara_error_t *err);
+static int sync_all(bool hot_cold, dhara_error_t *err);
+static int count_prog(const struct dhara_nand *n, dhara_page_t p, const uint8_t *page,
+                      dhara_error_t *err);
+static int count_copy(const struct dhara_nand *n, dhara_page_t src, dhara_page_t dst,
+                      dhara_error_t *err);
+
+// private variables
+static const uint32_t volume_sectors[] = {30000, 36000, 40000};
+// the image's ops, with programs and copies counted
+static struct dhara_nand_ops counting_ops;
+static uint32_t programs;
+static struct dhara_nand chip = {
+    .log2_page_size = SPI_NAND_LOG2_PAGE_SIZE,
+    .log2_ppb = SPI_NAND_LOG2_PAGES_PER_BLOCK,
+    .num_blocks = NUM_BLOCKS,
+};
+static dhara_nand_image_t image;
+static struct dhara_nand hot_nand, cold_nand;
+static dhara_nand_part_t hot_part, cold_part;
+static struct dhara_map map, cold_map;
+static uint8_t page_buffer[SPI_NAND_PAGE_SIZE];
+static uint8_t cold_page_buffer[SPI_NAND_PAGE_SIZE];
+static uint8_t data[SPI_NAND_PAGE_SIZE];
+
+// public function definitions
+int main(void)
+{
+    uint8_t *image_buffer = malloc(dhara_nand_image_size(&chip));
+    if (!image_buffer) return 1;
+    dhara_nand_image_init_ram(&chip, &image, image_buffer);
+    counting_ops = *chip.ops;
+    counting_ops.prog = count_prog;
+    counting_ops.copy = count_copy;
+    chip.ops = &counting_ops;
+
+    printf("flash pages programmed per write\n");
+    printf("%-14s %12s %12s\n", "sectors used", "single map", "hot/cold");
+    for (size_t i = 0; i < sizeof(volume_sectors) / sizeof(volume_sectors[0]); i++) {
+        double single_wa, hot_cold_wa;
+        if ((0 != run(volume_sectors[i], false, &single_wa)) ||
+            (0 != run(volume_sectors[i], true, &hot_cold_wa))) {
+            printf("%lu sectors: write failed\n", (unsigned long)volume_sectors[i]);
+            return 1;
+        }
+        printf("%-14lu %12.2f %12.2f\n", (unsigned long)volume_sectors[i], single_wa, hot_cold_wa);
+    }
+
+    free(image_buffer);
+    return 0;
+}
+
+// private function definitions
+static int run(uint32_t sectors, bool hot_cold, double *wa_out)
+{
+    dhara_error_t err;
+    if (0 != dhara_nand_image_format(&chip)) return -1;
+    if (hot_cold) {
+        dhara_nand_part_init(&hot_nand, &hot_part, &chip, 0, HOT_BLOCKS);
+        dhara_nand_part_init(&cold_nand, &cold_part, &chip, HOT_BLOCKS, NUM_BLOCKS - HOT_BLOCKS);
+        dhara_map_init(&cold_map, &cold_nand, cold_page_buffer, GC_RATIO);
+        dhara_map_resume(&cold_map, &err);
+        dhara_map_init(&map, &hot_nand, page_buffer, GC_RATIO);
+        dhara_map_resume(&map, &err);
+        ftl_hotcold_init(&map, &cold_map);
+        if (sectors > ftl_hotcold_sector_count()) return -1;
+    }
+    else {
+        dhara_map_init(&map, &chip, page_buffer, GC_RATIO);
+        dhara_map_resume(&map, &err);
+        if (sectors > dhara_map_capacity(&map)) return -1;
+    }
+
+    // static fill
+    for (uint32_t sector = 0; sector < sectors; sector++) {
+        memset(data, (uint8_t)sector, sizeof(data));
+        if (0 != write_sector(hot_cold, sector, data, &err)) return -1;
+    }
+    if (0 != sync_all(hot_cold, &err)) return -1;
+
+    // skewed rewrites
+    const uint32_t hot_sectors = sectors / 10;
+    const uint32_t start = programs;
+    srand(1);
+    for (uint32_t i = 0; i < WRITES; i++) {
+        const uint32_t sector = (rand() % 10) ? ((uint32_t)rand() % hot_sectors)
+                                              : (hot_sectors + ((uint32_t)rand() %
+                                                                (sectors - hot_sectors)));
+        data[0] = (uint8_t)i;
+        if (0 != write_sector(hot_cold, sector, data, &err)) return -1;
+        if (0 == ((i + 1) % SYNC_PERIOD)) {
+            if (0 != sync_all(hot_cold, &err)) return -1;
+        }
+    }
+
+    *wa_out = (double)(programs - start) / WRITES;
+    return 0;
+}
+
+static int write_sector(bool hot_cold, uint32_t sector, const uint8_t *page, dhara_error_t *err)
+{
+    if (hot_cold) return ftl_hotcold_write(sector, page, err);
+
+    return dhara_map_write(&map, sector, page, err);
+}
+
+static int sync_all(bool hot_cold, dhara_error_t *err)
+{
+    if (hot_cold) return ftl_hotcold_sync(err);
+
+    return dhara_map_sync(&map, err);
+}
+
+static int count_prog(const struct dhara_nand *n, dhara_page_t p, const uint8_t *page,
+                      dhara_error_t *err)
+{
+    programs++;
+    return dhara_nand_image_ops.prog(n, p, page, err);
+}
+
+static int count_copy(const struct dhara_nand *n, dhara_page_t src, dhara_page_t dst,
+                      dhara_error_t *err)
+{
+    programs++;
+    return dhara_nand_image_ops.copy(n, src, dst, err);
+}
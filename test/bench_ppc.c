@@ -0,0 +1,126 @@
+/**
+ * @file		bench_ppc.c
+ * @author		Andrew Loebs
+ * @brief		Sync cost and capacity for each checkpoint period (DHARA_PPC_SELECT)
+ *
+ * Formats a RAM image of the whole chip (nand_image.c) with each checkpoint period in turn, writes
+ * one sector and syncs SYNCS times, and prints the flash pages programmed per sync and the
+ * capacity of the volume. Each volume is then remounted asking for another period, and has to
+ * keep its own and read back.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/dhara/map.h"
+#include "../src/dhara/nand_image.h"
+#include "spi_nand.h"
+
+// defines
+#define GC_RATIO     4
+#define SYNCS        2000
+#define SECTORS      700 // sectors the writes cycle through
+#define LOG2_PPC_MAX 4 // largest period whose metadata fits in a 2048 byte page
+
+#if !DHARA_PPC_SELECT
+#error "bench_ppc needs DHARA_PPC_SELECT"
+#endif
+
+// private function prototypes
+static uint8_t mount(uint8_t log2_ppc, dhara_error_t *err);
+static int count_prog(const struct dhara_nand *n, dhara_page_t p, const uint8_t *page,
+                      dhara_error_t *err);
+static int count_copy(const struct dhara_nand *n, dhara_page_t src, dhara_page_t dst,
+                      dhara_error_t *err);
+
+// private variables
+// the image's ops, with programs and copies counted (syncs pad with copies of the root)
+static struct dhara_nand_ops counting_ops;
+static uint32_t programs;
+static struct dhara_nand nand = {
+    .log2_page_size = SPI_NAND_LOG2_PAGE_SIZE,
+    .log2_ppb = SPI_NAND_LOG2_PAGES_PER_BLOCK,
+    .num_blocks = SPI_NAND_BLOCKS_PER_LUN,
+};
+static dhara_nand_image_t image;
+static struct dhara_map map;
+static uint8_t page_buffer[SPI_NAND_PAGE_SIZE];
+static uint8_t data[SPI_NAND_PAGE_SIZE];
+
+// public function definitions
+int main(void)
+{
+    dhara_error_t err;
+    uint8_t *image_buffer = malloc(dhara_nand_image_size(&nand));
+    if (!image_buffer) return 1;
+    dhara_nand_image_init_ram(&nand, &image, image_buffer);
+    counting_ops = *nand.ops;
+    counting_ops.prog = count_prog;
+    counting_ops.copy = count_copy;
+    nand.ops = &counting_ops;
+
+    printf("%-10s %16s %10s\n", "log2_ppc", "pages per sync", "capacity");
+    for (uint8_t log2_ppc = 1; log2_ppc <= LOG2_PPC_MAX; log2_ppc++) {
+        if ((0 != dhara_nand_image_format(&nand)) || (log2_ppc != mount(log2_ppc, &err))) {
+            return 1;
+        }
+
+        const uint32_t start = programs;
+        for (uint32_t i = 0; i < SYNCS; i++) {
+            memset(data, (uint8_t)i, sizeof(data));
+            if ((0 != dhara_map_write(&map, i % SECTORS, data, &err)) ||
+                (0 != dhara_map_sync(&map, &err))) {
+                return 1;
+            }
+        }
+        const double pages_per_sync = (double)(programs - start) / SYNCS;
+
+        // the volume keeps the period it was formatted with
+        const uint8_t other = (1 == log2_ppc) ? LOG2_PPC_MAX : 1;
+        if (log2_ppc != mount(other, &err)) {
+            printf("log2_ppc %u: remount changed the period\n", log2_ppc);
+            return 1;
+        }
+        for (uint32_t i = SYNCS - SECTORS; i < SYNCS; i++) {
+            if ((0 != dhara_map_read(&map, i % SECTORS, data, &err)) || (data[0] != (uint8_t)i)) {
+                printf("log2_ppc %u: sector %lu read back wrong\n", log2_ppc,
+                       (unsigned long)(i % SECTORS));
+                return 1;
+            }
+        }
+
+        printf("%-10u %16.2f %10lu\n", log2_ppc, pages_per_sync,
+               (unsigned long)dhara_map_capacity(&map));
+    }
+
+    free(image_buffer);
+    return 0;
+}
+
+// private function definitions
+/// @brief Mounts the map, asking for a period should the chip be blank; returns the period used
+static uint8_t mount(uint8_t log2_ppc, dhara_error_t *err)
+{
+    dhara_map_init(&map, &nand, page_buffer, GC_RATIO);
+    dhara_journal_select_ppc(&map.journal, log2_ppc);
+    dhara_map_resume(&map, err);
+
+    return map.journal.log2_ppc;
+}
+
+static int count_prog(const struct dhara_nand *n, dhara_page_t p, const uint8_t *page,
+                      dhara_error_t *err)
+{
+    programs++;
+    return dhara_nand_image_ops.prog(n, p, page, err);
+}
+
+static int count_copy(const struct dhara_nand *n, dhara_page_t src, dhara_page_t dst,
+                      dhara_error_t *err)
+{
+    programs++;
+    return dhara_nand_image_ops.copy(n, src, dst, err);
+}
@@ -0,0 +1,151 @@
+/**
+ * @file		bench_resume.c
+ * @author		Andrew Loebs
+ * @brief		Cost of mounting a dhara map, by position of the journal head
+ *
+ * Runs dhara on the whole MT29F model (nand_spi.c and spi_nand.c on sim/sim_mt29f.c) and grows
+ * the journal with random writes, syncing every SYNC_PERIOD of them. At each of a few points it
+ * leaves a partly filled checkpoint group behind a sync, remounts, and prints the header reads,
+ * bytes and is_free probes of the journal's search (DHARA_RESUME_PROFILE) and the virtual time
+ * the mount took. It then mounts the same state with dhara_map_resume_lazy, and times that and the
+ * two writes following it -- the first one pays for the deferred head search.
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../src/dhara/map.h"
+#include "../src/dhara/nand_spi.h"
+#include "sim_mt29f.h"
+#include "spi_nand.h"
+#include "sys_time.h"
+
+// defines
+#define GC_RATIO    4
+#define SECTORS     30000 // sectors touched by the writes
+#define SYNC_PERIOD 50
+#define TAIL_WRITES 5 // writes of the partly filled group left before each mount
+
+#if !DHARA_RESUME_PROFILE
+#error "bench_resume needs DHARA_RESUME_PROFILE"
+#endif
+
+// private function prototypes
+static int write_until(uint32_t target, dhara_error_t *err);
+static int mount(bool lazy, double *ms_out, dhara_error_t *err);
+static int timed_write(double *ms_out, dhara_error_t *err);
+
+// private variables
+static const uint32_t targets[] = {1000, 20000, 45000, 120000, 300000};
+static struct dhara_nand nand = {
+    .log2_page_size = SPI_NAND_LOG2_PAGE_SIZE,
+    .log2_ppb = SPI_NAND_LOG2_PAGES_PER_BLOCK,
+    .num_blocks = SPI_NAND_BLOCKS_PER_LUN,
+    .ops = &dhara_nand_spi_ops,
+};
+static struct dhara_map map;
+static uint8_t page_buffer[SPI_NAND_PAGE_SIZE];
+static uint8_t data[SPI_NAND_PAGE_SIZE];
+static uint32_t writes;
+
+// public function definitions
+int main(void)
+{
+    dhara_error_t err;
+    sim_mt29f_reset();
+    if (SPI_NAND_RET_OK != spi_nand_init()) return 1;
+    dhara_map_init(&map, &nand, page_buffer, GC_RATIO);
+    dhara_map_resume(&map, &err);
+
+    printf("%-8s %6s %8s %8s %8s %10s %10s %10s %10s\n", "writes", "head", "reads", "bytes",
+           "probes", "full (ms)", "lazy (ms)", "1st write", "2nd write");
+    srand(1);
+    for (size_t i = 0; i < sizeof(targets) / sizeof(targets[0]); i++) {
+        if (0 != write_until(targets[i], &err)) return 1;
+
+        const uint32_t written = writes;
+        const dhara_page_t root = dhara_journal_root(&map.journal);
+        double full_ms;
+        if ((0 != mount(false, &full_ms, &err)) || (dhara_journal_root(&map.journal) != root)) {
+            printf("resume after %lu writes failed\n", (unsigned long)writes);
+            return 1;
+        }
+
+        uint32_t reads = 0, bytes = 0, probes = 0;
+        for (int phase = 0; phase < DHARA_RESUME_PHASES; phase++) {
+            reads += map.journal.profile.phase[phase].reads;
+            bytes += map.journal.profile.phase[phase].bytes;
+            probes += map.journal.profile.phase[phase].probes;
+        }
+        const dhara_page_t head = map.journal.head;
+
+        // the same state mounted lazily, then its first write (which looks for the head) and the
+        // next one
+        double lazy_ms, first_write_ms, next_write_ms;
+        if ((0 != mount(true, &lazy_ms, &err)) || (dhara_journal_root(&map.journal) != root) ||
+            (0 != timed_write(&first_write_ms, &err)) || (0 != timed_write(&next_write_ms, &err)) ||
+            (0 != dhara_map_sync(&map, &err))) {
+            printf("lazy resume after %lu writes failed\n", (unsigned long)writes);
+            return 1;
+        }
+
+        // the lazy journal must have found the head a full resume finds
+        const dhara_page_t lazy_head = map.journal.head;
+        double ms;
+        if ((0 != mount(false, &ms, &err)) || (map.journal.head != lazy_head)) {
+            printf("lazy head after %lu writes is wrong\n", (unsigned long)writes);
+            return 1;
+        }
+
+        printf("%-8lu %6lu %8lu %8lu %8lu %10.1f %10.1f %10.1f %10.1f\n",
+               (unsigned long)written, (unsigned long)(head >> nand.log2_ppb),
+               (unsigned long)reads, (unsigned long)bytes, (unsigned long)probes, full_ms,
+               lazy_ms, first_write_ms, next_write_ms);
+    }
+
+    return 0;
+}
+
+// private function definitions
+/// @brief Writes up to target, then leaves TAIL_WRITES more in a synced, partly filled group
+static int write_until(uint32_t target, dhara_error_t *err)
+{
+    for (; writes < target; writes++) {
+        data[0] = (uint8_t)writes;
+        if (0 != dhara_map_write(&map, (uint32_t)rand() % SECTORS, data, err)) return -1;
+        if (0 == ((writes + 1) % SYNC_PERIOD)) {
+            if (0 != dhara_map_sync(&map, err)) return -1;
+        }
+    }
+    for (int i = 0; i < TAIL_WRITES; i++) {
+        if (0 != dhara_map_write(&map, (uint32_t)rand() % SECTORS, data, err)) return -1;
+    }
+
+    return dhara_map_sync(&map, err);
+}
+
+/// @brief Remounts the map from the chip, timed on the model's clock
+static int mount(bool lazy, double *ms_out, dhara_error_t *err)
+{
+    dhara_map_init(&map, &nand, page_buffer, GC_RATIO);
+    map.journal.profile.clock = sys_time_get_us;
+    const double start = sim_mt29f_now_us();
+    const int ret = lazy ? dhara_map_resume_lazy(&map, err) : dhara_map_resume(&map, err);
+    *ms_out = (sim_mt29f_now_us() - start) / 1000.0;
+
+    return ret;
+}
+
+/// @brief One more write of the workload, timed on the model's clock
+static int timed_write(double *ms_out, dhara_error_t *err)
+{
+    data[0] = (uint8_t)writes++;
+    const double start = sim_mt29f_now_us();
+    const int ret = dhara_map_write(&map, (uint32_t)rand() % SECTORS, data, err);
+    *ms_out = (sim_mt29f_now_us() - start) / 1000.0;
+
+    return ret;
+}
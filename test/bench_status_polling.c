@@ -0,0 +1,82 @@
+/**
+ * @file		bench_status_polling.c
+ * @author		Andrew Loebs
+ * @brief		Status register reads and time per operation of the spi nand driver
+ *
+ * Runs each kind of blocking operation OPS times on the MT29F model (sim/sim_mt29f.c, whose busy
+ * times vary by +-5% around the datasheet values) and prints, per operation, the status reads the
+ * driver made, the virtual time it took and the part of it spent in the delay functions.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sim_mt29f.h"
+#include "spi_nand.h"
+
+// defines
+#define OPS 200
+
+typedef enum {
+    KIND_READ,
+    KIND_PROGRAM,
+    KIND_ERASE,
+    KIND_READ_PAGES,
+    KIND_COUNT,
+} kind_t;
+
+// private function prototypes
+static int run(kind_t kind, int i);
+
+// private variables
+static const char *names[KIND_COUNT] = {
+    [KIND_READ] = "page read",
+    [KIND_PROGRAM] = "page program",
+    [KIND_ERASE] = "block erase",
+    [KIND_READ_PAGES] = "read 64 pages",
+};
+static uint8_t buffer[SPI_NAND_PAGES_PER_BLOCK * SPI_NAND_PAGE_SIZE];
+
+// public function definitions
+int main(void)
+{
+    sim_mt29f_reset();
+    if (SPI_NAND_RET_OK != spi_nand_init()) return 1;
+
+    printf("%-14s %14s %12s %12s\n", "operation", "status reads", "time (us)", "asleep (us)");
+    for (kind_t kind = 0; kind < KIND_COUNT; kind++) {
+        sim_mt29f_stats_t stats;
+        sim_mt29f_clear_stats();
+        const double start = sim_mt29f_now_us();
+        for (int i = 0; i < OPS; i++) {
+            if (SPI_NAND_RET_OK != run(kind, i)) return 1;
+        }
+        sim_mt29f_get_stats(&stats);
+
+        printf("%-14s %14.1f %12.1f %12.1f\n", names[kind], (double)stats.status_reads / OPS,
+               (sim_mt29f_now_us() - start) / OPS, stats.delay_us / OPS);
+    }
+
+    return 0;
+}
+
+// private function definitions
+static int run(kind_t kind, int i)
+{
+    row_address_t row = {.block = i % 8, .page = i % SPI_NAND_PAGES_PER_BLOCK};
+    switch (kind) {
+        case KIND_READ:
+            return spi_nand_page_read(row, 0, buffer, SPI_NAND_PAGE_SIZE);
+        case KIND_PROGRAM:
+            memset(buffer, i, SPI_NAND_PAGE_SIZE);
+            return spi_nand_page_program(row, 0, buffer, SPI_NAND_PAGE_SIZE);
+        case KIND_ERASE:
+            return spi_nand_block_erase(row);
+        case KIND_READ_PAGES:
+        default:
+            row.page = 0;
+            return spi_nand_read_pages(row, SPI_NAND_PAGES_PER_BLOCK, buffer);
+    }
+}
@@ -0,0 +1,701 @@
+/**
+ * @file		sim_mt29f.c
+ * @author		Andrew Loebs
+ * @brief		Implementation file of the MT29F model used by the host tests
+ *
+ */
+
+#include "sim_mt29f.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spi.h"
+#include "st/ll/stm32l4xx_ll_gpio.h"
+#include "sys_time.h"
+
+// defines
+#define PAGE_BYTES      (SPI_NAND_PAGE_SIZE + SPI_NAND_OOB_SIZE)
+#define ROWS_PER_DIE    (SPI_NAND_BLOCKS_PER_LUN * SPI_NAND_PAGES_PER_BLOCK)
+#define BLOCK_SHIFT     SPI_NAND_LOG2_PAGES_PER_BLOCK
+#define NO_DIE          -1
+#define MAX_FAULTS      16
+
+#define CPU_STEP_US     0.05 // a clock read, or a pass of a polling loop
+#define SELECT_US       0.1  // chip select edge and command setup
+#define T_RESET_US      10.0
+
+#define CMD_RESET                    0xFF
+#define CMD_READ_ID                  0x9F
+#define CMD_SET_FEATURE              0x1F
+#define CMD_GET_FEATURE              0x0F
+#define CMD_PAGE_READ                0x13
+#define CMD_READ_FROM_CACHE          0x03
+#define CMD_PAGE_READ_CACHE_SEQ      0x31
+#define CMD_PAGE_READ_CACHE_LAST     0x3F
+#define CMD_WRITE_ENABLE             0x06
+#define CMD_WRITE_DISABLE            0x04
+#define CMD_PROGRAM_LOAD             0x02
+#define CMD_PROGRAM_LOAD_RANDOM_DATA 0x84
+#define CMD_READ_FROM_CACHE_X4       0x6B
+#define CMD_PROGRAM_LOAD_X4          0x32
+#define CMD_PROGRAM_LOAD_RANDOM_X4   0x34
+#define CMD_PROGRAM_EXECUTE          0x10
+#define CMD_BLOCK_ERASE              0xD8
+
+#define MFR_ID_MICRON     0x2C
+#define DEVICE_ID_1G_3V3  0x14
+
+#define REG_BLOCK_LOCK    0xA0
+#define REG_CONFIGURATION 0xB0
+#define REG_STATUS        0xC0
+
+#define BLOCK_LOCK_POWER_UP        0x38 // BP0-2 set: every block locked
+#define BLOCK_LOCK_BP_MASK         0x78
+#define BLOCK_LOCK_WP_HOLD_DISABLE 0x02
+#define CONFIGURATION_ECC_EN       0x10
+
+#define STATUS_OIP       0x01
+#define STATUS_WEL       0x02
+#define STATUS_E_FAIL    0x04
+#define STATUS_P_FAIL    0x08
+#define STATUS_ECC_SHIFT 4
+#define STATUS_ECC_MASK  0x70
+
+// private types
+typedef enum {
+    FAULT_NONE,
+    FAULT_ECC,
+    FAULT_PROGRAM,
+    FAULT_ERASE,
+} fault_kind_t;
+
+typedef struct {
+    fault_kind_t kind;
+    int die;
+    uint32_t row; // row within the die (block's first row for erase faults)
+    uint8_t ecc_status;
+} fault_t;
+
+typedef struct {
+    uint8_t *pages[ROWS_PER_DIE]; // NULL while erased
+    uint32_t erase_counts[SPI_NAND_BLOCKS_PER_LUN];
+    uint8_t cache[PAGE_BYTES];
+    uint8_t data_register[PAGE_BYTES];
+    uint8_t data_register_ecc;
+    double busy_until;          // OIP
+    double data_register_ready; // end of the background array read of a cache read
+    bool cache_read;            // a sequential cache read is running
+    uint32_t next_row;          // row the next sequential cache read fetches
+    uint8_t status;             // WEL, fail and ECC bits
+    uint8_t block_lock;
+    uint8_t configuration;
+} die_t;
+
+/// @brief Data phase of an asynchronous command
+typedef struct {
+    bool active;
+    int die;
+    uint8_t instruction;
+    uint16_t column;
+    uint8_t *read_buff;
+    const uint8_t *write_buff;
+    size_t len;
+    double end;
+    spi_callback_t callback;
+    void *context;
+} transfer_t;
+
+// private function prototypes
+static void fail(const char *format, ...);
+static double jitter(double us);
+static void bus(size_t single_line_bytes, size_t data_bytes, uint8_t data_lines);
+static die_t *selected_die(void);
+static bool die_is_busy(const die_t *d);
+static void check_idle(const die_t *d, uint8_t instruction);
+static void load_page(const die_t *d, int die, uint32_t row, uint8_t *out, uint8_t *ecc_out);
+static void row_command(uint8_t instruction, uint32_t row);
+static void cache_command(const spi_command_t *cmd, size_t len);
+static void move_data(const transfer_t *t);
+static void transfer_complete(void);
+static fault_t *find_fault(fault_kind_t kind, int die, uint32_t row);
+static void add_fault(fault_kind_t kind, uint32_t row, uint8_t ecc_status);
+
+// private variables
+static die_t dies[SPI_NAND_DIE_COUNT];
+static fault_t faults[MAX_FAULTS];
+static int selected = NO_DIE;
+static transfer_t transfer;
+static volatile int async_ret = SPI_RET_OK;
+static double now_us;
+static uint32_t jitter_state;
+static sim_mt29f_stats_t stats;
+
+// public variables (the ports of stm32l4xx_ll_gpio.h)
+GPIO_TypeDef sim_gpioa = {'A'};
+GPIO_TypeDef sim_gpiob = {'B'};
+
+// public function definitions
+void sim_mt29f_reset(void)
+{
+    for (int i = 0; i < SPI_NAND_DIE_COUNT; i++) {
+        die_t *d = &dies[i];
+        for (uint32_t row = 0; row < ROWS_PER_DIE; row++) {
+            free(d->pages[row]);
+        }
+        memset(d, 0, sizeof(*d));
+        memset(d->cache, 0xff, sizeof(d->cache));
+        memset(d->data_register, 0xff, sizeof(d->data_register));
+        d->block_lock = BLOCK_LOCK_POWER_UP;
+        d->configuration = CONFIGURATION_ECC_EN;
+    }
+    memset(faults, 0, sizeof(faults));
+    memset(&transfer, 0, sizeof(transfer));
+    selected = NO_DIE;
+    async_ret = SPI_RET_OK;
+    now_us = 0;
+    jitter_state = 1;
+    sim_mt29f_clear_stats();
+}
+
+double sim_mt29f_now_us(void)
+{
+    return now_us;
+}
+
+void sim_mt29f_get_stats(sim_mt29f_stats_t *stats_out)
+{
+    *stats_out = stats;
+}
+
+void sim_mt29f_clear_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+void sim_mt29f_inject_ecc(uint32_t row, uint8_t ecc_status)
+{
+    add_fault(FAULT_ECC, row, ecc_status);
+}
+
+void sim_mt29f_inject_program_fail(uint32_t row)
+{
+    add_fault(FAULT_PROGRAM, row, 0);
+}
+
+void sim_mt29f_inject_erase_fail(uint32_t block)
+{
+    add_fault(FAULT_ERASE, block << BLOCK_SHIFT, 0);
+}
+
+uint32_t sim_mt29f_erase_count(uint32_t block)
+{
+    return dies[block / SPI_NAND_BLOCKS_PER_LUN].erase_counts[block % SPI_NAND_BLOCKS_PER_LUN];
+}
+
+void sim_gpio_write(GPIO_TypeDef *port, uint32_t pin, int level)
+{
+    // the chip selects of spi_nand.c
+    static const struct {
+        GPIO_TypeDef *port;
+        uint32_t pin;
+    } csel_pins[] = {
+#if SPI_USE_QUADSPI
+        {GPIOA, LL_GPIO_PIN_4},
+#else
+        {GPIOB, LL_GPIO_PIN_0},
+#endif
+        {GPIOA, LL_GPIO_PIN_8},
+        {GPIOA, LL_GPIO_PIN_11},
+        {GPIOA, LL_GPIO_PIN_12},
+    };
+
+    int die = NO_DIE;
+    for (int i = 0; i < SPI_NAND_DIE_COUNT; i++) {
+        if ((port == csel_pins[i].port) && (pin == csel_pins[i].pin)) die = i;
+    }
+    if (NO_DIE == die) fail("GPIO%c pin mask 0x%04x is not a chip select", port->name, pin);
+
+    now_us += SELECT_US;
+    if (!level) {
+        if (NO_DIE != selected) fail("die %d selected while die %d still is", die, selected);
+        selected = die;
+    }
+    else if (die == selected) {
+        if (transfer.active) {
+            if (now_us < transfer.end) fail("chip select of die %d released mid-transfer", die);
+            transfer_complete();
+        }
+        selected = NO_DIE;
+    }
+}
+
+// spi.h
+void spi_init(void)
+{
+}
+
+int spi_write(const uint8_t *write_buff, size_t write_len, uint32_t timeout_ms)
+{
+    (void)timeout_ms;
+    die_t *d = selected_die();
+    if (transfer.active) fail("spi_write while a transfer is running");
+    bus(write_len, 0, 1);
+
+    const uint8_t instruction = write_buff[0];
+    switch (instruction) {
+        case CMD_RESET:
+            d->status = 0;
+            d->cache_read = false;
+            d->busy_until = now_us + T_RESET_US;
+            break;
+        case CMD_WRITE_ENABLE:
+            check_idle(d, instruction);
+            d->status |= STATUS_WEL;
+            break;
+        case CMD_WRITE_DISABLE:
+            check_idle(d, instruction);
+            d->status &= ~STATUS_WEL;
+            break;
+        case CMD_SET_FEATURE:
+            if (3 != write_len) fail("set feature of %zu bytes", write_len);
+            check_idle(d, instruction);
+            if (REG_BLOCK_LOCK == write_buff[1]) {
+                d->block_lock = write_buff[2];
+            }
+            else if (REG_CONFIGURATION == write_buff[1]) {
+                d->configuration = write_buff[2];
+            }
+            else {
+                fail("set feature of register 0x%02x", write_buff[1]);
+            }
+            break;
+        case CMD_PAGE_READ:
+        case CMD_PROGRAM_EXECUTE:
+        case CMD_BLOCK_ERASE:
+            if (4 != write_len) fail("row command 0x%02x of %zu bytes", instruction, write_len);
+            row_command(instruction, ((uint32_t)write_buff[1] << 16) | (write_buff[2] << 8) |
+                                         write_buff[3]);
+            break;
+        case CMD_PAGE_READ_CACHE_SEQ:
+        case CMD_PAGE_READ_CACHE_LAST: {
+            check_idle(d, instruction);
+            if (!d->cache_read) fail("cache read command 0x%02x without a page read", instruction);
+            // the data register moves to the cache once its array read is done
+            const double start = (d->data_register_ready > now_us) ? d->data_register_ready
+                                                                   : now_us;
+            memcpy(d->cache, d->data_register, PAGE_BYTES);
+            d->status = (d->status & ~STATUS_ECC_MASK) |
+                        (d->data_register_ecc << STATUS_ECC_SHIFT);
+            d->busy_until = start + jitter(SIM_MT29F_T_READ_CACHE_US);
+            if (CMD_PAGE_READ_CACHE_SEQ == instruction) {
+                if (0 == (d->next_row % SPI_NAND_PAGES_PER_BLOCK)) {
+                    fail("sequential cache read past the end of a block");
+                }
+                load_page(d, selected, d->next_row++, d->data_register, &d->data_register_ecc);
+                d->data_register_ready = d->busy_until + jitter(SIM_MT29F_T_READ_US);
+                stats.page_reads++;
+            }
+            else {
+                d->cache_read = false;
+            }
+            break;
+        }
+        default:
+            fail("unexpected command 0x%02x", instruction);
+    }
+
+    return SPI_RET_OK;
+}
+
+int spi_read(uint8_t *read_buff, size_t read_len, uint32_t timeout_ms)
+{
+    (void)read_buff, (void)read_len, (void)timeout_ms;
+    fail("raw spi_read isn't used by the driver");
+    return SPI_RET_BAD_CMD;
+}
+
+#if !SPI_USE_QUADSPI
+int spi_write_read(const uint8_t *write_buff, uint8_t *read_buff, size_t transfer_len,
+                   uint32_t timeout_ms)
+{
+    (void)write_buff, (void)read_buff, (void)transfer_len, (void)timeout_ms;
+    fail("raw spi_write_read isn't used by the driver");
+    return SPI_RET_BAD_CMD;
+}
+#endif
+
+int spi_command_write(const spi_command_t *cmd, const uint8_t *write_buff, size_t write_len,
+                      uint32_t timeout_ms)
+{
+    int ret = spi_command_write_start(cmd, write_buff, write_len, NULL, NULL);
+    return (SPI_RET_OK == ret) ? spi_wait(timeout_ms) : ret;
+}
+
+int spi_command_read(const spi_command_t *cmd, uint8_t *read_buff, size_t read_len,
+                     uint32_t timeout_ms)
+{
+    die_t *d = selected_die();
+    if (transfer.active) fail("command 0x%02x while a transfer is running", cmd->instruction);
+
+    switch (cmd->instruction) {
+        case CMD_READ_ID:
+            bus(2, read_len, 1);
+            for (size_t i = 0; i < read_len; i++) {
+                read_buff[i] = (0 == i) ? MFR_ID_MICRON : (1 == i) ? DEVICE_ID_1G_3V3 : 0;
+            }
+            return SPI_RET_OK;
+        case CMD_GET_FEATURE:
+            if ((1 != cmd->address_len) || (1 != read_len)) fail("malformed get feature");
+            bus(2, 1, 1);
+            if (REG_STATUS == cmd->address) {
+                stats.status_reads++;
+                read_buff[0] = d->status | (die_is_busy(d) ? STATUS_OIP : 0);
+            }
+            else if (REG_BLOCK_LOCK == cmd->address) {
+                read_buff[0] = d->block_lock;
+            }
+            else if (REG_CONFIGURATION == cmd->address) {
+                read_buff[0] = d->configuration;
+            }
+            else {
+                fail("get feature of register 0x%02x", cmd->address);
+            }
+            return SPI_RET_OK;
+        default: {
+            int ret = spi_command_read_start(cmd, read_buff, read_len, NULL, NULL);
+            return (SPI_RET_OK == ret) ? spi_wait(timeout_ms) : ret;
+        }
+    }
+}
+
+int spi_command_write_start(const spi_command_t *cmd, const uint8_t *write_buff, size_t write_len,
+                            spi_callback_t callback, void *context)
+{
+    if (SPI_RET_BUSY == spi_poll()) return SPI_RET_BUSY;
+    if ((CMD_PROGRAM_LOAD != cmd->instruction) && (CMD_PROGRAM_LOAD_RANDOM_DATA != cmd->instruction) &&
+        (CMD_PROGRAM_LOAD_X4 != cmd->instruction) &&
+        (CMD_PROGRAM_LOAD_RANDOM_X4 != cmd->instruction)) {
+        fail("unexpected write command 0x%02x", cmd->instruction);
+    }
+    cache_command(cmd, write_len);
+
+    transfer = (transfer_t){.active = true,
+                            .die = selected,
+                            .instruction = cmd->instruction,
+                            .column = cmd->address,
+                            .write_buff = write_buff,
+                            .len = write_len,
+                            .callback = callback,
+                            .context = context};
+    const double data_start = now_us + (1 + cmd->address_len) * SIM_MT29F_BYTE_US;
+    bus(1 + cmd->address_len, write_len, cmd->data_lines);
+    transfer.end = now_us;
+    now_us = data_start;
+    async_ret = SPI_RET_BUSY;
+    if (SIM_MT29F_SYNC_TRANSFERS) spi_wait(0);
+    return SPI_RET_OK;
+}
+
+int spi_command_read_start(const spi_command_t *cmd, uint8_t *read_buff, size_t read_len,
+                           spi_callback_t callback, void *context)
+{
+    if (SPI_RET_BUSY == spi_poll()) return SPI_RET_BUSY;
+    if ((CMD_READ_FROM_CACHE != cmd->instruction) &&
+        (CMD_READ_FROM_CACHE_X4 != cmd->instruction)) {
+        fail("unexpected read command 0x%02x", cmd->instruction);
+    }
+    if (8 != cmd->dummy_cycles) fail("read from cache with %d dummy cycles", cmd->dummy_cycles);
+    cache_command(cmd, read_len);
+
+    transfer = (transfer_t){.active = true,
+                            .die = selected,
+                            .instruction = cmd->instruction,
+                            .column = cmd->address,
+                            .read_buff = read_buff,
+                            .len = read_len,
+                            .callback = callback,
+                            .context = context};
+    const size_t header_len = 1 + cmd->address_len + cmd->dummy_cycles / 8;
+    const double data_start = now_us + header_len * SIM_MT29F_BYTE_US;
+    bus(header_len, read_len, cmd->data_lines);
+    transfer.end = now_us;
+    now_us = data_start;
+    async_ret = SPI_RET_BUSY;
+    if (SIM_MT29F_SYNC_TRANSFERS) spi_wait(0);
+    return SPI_RET_OK;
+}
+
+int spi_poll(void)
+{
+    now_us += CPU_STEP_US;
+    if (transfer.active && (now_us >= transfer.end)) transfer_complete();
+    return async_ret;
+}
+
+int spi_wait(uint32_t timeout_ms)
+{
+    (void)timeout_ms;
+    if (transfer.active) {
+        if (now_us < transfer.end) now_us = transfer.end;
+        transfer_complete();
+    }
+    return async_ret;
+}
+
+void spi_abort(void)
+{
+    if (!transfer.active) return;
+    transfer.active = false;
+    async_ret = SPI_RET_ABORTED;
+}
+
+void _spi_dma_isr(void)
+{
+}
+
+// sys_time.h
+void sys_time_init(void)
+{
+}
+
+void _sys_time_increment(void)
+{
+}
+
+uint32_t sys_time_get_ms(void)
+{
+    now_us += CPU_STEP_US;
+    return (uint32_t)(now_us / 1000);
+}
+
+uint32_t sys_time_get_elapsed(uint32_t start)
+{
+    return sys_time_get_ms() - start;
+}
+
+bool sys_time_is_elapsed(uint32_t start, uint32_t duration_ms)
+{
+    return sys_time_get_elapsed(start) >= duration_ms;
+}
+
+void sys_time_delay(uint32_t duration_ms)
+{
+    sys_time_delay_us(duration_ms * 1000);
+}
+
+uint32_t sys_time_get_us(void)
+{
+    now_us += CPU_STEP_US;
+    return (uint32_t)now_us;
+}
+
+uint32_t sys_time_get_elapsed_us(uint32_t start)
+{
+    return sys_time_get_us() - start;
+}
+
+void sys_time_delay_us(uint32_t duration_us)
+{
+    now_us += duration_us;
+    stats.delay_us += duration_us;
+}
+
+// private function definitions
+static void fail(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "mt29f model: ");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, " (at %.1f us)\n", now_us);
+    va_end(args);
+    abort();
+}
+
+/// @brief Returns a duration within 5% of us, from a fixed pseudo-random sequence
+static double jitter(double us)
+{
+    jitter_state = jitter_state * 1103515245 + 12345;
+    return us * (0.95 + 0.1 * ((jitter_state >> 16) & 0x7fff) / 0x7fff);
+}
+
+/// @brief Advances the clock by a transaction's time on the bus
+static void bus(size_t single_line_bytes, size_t data_bytes, uint8_t data_lines)
+{
+    const double us = (single_line_bytes + (double)data_bytes / data_lines) * SIM_MT29F_BYTE_US;
+    now_us += us;
+    stats.bus_us += us;
+    stats.bus_bytes += single_line_bytes + data_bytes;
+}
+
+static die_t *selected_die(void)
+{
+    if (NO_DIE == selected) fail("bus access without a chip select");
+    return &dies[selected];
+}
+
+static bool die_is_busy(const die_t *d)
+{
+    return now_us < d->busy_until;
+}
+
+/// @brief Only status reads and resets are allowed while a die is busy
+static void check_idle(const die_t *d, uint8_t instruction)
+{
+    if (die_is_busy(d)) fail("command 0x%02x to busy die %d", instruction, (int)(d - dies));
+}
+
+/// @brief Reads a page of the array, and the ECC status the read reports
+static void load_page(const die_t *d, int die, uint32_t row, uint8_t *out, uint8_t *ecc_out)
+{
+    if (d->pages[row]) {
+        memcpy(out, d->pages[row], PAGE_BYTES);
+    }
+    else {
+        memset(out, 0xff, PAGE_BYTES);
+    }
+
+    const fault_t *fault = find_fault(FAULT_ECC, die, row);
+    *ecc_out = fault ? fault->ecc_status : 0;
+}
+
+static void row_command(uint8_t instruction, uint32_t row)
+{
+    die_t *d = selected_die();
+    check_idle(d, instruction);
+    if (row >= ROWS_PER_DIE) fail("row 0x%06x out of range", row);
+    d->cache_read = false;
+
+    if (CMD_PAGE_READ == instruction) {
+        uint8_t ecc;
+        load_page(d, selected, row, d->data_register, &ecc);
+        memcpy(d->cache, d->data_register, PAGE_BYTES);
+        d->data_register_ecc = ecc;
+        d->status = (d->status & ~STATUS_ECC_MASK) | (ecc << STATUS_ECC_SHIFT);
+        d->busy_until = now_us + jitter(SIM_MT29F_T_READ_US);
+        d->data_register_ready = d->busy_until;
+        d->cache_read = true;
+        d->next_row = row + 1;
+        stats.page_reads++;
+        return;
+    }
+
+    if (!(d->status & STATUS_WEL)) fail("command 0x%02x without write enable", instruction);
+    if (d->block_lock & BLOCK_LOCK_BP_MASK) fail("command 0x%02x to a locked die", instruction);
+    d->status &= ~(STATUS_WEL | STATUS_P_FAIL | STATUS_E_FAIL);
+
+    fault_t *fault;
+    if (CMD_PROGRAM_EXECUTE == instruction) {
+        d->busy_until = now_us + jitter(SIM_MT29F_T_PROGRAM_US);
+        stats.page_programs++;
+        if ((fault = find_fault(FAULT_PROGRAM, selected, row))) {
+            fault->kind = FAULT_NONE;
+            d->status |= STATUS_P_FAIL;
+            return;
+        }
+        if (!d->pages[row]) {
+            d->pages[row] = malloc(PAGE_BYTES);
+            if (!d->pages[row]) fail("out of memory");
+            memset(d->pages[row], 0xff, PAGE_BYTES);
+        }
+        // programming only ever clears bits
+        for (int i = 0; i < PAGE_BYTES; i++) {
+            d->pages[row][i] &= d->cache[i];
+        }
+        return;
+    }
+
+    const uint32_t first = row & ~(SPI_NAND_PAGES_PER_BLOCK - 1);
+    d->busy_until = now_us + jitter(SIM_MT29F_T_ERASE_US);
+    stats.block_erases++;
+    if ((fault = find_fault(FAULT_ERASE, selected, first))) {
+        fault->kind = FAULT_NONE;
+        d->status |= STATUS_E_FAIL;
+        return;
+    }
+    for (uint32_t r = first; r < first + SPI_NAND_PAGES_PER_BLOCK; r++) {
+        free(d->pages[r]);
+        d->pages[r] = NULL;
+        // worn bits come back good after an erase
+        while ((fault = find_fault(FAULT_ECC, selected, r))) fault->kind = FAULT_NONE;
+    }
+    d->erase_counts[first >> BLOCK_SHIFT]++;
+}
+
+/// @brief Checks the framing of a cache read or load
+static void cache_command(const spi_command_t *cmd, size_t len)
+{
+    die_t *d = selected_die();
+    check_idle(d, cmd->instruction);
+
+    const bool x4 = (CMD_READ_FROM_CACHE_X4 == cmd->instruction) ||
+                    (CMD_PROGRAM_LOAD_X4 == cmd->instruction) ||
+                    (CMD_PROGRAM_LOAD_RANDOM_X4 == cmd->instruction);
+    if (cmd->data_lines != (x4 ? 4 : 1)) {
+        fail("command 0x%02x with %d data lines", cmd->instruction, cmd->data_lines);
+    }
+    if (cmd->data_lines > SPI_MAX_DATA_LINES) {
+        fail("%d data lines on a bus with %d", cmd->data_lines, SPI_MAX_DATA_LINES);
+    }
+    if (x4 && !(d->block_lock & BLOCK_LOCK_WP_HOLD_DISABLE)) {
+        fail("x4 command 0x%02x with WP#/HOLD# enabled", cmd->instruction);
+    }
+    if (2 != cmd->address_len) fail("column address of %d bytes", cmd->address_len);
+    if (cmd->address + len > PAGE_BYTES) {
+        fail("%zu bytes from column %u run past the cache", len, cmd->address);
+    }
+}
+
+/// @brief Moves the data of a finished transfer between the host buffer and the cache
+static void move_data(const transfer_t *t)
+{
+    die_t *d = &dies[t->die];
+    if (t->read_buff) {
+        memcpy(t->read_buff, &d->cache[t->column], t->len);
+        return;
+    }
+
+    // program load resets the rest of the cache, program load random data keeps it
+    if ((CMD_PROGRAM_LOAD == t->instruction) || (CMD_PROGRAM_LOAD_X4 == t->instruction)) {
+        memset(d->cache, 0xff, PAGE_BYTES);
+    }
+    memcpy(&d->cache[t->column], t->write_buff, t->len);
+}
+
+static void transfer_complete(void)
+{
+    const transfer_t t = transfer;
+    transfer.active = false;
+    move_data(&t);
+    async_ret = SPI_RET_OK;
+    if (t.callback) t.callback(SPI_RET_OK, t.context);
+}
+
+static fault_t *find_fault(fault_kind_t kind, int die, uint32_t row)
+{
+    for (int i = 0; i < MAX_FAULTS; i++) {
+        if ((kind == faults[i].kind) && (die == faults[i].die) && (row == faults[i].row)) {
+            return &faults[i];
+        }
+    }
+    return NULL;
+}
+
+static void add_fault(fault_kind_t kind, uint32_t row, uint8_t ecc_status)
+{
+    const row_address_t address = {.whole = row};
+    for (int i = 0; i < MAX_FAULTS; i++) {
+        if (FAULT_NONE == faults[i].kind) {
+            faults[i].kind = kind;
+            faults[i].die = SPI_NAND_ROW_DIE(address);
+            faults[i].row = row % ROWS_PER_DIE;
+            faults[i].ecc_status = ecc_status;
+            return;
+        }
+    }
+    fail("too many injected faults");
+}
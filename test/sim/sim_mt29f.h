@@ -0,0 +1,84 @@
+/**
+ * @file		sim_mt29f.h
+ * @author		Andrew Loebs
+ * @brief		Header file of the MT29F model used by the host tests
+ *
+ * Stands in for spi.c and sys_time.c under the spi nand driver: it implements the spi.h and
+ * sys_time.h interfaces on top of a model of SPI_NAND_DIE_COUNT MT29F1G01 chips, one per chip
+ * select (see stm32l4xx_ll_gpio.h in this directory), so spi_nand.c runs unmodified on a host.
+ *
+ * The model decodes the commands spi_nand.c sends -- single byte, feature, row and cache
+ * commands, including the x4 cache commands when the driver is built with SPI_USE_QUADSPI --
+ * keeps each die's page cache, data register and cell array, and reports OIP, WEL, P_FAIL,
+ * E_FAIL and ECC status the way the chip does. Protocol errors (a command to a busy die, two dies
+ * selected at once, chip select released while a transfer is running, an x4 transfer without
+ * WP#/HOLD# disabled, ..) stop the program with a message.
+ *
+ * Time is virtual: bus transfers take SIM_MT29F_BYTE_US per byte on one line, array operations
+ * take their datasheet time with a little deterministic jitter, every clock read costs the CPU a
+ * little, and delays simply advance the clock. Asynchronous transfers complete once the clock has
+ * passed their end, as the DMA would.
+ *
+ */
+
+#ifndef __SIM_MT29F_H
+#define __SIM_MT29F_H
+
+#include <stdint.h>
+
+#include "spi_nand.h"
+
+/// @brief Bus time per byte on a single line, in us (40 MHz SPI clock)
+#define SIM_MT29F_BYTE_US 0.2
+
+/// @brief Completes the data phase of spi_command_*_start before returning, like spi.c does
+/// without SPI_USE_DMA (otherwise it completes in the background, as on DMA)
+#ifndef SIM_MT29F_SYNC_TRANSFERS
+#define SIM_MT29F_SYNC_TRANSFERS 0
+#endif
+
+/// @brief Nominal array operation times, in us
+#define SIM_MT29F_T_READ_US      45.0
+#define SIM_MT29F_T_READ_CACHE_US 5.0 // tRCBSY: data register -> cache during a cache read
+#define SIM_MT29F_T_PROGRAM_US   220.0
+#define SIM_MT29F_T_ERASE_US     2500.0
+
+/// @brief Counters of the model, for the benchmarks
+typedef struct {
+    /// status register reads
+    uint32_t status_reads;
+    /// cell array operations
+    uint32_t page_reads;
+    uint32_t page_programs;
+    uint32_t block_erases;
+    /// bytes moved over the bus, and the time the bus spent moving them (us)
+    uint32_t bus_bytes;
+    double bus_us;
+    /// time spent in the delay functions (us)
+    double delay_us;
+} sim_mt29f_stats_t;
+
+/// @brief Erases every block, clears the injected faults and stats, and sets the clock to 0
+void sim_mt29f_reset(void);
+
+/// @brief Returns the virtual time, in us
+double sim_mt29f_now_us(void);
+
+void sim_mt29f_get_stats(sim_mt29f_stats_t *stats_out);
+void sim_mt29f_clear_stats(void);
+
+/// @brief Makes every read of a row report an ECC status (e.g. 0b011: corrected, refresh advised)
+/// until its block is erased
+/// @note row is a driver row address (row_address_t.whole) -- its block selects the die
+void sim_mt29f_inject_ecc(uint32_t row, uint8_t ecc_status);
+
+/// @brief Makes the next program of a row fail (P_FAIL), leaving the page as it was
+void sim_mt29f_inject_program_fail(uint32_t row);
+
+/// @brief Makes the next erase of a block fail (E_FAIL), leaving the block as it was
+void sim_mt29f_inject_erase_fail(uint32_t block);
+
+/// @brief Returns the number of times a block has been erased since the last reset
+uint32_t sim_mt29f_erase_count(uint32_t block);
+
+#endif // __SIM_MT29F_H
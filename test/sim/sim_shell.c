@@ -0,0 +1,46 @@
+/**
+ * @file		sim_shell.c
+ * @author		Andrew Loebs
+ * @brief		Host stand-in for the shell output used by the firmware modules
+ *
+ * The modules report mounts and failures to the shell. Under test, those lines are dropped unless
+ * SIM_SHELL_ECHO is set, in which case they go to stdout.
+ *
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "shell.h"
+
+// defines
+#ifndef SIM_SHELL_ECHO
+#define SIM_SHELL_ECHO 0
+#endif
+
+// shell.h
+void shell_printf(const char *format, ...)
+{
+#if SIM_SHELL_ECHO
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+#else
+    (void)format;
+#endif
+}
+
+void shell_printf_line(const char *format, ...)
+{
+#if SIM_SHELL_ECHO
+    va_list args;
+    va_start(args, format);
+    printf("  shell: ");
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+#else
+    (void)format;
+#endif
+}
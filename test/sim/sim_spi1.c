@@ -0,0 +1,256 @@
+/**
+ * @file		sim_spi1.c
+ * @author		Andrew Loebs
+ * @brief		Implementation file of the SPI1 register model used by the host tests
+ *
+ */
+
+#include "sim_spi1.h"
+
+#include <string.h>
+
+#include "st/ll/stm32l4xx_ll_gpio.h"
+#include "st/ll/stm32l4xx_ll_spi.h"
+#include "sys_time.h"
+
+// defines
+#define FIFO_SIZE 4
+#define TXE_LEVEL (FIFO_SIZE / 2) // txe while the tx fifo holds at most this many
+
+// private types
+typedef struct {
+    uint8_t data[FIFO_SIZE];
+    uint32_t head;
+    uint32_t level;
+} fifo_t;
+
+// private function prototypes
+static void step(void);
+static bool fifo_push(fifo_t *fifo, uint8_t data);
+static bool fifo_pop(fifo_t *fifo, uint8_t *data_out);
+
+// private variables
+static fifo_t tx_fifo;
+static fifo_t rx_fifo;
+static bool shifting; // a byte is in the shift register
+static uint8_t shift_register;
+static uint32_t shift_polls;
+static uint32_t polls_per_byte;
+static uint32_t interruption_polls;
+static uint32_t polls;
+static uint32_t bytes_to_stall;
+static bool threshold_quarter;
+static bool ovr;
+
+static uint8_t *mosi_log;
+static const uint8_t *miso;
+static size_t peer_len;
+static size_t peer_index;
+
+static double now_us;
+static sim_spi1_stats_t stats;
+
+// public variables (the peripheral of stm32l4xx_ll_spi.h, and the ports of stm32l4xx_ll_gpio.h)
+SPI_TypeDef sim_spi1 = {'1'};
+GPIO_TypeDef sim_gpioa = {'A'};
+GPIO_TypeDef sim_gpiob = {'B'};
+
+// public function definitions
+void sim_spi1_reset(void)
+{
+    memset(&tx_fifo, 0, sizeof(tx_fifo));
+    memset(&rx_fifo, 0, sizeof(rx_fifo));
+    shifting = false;
+    shift_polls = 0;
+    polls_per_byte = SIM_SPI1_POLLS_PER_BYTE;
+    interruption_polls = 0;
+    polls = 0;
+    bytes_to_stall = SIM_SPI1_NEVER;
+    threshold_quarter = true;
+    ovr = false;
+    sim_spi1_connect(NULL, NULL, 0);
+    now_us = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+void sim_spi1_connect(uint8_t *mosi_log_in, const uint8_t *miso_in, size_t len)
+{
+    mosi_log = mosi_log_in;
+    miso = miso_in;
+    peer_len = len;
+    peer_index = 0;
+}
+
+void sim_spi1_set_speed(uint32_t polls_per_byte_in)
+{
+    polls_per_byte = polls_per_byte_in;
+}
+
+void sim_spi1_set_interruptions(uint32_t every_polls)
+{
+    interruption_polls = every_polls;
+}
+
+void sim_spi1_stall_after(uint32_t bytes)
+{
+    bytes_to_stall = bytes;
+}
+
+void sim_spi1_get_stats(sim_spi1_stats_t *stats_out)
+{
+    *stats_out = stats;
+}
+
+uint32_t sim_spi1_rx_level(void)
+{
+    return rx_fifo.level;
+}
+
+bool sim_spi1_rx_threshold_quarter(void)
+{
+    return threshold_quarter;
+}
+
+bool sim_spi1_ovr(void)
+{
+    return ovr;
+}
+
+// stm32l4xx_ll_spi.h
+uint32_t sim_spi_read_flag(SPI_TypeDef *spi, int flag)
+{
+    (void)spi;
+    step();
+    if (interruption_polls && (0 == (++polls % interruption_polls))) {
+        while (shifting || tx_fifo.level) {
+            if (!bytes_to_stall) break;
+            step();
+        }
+    }
+    switch (flag) {
+        case SIM_SPI_FLAG_TXE:
+            return tx_fifo.level <= TXE_LEVEL;
+        case SIM_SPI_FLAG_RXNE:
+            return rx_fifo.level >= (threshold_quarter ? 1 : 2);
+        default:
+            return shifting || tx_fifo.level;
+    }
+}
+
+void sim_spi_write_dr(SPI_TypeDef *spi, uint16_t data, int bytes)
+{
+    (void)spi;
+    if (2 == bytes) {
+        stats.writes16++;
+    }
+    else {
+        stats.writes8++;
+    }
+    for (int i = 0; i < bytes; i++) {
+        if (!fifo_push(&tx_fifo, data >> (8 * i))) stats.misuses++;
+    }
+}
+
+uint16_t sim_spi_read_dr(SPI_TypeDef *spi, int bytes)
+{
+    (void)spi;
+    if (2 == bytes) {
+        stats.reads16++;
+    }
+    else {
+        stats.reads8++;
+    }
+    uint16_t data = 0;
+    for (int i = 0; i < bytes; i++) {
+        uint8_t byte = 0;
+        if (!fifo_pop(&rx_fifo, &byte)) stats.misuses++;
+        data |= byte << (8 * i);
+    }
+    return data;
+}
+
+void sim_spi_set_rx_threshold(SPI_TypeDef *spi, uint32_t threshold)
+{
+    (void)spi;
+    threshold_quarter = (LL_SPI_RX_FIFO_TH_QUARTER == threshold);
+}
+
+void sim_spi_clear_ovr(SPI_TypeDef *spi)
+{
+    (void)spi;
+    ovr = false;
+}
+
+// stm32l4xx_ll_gpio.h -- spi.c only sets its pins up
+void sim_gpio_write(GPIO_TypeDef *port, uint32_t pin, int level)
+{
+    (void)port, (void)pin, (void)level;
+}
+
+// sys_time.h
+uint32_t sys_time_get_ms(void)
+{
+    now_us += SIM_SPI1_POLL_US;
+    return (uint32_t)(now_us / 1000);
+}
+
+uint32_t sys_time_get_elapsed(uint32_t start)
+{
+    return sys_time_get_ms() - start;
+}
+
+bool sys_time_is_elapsed(uint32_t start, uint32_t duration_ms)
+{
+    return sys_time_get_elapsed(start) >= duration_ms;
+}
+
+// private function definitions
+/// @brief Advances the bus by one flag read
+static void step(void)
+{
+    now_us += SIM_SPI1_POLL_US;
+    if (!bytes_to_stall) return;
+
+    if (!shifting) {
+        if (!fifo_pop(&tx_fifo, &shift_register)) return;
+        shifting = true;
+        shift_polls = 0;
+        stats.bursts++;
+    }
+    if (++shift_polls < polls_per_byte) return;
+
+    // the byte is out, and the peer's answer is in
+    uint8_t in = 0xff;
+    if (peer_index < peer_len) {
+        if (mosi_log) mosi_log[peer_index] = shift_register;
+        if (miso) in = miso[peer_index];
+        peer_index++;
+    }
+    stats.bytes++;
+    if (SIM_SPI1_NEVER != bytes_to_stall) bytes_to_stall--;
+    if (!fifo_push(&rx_fifo, in)) {
+        ovr = true;
+        stats.overruns++;
+    }
+
+    // the next byte follows without a gap
+    shifting = fifo_pop(&tx_fifo, &shift_register);
+    shift_polls = 0;
+}
+
+static bool fifo_push(fifo_t *fifo, uint8_t data)
+{
+    if (FIFO_SIZE == fifo->level) return false;
+    fifo->data[(fifo->head + fifo->level) % FIFO_SIZE] = data;
+    fifo->level++;
+    return true;
+}
+
+static bool fifo_pop(fifo_t *fifo, uint8_t *data_out)
+{
+    if (!fifo->level) return false;
+    *data_out = fifo->data[fifo->head];
+    fifo->head = (fifo->head + 1) % FIFO_SIZE;
+    fifo->level--;
+    return true;
+}
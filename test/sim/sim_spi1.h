@@ -0,0 +1,84 @@
+/**
+ * @file		sim_spi1.h
+ * @author		Andrew Loebs
+ * @brief		Header file of the SPI1 register model used by the host tests
+ *
+ * Stands in for the SPI1 peripheral under spi.c (see stm32l4xx_ll_spi.h in this directory), and
+ * for sys_time.c, so the driver's polled transfers run unmodified on a host. The model keeps the
+ * four byte tx and rx fifos of the STM32L4, with TXE while the tx fifo is at most half full and
+ * RXNE on one or two bytes per the rx fifo threshold. A 16 bit data register access moves two
+ * bytes, low byte first; reading bytes that aren't there, or writing to a full tx fifo, is
+ * counted as a misuse. A byte arriving at a full rx fifo is lost and sets OVR, as on the chip.
+ *
+ * Time is virtual and counted in flag reads: the byte in the shift register is done after
+ * SIM_SPI1_POLLS_PER_BYTE of them (or whatever sim_spi1_set_speed() says), and the next one is
+ * loaded straight from the tx fifo if there is one. Interruptions let the bus run on unattended
+ * until the tx fifo is empty, so whatever the driver has written ahead lands in the rx fifo at
+ * once. Each flag read, and each clock read, costs
+ * SIM_SPI1_POLL_US of the millisecond clock.
+ *
+ */
+
+#ifndef __SIM_SPI1_H
+#define __SIM_SPI1_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief Flag reads per byte on the wire, by default
+#define SIM_SPI1_POLLS_PER_BYTE 8
+
+/// @brief Time per flag or clock read, in us
+#define SIM_SPI1_POLL_US 0.05
+
+#define SIM_SPI1_NEVER UINT32_MAX
+
+/// @brief Counters of the model
+typedef struct {
+    /// bytes clocked out and in
+    uint32_t bytes;
+    /// times the bus started from idle: a transfer sent back to back is one burst
+    uint32_t bursts;
+    /// data register accesses
+    uint32_t writes8;
+    uint32_t writes16;
+    uint32_t reads8;
+    uint32_t reads16;
+    /// bytes lost to a full rx fifo
+    uint32_t overruns;
+    /// writes to a full tx fifo, reads of an empty rx fifo
+    uint32_t misuses;
+} sim_spi1_stats_t;
+
+/// @brief Empties the fifos, clears the counters and the flag and sets the bus running at the
+/// default speed
+void sim_spi1_reset(void);
+
+/// @brief Logs the bytes sent to mosi_log and answers with those of miso, for len bytes --
+/// bytes beyond that aren't logged, and are answered with 0xff
+void sim_spi1_connect(uint8_t *mosi_log, const uint8_t *miso, size_t len);
+
+/// @brief Sets the flag reads per byte on the wire
+void sim_spi1_set_speed(uint32_t polls_per_byte);
+
+/// @brief Takes the CPU away every this many flag reads (0 for never) for as long as the bus
+/// takes to empty the tx fifo, as a long interrupt would
+void sim_spi1_set_interruptions(uint32_t every_polls);
+
+/// @brief Stops the bus clock once this many more bytes have gone out (SIM_SPI1_NEVER to run
+/// freely): nothing moves in or out of the fifos after that
+void sim_spi1_stall_after(uint32_t bytes);
+
+void sim_spi1_get_stats(sim_spi1_stats_t *stats_out);
+
+/// @brief Bytes waiting in the rx fifo
+uint32_t sim_spi1_rx_level(void);
+
+/// @brief Whether RXNE is set on a single byte (the threshold spi.c leaves between transfers)
+bool sim_spi1_rx_threshold_quarter(void);
+
+/// @brief Whether a byte was lost to a full rx fifo since the flag was last cleared
+bool sim_spi1_ovr(void);
+
+#endif // __SIM_SPI1_H
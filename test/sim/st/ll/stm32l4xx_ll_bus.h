@@ -0,0 +1,33 @@
+/**
+ * @file		stm32l4xx_ll_bus.h
+ * @author		Andrew Loebs
+ * @brief		Host stand-in for the ST bus header -- the clocks are always on
+ *
+ */
+
+#ifndef __STM32L4xx_LL_BUS_H
+#define __STM32L4xx_LL_BUS_H
+
+#include <stdint.h>
+
+#define LL_AHB2_GRP1_PERIPH_GPIOA 0x00000001
+#define LL_AHB2_GRP1_PERIPH_GPIOB 0x00000002
+#define LL_APB2_GRP1_PERIPH_SPI1  0x00001000
+
+static inline uint32_t LL_AHB2_GRP1_IsEnabledClock(uint32_t periphs)
+{
+    (void)periphs;
+    return 1;
+}
+
+static inline void LL_AHB2_GRP1_EnableClock(uint32_t periphs)
+{
+    (void)periphs;
+}
+
+static inline void LL_APB2_GRP1_EnableClock(uint32_t periphs)
+{
+    (void)periphs;
+}
+
+#endif // __STM32L4xx_LL_BUS_H
@@ -0,0 +1,81 @@
+/**
+ * @file		stm32l4xx_ll_gpio.h
+ * @author		Andrew Loebs
+ * @brief		Host stand-in for the ST GPIO header
+ *
+ * Only output levels mean anything: they go to the flash model (sim_mt29f.c), which treats the
+ * chip select pins of spi_nand.c as the chip selects of its dies (the SPI1 model, sim_spi1.c,
+ * ignores them). Pin setup is ignored.
+ *
+ */
+
+#ifndef __STM32L4xx_LL_GPIO_H
+#define __STM32L4xx_LL_GPIO_H
+
+#include <stdint.h>
+
+typedef struct {
+    char name; // 'A', 'B', ..
+} GPIO_TypeDef;
+
+extern GPIO_TypeDef sim_gpioa;
+extern GPIO_TypeDef sim_gpiob;
+#define GPIOA (&sim_gpioa)
+#define GPIOB (&sim_gpiob)
+
+#define LL_GPIO_PIN_0  0x0001
+#define LL_GPIO_PIN_1  0x0002
+#define LL_GPIO_PIN_4  0x0010
+#define LL_GPIO_PIN_6  0x0040
+#define LL_GPIO_PIN_7  0x0080
+#define LL_GPIO_PIN_8  0x0100
+#define LL_GPIO_PIN_11 0x0800
+#define LL_GPIO_PIN_12 0x1000
+
+#define LL_GPIO_MODE_OUTPUT          1
+#define LL_GPIO_MODE_ALTERNATE       2
+#define LL_GPIO_AF_5                 5
+#define LL_GPIO_OUTPUT_PUSHPULL      0
+#define LL_GPIO_SPEED_FREQ_VERY_HIGH 3
+#define LL_GPIO_PULL_NO              0
+#define LL_GPIO_PULL_DOWN            2
+
+/// @brief Drives a pin of the simulated MCU (see sim_mt29f.c)
+void sim_gpio_write(GPIO_TypeDef *port, uint32_t pin, int level);
+
+static inline void LL_GPIO_SetOutputPin(GPIO_TypeDef *port, uint32_t pin)
+{
+    sim_gpio_write(port, pin, 1);
+}
+
+static inline void LL_GPIO_ResetOutputPin(GPIO_TypeDef *port, uint32_t pin)
+{
+    sim_gpio_write(port, pin, 0);
+}
+
+static inline void LL_GPIO_SetPinMode(GPIO_TypeDef *port, uint32_t pin, uint32_t mode)
+{
+    (void)port, (void)pin, (void)mode;
+}
+
+static inline void LL_GPIO_SetAFPin_0_7(GPIO_TypeDef *port, uint32_t pin, uint32_t alternate)
+{
+    (void)port, (void)pin, (void)alternate;
+}
+
+static inline void LL_GPIO_SetPinOutputType(GPIO_TypeDef *port, uint32_t pin, uint32_t type)
+{
+    (void)port, (void)pin, (void)type;
+}
+
+static inline void LL_GPIO_SetPinSpeed(GPIO_TypeDef *port, uint32_t pin, uint32_t speed)
+{
+    (void)port, (void)pin, (void)speed;
+}
+
+static inline void LL_GPIO_SetPinPull(GPIO_TypeDef *port, uint32_t pin, uint32_t pull)
+{
+    (void)port, (void)pin, (void)pull;
+}
+
+#endif // __STM32L4xx_LL_GPIO_H
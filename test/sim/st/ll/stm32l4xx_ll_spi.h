@@ -0,0 +1,130 @@
+/**
+ * @file		stm32l4xx_ll_spi.h
+ * @author		Andrew Loebs
+ * @brief		Host stand-in for the ST SPI header
+ *
+ * The flags and the data register go to the register model of SPI1 (sim_spi1.c): each flag read
+ * is a step of its clock, and data register accesses of 8 or 16 bits move one or two bytes through
+ * its fifos. Of the setup, only the rx fifo threshold means anything.
+ *
+ */
+
+#ifndef __STM32L4xx_LL_SPI_H
+#define __STM32L4xx_LL_SPI_H
+
+#include <stdint.h>
+
+typedef struct {
+    char name;
+} SPI_TypeDef;
+
+extern SPI_TypeDef sim_spi1;
+#define SPI1 (&sim_spi1)
+
+#define LL_SPI_BAUDRATEPRESCALER_DIV2 0x0000
+#define LL_SPI_FULL_DUPLEX            0x0000
+#define LL_SPI_POLARITY_LOW           0x0000
+#define LL_SPI_PHASE_1EDGE            0x0000
+#define LL_SPI_DATAWIDTH_8BIT         0x0700
+#define LL_SPI_NSS_SOFT               0x0200
+#define LL_SPI_RX_FIFO_TH_HALF        0x0000 // rxne on two bytes
+#define LL_SPI_RX_FIFO_TH_QUARTER     0x1000 // rxne on one byte
+#define LL_SPI_MODE_MASTER            0x0104
+
+#define SIM_SPI_FLAG_TXE  0
+#define SIM_SPI_FLAG_RXNE 1
+#define SIM_SPI_FLAG_BSY  2
+
+/// @brief The register model behind the functions below (see sim_spi1.c)
+uint32_t sim_spi_read_flag(SPI_TypeDef *spi, int flag);
+void sim_spi_write_dr(SPI_TypeDef *spi, uint16_t data, int bytes);
+uint16_t sim_spi_read_dr(SPI_TypeDef *spi, int bytes);
+void sim_spi_set_rx_threshold(SPI_TypeDef *spi, uint32_t threshold);
+void sim_spi_clear_ovr(SPI_TypeDef *spi);
+
+static inline void LL_SPI_SetBaudRatePrescaler(SPI_TypeDef *spi, uint32_t prescaler)
+{
+    (void)spi, (void)prescaler;
+}
+
+static inline void LL_SPI_SetTransferDirection(SPI_TypeDef *spi, uint32_t direction)
+{
+    (void)spi, (void)direction;
+}
+
+static inline void LL_SPI_SetClockPolarity(SPI_TypeDef *spi, uint32_t polarity)
+{
+    (void)spi, (void)polarity;
+}
+
+static inline void LL_SPI_SetClockPhase(SPI_TypeDef *spi, uint32_t phase)
+{
+    (void)spi, (void)phase;
+}
+
+static inline void LL_SPI_SetDataWidth(SPI_TypeDef *spi, uint32_t width)
+{
+    (void)spi, (void)width;
+}
+
+static inline void LL_SPI_SetNSSMode(SPI_TypeDef *spi, uint32_t nss)
+{
+    (void)spi, (void)nss;
+}
+
+static inline void LL_SPI_SetMode(SPI_TypeDef *spi, uint32_t mode)
+{
+    (void)spi, (void)mode;
+}
+
+static inline void LL_SPI_Enable(SPI_TypeDef *spi)
+{
+    (void)spi;
+}
+
+static inline void LL_SPI_SetRxFIFOThreshold(SPI_TypeDef *spi, uint32_t threshold)
+{
+    sim_spi_set_rx_threshold(spi, threshold);
+}
+
+static inline uint32_t LL_SPI_IsActiveFlag_TXE(SPI_TypeDef *spi)
+{
+    return sim_spi_read_flag(spi, SIM_SPI_FLAG_TXE);
+}
+
+static inline uint32_t LL_SPI_IsActiveFlag_RXNE(SPI_TypeDef *spi)
+{
+    return sim_spi_read_flag(spi, SIM_SPI_FLAG_RXNE);
+}
+
+static inline uint32_t LL_SPI_IsActiveFlag_BSY(SPI_TypeDef *spi)
+{
+    return sim_spi_read_flag(spi, SIM_SPI_FLAG_BSY);
+}
+
+static inline void LL_SPI_ClearFlag_OVR(SPI_TypeDef *spi)
+{
+    sim_spi_clear_ovr(spi);
+}
+
+static inline void LL_SPI_TransmitData8(SPI_TypeDef *spi, uint8_t data)
+{
+    sim_spi_write_dr(spi, data, 1);
+}
+
+static inline void LL_SPI_TransmitData16(SPI_TypeDef *spi, uint16_t data)
+{
+    sim_spi_write_dr(spi, data, 2);
+}
+
+static inline uint8_t LL_SPI_ReceiveData8(SPI_TypeDef *spi)
+{
+    return (uint8_t)sim_spi_read_dr(spi, 1);
+}
+
+static inline uint16_t LL_SPI_ReceiveData16(SPI_TypeDef *spi)
+{
+    return sim_spi_read_dr(spi, 2);
+}
+
+#endif // __STM32L4xx_LL_SPI_H
@@ -0,0 +1,32 @@
+/**
+ * @file		test.h
+ * @author		Andrew Loebs
+ * @brief		Minimal helpers shared by the host tests
+ *
+ * Each test is a function returning true on success; CHECK() reports the first failed condition
+ * and fails the test. RUN() runs one test and counts the failures for main() to return.
+ *
+ */
+
+#ifndef __TEST_H
+#define __TEST_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#define CHECK(cond)                                                                  \
+    do {                                                                             \
+        if (!(cond)) {                                                               \
+            printf("  %s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);        \
+            return false;                                                            \
+        }                                                                            \
+    } while (0)
+
+#define RUN(test, failures)                                                          \
+    do {                                                                             \
+        const bool passed = test();                                                  \
+        printf("%s %s\n", passed ? "pass" : "FAIL", #test);                          \
+        if (!passed) (failures)++;                                                   \
+    } while (0)
+
+#endif // __TEST_H
@@ -0,0 +1,237 @@
+/**
+ * @file		test_compress.c
+ * @author		Andrew Loebs
+ * @brief		Host tests of the ftl compression module
+ *
+ * Runs ftl_compress on a dhara map kept in a RAM image of the chip (nand_image.c).
+ *
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/dhara/bytes.h"
+#include "../src/dhara/map.h"
+#include "../src/dhara/nand_image.h"
+#include "../src/modules/ftl_compress.h"
+#include "test.h"
+
+// defines
+#define PAGE_SIZE     2048
+#define NUM_BLOCKS    128
+#define GC_RATIO      4
+#define RANDOM_ROUNDS 20000
+#define RANDOM_SPAN   2000 // logical sectors touched by the random workload
+// dhara sector of the first group's pack page (see group_sector() in ftl_compress.c)
+#define PACK_SECTOR   ((NUM_BLOCKS << 6) * FTL_COMPRESS_OVERCOMMIT)
+
+// private function prototypes
+static bool test_rewrite_packed_slot(void);
+static bool test_rewrite_changes_size(void);
+static bool test_random_workload(void);
+static bool test_damaged_slot_table(void);
+
+static void open_volume(bool blank);
+static void fill(uint8_t *data, uint32_t sector, uint32_t version);
+static bool read_matches(uint32_t sector, uint32_t version);
+
+// private variables
+static struct dhara_nand nand = {
+    .log2_page_size = 11,
+    .log2_ppb = 6,
+    .num_blocks = NUM_BLOCKS,
+};
+static dhara_nand_image_t image;
+static struct dhara_map map;
+static uint8_t *image_buffer;
+static uint8_t page_buffer[PAGE_SIZE];
+static uint8_t data[PAGE_SIZE];
+static uint8_t readback[PAGE_SIZE];
+// version last written to each sector of the random workload (0: trimmed / never written)
+static uint32_t versions[RANDOM_SPAN];
+
+// public function definitions
+int main(void)
+{
+    image_buffer = malloc(dhara_nand_image_size(&nand));
+    if (!image_buffer) return 1;
+    dhara_nand_image_init_ram(&nand, &image, image_buffer);
+
+    int failures = 0;
+    RUN(test_rewrite_packed_slot, failures);
+    RUN(test_rewrite_changes_size, failures);
+    RUN(test_random_workload, failures);
+    RUN(test_damaged_slot_table, failures);
+
+    free(image_buffer);
+    return failures ? 1 : 0;
+}
+
+// private function definitions
+/// @brief Rewrites a packed sector while other sectors of its pack page follow it
+static bool test_rewrite_packed_slot(void)
+{
+    dhara_error_t err;
+    open_volume(true);
+
+    for (uint32_t sector = 0; sector < 2; sector++) {
+        fill(data, sector, 1);
+        CHECK(0 == ftl_compress_write(sector, data, 1, &err));
+    }
+    fill(data, 0, 2);
+    CHECK(0 == ftl_compress_write(0, data, 1, &err));
+    fill(data, 2, 1);
+    CHECK(0 == ftl_compress_write(2, data, 1, &err));
+
+    CHECK(read_matches(0, 2));
+    CHECK(read_matches(1, 1));
+    CHECK(read_matches(2, 1));
+
+    // and the same from flash, after a remount
+    CHECK(0 == dhara_map_sync(&map, &err));
+    open_volume(false);
+    CHECK(read_matches(0, 2));
+    CHECK(read_matches(1, 1));
+    CHECK(read_matches(2, 1));
+    return true;
+}
+
+/// @brief Moves every sector of a group through packed, raw and blank images of varying size
+static bool test_rewrite_changes_size(void)
+{
+    dhara_error_t err;
+    open_volume(true);
+
+    uint32_t written[FTL_COMPRESS_SECTORS_PER_PAGE] = {0};
+    for (uint32_t round = 1; round <= 64; round++) {
+        const uint32_t sector = (round * 3) % FTL_COMPRESS_SECTORS_PER_PAGE;
+        fill(data, sector, round);
+        CHECK(0 == ftl_compress_write(sector, data, 1, &err));
+        written[sector] = round;
+
+        for (uint32_t s = 0; s < FTL_COMPRESS_SECTORS_PER_PAGE; s++) {
+            CHECK(read_matches(s, written[s]));
+        }
+    }
+    return true;
+}
+
+/// @brief Random writes, reads, trims, syncs and remounts, checked against the expected contents
+static bool test_random_workload(void)
+{
+    dhara_error_t err;
+    open_volume(true);
+    memset(versions, 0, sizeof(versions));
+
+    srand(1);
+    for (uint32_t round = 0; round < RANDOM_ROUNDS; round++) {
+        const int op = rand() % 100;
+        const uint32_t sector = rand() % RANDOM_SPAN;
+
+        if (op < 50) {
+            const uint32_t version = 1 + rand() % 1000;
+            fill(data, sector, version);
+            CHECK(0 == ftl_compress_write(sector, data, 1, &err));
+            versions[sector] = version;
+        }
+        else if (op < 85) {
+            CHECK(read_matches(sector, versions[sector]));
+        }
+        else if (op < 90) {
+            CHECK(0 == ftl_compress_trim(sector, &err));
+            versions[sector] = 0;
+        }
+        else if (op < 97) {
+            CHECK(0 == dhara_map_sync(&map, &err));
+        }
+        else {
+            CHECK(0 == dhara_map_sync(&map, &err));
+            open_volume(false);
+        }
+    }
+
+    for (uint32_t sector = 0; sector < RANDOM_SPAN; sector++) {
+        CHECK(read_matches(sector, versions[sector]));
+    }
+    return true;
+}
+
+/// @brief A pack page whose slot table points outside the page fails its reads with DHARA_E_ECC,
+/// leaving the other groups readable
+static bool test_damaged_slot_table(void)
+{
+    dhara_error_t err;
+    open_volume(true);
+
+    for (uint32_t sector = 0; sector < 2 * FTL_COMPRESS_SECTORS_PER_PAGE; sector++) {
+        fill(data, sector, 1);
+        CHECK(0 == ftl_compress_write(sector, data, 1, &err));
+    }
+    CHECK(0 == dhara_map_read(&map, PACK_SECTOR, readback, &err));
+
+    // slot 1 past the end of the page, then overlapping the slot table, then too long
+    static const uint16_t damage[][2] = {{PAGE_SIZE, 16}, {2, 16}, {100, PAGE_SIZE}};
+    for (size_t i = 0; i < sizeof(damage) / sizeof(damage[0]); i++) {
+        memcpy(data, readback, PAGE_SIZE);
+        dhara_w16(&data[4], damage[i][0]);
+        dhara_w16(&data[6], damage[i][1]);
+        CHECK(0 == dhara_map_write(&map, PACK_SECTOR, data, &err));
+        ftl_compress_init(&map); // drop the buffered pack page
+
+        err = DHARA_E_NONE;
+        CHECK(0 != ftl_compress_read(1, data, &err));
+        CHECK(DHARA_E_ECC == err);
+        CHECK(0 != ftl_compress_read(0, data, &err));
+        for (uint32_t sector = FTL_COMPRESS_SECTORS_PER_PAGE;
+             sector < 2 * FTL_COMPRESS_SECTORS_PER_PAGE; sector++) {
+            CHECK(read_matches(sector, 1));
+        }
+    }
+    return true;
+}
+
+/// @brief Mounts the map (erasing the image first if blank) and attaches the compression layer
+static void open_volume(bool blank)
+{
+    dhara_error_t err;
+    if (blank) dhara_nand_image_format(&nand);
+    dhara_map_init(&map, &nand, page_buffer, GC_RATIO);
+    dhara_map_resume(&map, &err);
+    ftl_compress_init(&map);
+}
+
+/// @brief Fills data with the image of a version of a sector
+/// @note Versions cycle through text-like (compressible) data, random (incompressible) data and
+/// blank sectors; version 0 is a sector that was never written.
+static void fill(uint8_t *data, uint32_t sector, uint32_t version)
+{
+    static const char text[] = "abcdefghij0123456789\r\n";
+
+    if (!version || (3 == version % 4)) {
+        memset(data, 0xff, PAGE_SIZE);
+        return;
+    }
+
+    uint32_t state = sector * 7919 + version;
+    for (int i = 0; i < PAGE_SIZE; i++) {
+        state = state * 1103515245 + 12345;
+        const uint32_t r = state >> 16;
+        if (0 == version % 4) {
+            data[i] = (uint8_t)r;
+        }
+        else {
+            // varies in length from version to version
+            data[i] = text[(i * (version % 4) + r % (1 + version % 3)) % (sizeof(text) - 1)];
+        }
+    }
+}
+
+/// @brief Returns true if the sector reads back as the given version
+static bool read_matches(uint32_t sector, uint32_t version)
+{
+    dhara_error_t err;
+    fill(data, sector, version);
+    if (ftl_compress_read(sector, readback, &err)) return false;
+    return 0 == memcmp(data, readback, PAGE_SIZE);
+}
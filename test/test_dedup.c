@@ -0,0 +1,252 @@
+/**
+ * @file		test_dedup.c
+ * @author		Andrew Loebs
+ * @brief		Host tests of dhara write deduplication (DHARA_DEDUP_ENTRIES)
+ *
+ * Runs a dhara map on a RAM image of a small chip (nand_image.c), built with the deduplication
+ * settings of the firmware, and counts the pages programmed to tell a skipped write from a written
+ * one.
+ *
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/dhara/crc.h"
+#include "../src/dhara/map.h"
+#include "../src/dhara/nand_image.h"
+#include "test.h"
+
+// defines
+#define LOG2_PAGE_SIZE 9
+#define PAGE_SIZE      (1 << LOG2_PAGE_SIZE)
+#define LOG2_PPB       4
+#define NUM_BLOCKS     64
+#define GC_RATIO       4
+#define SECTOR         5
+#define COLLISION_AT   100 // where the collision pattern goes in the page
+
+#if !DHARA_DEDUP_ENTRIES || !DHARA_DEDUP_VERIFY
+#error "test_dedup needs DHARA_DEDUP_ENTRIES and DHARA_DEDUP_VERIFY"
+#endif
+
+// private function prototypes
+static bool test_identical_rewrite_skipped(void);
+static bool test_collision_written(void);
+static bool test_trim_forgets(void);
+static bool test_gc_forgets(void);
+
+static bool open_volume(void);
+static bool write_counted(uint32_t sector, const uint8_t *page, bool *written);
+static bool read_matches(uint32_t sector, const uint8_t *page);
+static uint32_t sector_page(uint32_t sector);
+static void fill(uint8_t *page, uint32_t sector, uint32_t version);
+static int count_prog(const struct dhara_nand *n, dhara_page_t p, const uint8_t *page,
+                      dhara_error_t *err);
+static int count_copy(const struct dhara_nand *n, dhara_page_t src, dhara_page_t dst,
+                      dhara_error_t *err);
+
+// private variables
+// the image's ops, with programs and copies counted
+static struct dhara_nand_ops counting_ops;
+static uint32_t programs;
+static struct dhara_nand nand = {
+    .log2_page_size = LOG2_PAGE_SIZE,
+    .log2_ppb = LOG2_PPB,
+    .num_blocks = NUM_BLOCKS,
+};
+static dhara_nand_image_t image;
+static struct dhara_map map;
+static uint8_t page_buffer[PAGE_SIZE];
+static uint8_t data[PAGE_SIZE];
+static uint8_t readback[PAGE_SIZE];
+
+// public function definitions
+int main(void)
+{
+    uint8_t *image_buffer = malloc(dhara_nand_image_size(&nand));
+    if (!image_buffer) return 1;
+    dhara_nand_image_init_ram(&nand, &image, image_buffer);
+    counting_ops = *nand.ops;
+    counting_ops.prog = count_prog;
+    counting_ops.copy = count_copy;
+    nand.ops = &counting_ops;
+
+    int failures = 0;
+    RUN(test_identical_rewrite_skipped, failures);
+    RUN(test_collision_written, failures);
+    RUN(test_trim_forgets, failures);
+    RUN(test_gc_forgets, failures);
+
+    free(image_buffer);
+    return failures ? 1 : 0;
+}
+
+// private function definitions
+/// @brief Writing a sector's data again, as written or as read back, programs nothing and is
+/// counted; other data is written
+static bool test_identical_rewrite_skipped(void)
+{
+    dhara_error_t err;
+    bool written;
+    CHECK(open_volume());
+
+    fill(data, SECTOR, 1);
+    CHECK(write_counted(SECTOR, data, &written) && written);
+    CHECK(write_counted(SECTOR, data, &written) && !written);
+    CHECK(1 == map.dedup_skipped);
+
+    // a remount forgets everything, and a read learns the sector again
+    CHECK(0 == dhara_map_sync(&map, &err));
+    dhara_map_init(&map, &nand, page_buffer, GC_RATIO);
+    CHECK(0 == dhara_map_resume(&map, &err));
+    CHECK(write_counted(SECTOR, data, &written) && written);
+    CHECK(0 == dhara_map_sync(&map, &err));
+    dhara_map_init(&map, &nand, page_buffer, GC_RATIO);
+    CHECK(0 == dhara_map_resume(&map, &err));
+    CHECK(read_matches(SECTOR, data));
+    CHECK(write_counted(SECTOR, data, &written) && !written);
+
+    fill(data, SECTOR, 2);
+    CHECK(write_counted(SECTOR, data, &written) && written);
+    CHECK(read_matches(SECTOR, data));
+    CHECK(1 == map.dedup_skipped);
+    return true;
+}
+
+/// @brief Data with the same CRC as the sector's, but different, fails the verify read and is
+/// written
+static bool test_collision_written(void)
+{
+    bool written;
+    CHECK(open_volume());
+
+    fill(data, SECTOR, 1);
+    CHECK(write_counted(SECTOR, data, &written) && written);
+
+    // adding a multiple of the CRC polynomial leaves the CRC unchanged
+    static const uint8_t poly[] = {0x41, 0x06, 0x71, 0xdb, 0x01};
+    uint8_t collision[PAGE_SIZE];
+    memcpy(collision, data, PAGE_SIZE);
+    for (size_t i = 0; i < sizeof(poly); i++) collision[COLLISION_AT + i] ^= poly[i];
+    CHECK(dhara_crc32(DHARA_CRC_INIT, collision, PAGE_SIZE) ==
+          dhara_crc32(DHARA_CRC_INIT, data, PAGE_SIZE));
+
+    CHECK(write_counted(SECTOR, collision, &written) && written);
+    CHECK(0 == map.dedup_skipped);
+    CHECK(read_matches(SECTOR, collision));
+
+    // and the entry now stands for the new data
+    CHECK(write_counted(SECTOR, data, &written) && written);
+    CHECK(read_matches(SECTOR, data));
+    return true;
+}
+
+/// @brief After a trim, writing the old data again maps the sector again
+static bool test_trim_forgets(void)
+{
+    dhara_error_t err;
+    bool written;
+    CHECK(open_volume());
+
+    fill(data, SECTOR, 1);
+    CHECK(write_counted(SECTOR, data, &written) && written);
+    CHECK(0 == dhara_map_trim(&map, SECTOR, &err));
+    CHECK(DHARA_PAGE_NONE == sector_page(SECTOR));
+
+    CHECK(write_counted(SECTOR, data, &written) && written);
+    CHECK(0 == map.dedup_skipped);
+    CHECK(read_matches(SECTOR, data));
+    return true;
+}
+
+/// @brief Once garbage collection has moved the sector, writing its data again isn't skipped
+static bool test_gc_forgets(void)
+{
+    dhara_error_t err;
+    bool written;
+    CHECK(open_volume());
+
+    fill(data, SECTOR, 1);
+    CHECK(write_counted(SECTOR, data, &written) && written);
+    const uint32_t first = sector_page(SECTOR);
+
+    // churn other sectors -- none sharing the sector's slot in the table -- until it's moved
+    const uint32_t span = dhara_map_capacity(&map) / 2;
+    uint8_t other[PAGE_SIZE];
+    for (uint32_t i = 0; sector_page(SECTOR) == first; i++) {
+        const uint32_t sector = SECTOR + 1 + (i % span);
+        CHECK(i < 100 * span);
+        if (SECTOR == sector % DHARA_DEDUP_ENTRIES) continue;
+        fill(other, sector, i);
+        CHECK(0 == dhara_map_write(&map, sector, other, &err));
+    }
+
+    // (a read would learn the data again, from the new page)
+    CHECK(write_counted(SECTOR, data, &written) && written);
+    CHECK(0 == map.dedup_skipped);
+    CHECK(read_matches(SECTOR, data));
+    CHECK(write_counted(SECTOR, data, &written) && !written);
+    return true;
+}
+
+/// @brief Formats the image and mounts an empty map
+static bool open_volume(void)
+{
+    dhara_error_t err;
+    CHECK(0 == dhara_nand_image_format(&nand));
+    dhara_map_init(&map, &nand, page_buffer, GC_RATIO);
+    dhara_map_resume(&map, &err);
+    dhara_map_clear(&map);
+    return true;
+}
+
+/// @brief Writes a sector, reporting whether any page was programmed for it
+static bool write_counted(uint32_t sector, const uint8_t *page, bool *written)
+{
+    dhara_error_t err;
+    const uint32_t before = programs;
+    CHECK(0 == dhara_map_write(&map, sector, page, &err));
+    *written = (programs != before);
+    return true;
+}
+
+static bool read_matches(uint32_t sector, const uint8_t *page)
+{
+    dhara_error_t err;
+    CHECK(0 == dhara_map_read(&map, sector, readback, &err));
+    CHECK(0 == memcmp(page, readback, PAGE_SIZE));
+    return true;
+}
+
+/// @brief Returns the page holding a sector, or DHARA_PAGE_NONE
+static uint32_t sector_page(uint32_t sector)
+{
+    dhara_error_t err;
+    dhara_page_t p = DHARA_PAGE_NONE;
+    if (dhara_map_find(&map, sector, &p, &err)) return DHARA_PAGE_NONE;
+    return p;
+}
+
+/// @brief Fills a page with a pattern unique to a sector and version
+static void fill(uint8_t *page, uint32_t sector, uint32_t version)
+{
+    for (size_t i = 0; i < PAGE_SIZE; i++) {
+        page[i] = (uint8_t)((sector * 7) + (version * 13) + i);
+    }
+}
+
+static int count_prog(const struct dhara_nand *n, dhara_page_t p, const uint8_t *page,
+                      dhara_error_t *err)
+{
+    programs++;
+    return dhara_nand_image_ops.prog(n, p, page, err);
+}
+
+static int count_copy(const struct dhara_nand *n, dhara_page_t src, dhara_page_t dst,
+                      dhara_error_t *err)
+{
+    programs++;
+    return dhara_nand_image_ops.copy(n, src, dst, err);
+}
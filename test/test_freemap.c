@@ -0,0 +1,388 @@
+/**
+ * @file		test_freemap.c
+ * @author		Andrew Loebs
+ * @brief		Host tests of the free cluster map module
+ *
+ * Runs FatFs on the firmware's disk io glue (nand_ftl_diskio.c, on dhara and the MT29F model) and
+ * churns files -- created, extended, truncated and deleted at random -- checking after each step
+ * that f_getfree() matches a count of the free entries read straight from the FAT, and that the
+ * files still read back as written (a cluster handed out twice would corrupt one of them). Built
+ * once for the firmware's FAT16 volume, and once at 512 byte sectors with TEST_FAT32 set, where
+ * the count FatFs keeps in the FSInfo sector is checked against the FAT too.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../src/fatfs/diskio.h"
+#include "../src/fatfs/ff.h"
+#include "fs_freemap.h"
+#include "sim_mt29f.h"
+#include "test.h"
+
+// defines
+#ifndef TEST_FAT32
+#define TEST_FAT32 0
+#endif
+#define FILES        12
+#define MAX_CLUSTERS 6 // per file
+#define ROUNDS       40
+#define FSI_FREE     488 // FSInfo: free cluster count (DWORD)
+
+// private function prototypes
+static bool test_churn(void);
+static bool test_freed_reused(void);
+static bool test_remount(void);
+#if TEST_FAT32
+static bool test_stale_fsinfo(void);
+#endif
+static bool test_mkfs_forgets(void);
+
+static bool format_volume(void);
+static bool churn(uint32_t rounds);
+static bool write_file(uint32_t file, FSIZE_t from, FSIZE_t to, BYTE mode);
+static bool files_match(void);
+static bool free_matches(void);
+static bool scan_fat(DWORD *free_out, DWORD *first_out);
+static bool mark_used(DWORD clst);
+static DWORD first_cluster(uint32_t file);
+#if TEST_FAT32
+static DWORD read_dword(LBA_t sector, UINT offset);
+#endif
+static uint8_t pattern(uint32_t file, FSIZE_t ofs);
+static uint32_t next_random(void);
+
+// private variables
+static FATFS fs;
+static FIL fil;
+static BYTE work[FF_MAX_SS];
+static uint8_t buffer[4096];
+static uint8_t sector_buffer[FF_MAX_SS];
+static UINT cluster_size;
+// size of each file, or -1 if it doesn't exist
+static int32_t sizes[FILES];
+static uint32_t random_state = 1;
+#if TEST_FAT32
+static const MKFS_PARM format = {.fmt = FM_FAT32, .au_size = 1024};
+#else
+static const MKFS_PARM format = {.fmt = FM_FAT, .au_size = 8192};
+#endif
+
+// public function definitions
+int main(void)
+{
+    int failures = 0;
+    RUN(test_churn, failures);
+    RUN(test_freed_reused, failures);
+    RUN(test_remount, failures);
+#if TEST_FAT32
+    RUN(test_stale_fsinfo, failures);
+#endif
+    RUN(test_mkfs_forgets, failures);
+
+    return failures ? 1 : 0;
+}
+
+// private function definitions
+/// @brief The count stays in step with the FAT as chains are created, grown, cut and removed
+static bool test_churn(void)
+{
+    CHECK(format_volume());
+#if TEST_FAT32
+    CHECK(FS_FAT32 == fs.fs_type);
+#else
+    CHECK(FS_FAT16 == fs.fs_type);
+#endif
+    CHECK(fs.n_fatent <= FS_FREEMAP_CLUSTERS);
+    CHECK(free_matches());
+
+    CHECK(churn(ROUNDS));
+    CHECK(files_match());
+    return true;
+}
+
+/// @brief Clusters of a deleted file are handed out again once the search comes round to them
+static bool test_freed_reused(void)
+{
+    CHECK(format_volume());
+    CHECK(write_file(0, 0, 2 * cluster_size, FA_WRITE | FA_CREATE_ALWAYS));
+    CHECK(write_file(1, 0, cluster_size, FA_WRITE | FA_CREATE_ALWAYS));
+    const DWORD freed = first_cluster(0);
+    CHECK(FR_OK == f_unlink("file00.bin"));
+    sizes[0] = -1;
+    CHECK(free_matches());
+
+    // the next chain is looked for from the cluster after the last one allocated -- wrap it
+    fs.last_clst = fs.n_fatent - 1;
+    CHECK(write_file(2, 0, cluster_size, FA_WRITE | FA_CREATE_ALWAYS));
+    CHECK(freed == first_cluster(2));
+    CHECK(free_matches());
+    CHECK(files_match());
+    return true;
+}
+
+/// @brief A remount builds the map again from the FAT -- with any changes made to it behind
+/// FatFs' back, as by a USB host -- and allocation carries on from it
+static bool test_remount(void)
+{
+    CHECK(format_volume());
+    for (uint32_t i = 0; i < 3; i++) {
+        CHECK(churn(ROUNDS / 4));
+        CHECK(free_matches());
+
+        // the first free cluster taken, between the map's last use and the remount
+        DWORD actual, taken;
+        CHECK(scan_fat(&actual, &taken));
+        CHECK(mark_used(taken));
+
+        CHECK(FR_OK == f_mount(&fs, "", 1));
+        CHECK(free_matches());
+        fs.last_clst = fs.n_fatent - 1;
+        CHECK(write_file(FILES - 1 - i, 0, cluster_size, FA_WRITE | FA_CREATE_ALWAYS));
+        CHECK(taken != first_cluster(FILES - 1 - i));
+        CHECK(free_matches());
+        CHECK(files_match());
+    }
+    return true;
+}
+
+#if TEST_FAT32
+/// @brief A wrong count in the FSInfo sector is replaced at the first allocation, and written back
+static bool test_stale_fsinfo(void)
+{
+    CHECK(format_volume());
+    CHECK(churn(ROUNDS / 4));
+
+    // a count left behind by, say, a power loss between the FAT and the FSInfo writes
+    const LBA_t fsinfo = fs.volbase + 1;
+    DWORD actual, first;
+    CHECK(scan_fat(&actual, &first));
+    CHECK(actual == read_dword(fsinfo, FSI_FREE));
+    CHECK(RES_OK == disk_read(fs.pdrv, sector_buffer, fsinfo, 1));
+    const DWORD stale = actual - 100;
+    memcpy(&sector_buffer[FSI_FREE], &stale, sizeof(stale));
+    CHECK(RES_OK == disk_write(fs.pdrv, sector_buffer, fsinfo, 1));
+    CHECK(RES_OK == disk_ioctl(fs.pdrv, CTRL_SYNC, NULL));
+
+    CHECK(FR_OK == f_mount(&fs, "", 1));
+    CHECK(stale == fs.free_clst);
+    CHECK(free_matches());
+
+    // the corrected count goes out with the next sync, even one that allocates nothing
+    CHECK(FR_OK == f_open(&fil, "empty.txt", FA_WRITE | FA_CREATE_NEW));
+    CHECK(FR_OK == f_close(&fil));
+    CHECK(actual == read_dword(fsinfo, FSI_FREE));
+    CHECK(write_file(0, 0, cluster_size, FA_WRITE | FA_CREATE_ALWAYS));
+    CHECK(scan_fat(&actual, &first));
+    CHECK(actual == read_dword(fsinfo, FSI_FREE));
+    CHECK(files_match());
+    return true;
+}
+#endif
+
+/// @brief Formatting the mounted volume leaves nothing of the old map behind
+static bool test_mkfs_forgets(void)
+{
+    CHECK(format_volume());
+    CHECK(churn(ROUNDS / 4));
+    CHECK(write_file(0, 0, cluster_size, FA_WRITE | FA_CREATE_ALWAYS));
+    CHECK(free_matches());
+
+    // no f_mount() after: the next call mounts the new volume on the same object
+    CHECK(FR_OK == f_mkfs("", &format, work, sizeof(work)));
+    for (uint32_t i = 0; i < FILES; i++) sizes[i] = -1;
+    CHECK(free_matches());
+    CHECK(fs.n_fatent - 2 - TEST_FAT32 == fs.free_clst);
+
+    CHECK(churn(ROUNDS / 4));
+    CHECK(files_match());
+    return true;
+}
+
+/// @brief Starts from a blank chip and makes a file system on it
+static bool format_volume(void)
+{
+    sim_mt29f_reset();
+    CHECK(FR_NO_FILESYSTEM == f_mount(&fs, "", 1));
+    CHECK(FR_OK == f_mkfs("", &format, work, sizeof(work)));
+    CHECK(FR_OK == f_mount(&fs, "", 1));
+    cluster_size = fs.csize * FF_MAX_SS;
+    for (uint32_t i = 0; i < FILES; i++) sizes[i] = -1;
+    return true;
+}
+
+/// @brief Creates, extends, truncates and deletes files at random, checking the count after each
+static bool churn(uint32_t rounds)
+{
+    for (uint32_t round = 0; round < rounds; round++) {
+        const uint32_t file = next_random() % FILES;
+        const FSIZE_t max_size = MAX_CLUSTERS * cluster_size;
+        const FSIZE_t size = next_random() % (max_size + 1);
+        char name[20];
+        snprintf(name, sizeof(name), "file%02lu.bin", (unsigned long)file);
+
+        switch (next_random() % 4) {
+            case 0: // (re)create
+                CHECK(write_file(file, 0, size, FA_WRITE | FA_CREATE_ALWAYS));
+                break;
+            case 1: // extend (or create)
+                if ((sizes[file] < 0) || (size > (FSIZE_t)sizes[file])) {
+                    const FSIZE_t from = (sizes[file] < 0) ? 0 : sizes[file];
+                    CHECK(write_file(file, from, size, FA_WRITE | FA_OPEN_ALWAYS));
+                }
+                break;
+            case 2: // truncate
+                if ((sizes[file] >= 0) && (size < (FSIZE_t)sizes[file])) {
+                    CHECK(FR_OK == f_open(&fil, name, FA_WRITE));
+                    CHECK(FR_OK == f_lseek(&fil, size));
+                    CHECK(FR_OK == f_truncate(&fil));
+                    CHECK(FR_OK == f_close(&fil));
+                    sizes[file] = size;
+                }
+                break;
+            default: // delete
+                if (sizes[file] >= 0) {
+                    CHECK(FR_OK == f_unlink(name));
+                    sizes[file] = -1;
+                }
+                break;
+        }
+        CHECK(free_matches());
+    }
+    return true;
+}
+
+/// @brief Writes bytes [from, to) of a file's pattern, and closes it
+static bool write_file(uint32_t file, FSIZE_t from, FSIZE_t to, BYTE mode)
+{
+    char name[20];
+    snprintf(name, sizeof(name), "file%02lu.bin", (unsigned long)file);
+    CHECK(FR_OK == f_open(&fil, name, mode));
+    CHECK(FR_OK == f_lseek(&fil, from));
+
+    for (FSIZE_t ofs = from; ofs < to;) {
+        UINT n = (to - ofs < sizeof(buffer)) ? (UINT)(to - ofs) : sizeof(buffer);
+        for (UINT i = 0; i < n; i++) buffer[i] = pattern(file, ofs + i);
+        UINT bw;
+        CHECK((FR_OK == f_write(&fil, buffer, n, &bw)) && (n == bw));
+        ofs += n;
+    }
+    CHECK(FR_OK == f_close(&fil));
+    sizes[file] = to;
+    return true;
+}
+
+/// @brief Returns true if every file has its size and reads back as written
+static bool files_match(void)
+{
+    for (uint32_t file = 0; file < FILES; file++) {
+        char name[20];
+        snprintf(name, sizeof(name), "file%02lu.bin", (unsigned long)file);
+        if (sizes[file] < 0) {
+            CHECK(FR_NO_FILE == f_stat(name, NULL));
+            continue;
+        }
+
+        CHECK(FR_OK == f_open(&fil, name, FA_READ));
+        CHECK((FSIZE_t)sizes[file] == f_size(&fil));
+        for (FSIZE_t ofs = 0; ofs < (FSIZE_t)sizes[file];) {
+            UINT br;
+            CHECK(FR_OK == f_read(&fil, buffer, sizeof(buffer), &br));
+            for (UINT i = 0; i < br; i++) CHECK(pattern(file, ofs + i) == buffer[i]);
+            ofs += br;
+        }
+        CHECK(FR_OK == f_close(&fil));
+    }
+    return true;
+}
+
+/// @brief Returns true if f_getfree() -- and on FAT32, the FSInfo sector -- agree with the FAT
+/// @note Each step of the tests ends with a sync, so the FAT on the disk is up to date.
+static bool free_matches(void)
+{
+    DWORD nfree;
+    FATFS *pfs;
+    CHECK(FR_OK == f_getfree("", &nfree, &pfs));
+    DWORD actual, first;
+    CHECK(scan_fat(&actual, &first));
+    if (nfree != actual) {
+        printf("  f_getfree says %lu free clusters, the FAT %lu\n", (unsigned long)nfree,
+               (unsigned long)actual);
+        return false;
+    }
+#if TEST_FAT32
+    // written back by the sync that ends each step, once the map has been built
+    if (!(fs.fsi_flag & 1)) CHECK(actual == read_dword(fs.volbase + 1, FSI_FREE));
+#endif
+    return true;
+}
+
+/// @brief Counts the free entries of the first FAT, reading it sector by sector, and finds the
+/// first of them
+static bool scan_fat(DWORD *free_out, DWORD *first_out)
+{
+    const UINT entry_size = (FS_FAT32 == fs.fs_type) ? 4 : 2;
+    const DWORD per_sector = FF_MAX_SS / entry_size;
+    DWORD count = 0;
+    *first_out = 0;
+    for (DWORD clst = 2; clst < fs.n_fatent; clst++) {
+        if ((2 == clst) || (0 == clst % per_sector)) {
+            CHECK(RES_OK == disk_read(fs.pdrv, sector_buffer, fs.fatbase + clst / per_sector, 1));
+        }
+        const uint8_t *p = &sector_buffer[(clst % per_sector) * entry_size];
+        DWORD entry = (DWORD)p[0] | ((DWORD)p[1] << 8);
+        if (4 == entry_size) entry |= ((DWORD)p[2] << 16) | ((DWORD)(p[3] & 0x0f) << 24);
+        if (0 == entry) {
+            if (!count) *first_out = clst;
+            count++;
+        }
+    }
+    *free_out = count;
+    return true;
+}
+
+/// @brief Marks a cluster as the end of a chain in the first FAT, writing the disk directly
+static bool mark_used(DWORD clst)
+{
+    const UINT entry_size = (FS_FAT32 == fs.fs_type) ? 4 : 2;
+    const DWORD per_sector = FF_MAX_SS / entry_size;
+    const LBA_t sector = fs.fatbase + clst / per_sector;
+    CHECK(RES_OK == disk_read(fs.pdrv, sector_buffer, sector, 1));
+    memset(&sector_buffer[(clst % per_sector) * entry_size], 0xff, entry_size);
+    CHECK(RES_OK == disk_write(fs.pdrv, sector_buffer, sector, 1));
+    CHECK(RES_OK == disk_ioctl(fs.pdrv, CTRL_SYNC, NULL));
+    return true;
+}
+
+/// @brief Returns the first cluster of a file, or 0
+static DWORD first_cluster(uint32_t file)
+{
+    char name[20];
+    snprintf(name, sizeof(name), "file%02lu.bin", (unsigned long)file);
+    if (FR_OK != f_open(&fil, name, FA_READ)) return 0;
+    const DWORD clst = fil.obj.sclust;
+    f_close(&fil);
+    return clst;
+}
+
+#if TEST_FAT32
+static DWORD read_dword(LBA_t sector, UINT offset)
+{
+    if (RES_OK != disk_read(fs.pdrv, sector_buffer, sector, 1)) return 0xFFFFFFFF;
+    DWORD value;
+    memcpy(&value, &sector_buffer[offset], sizeof(value));
+    return value;
+}
+#endif
+
+static uint8_t pattern(uint32_t file, FSIZE_t ofs)
+{
+    return (uint8_t)((file * 31) + (ofs * 7) + (ofs / 509));
+}
+
+static uint32_t next_random(void)
+{
+    random_state = random_state * 1103515245 + 12345;
+    return random_state >> 16;
+}
@@ -0,0 +1,298 @@
+/**
+ * @file		test_fs_clone.c
+ * @author		Andrew Loebs
+ * @brief		Host tests of the file clone module
+ *
+ * Runs FatFs on the firmware's disk io glue (nand_ftl_diskio.c, on dhara and the MT29F model) and
+ * clones files laid out in one piece and in fragments, with and without a partial last cluster.
+ * The calls fs_clone makes to nand_ftl_diskio_copy() are recorded (the Makefile links it wrapped,
+ * with --wrap), so the runs it coalesces are checked as well as the copies, byte for byte. Built
+ * at 2048 byte sectors, and at 512 where the partial pages of a run go through the write-combining
+ * stage.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../src/fatfs/ff.h"
+#include "fs_clone.h"
+#include "nand_ftl_diskio.h"
+#include "sim_mt29f.h"
+#include "test.h"
+
+// defines
+#define MAX_CALLS 16
+#define FRAGMENTS 4 // of the fragmented source
+
+#if !NAND_FTL_COPY
+#error "test_fs_clone needs a build that copies inside the flash translation layer"
+#endif
+
+// private types
+typedef struct {
+    LBA_t src;
+    LBA_t dst;
+    UINT count;
+} copy_call_t;
+
+// private function prototypes
+static bool test_contiguous_one_run(void);
+static bool test_fragments_one_run_each(void);
+static bool test_small_files(void);
+static bool test_replaces_existing(void);
+
+static bool format_volume(void);
+static bool write_file(const char *name, uint32_t seed, FSIZE_t size);
+static bool clone_matches(const char *src, const char *dst, uint32_t seed, FSIZE_t size);
+static bool file_matches(const char *name, uint32_t seed, FSIZE_t size);
+static bool copy_through_ram(const char *src, const char *dst);
+static uint32_t bus_bytes(void);
+static UINT sectors_of(FSIZE_t size);
+static uint8_t pattern(uint32_t seed, FSIZE_t ofs);
+DRESULT __real_nand_ftl_diskio_copy(LBA_t src, LBA_t dst, UINT count);
+DRESULT __wrap_nand_ftl_diskio_copy(LBA_t src, LBA_t dst, UINT count);
+
+// private variables
+static FATFS fs;
+static FIL fil;
+static BYTE work[FF_MAX_SS];
+static uint8_t buffer[4096];
+static UINT cluster_size;
+static copy_call_t calls[MAX_CALLS];
+static uint32_t call_count;
+
+// public function definitions
+int main(void)
+{
+    int failures = 0;
+    RUN(test_contiguous_one_run, failures);
+    RUN(test_fragments_one_run_each, failures);
+    RUN(test_small_files, failures);
+    RUN(test_replaces_existing, failures);
+
+    return failures ? 1 : 0;
+}
+
+/// @brief Records each copy, and passes it on
+DRESULT __wrap_nand_ftl_diskio_copy(LBA_t src, LBA_t dst, UINT count)
+{
+    if (call_count < MAX_CALLS) calls[call_count] = (copy_call_t){src, dst, count};
+    call_count++;
+    return __real_nand_ftl_diskio_copy(src, dst, count);
+}
+
+// private function definitions
+/// @brief A file in one piece, ending part way into a cluster and a sector, goes in one copy --
+/// its last cluster only as far as the sectors it uses -- with no data on the bus
+static bool test_contiguous_one_run(void)
+{
+    CHECK(format_volume());
+    const FSIZE_t size = 100 * cluster_size + 3 * FF_MAX_SS + 100;
+    CHECK(write_file("src.bin", 1, size));
+
+    call_count = 0;
+    const uint32_t clone_bytes = bus_bytes();
+    CHECK(FR_OK == fs_clone_file("src.bin", "dst.bin"));
+    const uint32_t cloned = bus_bytes() - clone_bytes;
+    CHECK(file_matches("dst.bin", 1, size));
+    CHECK(1 == call_count);
+    CHECK(sectors_of(size) == calls[0].count);
+
+    // the map's lookups still cross the bus, but no page of data: a third of what a copy through
+    // RAM moves is plenty
+    const uint32_t read_bytes = bus_bytes();
+    CHECK(copy_through_ram("src.bin", "ram.bin"));
+    CHECK(3 * cloned < bus_bytes() - read_bytes);
+
+    // and the copy is on the flash, not in a cache
+    CHECK(FR_OK == f_mount(&fs, "", 1));
+    CHECK(file_matches("dst.bin", 1, size));
+    CHECK(file_matches("src.bin", 1, size));
+    return true;
+}
+
+/// @brief A source in fragments goes in one copy per fragment, each as long as the fragment
+static bool test_fragments_one_run_each(void)
+{
+    CHECK(format_volume());
+
+    // two clusters of the source, then one of a filler, and again -- the last fragment short
+    FIL src, filler;
+    CHECK(FR_OK == f_open(&src, "src.bin", FA_WRITE | FA_CREATE_ALWAYS));
+    CHECK(FR_OK == f_open(&filler, "filler.bin", FA_WRITE | FA_CREATE_ALWAYS));
+    const FSIZE_t size = (2 * FRAGMENTS - 1) * cluster_size + FF_MAX_SS + 1;
+    for (FSIZE_t ofs = 0; ofs < size;) {
+        for (int i = 0; (i < 2) && (ofs < size); i++) {
+            for (UINT done = 0; (done < cluster_size) && (ofs < size);) {
+                UINT n = sizeof(buffer);
+                if (n > cluster_size - done) n = cluster_size - done;
+                if (n > size - ofs) n = (UINT)(size - ofs);
+                for (UINT b = 0; b < n; b++) buffer[b] = pattern(2, ofs + b);
+                UINT bw;
+                CHECK((FR_OK == f_write(&src, buffer, n, &bw)) && (n == bw));
+                ofs += n;
+                done += n;
+            }
+            CHECK(FR_OK == f_sync(&src));
+        }
+        memset(buffer, 0, sizeof(buffer));
+        for (UINT done = 0; done < cluster_size; done += sizeof(buffer)) {
+            UINT bw;
+            CHECK((FR_OK == f_write(&filler, buffer, sizeof(buffer), &bw)) &&
+                  (sizeof(buffer) == bw));
+        }
+        CHECK(FR_OK == f_sync(&filler));
+    }
+    CHECK(FR_OK == f_close(&src));
+    CHECK(FR_OK == f_close(&filler));
+
+    CHECK(clone_matches("src.bin", "dst.bin", 2, size));
+    CHECK(FRAGMENTS == call_count);
+    UINT total = 0;
+    for (uint32_t i = 0; i < FRAGMENTS; i++) {
+        const UINT expected = (i < FRAGMENTS - 1) ? sectors_of(2 * cluster_size)
+                                                  : sectors_of(size % (2 * cluster_size));
+        CHECK(expected == calls[i].count);
+        // the destination is in one piece, so its runs follow on from each other
+        if (i) CHECK(calls[i - 1].dst + calls[i - 1].count == calls[i].dst);
+        total += calls[i].count;
+    }
+    CHECK(sectors_of(size) == total);
+
+    CHECK(FR_OK == f_mount(&fs, "", 1));
+    CHECK(file_matches("dst.bin", 2, size));
+    return true;
+}
+
+/// @brief Empty files need no copy, and files under a sector or a cluster need just the sectors
+/// they use
+static bool test_small_files(void)
+{
+    CHECK(format_volume());
+    const FSIZE_t sizes[] = {0, 1, 100, FF_MAX_SS, FF_MAX_SS + 1, cluster_size - 1, cluster_size,
+                             cluster_size + 1};
+    for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        // on a blank volume each time, so neither file is left in fragments by the one before
+        CHECK(format_volume());
+        CHECK(write_file("src.bin", 10 + i, sizes[i]));
+        CHECK(clone_matches("src.bin", "dst.bin", 10 + i, sizes[i]));
+
+        UINT total = 0;
+        for (uint32_t c = 0; c < call_count; c++) total += calls[c].count;
+        CHECK(sectors_of(sizes[i]) == total);
+        CHECK(call_count == (sizes[i] ? 1 : 0));
+    }
+    return true;
+}
+
+/// @brief A clone over a larger file replaces it, and a clone of a clone matches the original
+static bool test_replaces_existing(void)
+{
+    CHECK(format_volume());
+    CHECK(write_file("big.bin", 20, 7 * cluster_size + 5));
+    CHECK(write_file("src.bin", 21, 2 * cluster_size + FF_MAX_SS / 2));
+
+    CHECK(clone_matches("src.bin", "big.bin", 21, 2 * cluster_size + FF_MAX_SS / 2));
+    CHECK(clone_matches("big.bin", "copy.bin", 21, 2 * cluster_size + FF_MAX_SS / 2));
+    CHECK(FR_OK == f_mount(&fs, "", 1));
+    CHECK(file_matches("big.bin", 21, 2 * cluster_size + FF_MAX_SS / 2));
+    CHECK(file_matches("copy.bin", 21, 2 * cluster_size + FF_MAX_SS / 2));
+
+    // the old file's clusters are all free again: three files of three clusters are left
+    DWORD nfree;
+    FATFS *pfs;
+    CHECK(FR_OK == f_getfree("", &nfree, &pfs));
+    CHECK(fs.n_fatent - 2 - (FS_FAT32 == fs.fs_type) - nfree == 3 * 3);
+    return true;
+}
+
+/// @brief Starts from a blank chip and makes a file system on it
+static bool format_volume(void)
+{
+    sim_mt29f_reset();
+    CHECK(FR_NO_FILESYSTEM == f_mount(&fs, "", 1));
+    CHECK(FR_OK == f_mkfs("", NULL, work, sizeof(work)));
+    CHECK(FR_OK == f_mount(&fs, "", 1));
+    cluster_size = fs.csize * FF_MAX_SS;
+    return true;
+}
+
+/// @brief Writes a file of the given size with a pattern unique to the seed
+static bool write_file(const char *name, uint32_t seed, FSIZE_t size)
+{
+    CHECK(FR_OK == f_open(&fil, name, FA_WRITE | FA_CREATE_ALWAYS));
+    for (FSIZE_t ofs = 0; ofs < size;) {
+        const UINT n = (size - ofs < sizeof(buffer)) ? (UINT)(size - ofs) : sizeof(buffer);
+        for (UINT i = 0; i < n; i++) buffer[i] = pattern(seed, ofs + i);
+        UINT bw;
+        CHECK((FR_OK == f_write(&fil, buffer, n, &bw)) && (n == bw));
+        ofs += n;
+    }
+    CHECK(FR_OK == f_close(&fil));
+    return true;
+}
+
+/// @brief Clones a file, recording the copies made, and checks the clone's data
+static bool clone_matches(const char *src, const char *dst, uint32_t seed, FSIZE_t size)
+{
+    call_count = 0;
+    CHECK(FR_OK == fs_clone_file(src, dst));
+    CHECK(call_count <= MAX_CALLS);
+    CHECK(file_matches(dst, seed, size));
+    return true;
+}
+
+static bool file_matches(const char *name, uint32_t seed, FSIZE_t size)
+{
+    CHECK(FR_OK == f_open(&fil, name, FA_READ));
+    CHECK(size == f_size(&fil));
+    for (FSIZE_t ofs = 0; ofs < size;) {
+        UINT br;
+        CHECK(FR_OK == f_read(&fil, buffer, sizeof(buffer), &br));
+        for (UINT i = 0; i < br; i++) {
+            if (pattern(seed, ofs + i) != buffer[i]) {
+                printf("  %s: byte %lu read back wrong\n", name, (unsigned long)(ofs + i));
+                return false;
+            }
+        }
+        ofs += br;
+    }
+    CHECK(FR_OK == f_close(&fil));
+    return true;
+}
+
+/// @brief Copies a file with f_read() and f_write(), as builds without NAND_FTL_COPY do
+static bool copy_through_ram(const char *src, const char *dst)
+{
+    FIL out;
+    CHECK(FR_OK == f_open(&fil, src, FA_READ));
+    CHECK(FR_OK == f_open(&out, dst, FA_WRITE | FA_CREATE_ALWAYS));
+    UINT br;
+    do {
+        CHECK(FR_OK == f_read(&fil, buffer, sizeof(buffer), &br));
+        UINT bw;
+        CHECK((FR_OK == f_write(&out, buffer, br, &bw)) && (br == bw));
+    } while (sizeof(buffer) == br);
+    CHECK(FR_OK == f_close(&out));
+    CHECK(FR_OK == f_close(&fil));
+    return true;
+}
+
+/// @brief Returns the bytes the model has moved over the bus since it was reset
+static uint32_t bus_bytes(void)
+{
+    sim_mt29f_stats_t stats;
+    sim_mt29f_get_stats(&stats);
+    return stats.bus_bytes;
+}
+
+static UINT sectors_of(FSIZE_t size)
+{
+    return (UINT)((size + FF_MAX_SS - 1) / FF_MAX_SS);
+}
+
+static uint8_t pattern(uint32_t seed, FSIZE_t ofs)
+{
+    return (uint8_t)((seed * 29) + (ofs * 5) + (ofs / 487));
+}
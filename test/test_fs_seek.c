@@ -0,0 +1,192 @@
+/**
+ * @file		test_fs_seek.c
+ * @author		Andrew Loebs
+ * @brief		Host tests of the file seek module
+ *
+ * Runs FatFs on the firmware's disk IO glue (nand_ftl_diskio.c, on dhara and the MT29F model),
+ * with the tables cut down to two fragments each, so that a file of four fragments is too
+ * fragmented for one. Files are closed with plain f_close() and their FIL reused, as a caller that
+ * forgets fs_seek_close() would, and the pool has to hand the tables out again.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../src/fatfs/ff.h"
+#include "fs_seek.h"
+#include "sim_mt29f.h"
+#include "test.h"
+
+// defines
+#define CLUSTERS 4 // per file
+
+#if (FS_SEEK_TABLES != 2) || (FS_SEEK_TABLE_SIZE != 6)
+#error "test_fs_seek expects FS_SEEK_TABLES=2 and FS_SEEK_TABLE_SIZE=6"
+#endif
+
+// private function prototypes
+static bool test_plain_close_frees_slot(void);
+static bool test_reused_fil_not_refused(void);
+static bool test_seek_close_frees_slot(void);
+
+static bool format_volume(void);
+static bool write_files(void);
+static bool seek_matches(FIL *fp, uint32_t file, FSIZE_t ofs);
+static uint8_t pattern(uint32_t file, FSIZE_t ofs);
+
+// private variables
+static FATFS fs;
+static BYTE work[FF_MAX_SS];
+// the FILs of the tests -- static, so a plain f_close() leaves them where the pool can look
+static FIL files[4];
+static uint8_t buffer[FF_MAX_SS];
+static UINT cluster_size;
+// files 0 and 1 are contiguous, file 2 is interleaved cluster by cluster with file 3
+static const char *const names[] = {"plain0.bin", "plain1.bin", "split.bin", "filler.bin"};
+
+// public function definitions
+int main(void)
+{
+    int failures = 0;
+    RUN(test_plain_close_frees_slot, failures);
+    RUN(test_reused_fil_not_refused, failures);
+    RUN(test_seek_close_frees_slot, failures);
+
+    return failures ? 1 : 0;
+}
+
+// private function definitions
+/// @brief A file closed with f_close() gives its table up to the next file that wants one
+static bool test_plain_close_frees_slot(void)
+{
+    CHECK(format_volume());
+    CHECK(write_files());
+
+    // both tables taken, then one owner closed the plain way
+    for (int i = 0; i < 2; i++) {
+        CHECK(FR_OK == f_open(&files[i], names[i], FA_READ));
+        CHECK(seek_matches(&files[i], i, cluster_size + 5));
+        CHECK(fs_seek_is_fast(&files[i]));
+    }
+    CHECK(FR_OK == f_close(&files[0]));
+
+    CHECK(FR_OK == f_open(&files[2], names[0], FA_READ));
+    CHECK(seek_matches(&files[2], 0, 3 * cluster_size - 7));
+    CHECK(fs_seek_is_fast(&files[2]));
+    CHECK(seek_matches(&files[1], 1, 2 * cluster_size));
+
+    CHECK(FR_OK == fs_seek_close(&files[1]));
+    CHECK(FR_OK == fs_seek_close(&files[2]));
+    return true;
+}
+
+/// @brief A FIL reused for another file after f_close() doesn't inherit the slot of the file it
+/// held before -- here one marked too fragmented for a table
+static bool test_reused_fil_not_refused(void)
+{
+    CHECK(format_volume());
+    CHECK(write_files());
+
+    CHECK(FR_OK == f_open(&files[0], names[2], FA_READ));
+    CHECK(seek_matches(&files[0], 2, 2 * cluster_size + 1));
+    CHECK(!fs_seek_is_fast(&files[0]));
+    CHECK(FR_OK == f_close(&files[0]));
+
+    CHECK(FR_OK == f_open(&files[0], names[0], FA_READ));
+    CHECK(seek_matches(&files[0], 0, 2 * cluster_size + 1));
+    CHECK(fs_seek_is_fast(&files[0]));
+
+    // and the same goes for a remount, with the same file in the same FIL
+    CHECK(FR_OK == f_close(&files[0]));
+    CHECK(FR_OK == f_mount(&fs, "", 1));
+    CHECK(FR_OK == f_open(&files[1], names[1], FA_READ));
+    CHECK(FR_OK == f_open(&files[2], names[0], FA_READ));
+    CHECK(seek_matches(&files[1], 1, cluster_size));
+    CHECK(seek_matches(&files[2], 0, cluster_size));
+    CHECK(fs_seek_is_fast(&files[1]) && fs_seek_is_fast(&files[2]));
+
+    CHECK(FR_OK == fs_seek_close(&files[1]));
+    CHECK(FR_OK == fs_seek_close(&files[2]));
+    return true;
+}
+
+/// @brief fs_seek_close() gives the table back at once, and a third file is turned away until then
+static bool test_seek_close_frees_slot(void)
+{
+    CHECK(format_volume());
+    CHECK(write_files());
+
+    for (int i = 0; i < 3; i++) {
+        CHECK(FR_OK == f_open(&files[i], names[i % 2], FA_READ));
+        CHECK(seek_matches(&files[i], i % 2, cluster_size + i));
+    }
+    CHECK(fs_seek_is_fast(&files[0]) && fs_seek_is_fast(&files[1]));
+    CHECK(!fs_seek_is_fast(&files[2]));
+
+    CHECK(FR_OK == fs_seek_close(&files[0]));
+    CHECK(FR_OK == f_close(&files[2]));
+    CHECK(FR_OK == f_open(&files[2], names[0], FA_READ));
+    CHECK(seek_matches(&files[2], 0, 3 * cluster_size));
+    CHECK(fs_seek_is_fast(&files[2]));
+
+    CHECK(FR_OK == fs_seek_close(&files[1]));
+    CHECK(FR_OK == fs_seek_close(&files[2]));
+    return true;
+}
+
+/// @brief Starts from a blank chip and makes a file system on it
+static bool format_volume(void)
+{
+    sim_mt29f_reset();
+    CHECK(FR_NO_FILESYSTEM == f_mount(&fs, "", 1));
+    CHECK(FR_OK == f_mkfs("", NULL, work, sizeof(work)));
+    CHECK(FR_OK == f_mount(&fs, "", 1));
+    cluster_size = fs.csize * FF_MAX_SS;
+    return true;
+}
+
+/// @brief Writes the files, a cluster at a time (syncing each, so the allocation is in order)
+static bool write_files(void)
+{
+    for (int i = 0; i < 4; i++) {
+        CHECK(FR_OK == f_open(&files[i], names[i], FA_WRITE | FA_CREATE_ALWAYS));
+    }
+
+    // files 0 and 1 in turn, then files 2 and 3 taking turns
+    const int order[] = {0, 0, 0, 0, 1, 1, 1, 1, 2, 3, 2, 3, 2, 3, 2, 3};
+    FSIZE_t written[4] = {0};
+    for (size_t n = 0; n < sizeof(order) / sizeof(order[0]); n++) {
+        const int i = order[n];
+        for (UINT done = 0; done < cluster_size; done += sizeof(buffer)) {
+            for (size_t b = 0; b < sizeof(buffer); b++) buffer[b] = pattern(i, written[i] + b);
+            UINT bw;
+            CHECK((FR_OK == f_write(&files[i], buffer, sizeof(buffer), &bw)) &&
+                  (sizeof(buffer) == bw));
+            written[i] += bw;
+        }
+        CHECK(FR_OK == f_sync(&files[i]));
+    }
+
+    for (int i = 0; i < 4; i++) {
+        CHECK(CLUSTERS * cluster_size == written[i]);
+        CHECK(FR_OK == f_close(&files[i]));
+    }
+    return true;
+}
+
+/// @brief Seeks through the module and checks the bytes found there
+static bool seek_matches(FIL *fp, uint32_t file, FSIZE_t ofs)
+{
+    uint8_t got[16];
+    UINT br;
+    CHECK(FR_OK == fs_seek_lseek(fp, ofs));
+    CHECK((FR_OK == f_read(fp, got, sizeof(got), &br)) && (sizeof(got) == br));
+    for (size_t i = 0; i < sizeof(got); i++) CHECK(pattern(file, ofs + i) == got[i]);
+    return true;
+}
+
+static uint8_t pattern(uint32_t file, FSIZE_t ofs)
+{
+    return (uint8_t)((ofs * 3) + (file * 101) + (ofs / 251));
+}
@@ -0,0 +1,315 @@
+/**
+ * @file		test_ftl_diskio.c
+ * @author		Andrew Loebs
+ * @brief		Host tests of the disk io glue at the sector size of the build (FF_MAX_SS)
+ *
+ * Drives nand_ftl_diskio.c directly, on dhara's spi backend and the MT29F model, and checks every
+ * sector read against a copy of what was written. Built once per sector size by the Makefile: at
+ * 512 bytes, four sectors share each flash page, and the write-combining stage is tested by the
+ * pages the model programs as well as by the data; at 4096, each sector spans two flash pages.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "nand_ftl_diskio.h"
+#include "sim_mt29f.h"
+#include "spi_nand.h"
+#include "test.h"
+
+// defines
+#define SECTOR_SIZE NAND_FTL_SECTOR_SIZE
+#if SECTOR_SIZE < SPI_NAND_PAGE_SIZE
+#define PACKED (SPI_NAND_PAGE_SIZE / SECTOR_SIZE) // sectors per flash page
+#else
+#define PACKED 1
+#endif
+#define SPANNED (SECTOR_SIZE > SPI_NAND_PAGE_SIZE) // each sector takes two flash pages
+#define SPAN     (64 * PACKED) // sectors the tests work in
+#define MAX_RUN  (3 * PACKED + 1)
+#define OPS      600
+#define PAGES    16 // written by test_staged_writes_one_program
+
+// private function prototypes
+static bool test_random_runs(void);
+#if PACKED > 1
+static bool test_staged_writes_one_program(void);
+static bool test_partial_page_flush(void);
+static bool test_read_through_stage(void);
+static bool test_trim_whole_pages(void);
+#endif
+#if SPANNED
+static bool test_sector_spans_two_pages(void);
+#endif
+
+static bool format_volume(void);
+static bool remount(void);
+static bool sync(void);
+static bool write_run(uint32_t sector, uint32_t count, uint32_t version);
+static bool read_matches(uint32_t sector, uint32_t count);
+#if (PACKED > 1) || SPANNED
+static uint32_t programs(void);
+#endif
+static void fill(uint8_t *data, uint32_t sector, uint32_t version);
+static uint32_t next_random(void);
+
+// private variables
+// what each sector of the span should read back as
+static uint8_t shadow[SPAN][SECTOR_SIZE];
+static uint8_t buffer[SPAN * SECTOR_SIZE];
+static uint32_t random_state = 1;
+
+// public function definitions
+int main(void)
+{
+    int failures = 0;
+    RUN(test_random_runs, failures);
+#if PACKED > 1
+    RUN(test_staged_writes_one_program, failures);
+    RUN(test_partial_page_flush, failures);
+    RUN(test_read_through_stage, failures);
+    RUN(test_trim_whole_pages, failures);
+#endif
+#if SPANNED
+    RUN(test_sector_spans_two_pages, failures);
+#endif
+
+    return failures ? 1 : 0;
+}
+
+// private function definitions
+/// @brief Runs of every length and alignment, written and read back in random order, with syncs
+/// and remounts in between -- blank sectors read back as 0xff's
+static bool test_random_runs(void)
+{
+    CHECK(format_volume());
+
+    for (uint32_t op = 0; op < OPS; op++) {
+        const uint32_t count = 1 + next_random() % MAX_RUN;
+        const uint32_t sector = next_random() % (SPAN - count + 1);
+        const uint32_t r = next_random() % 16;
+        if (r < 8) {
+            CHECK(write_run(sector, count, op));
+        }
+        else if (r < 14) {
+            CHECK(read_matches(sector, count));
+        }
+        else if (r < 15) {
+            CHECK(sync());
+        }
+        else {
+            CHECK(sync());
+            CHECK(remount());
+        }
+    }
+
+    CHECK(sync());
+    CHECK(remount());
+    CHECK(read_matches(0, SPAN));
+    return true;
+}
+
+#if PACKED > 1
+/// @brief A page written a sector at a time is programmed once, when the writes move on: as many
+/// pages as the same data written a page at a time
+static bool test_staged_writes_one_program(void)
+{
+    CHECK(format_volume());
+    uint32_t before = programs();
+    for (uint32_t slot = 0; slot < PACKED; slot++) {
+        CHECK(write_run(slot, 1, 1));
+        CHECK(before == programs());
+    }
+    CHECK(write_run(PACKED, 1, 1));
+    CHECK(before + 1 == programs());
+
+    // the same pages, sector by sector and then page by page, from a blank chip each time
+    CHECK(format_volume());
+    before = programs();
+    for (uint32_t sector = 0; sector < PAGES * PACKED; sector++) CHECK(write_run(sector, 1, 2));
+    CHECK(sync());
+    const uint32_t by_sector = programs() - before;
+
+    CHECK(format_volume());
+    before = programs();
+    for (uint32_t page = 0; page < PAGES; page++) CHECK(write_run(page * PACKED, PACKED, 2));
+    CHECK(sync());
+    const uint32_t by_page = programs() - before;
+
+    CHECK(by_sector == by_page);
+    CHECK(remount());
+    CHECK(read_matches(0, PAGES * PACKED));
+    return true;
+}
+
+/// @brief A sync programs a partly rewritten page with the rest of its sectors as they were --
+/// blank, for a page never written before
+static bool test_partial_page_flush(void)
+{
+    CHECK(format_volume());
+    CHECK(write_run(2 * PACKED, PACKED, 1));
+    CHECK(sync());
+
+    CHECK(write_run(2 * PACKED + 1, 1, 2));
+    CHECK(write_run(5 * PACKED + PACKED - 1, 1, 3));
+    CHECK(sync());
+    CHECK(remount());
+    CHECK(read_matches(0, 8 * PACKED));
+
+    // and again, after the page has been staged and left behind
+    CHECK(write_run(2 * PACKED + PACKED - 1, 1, 4));
+    CHECK(write_run(7 * PACKED, 1, 5));
+    CHECK(write_run(7 * PACKED + 1, 1, 6));
+    CHECK(sync());
+    CHECK(remount());
+    CHECK(read_matches(0, 8 * PACKED));
+    return true;
+}
+
+/// @brief Sectors of the staged page read back as written before the stage is programmed, alone
+/// or in a run streamed from the pages around it -- and a whole page written over it wins
+static bool test_read_through_stage(void)
+{
+    CHECK(format_volume());
+    CHECK(write_run(0, 4 * PACKED, 1));
+    CHECK(sync());
+
+    const uint32_t before = programs();
+    CHECK(write_run(2 * PACKED + 1, 1, 2));
+    CHECK(read_matches(2 * PACKED + 1, 1));
+    CHECK(read_matches(2 * PACKED, PACKED));
+    CHECK(read_matches(0, 4 * PACKED));
+    CHECK(read_matches(PACKED + 1, 2 * PACKED));
+    CHECK(before == programs());
+
+    CHECK(write_run(2 * PACKED, PACKED, 3));
+    CHECK(read_matches(0, 4 * PACKED));
+    // the staged copy was dropped, not left to be programmed over the new page
+    CHECK(sync());
+    CHECK(remount());
+    CHECK(read_matches(0, 4 * PACKED));
+    return true;
+}
+
+/// @brief A trim releases only the pages it covers in full, and drops the staged copy of one
+static bool test_trim_whole_pages(void)
+{
+    CHECK(format_volume());
+    CHECK(write_run(0, 4 * PACKED, 1));
+    CHECK(sync());
+    CHECK(write_run(2 * PACKED, 1, 2));
+
+    // from part way into page 0 to the end of page 2
+    LBA_t range[2] = {1, 3 * PACKED - 1};
+    CHECK(RES_OK == nand_ftl_diskio_ioctl(CTRL_TRIM, range));
+    memset(shadow[PACKED], 0xff, 2 * PACKED * SECTOR_SIZE);
+    CHECK(read_matches(0, 4 * PACKED));
+
+    CHECK(sync());
+    CHECK(remount());
+    CHECK(read_matches(0, 4 * PACKED));
+    return true;
+}
+#endif
+
+#if SPANNED
+/// @brief A sector costs two flash programs -- one per half, nothing more on a blank chip -- and
+/// comes back whole after a remount, alone or in a run
+static bool test_sector_spans_two_pages(void)
+{
+    CHECK(format_volume());
+    uint32_t before = programs();
+    CHECK(write_run(5, 1, 1));
+    CHECK(before + 2 == programs());
+
+    before = programs();
+    CHECK(write_run(8, 8, 2));
+    CHECK(before + 16 == programs());
+
+    // the last sector rewritten, so its halves no longer follow the sector before it
+    CHECK(write_run(15, 1, 3));
+    CHECK(sync());
+    CHECK(remount());
+    CHECK(read_matches(5, 1));
+    CHECK(read_matches(0, 16));
+
+    DWORD block_size;
+    CHECK(RES_OK == nand_ftl_diskio_ioctl(GET_BLOCK_SIZE, &block_size));
+    CHECK((SPI_NAND_PAGES_PER_BLOCK * SPI_NAND_DIE_COUNT / 2) == block_size);
+    return true;
+}
+#endif
+
+/// @brief Starts from a blank chip, with every sector of the span blank
+static bool format_volume(void)
+{
+    sim_mt29f_reset();
+    CHECK(0 == nand_ftl_diskio_initialize());
+    memset(shadow, 0xff, sizeof(shadow));
+
+    WORD sector_size;
+    CHECK(RES_OK == nand_ftl_diskio_ioctl(GET_SECTOR_SIZE, &sector_size));
+    CHECK(SECTOR_SIZE == sector_size);
+    return true;
+}
+
+/// @brief Mounts the volume again, as at power up -- anything not synced is lost
+static bool remount(void)
+{
+    CHECK(0 == nand_ftl_diskio_initialize());
+    return true;
+}
+
+static bool sync(void)
+{
+    CHECK(RES_OK == nand_ftl_diskio_ioctl(CTRL_SYNC, NULL));
+    return true;
+}
+
+/// @brief Writes count sectors in one call, with a pattern unique to each sector and version
+static bool write_run(uint32_t sector, uint32_t count, uint32_t version)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        fill(shadow[sector + i], sector + i, version);
+        memcpy(&buffer[i * SECTOR_SIZE], shadow[sector + i], SECTOR_SIZE);
+    }
+    CHECK(RES_OK == nand_ftl_diskio_write(buffer, sector, count));
+    return true;
+}
+
+/// @brief Reads count sectors in one call and checks them against what was written
+static bool read_matches(uint32_t sector, uint32_t count)
+{
+    CHECK(RES_OK == nand_ftl_diskio_read(buffer, sector, count));
+    for (uint32_t i = 0; i < count; i++) {
+        if (0 != memcmp(shadow[sector + i], &buffer[i * SECTOR_SIZE], SECTOR_SIZE)) {
+            printf("  sector %lu read back wrong\n", (unsigned long)(sector + i));
+            return false;
+        }
+    }
+    return true;
+}
+
+#if (PACKED > 1) || SPANNED
+/// @brief Returns the flash pages the model has programmed since it was reset
+static uint32_t programs(void)
+{
+    sim_mt29f_stats_t stats;
+    sim_mt29f_get_stats(&stats);
+    return stats.page_programs;
+}
+#endif
+
+static void fill(uint8_t *data, uint32_t sector, uint32_t version)
+{
+    for (size_t i = 0; i < SECTOR_SIZE; i++) {
+        data[i] = (uint8_t)((sector * 7) + (version * 13) + i + (i >> 8));
+    }
+}
+
+static uint32_t next_random(void)
+{
+    random_state = random_state * 1103515245 + 12345;
+    return random_state >> 16;
+}
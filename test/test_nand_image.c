@@ -0,0 +1,205 @@
+/**
+ * @file		test_nand_image.c
+ * @author		Andrew Loebs
+ * @brief		Host tests of the RAM and file image dhara_nand backends
+ *
+ * Checks the flash semantics of nand_image.c, then runs dhara maps on two RAM images and a file
+ * image side by side, resumes each from its image and reads everything back.
+ *
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/dhara/map.h"
+#include "../src/dhara/nand_image.h"
+#include "test.h"
+
+// defines
+#define LOG2_PAGE_SIZE 9
+#define PAGE_SIZE      (1 << LOG2_PAGE_SIZE)
+#define LOG2_PPB       4
+#define NUM_BLOCKS     64
+#define GC_RATIO       4
+#define WRITES         20000
+#define SYNC_PERIOD    997 // writes between syncs
+#define MAX_SECTORS    4096
+
+// private function prototypes
+static bool test_program_ands(void);
+static bool test_bad_block(void);
+static bool test_maps_side_by_side(void);
+
+static bool attach_ram(struct dhara_nand *n, dhara_nand_image_t *image, uint8_t **buffer);
+static bool run_map(const struct dhara_nand *n, unsigned int seed);
+static void fill(uint8_t *page, uint32_t sector, uint32_t version);
+
+// private variables
+static const struct dhara_nand geometry = {
+    .log2_page_size = LOG2_PAGE_SIZE,
+    .log2_ppb = LOG2_PPB,
+    .num_blocks = NUM_BLOCKS,
+};
+static uint8_t page_buffer[PAGE_SIZE];
+static uint8_t data[PAGE_SIZE];
+static uint8_t readback[PAGE_SIZE];
+// version last written to each sector by run_map (0: never written)
+static uint32_t versions[MAX_SECTORS];
+
+// public function definitions
+int main(void)
+{
+    int failures = 0;
+    RUN(test_program_ands, failures);
+    RUN(test_bad_block, failures);
+    RUN(test_maps_side_by_side, failures);
+
+    return failures ? 1 : 0;
+}
+
+// private function definitions
+/// @brief Programs AND into a page, mark it programmed even when all 0xff, and erases undo both
+static bool test_program_ands(void)
+{
+    struct dhara_nand n;
+    dhara_nand_image_t image;
+    uint8_t *buffer;
+    dhara_error_t err;
+    CHECK(attach_ram(&n, &image, &buffer));
+
+    CHECK(dhara_nand_is_free(&n, 1));
+    memset(data, 0xf0, PAGE_SIZE);
+    CHECK(0 == dhara_nand_prog(&n, 1, data, &err));
+    memset(data, 0x3c, PAGE_SIZE);
+    CHECK(0 == dhara_nand_prog(&n, 1, data, &err));
+    CHECK(!dhara_nand_is_free(&n, 1));
+    CHECK(0 == dhara_nand_read(&n, 1, 0, PAGE_SIZE, readback, &err));
+    CHECK((0x30 == readback[0]) && (0x30 == readback[PAGE_SIZE - 1]));
+
+    memset(data, 0xff, PAGE_SIZE);
+    CHECK(0 == dhara_nand_prog(&n, 2, data, &err));
+    CHECK(!dhara_nand_is_free(&n, 2));
+
+    CHECK(0 == dhara_nand_copy(&n, 1, 3, &err));
+    CHECK(0 == dhara_nand_read(&n, 3, PAGE_SIZE - 4, 4, readback, &err));
+    CHECK(0x30 == readback[3]);
+
+    CHECK(0 == dhara_nand_erase(&n, 0, &err));
+    CHECK(dhara_nand_is_free(&n, 1) && dhara_nand_is_free(&n, 2) && dhara_nand_is_free(&n, 3));
+    CHECK(0 == dhara_nand_read(&n, 1, 0, PAGE_SIZE, readback, &err));
+    CHECK((0xff == readback[0]) && (0xff == readback[PAGE_SIZE - 1]));
+
+    free(buffer);
+    return true;
+}
+
+/// @brief A bad block mark stays on its own image and block
+static bool test_bad_block(void)
+{
+    struct dhara_nand a, b;
+    dhara_nand_image_t image_a, image_b;
+    uint8_t *buffer_a, *buffer_b;
+    CHECK(attach_ram(&a, &image_a, &buffer_a));
+    CHECK(attach_ram(&b, &image_b, &buffer_b));
+
+    dhara_nand_mark_bad(&b, 5);
+    CHECK(dhara_nand_is_bad(&b, 5));
+    CHECK(!dhara_nand_is_bad(&a, 5) && !dhara_nand_is_bad(&b, 4) && !dhara_nand_is_bad(&b, 6));
+
+    free(buffer_a);
+    free(buffer_b);
+    return true;
+}
+
+/// @brief Three maps, two on RAM images (one with a bad block) and one on a file image, each
+/// written, resumed and read back; the file image ends up identical to the RAM image that went
+/// through the same writes
+static bool test_maps_side_by_side(void)
+{
+    struct dhara_nand a, b, f = geometry;
+    dhara_nand_image_t image_a, image_b, image_f;
+    uint8_t *buffer_a, *buffer_b;
+    CHECK(attach_ram(&a, &image_a, &buffer_a));
+    CHECK(attach_ram(&b, &image_b, &buffer_b));
+
+    FILE *file = tmpfile();
+    CHECK(file);
+    dhara_nand_image_init_file(&f, &image_f, file);
+    CHECK(0 == dhara_nand_image_format(&f));
+
+    dhara_nand_mark_bad(&b, 5);
+    CHECK(run_map(&a, 1));
+    CHECK(run_map(&b, 2));
+    CHECK(run_map(&f, 1));
+
+    const size_t size = dhara_nand_image_size(&f);
+    uint8_t *file_copy = malloc(size);
+    CHECK(file_copy);
+    rewind(file);
+    CHECK(size == fread(file_copy, 1, size, file));
+    CHECK(0 == memcmp(file_copy, buffer_a, size));
+
+    free(file_copy);
+    fclose(file);
+    free(buffer_a);
+    free(buffer_b);
+    return true;
+}
+
+/// @brief Attaches n to a newly allocated, formatted RAM image (freed by the caller)
+static bool attach_ram(struct dhara_nand *n, dhara_nand_image_t *image, uint8_t **buffer)
+{
+    *n = geometry;
+    *buffer = malloc(dhara_nand_image_size(n));
+    CHECK(*buffer);
+    dhara_nand_image_init_ram(n, image, *buffer);
+    CHECK(0 == dhara_nand_image_format(n));
+    return true;
+}
+
+/// @brief Random writes over half of a blank volume, then a resume from the image and a read back
+static bool run_map(const struct dhara_nand *n, unsigned int seed)
+{
+    struct dhara_map map;
+    dhara_error_t err;
+    dhara_map_init(&map, n, page_buffer, GC_RATIO);
+    dhara_map_resume(&map, &err);
+    dhara_map_clear(&map);
+
+    uint32_t span = dhara_map_capacity(&map) / 2;
+    if (span > MAX_SECTORS) span = MAX_SECTORS;
+    CHECK(span > 0);
+    memset(versions, 0, sizeof(versions));
+    srand(seed);
+    for (uint32_t i = 1; i <= WRITES; i++) {
+        const uint32_t sector = (uint32_t)rand() % span;
+        versions[sector] = i;
+        fill(data, sector, i);
+        CHECK(0 == dhara_map_write(&map, sector, data, &err));
+        if (0 == (i % SYNC_PERIOD)) CHECK(0 == dhara_map_sync(&map, &err));
+    }
+    CHECK(0 == dhara_map_sync(&map, &err));
+
+    dhara_map_init(&map, n, page_buffer, GC_RATIO);
+    CHECK(0 == dhara_map_resume(&map, &err));
+    for (uint32_t sector = 0; sector < span; sector++) {
+        CHECK(0 == dhara_map_read(&map, sector, readback, &err));
+        if (versions[sector]) {
+            fill(data, sector, versions[sector]);
+        }
+        else {
+            memset(data, 0xff, PAGE_SIZE);
+        }
+        CHECK(0 == memcmp(data, readback, PAGE_SIZE));
+    }
+    return true;
+}
+
+/// @brief Fills a page with a pattern unique to a sector and version
+static void fill(uint8_t *page, uint32_t sector, uint32_t version)
+{
+    for (size_t i = 0; i < PAGE_SIZE; i++) {
+        page[i] = (uint8_t)((sector * 7) + (version * 13) + i);
+    }
+}
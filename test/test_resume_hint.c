@@ -0,0 +1,183 @@
+/**
+ * @file		test_resume_hint.c
+ * @author		Andrew Loebs
+ * @brief		Host tests of the journal resume hints and the hint store
+ *
+ * Runs a dhara map on a RAM image of a small chip (nand_image.c), with a hint store in the blocks
+ * following the journal as nand_ftl_diskio does with NAND_FTL_RESUME_HINT. Rounds of random
+ * writes are followed by a sync or by a simulated power loss, the hint is saved or not, and every
+ * so often the volume is remounted both ways: with a full search, and from the stored hint. The
+ * two must agree.
+ *
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/dhara/hint_store.h"
+#include "../src/dhara/map.h"
+#include "../src/dhara/nand_image.h"
+#include "test.h"
+
+// defines
+#define LOG2_PAGE_SIZE 9
+#define PAGE_SIZE      (1 << LOG2_PAGE_SIZE)
+#define LOG2_PPB       4
+#define NUM_BLOCKS     256
+#define HINT_BLOCKS    2
+#define JOURNAL_BLOCKS (NUM_BLOCKS - HINT_BLOCKS)
+#define GC_RATIO       4
+#define SECTORS        1500 // sectors touched by the writes
+#define ROUNDS         3000
+#define MAX_WRITES     100 // per round
+
+// private function prototypes
+static bool test_hint_withdrawn_by_write(void);
+static bool test_random_remounts(void);
+
+static bool open_volume(void);
+static bool remount(bool *hinted_out);
+
+// private variables
+static struct dhara_nand chip = {
+    .log2_page_size = LOG2_PAGE_SIZE,
+    .log2_ppb = LOG2_PPB,
+    .num_blocks = NUM_BLOCKS,
+};
+static struct dhara_nand nand = {
+    .log2_page_size = LOG2_PAGE_SIZE,
+    .log2_ppb = LOG2_PPB,
+    .num_blocks = JOURNAL_BLOCKS,
+};
+static dhara_nand_image_t image;
+static uint8_t *image_buffer;
+static struct dhara_map map;
+static dhara_hint_store_t hint_store;
+static uint8_t page_buffer[PAGE_SIZE];
+static uint8_t hint_page_buffer[PAGE_SIZE];
+static uint8_t data[PAGE_SIZE];
+
+// public function definitions
+int main(void)
+{
+    image_buffer = malloc(dhara_nand_image_size(&chip));
+    if (!image_buffer) return 1;
+    // the journal sees the first JOURNAL_BLOCKS blocks of the image, the hint store the rest
+    dhara_nand_image_init_ram(&chip, &image, image_buffer);
+    dhara_nand_image_init_ram(&nand, &image, image_buffer);
+
+    int failures = 0;
+    RUN(test_hint_withdrawn_by_write, failures);
+    RUN(test_random_remounts, failures);
+
+    free(image_buffer);
+    return failures ? 1 : 0;
+}
+
+// private function definitions
+/// @brief A hint saved after a sync is found until it's withdrawn
+static bool test_hint_withdrawn_by_write(void)
+{
+    dhara_error_t err;
+    struct dhara_journal_hint hint, loaded;
+    CHECK(open_volume());
+
+    for (uint32_t sector = 0; sector < 100; sector++) {
+        memset(data, (uint8_t)sector, PAGE_SIZE);
+        CHECK(0 == dhara_map_write(&map, sector, data, &err));
+    }
+    CHECK(0 != dhara_hint_store_load(&hint_store, &loaded));
+    CHECK(0 == dhara_map_sync(&map, &err));
+    CHECK(0 == dhara_journal_get_hint(&map.journal, &hint));
+    CHECK(0 == dhara_hint_store_save(&hint_store, &hint, &err));
+
+    dhara_hint_store_init(&hint_store, &nand, JOURNAL_BLOCKS, HINT_BLOCKS, hint_page_buffer);
+    CHECK(0 == dhara_hint_store_load(&hint_store, &loaded));
+    CHECK((hint.checkpoint == loaded.checkpoint) && (hint.epoch == loaded.epoch));
+
+    CHECK(0 == dhara_hint_store_withdraw(&hint_store, &err));
+    dhara_hint_store_init(&hint_store, &nand, JOURNAL_BLOCKS, HINT_BLOCKS, hint_page_buffer);
+    CHECK(0 != dhara_hint_store_load(&hint_store, &loaded));
+    return true;
+}
+
+/// @brief Random writes, syncs, power losses and hint saves; every hinted mount matches a full one
+static bool test_random_remounts(void)
+{
+    dhara_error_t err;
+    struct dhara_journal_hint hint;
+    uint32_t hinted = 0;
+    CHECK(open_volume());
+
+    srand(5);
+    for (int round = 0; round < ROUNDS; round++) {
+        // as nand_ftl_diskio: withdraw before writing, save after a sync
+        CHECK(0 == dhara_hint_store_withdraw(&hint_store, &err));
+        const int writes = rand() % MAX_WRITES;
+        for (int i = 0; i < writes; i++) {
+            data[0] = (uint8_t)i;
+            CHECK(0 == dhara_map_write(&map, (uint32_t)rand() % SECTORS, data, &err));
+        }
+        // 1 in 8: power lost before the sync; 1 in 4: power lost before the hint is saved
+        if (rand() % 8) CHECK(0 == dhara_map_sync(&map, &err));
+        if ((rand() % 4) && !dhara_journal_get_hint(&map.journal, &hint)) {
+            CHECK(0 == dhara_hint_store_save(&hint_store, &hint, &err));
+        }
+        if (0 == (rand() % 3)) {
+            bool used_hint;
+            CHECK(remount(&used_hint));
+            if (used_hint) hinted++;
+        }
+    }
+
+    // make sure the hinted path got exercised
+    CHECK(hinted > (ROUNDS / 10));
+    return true;
+}
+
+/// @brief Formats the image and opens a blank volume and hint store on it
+static bool open_volume(void)
+{
+    dhara_error_t err;
+    CHECK(0 == dhara_nand_image_format(&chip));
+    dhara_map_init(&map, &nand, page_buffer, GC_RATIO);
+    dhara_map_resume(&map, &err);
+    dhara_map_clear(&map);
+    dhara_hint_store_init(&hint_store, &nand, JOURNAL_BLOCKS, HINT_BLOCKS, hint_page_buffer);
+    return true;
+}
+
+/// @brief Remounts with a full search, then from the hint store (if it holds a hint), and checks
+/// both find the same journal; carries on with the second one
+static bool remount(bool *hinted_out)
+{
+    dhara_error_t err;
+    dhara_map_init(&map, &nand, page_buffer, GC_RATIO);
+    CHECK(0 == dhara_map_resume(&map, &err));
+    const struct dhara_journal full = map.journal;
+    const dhara_sector_t count = map.count;
+
+    struct dhara_journal_hint hint;
+    dhara_hint_store_init(&hint_store, &nand, JOURNAL_BLOCKS, HINT_BLOCKS, hint_page_buffer);
+    dhara_map_init(&map, &nand, page_buffer, GC_RATIO);
+    *hinted_out = !dhara_hint_store_load(&hint_store, &hint);
+    if (*hinted_out) {
+        CHECK(0 == dhara_map_resume_hint(&map, &hint, &err));
+    }
+    else {
+        CHECK(0 == dhara_map_resume(&map, &err));
+    }
+
+    const struct dhara_journal *j = &map.journal;
+    CHECK((full.root == j->root) && (full.head == j->head) && (full.tail == j->tail));
+    CHECK((full.epoch == j->epoch) && (full.flags == j->flags));
+    CHECK((full.bb_current == j->bb_current) && (full.bb_last == j->bb_last));
+    CHECK(count == map.count);
+
+    // a stale hint is replaced at mount, as nand_ftl_diskio does
+    if (!dhara_journal_get_hint(j, &hint)) {
+        CHECK(0 == dhara_hint_store_save(&hint_store, &hint, &err));
+    }
+    return true;
+}
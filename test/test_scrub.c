@@ -0,0 +1,198 @@
+/**
+ * @file		test_scrub.c
+ * @author		Andrew Loebs
+ * @brief		Host tests of the ftl scrub module
+ *
+ * Runs dhara on the MT29F model (nand_spi.c and spi_nand.c on sim/sim_mt29f.c), with ftl_scrub as
+ * the backend's refresh hook as nand_ftl_diskio sets it up. The model is made to report ECC
+ * status on chosen pages, and the tests follow those pages from the read that reports them to
+ * their relocation.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../src/dhara/map.h"
+#include "../src/dhara/nand_spi.h"
+#include "ftl_scrub.h"
+#include "sim_mt29f.h"
+#include "spi_nand.h"
+#include "sys_time.h"
+#include "test.h"
+
+// defines
+#define GC_RATIO 4
+#define SECTORS  100
+
+// ECC status of a read (see the MT29F datasheet)
+#define ECC_REFRESH       0b011 // 4-6 bits corrected, refresh advised
+#define ECC_NOT_CORRECTED 0b010
+
+// private function prototypes
+static bool test_read_refresh_relocated(void);
+static bool test_patrol_queues_refresh(void);
+static bool test_patrol_passes_uncorrectable(void);
+
+static bool open_volume(void);
+static bool check_sector(uint32_t sector);
+static uint32_t sector_page(uint32_t sector);
+static void fill(uint8_t *page, uint32_t sector);
+
+// private variables
+static dhara_nand_spi_t spi = {.refresh = ftl_scrub_report};
+static struct dhara_nand nand = {
+    .log2_page_size = SPI_NAND_LOG2_PAGE_SIZE,
+    .log2_ppb = SPI_NAND_LOG2_PAGES_PER_BLOCK,
+    .num_blocks = SPI_NAND_BLOCKS_PER_LUN,
+    .ops = &dhara_nand_spi_ops,
+    .ctx = &spi,
+};
+static struct dhara_map map;
+static uint8_t page_buffer[SPI_NAND_PAGE_SIZE];
+static uint8_t data[SPI_NAND_PAGE_SIZE];
+static uint8_t readback[SPI_NAND_PAGE_SIZE];
+
+// public function definitions
+int main(void)
+{
+    int failures = 0;
+    RUN(test_read_refresh_relocated, failures);
+    RUN(test_patrol_queues_refresh, failures);
+    RUN(test_patrol_passes_uncorrectable, failures);
+
+    return failures ? 1 : 0;
+}
+
+// private function definitions
+/// @brief A read with a refresh advised succeeds and queues its page, which ftl_scrub_relocate()
+/// then moves to the head of the journal
+static bool test_read_refresh_relocated(void)
+{
+    dhara_error_t err;
+    ftl_scrub_stats_t stats;
+    CHECK(open_volume());
+
+    ftl_scrub_get_stats(&stats);
+    const ftl_scrub_stats_t before = stats;
+    const uint32_t worn = sector_page(42);
+    sim_mt29f_inject_ecc(worn, ECC_REFRESH);
+    CHECK(!ftl_scrub_pending());
+    CHECK(check_sector(42));
+    CHECK(ftl_scrub_pending());
+    ftl_scrub_get_stats(&stats);
+    CHECK((stats.reported == before.reported + 1) && (stats.relocated == before.relocated));
+
+    // reading it again doesn't queue it twice
+    CHECK(check_sector(42));
+    ftl_scrub_get_stats(&stats);
+    CHECK(stats.reported == before.reported + 1);
+
+    CHECK(0 == ftl_scrub_relocate(&err));
+    CHECK(!ftl_scrub_pending());
+    ftl_scrub_get_stats(&stats);
+    CHECK(stats.relocated == before.relocated + 1);
+    CHECK(sector_page(42) != worn);
+    CHECK(check_sector(42));
+
+    // the move survives a remount, and the other sectors are untouched
+    CHECK(0 == dhara_map_sync(&map, &err));
+    dhara_map_init(&map, &nand, page_buffer, GC_RATIO);
+    CHECK(0 == dhara_map_resume(&map, &err));
+    CHECK(sector_page(42) != worn);
+    for (uint32_t sector = 0; sector < SECTORS; sector++) CHECK(check_sector(sector));
+    return true;
+}
+
+/// @brief The patrol finds a worn page that nothing reads, and it's relocated
+static bool test_patrol_queues_refresh(void)
+{
+    dhara_error_t err;
+    ftl_scrub_stats_t stats;
+    CHECK(open_volume());
+
+    ftl_scrub_get_stats(&stats);
+    const ftl_scrub_stats_t before = stats;
+    const uint32_t worn = sector_page(7);
+    sim_mt29f_inject_ecc(worn, ECC_REFRESH);
+    for (int i = 0; (i < 1000) && !ftl_scrub_pending(); i++) {
+        sys_time_delay(FTL_SCRUB_PATROL_INTERVAL_MS);
+        CHECK(0 == ftl_scrub_patrol(&err));
+    }
+    CHECK(ftl_scrub_pending());
+
+    CHECK(0 == ftl_scrub_relocate(&err));
+    ftl_scrub_get_stats(&stats);
+    CHECK((stats.reported == before.reported + 1) && (stats.relocated == before.relocated + 1));
+    CHECK(stats.patrolled > before.patrolled);
+    CHECK(sector_page(7) != worn);
+    CHECK(check_sector(7));
+    return true;
+}
+
+/// @brief An uncorrectable page is lost either way: the patrol goes on past it
+static bool test_patrol_passes_uncorrectable(void)
+{
+    dhara_error_t err;
+    ftl_scrub_stats_t stats;
+    CHECK(open_volume());
+
+    sim_mt29f_inject_ecc(sector_page(3), ECC_NOT_CORRECTED);
+    CHECK(0 != dhara_map_read(&map, 3, readback, &err));
+    CHECK(DHARA_E_ECC == err);
+
+    ftl_scrub_get_stats(&stats);
+    const uint32_t passes = stats.passes;
+    for (int i = 0; (i < 1000) && (stats.passes == passes); i++) {
+        sys_time_delay(FTL_SCRUB_PATROL_INTERVAL_MS);
+        CHECK(0 == ftl_scrub_patrol(&err));
+        ftl_scrub_get_stats(&stats);
+    }
+    CHECK(stats.passes > passes);
+    CHECK(!ftl_scrub_pending());
+    return true;
+}
+
+/// @brief Starts from a blank chip, writes and syncs the first sectors, and attaches the scrub
+static bool open_volume(void)
+{
+    dhara_error_t err;
+    sim_mt29f_reset();
+    CHECK(SPI_NAND_RET_OK == spi_nand_init());
+    dhara_map_init(&map, &nand, page_buffer, GC_RATIO);
+    dhara_map_resume(&map, &err);
+
+    for (uint32_t sector = 0; sector < SECTORS; sector++) {
+        fill(data, sector);
+        CHECK(0 == dhara_map_write(&map, sector, data, &err));
+    }
+    CHECK(0 == dhara_map_sync(&map, &err));
+    ftl_scrub_init(&map);
+    return true;
+}
+
+static bool check_sector(uint32_t sector)
+{
+    dhara_error_t err;
+    CHECK(0 == dhara_map_read(&map, sector, readback, &err));
+    fill(data, sector);
+    CHECK(0 == memcmp(data, readback, SPI_NAND_PAGE_SIZE));
+    return true;
+}
+
+/// @brief Returns the page holding a sector -- with one die, that's also its flash row
+static uint32_t sector_page(uint32_t sector)
+{
+    dhara_error_t err;
+    dhara_page_t p = DHARA_PAGE_NONE;
+    dhara_map_find(&map, sector, &p, &err);
+    return p;
+}
+
+/// @brief Fills a page with a pattern unique to a sector
+static void fill(uint8_t *page, uint32_t sector)
+{
+    for (size_t i = 0; i < SPI_NAND_PAGE_SIZE; i++) {
+        page[i] = (uint8_t)((sector * 7) + i);
+    }
+}
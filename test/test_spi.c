@@ -0,0 +1,231 @@
+/**
+ * @file		test_spi.c
+ * @author		Andrew Loebs
+ * @brief		Host tests of the SPI1 polled transfers
+ *
+ * Runs spi.c on the register model of SPI1 (sim/sim_spi1.c), which keeps the peripheral's fifos
+ * and flags and counts every data register access. Built with and without SPI_USE_FIFO_PACKING:
+ * both have to move the bytes of odd and even lengths unchanged, without an overrun or a read of
+ * a byte not yet there, and leave the rx fifo empty and its threshold at one byte, on success and
+ * on a timeout. The packed build also has to send a transfer back to back, mostly two bytes per
+ * access.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "sim_spi1.h"
+#include "spi.h"
+#include "st/ll/stm32l4xx_ll_spi.h"
+#include "sys_time.h"
+#include "test.h"
+
+// defines
+#define MAX_LEN 2176
+#define TIMEOUT 100 // ms
+
+// private function prototypes
+static bool test_lengths(void);
+static bool test_bus_speeds(void);
+static bool test_null_buffers(void);
+static bool test_command_header(void);
+static bool test_timeout(void);
+
+static bool transfer_matches(size_t len);
+static bool left_clean(void);
+static void connect(size_t len);
+
+// private variables
+static uint8_t write_data[MAX_LEN];
+static uint8_t read_data[MAX_LEN];
+static uint8_t mosi[MAX_LEN];
+static uint8_t miso[MAX_LEN];
+static const size_t lengths[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 31, 32, 255, 256, 2048, 2051};
+
+// public function definitions
+int main(void)
+{
+    sim_spi1_reset();
+    spi_init();
+    for (size_t i = 0; i < MAX_LEN; i++) {
+        write_data[i] = (uint8_t)(i * 7 + 3);
+        miso[i] = (uint8_t)(i * 13 + (i >> 8) + 1);
+    }
+
+    int failures = 0;
+    RUN(test_lengths, failures);
+    RUN(test_bus_speeds, failures);
+    RUN(test_null_buffers, failures);
+    RUN(test_command_header, failures);
+    RUN(test_timeout, failures);
+
+    return failures ? 1 : 0;
+}
+
+// private function definitions
+/// @brief Odd and even lengths go through unchanged -- packed, with a single byte access at most
+/// at each end of an odd one, and no gap on the wire
+static bool test_lengths(void)
+{
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        const size_t len = lengths[i];
+        sim_spi1_reset();
+        CHECK(transfer_matches(len));
+
+        sim_spi1_stats_t stats;
+        sim_spi1_get_stats(&stats);
+        CHECK(len == stats.bytes);
+        CHECK(len == (2 * stats.writes16 + stats.writes8));
+        CHECK(len == (2 * stats.reads16 + stats.reads8));
+#if SPI_USE_FIFO_PACKING
+        CHECK(1 == stats.bursts);
+        CHECK(stats.writes8 <= (len % 2) + 1);
+        CHECK(stats.reads8 == len % 2);
+#else
+        CHECK(0 == (stats.writes16 + stats.reads16));
+        CHECK(len == stats.bursts);
+#endif
+    }
+    return true;
+}
+
+/// @brief A bus as fast as the polling loop doesn't overrun the rx fifo, and a slow one doesn't
+/// starve it -- nor does a CPU called away while the bus runs on, for however long
+static bool test_bus_speeds(void)
+{
+    const uint32_t speeds[] = {1, 2, 3, 32};
+    const uint32_t interruptions[] = {0, 3, 7, 50};
+    for (size_t s = 0; s < sizeof(speeds) / sizeof(speeds[0]); s++) {
+        for (size_t n = 0; n < sizeof(interruptions) / sizeof(interruptions[0]); n++) {
+            for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+                sim_spi1_reset();
+                sim_spi1_set_speed(speeds[s]);
+                sim_spi1_set_interruptions(interruptions[n]);
+                CHECK(transfer_matches(lengths[i]));
+            }
+        }
+    }
+    return true;
+}
+
+/// @brief A read sends 0x00's, a write drops what comes back, and a missing buffer is refused
+/// without anything going out
+static bool test_null_buffers(void)
+{
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        const size_t len = lengths[i];
+        sim_spi1_reset();
+        connect(len);
+        CHECK(SPI_RET_OK == spi_read(read_data, len, TIMEOUT));
+        for (size_t b = 0; b < len; b++) CHECK(0 == mosi[b]);
+        CHECK(0 == memcmp(miso, read_data, len));
+        CHECK(left_clean());
+
+        sim_spi1_reset();
+        connect(len);
+        CHECK(SPI_RET_OK == spi_write(write_data, len, TIMEOUT));
+        CHECK(0 == memcmp(write_data, mosi, len));
+        CHECK(left_clean());
+    }
+
+    sim_spi1_reset();
+    CHECK(SPI_RET_NULL_PTR == spi_write(NULL, 4, TIMEOUT));
+    CHECK(SPI_RET_NULL_PTR == spi_read(NULL, 4, TIMEOUT));
+    CHECK(SPI_RET_NULL_PTR == spi_write_read(write_data, NULL, 4, TIMEOUT));
+    CHECK(SPI_RET_NULL_PTR == spi_write_read(NULL, read_data, 4, TIMEOUT));
+    sim_spi1_stats_t stats;
+    sim_spi1_get_stats(&stats);
+    CHECK(0 == stats.bytes);
+    return true;
+}
+
+/// @brief A command sends its instruction, address (MSB first) and dummy bytes ahead of the data
+static bool test_command_header(void)
+{
+    const spi_command_t cmd = {
+        .instruction = 0x0B,
+        .address_len = 3,
+        .address = 0x123456,
+        .dummy_cycles = 8,
+        .data_lines = 1,
+    };
+    const uint8_t header[] = {0x0B, 0x12, 0x34, 0x56, 0x00};
+    const size_t len = 2048 + 64;
+
+    sim_spi1_reset();
+    connect(sizeof(header) + len);
+    CHECK(SPI_RET_OK == spi_command_read(&cmd, read_data, len, TIMEOUT));
+    CHECK(0 == memcmp(header, mosi, sizeof(header)));
+    CHECK(0 == memcmp(&miso[sizeof(header)], read_data, len));
+    CHECK(left_clean());
+
+    sim_spi1_reset();
+    connect(sizeof(header) + len);
+    CHECK(SPI_RET_OK == spi_command_write(&cmd, write_data, len, TIMEOUT));
+    CHECK(0 == memcmp(header, mosi, sizeof(header)));
+    CHECK(0 == memcmp(write_data, &mosi[sizeof(header)], len));
+    CHECK(left_clean());
+
+    const spi_command_t dual = {.instruction = 0x3B, .data_lines = 2};
+    CHECK(SPI_RET_BAD_CMD == spi_command_read(&dual, read_data, len, TIMEOUT));
+    return true;
+}
+
+/// @brief A bus that stops part way, or before the first byte, times the transfer out -- in time,
+/// and with the rx fifo threshold set back to one byte for the next one
+static bool test_timeout(void)
+{
+    const uint32_t stall_after[] = {0, 1, 2, 7, 100};
+    for (size_t i = 0; i < sizeof(stall_after) / sizeof(stall_after[0]); i++) {
+        sim_spi1_reset();
+        connect(256);
+        sim_spi1_stall_after(stall_after[i]);
+        const uint32_t start = sys_time_get_ms();
+        CHECK(SPI_RET_TIMEOUT == spi_write_read(write_data, read_data, 256, TIMEOUT));
+        const uint32_t elapsed = sys_time_get_elapsed(start);
+        CHECK((elapsed >= TIMEOUT) && (elapsed <= TIMEOUT + 1));
+        CHECK(sim_spi1_rx_threshold_quarter());
+
+        sim_spi1_stats_t stats;
+        sim_spi1_get_stats(&stats);
+        CHECK(stall_after[i] == stats.bytes);
+        CHECK(0 == (stats.overruns + stats.misuses));
+        CHECK(0 == memcmp(write_data, mosi, stall_after[i]));
+    }
+    return true;
+}
+
+/// @brief Runs a full duplex transfer of len bytes and checks both directions
+static bool transfer_matches(size_t len)
+{
+    connect(len);
+    CHECK(SPI_RET_OK == spi_write_read(write_data, read_data, len, TIMEOUT));
+    CHECK(0 == memcmp(write_data, mosi, len));
+    CHECK(0 == memcmp(miso, read_data, len));
+    CHECK(left_clean());
+    return true;
+}
+
+/// @brief Checks that a transfer left nothing behind: no byte lost or misread, none waiting, and
+/// rxne back on a single byte
+static bool left_clean(void)
+{
+    sim_spi1_stats_t stats;
+    sim_spi1_get_stats(&stats);
+    CHECK(0 == stats.overruns);
+    CHECK(0 == stats.misuses);
+    CHECK(!sim_spi1_ovr());
+    CHECK(0 == sim_spi1_rx_level());
+    CHECK(sim_spi1_rx_threshold_quarter());
+    CHECK(!LL_SPI_IsActiveFlag_BSY(SPI1));
+    return true;
+}
+
+/// @brief Points the model at fresh buffers for the next len bytes
+static void connect(size_t len)
+{
+    memset(mosi, 0xa5, sizeof(mosi));
+    memset(read_data, 0x5a, sizeof(read_data));
+    sim_spi1_connect(mosi, miso, len);
+}
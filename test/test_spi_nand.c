@@ -0,0 +1,325 @@
+/**
+ * @file		test_spi_nand.c
+ * @author		Andrew Loebs
+ * @brief		Host tests of the spi nand module
+ *
+ * Runs spi_nand.c against the MT29F model (sim/sim_mt29f.c). The Makefile builds it for SPI1 (x1
+ * cache commands) with the cache transfers completing in the background (as on DMA) and in place
+ * (as without SPI_USE_DMA), with SPI_USE_QUADSPI (x4 cache commands) and with four dies.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "sim_mt29f.h"
+#include "spi_nand.h"
+#include "test.h"
+
+// defines
+#define PAGE_BYTES (SPI_NAND_PAGE_SIZE + SPI_NAND_OOB_SIZE)
+#define USER_COLUMN (SPI_NAND_PAGE_SIZE + SPI_NAND_OOB_USER_OFFSET)
+
+#define ECC_STATUS_4_6_REFRESH   0b011
+#define ECC_STATUS_NOT_CORRECTED 0b010
+
+// private function prototypes
+static bool test_program_and_read(void);
+static bool test_program_with_oob(void);
+static bool test_read_pages(void);
+static bool test_start_and_poll(void);
+static bool test_erase_and_is_free(void);
+static bool test_copy_with_oob(void);
+static bool test_ecc_status(void);
+static bool test_program_and_erase_fail(void);
+static bool test_bad_block_mark(void);
+static bool test_dies_run_concurrently(void);
+
+static bool setup(void);
+static row_address_t row_at(uint32_t block, uint32_t page);
+static void fill(uint8_t *data, size_t len, uint32_t seed);
+
+// private variables
+static uint8_t data[SPI_NAND_PAGE_SIZE * 8];
+static uint8_t readback[SPI_NAND_PAGE_SIZE * 8];
+
+// public function definitions
+int main(void)
+{
+    int failures = 0;
+    RUN(test_program_and_read, failures);
+    RUN(test_program_with_oob, failures);
+    RUN(test_read_pages, failures);
+    RUN(test_start_and_poll, failures);
+    RUN(test_erase_and_is_free, failures);
+    RUN(test_copy_with_oob, failures);
+    RUN(test_ecc_status, failures);
+    RUN(test_program_and_erase_fail, failures);
+    RUN(test_bad_block_mark, failures);
+    RUN(test_dies_run_concurrently, failures);
+
+    return failures ? 1 : 0;
+}
+
+// private function definitions
+static bool test_program_and_read(void)
+{
+    CHECK(setup());
+    const row_address_t row = row_at(3, 5);
+
+    fill(data, SPI_NAND_PAGE_SIZE, 1);
+    CHECK(SPI_NAND_RET_OK == spi_nand_page_program(row, 0, data, SPI_NAND_PAGE_SIZE));
+    CHECK(SPI_NAND_RET_OK == spi_nand_page_read(row, 0, readback, SPI_NAND_PAGE_SIZE));
+    CHECK(0 == memcmp(data, readback, SPI_NAND_PAGE_SIZE));
+
+    // part of a page, and the (unwritten) spare area behind it
+    CHECK(SPI_NAND_RET_OK == spi_nand_page_read(row, 100, readback, 50));
+    CHECK(0 == memcmp(&data[100], readback, 50));
+    CHECK(SPI_NAND_RET_OK == spi_nand_page_read(row, SPI_NAND_PAGE_SIZE, readback, 4));
+    CHECK(0xff == readback[0] && 0xff == readback[3]);
+
+    // out of range
+    CHECK(SPI_NAND_RET_BAD_ADDRESS == spi_nand_page_read(row, PAGE_BYTES, readback, 1));
+    CHECK(SPI_NAND_RET_INVALID_LEN == spi_nand_page_read(row, 100, readback, PAGE_BYTES));
+    CHECK(SPI_NAND_RET_BAD_ADDRESS ==
+          spi_nand_page_read(row_at(SPI_NAND_BLOCK_COUNT, 0), 0, readback, 1));
+    return true;
+}
+
+static bool test_program_with_oob(void)
+{
+    CHECK(setup());
+    const row_address_t row = row_at(7, 0);
+    uint8_t oob[SPI_NAND_OOB_USER_SIZE];
+    fill(oob, sizeof(oob), 2);
+
+    // main area and spare area in one program
+    fill(data, SPI_NAND_PAGE_SIZE, 3);
+    CHECK(SPI_NAND_RET_OK ==
+          spi_nand_page_program_with_oob(row, data, USER_COLUMN, oob, sizeof(oob)));
+    CHECK(SPI_NAND_RET_OK == spi_nand_page_read(row, 0, readback, PAGE_BYTES));
+    CHECK(0 == memcmp(data, readback, SPI_NAND_PAGE_SIZE));
+    CHECK(0 == memcmp(oob, &readback[USER_COLUMN], sizeof(oob)));
+    CHECK(0xff == readback[SPI_NAND_PAGE_SIZE]); // bad block mark untouched
+
+    // spare area only: the main area stays erased
+    const row_address_t row2 = row_at(7, 1);
+    CHECK(SPI_NAND_RET_OK ==
+          spi_nand_page_program_with_oob(row2, NULL, USER_COLUMN, oob, sizeof(oob)));
+    CHECK(SPI_NAND_RET_OK == spi_nand_page_read(row2, 0, readback, PAGE_BYTES));
+    CHECK(0xff == readback[0] && 0xff == readback[SPI_NAND_PAGE_SIZE - 1]);
+    CHECK(0 == memcmp(oob, &readback[USER_COLUMN], sizeof(oob)));
+    return true;
+}
+
+static bool test_read_pages(void)
+{
+    CHECK(setup());
+
+    // a run crossing from one block into the next
+    const row_address_t first = row_at(1, SPI_NAND_PAGES_PER_BLOCK - 3);
+    fill(data, sizeof(data), 4);
+    for (int i = 0; i < 8; i++) {
+        const row_address_t row = {.whole = first.whole + i};
+        CHECK(SPI_NAND_RET_OK == spi_nand_page_program(row, 0, &data[i * SPI_NAND_PAGE_SIZE],
+                                                       SPI_NAND_PAGE_SIZE));
+    }
+
+    memset(readback, 0, sizeof(readback));
+    CHECK(SPI_NAND_RET_OK == spi_nand_read_pages(first, 8, readback));
+    CHECK(0 == memcmp(data, readback, sizeof(data)));
+
+    // a single page goes without the cache read commands
+    CHECK(SPI_NAND_RET_OK == spi_nand_read_pages(first, 1, readback));
+    CHECK(0 == memcmp(data, readback, SPI_NAND_PAGE_SIZE));
+
+    CHECK(SPI_NAND_RET_INVALID_LEN == spi_nand_read_pages(first, 0, readback));
+    return true;
+}
+
+static bool test_start_and_poll(void)
+{
+    CHECK(setup());
+    const row_address_t row = row_at(2, 0);
+    spi_nand_stats_t before;
+    spi_nand_get_stats(&before);
+
+    fill(data, SPI_NAND_PAGE_SIZE, 5);
+    CHECK(SPI_NAND_RET_OK == spi_nand_page_program_start(row, 0, data, SPI_NAND_PAGE_SIZE));
+    // the die is taken until the program is done
+    CHECK(SPI_NAND_RET_BUSY == spi_nand_page_read_start(row, 0, readback, 1));
+    CHECK(SPI_NAND_RET_BUSY == spi_nand_block_erase_start(row));
+
+    int ret;
+    int polls = 0;
+    while (SPI_NAND_RET_BUSY == (ret = spi_nand_poll())) polls++;
+    CHECK(SPI_NAND_RET_OK == ret);
+    CHECK(polls > 0);
+    // each result is reported once
+    CHECK(SPI_NAND_RET_OK == spi_nand_poll());
+
+    CHECK(SPI_NAND_RET_OK == spi_nand_page_read_start(row, 0, readback, SPI_NAND_PAGE_SIZE));
+    CHECK(SPI_NAND_RET_OK == spi_nand_wait());
+    CHECK(0 == memcmp(data, readback, SPI_NAND_PAGE_SIZE));
+
+    // the learned timings follow the chip
+    spi_nand_stats_t stats;
+    spi_nand_get_stats(&stats);
+    CHECK(1 == stats.page_programs - before.page_programs);
+    CHECK(1 == stats.page_reads - before.page_reads);
+    CHECK(stats.t_program_us > 150 && stats.t_program_us < 300);
+    return true;
+}
+
+static bool test_erase_and_is_free(void)
+{
+    CHECK(setup());
+    const row_address_t row = row_at(9, 12);
+    bool is_free;
+
+    CHECK(SPI_NAND_RET_OK == spi_nand_page_is_free(row, &is_free));
+    CHECK(is_free);
+
+    // a page programmed beyond the bytes probed first still isn't free
+    uint8_t byte = 0x00;
+    CHECK(SPI_NAND_RET_OK == spi_nand_page_program(row, 1000, &byte, 1));
+    CHECK(SPI_NAND_RET_OK == spi_nand_page_is_free(row, &is_free));
+    CHECK(!is_free);
+
+    CHECK(SPI_NAND_RET_OK == spi_nand_block_erase(row));
+    CHECK(1 == sim_mt29f_erase_count(9));
+    CHECK(SPI_NAND_RET_OK == spi_nand_page_is_free(row, &is_free));
+    CHECK(is_free);
+    return true;
+}
+
+static bool test_copy_with_oob(void)
+{
+    CHECK(setup());
+    const row_address_t src = row_at(4, 2);
+    const row_address_t dest = row_at(5, 0);
+    uint8_t oob[SPI_NAND_OOB_USER_SIZE];
+
+    fill(data, SPI_NAND_PAGE_SIZE, 6);
+    fill(oob, sizeof(oob), 7);
+    CHECK(SPI_NAND_RET_OK ==
+          spi_nand_page_program_with_oob(src, data, USER_COLUMN, oob, sizeof(oob)));
+
+    // the main area moves inside the chip, the spare area run is replaced
+    fill(oob, sizeof(oob), 8);
+    CHECK(SPI_NAND_RET_OK == spi_nand_page_copy_with_oob(src, dest, USER_COLUMN, oob, 4));
+    CHECK(SPI_NAND_RET_OK == spi_nand_page_read(dest, 0, readback, PAGE_BYTES));
+    CHECK(0 == memcmp(data, readback, SPI_NAND_PAGE_SIZE));
+    CHECK(0 == memcmp(oob, &readback[USER_COLUMN], 4));
+
+    // a plain copy keeps the spare area
+    const row_address_t dest2 = row_at(5, 1);
+    CHECK(SPI_NAND_RET_OK == spi_nand_page_copy(dest, dest2));
+    CHECK(SPI_NAND_RET_OK == spi_nand_page_read(dest2, 0, data, PAGE_BYTES));
+    CHECK(0 == memcmp(data, readback, PAGE_BYTES));
+    return true;
+}
+
+static bool test_ecc_status(void)
+{
+    CHECK(setup());
+    const row_address_t worn = row_at(6, 3);
+    const row_address_t lost = row_at(6, 4);
+
+    fill(data, SPI_NAND_PAGE_SIZE * 2, 9);
+    CHECK(SPI_NAND_RET_OK == spi_nand_page_program(worn, 0, data, SPI_NAND_PAGE_SIZE));
+    CHECK(SPI_NAND_RET_OK ==
+          spi_nand_page_program(lost, 0, &data[SPI_NAND_PAGE_SIZE], SPI_NAND_PAGE_SIZE));
+    sim_mt29f_inject_ecc(worn.whole, ECC_STATUS_4_6_REFRESH);
+    sim_mt29f_inject_ecc(lost.whole, ECC_STATUS_NOT_CORRECTED);
+
+    // corrected data still arrives, with the advice to rewrite it
+    CHECK(SPI_NAND_RET_ECC_REFRESH == spi_nand_page_read(worn, 0, readback, SPI_NAND_PAGE_SIZE));
+    CHECK(0 == memcmp(data, readback, SPI_NAND_PAGE_SIZE));
+    CHECK(SPI_NAND_RET_ECC_ERR == spi_nand_page_read(lost, 0, readback, SPI_NAND_PAGE_SIZE));
+
+    // streamed reads return the worst result of the run, after every page
+    CHECK(SPI_NAND_RET_ECC_REFRESH == spi_nand_read_pages(row_at(6, 2), 2, readback));
+    CHECK(SPI_NAND_RET_ECC_ERR == spi_nand_read_pages(worn, 2, readback));
+    CHECK(0 == memcmp(data, readback, SPI_NAND_PAGE_SIZE * 2));
+
+    // a copy of a worn page goes ahead -- the destination is the rewrite
+    CHECK(SPI_NAND_RET_OK == spi_nand_page_copy(worn, row_at(6, 10)));
+    CHECK(SPI_NAND_RET_OK == spi_nand_page_read(row_at(6, 10), 0, readback, SPI_NAND_PAGE_SIZE));
+    CHECK(0 == memcmp(data, readback, SPI_NAND_PAGE_SIZE));
+    return true;
+}
+
+static bool test_program_and_erase_fail(void)
+{
+    CHECK(setup());
+    const row_address_t row = row_at(8, 0);
+
+    fill(data, SPI_NAND_PAGE_SIZE, 10);
+    sim_mt29f_inject_program_fail(row.whole);
+    CHECK(SPI_NAND_RET_P_FAIL == spi_nand_page_program(row, 0, data, SPI_NAND_PAGE_SIZE));
+    CHECK(SPI_NAND_RET_OK == spi_nand_page_program(row, 0, data, SPI_NAND_PAGE_SIZE));
+
+    sim_mt29f_inject_erase_fail(8);
+    CHECK(SPI_NAND_RET_OK == spi_nand_block_erase_start(row));
+    CHECK(SPI_NAND_RET_E_FAIL == spi_nand_wait());
+    CHECK(SPI_NAND_RET_OK == spi_nand_page_read(row, 0, readback, SPI_NAND_PAGE_SIZE));
+    CHECK(0 == memcmp(data, readback, SPI_NAND_PAGE_SIZE));
+    return true;
+}
+
+static bool test_bad_block_mark(void)
+{
+    CHECK(setup());
+    const row_address_t row = row_at(11, 0);
+    bool is_bad;
+
+    CHECK(SPI_NAND_RET_OK == spi_nand_block_is_bad(row, &is_bad));
+    CHECK(!is_bad);
+    CHECK(SPI_NAND_RET_OK == spi_nand_block_mark_bad(row));
+    CHECK(SPI_NAND_RET_OK == spi_nand_block_is_bad(row, &is_bad));
+    CHECK(is_bad);
+    return true;
+}
+
+/// @brief Erases one block on every die at once -- about as long as a single erase
+static bool test_dies_run_concurrently(void)
+{
+    CHECK(setup());
+
+    const double start = sim_mt29f_now_us();
+    for (int die = 0; die < SPI_NAND_DIE_COUNT; die++) {
+        const row_address_t row = row_at(die * SPI_NAND_BLOCKS_PER_LUN + 1, 0);
+        CHECK(SPI_NAND_RET_OK == spi_nand_block_erase_start(row));
+    }
+    CHECK(SPI_NAND_RET_OK == spi_nand_wait());
+    const double elapsed = sim_mt29f_now_us() - start;
+
+    for (int die = 0; die < SPI_NAND_DIE_COUNT; die++) {
+        CHECK(1 == sim_mt29f_erase_count(die * SPI_NAND_BLOCKS_PER_LUN + 1));
+    }
+    CHECK(elapsed < 1.5 * SIM_MT29F_T_ERASE_US);
+    return true;
+}
+
+/// @brief Fresh chip, fresh driver
+static bool setup(void)
+{
+    sim_mt29f_reset();
+    return SPI_NAND_RET_OK == spi_nand_init();
+}
+
+static row_address_t row_at(uint32_t block, uint32_t page)
+{
+    const row_address_t row = {.block = block, .page = page};
+    return row;
+}
+
+static void fill(uint8_t *data, size_t len, uint32_t seed)
+{
+    uint32_t state = seed;
+    for (size_t i = 0; i < len; i++) {
+        state = state * 1103515245 + 12345;
+        data[i] = state >> 16;
+    }
+}
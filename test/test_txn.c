@@ -0,0 +1,286 @@
+/**
+ * @file		test_txn.c
+ * @author		Andrew Loebs
+ * @brief		Host tests of dhara map transactions (DHARA_TXN)
+ *
+ * Runs a dhara map on a RAM image of a small chip (nand_image.c). Each test lays down a base of
+ * synced sectors, then updates them inside a transaction. Power loss is simulated by copying the
+ * image mid-transaction and resuming from the copy later, which has to find the base unchanged.
+ *
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/dhara/map.h"
+#include "../src/dhara/nand_image.h"
+#include "test.h"
+
+// defines
+#define LOG2_PAGE_SIZE 9
+#define PAGE_SIZE      (1 << LOG2_PAGE_SIZE)
+#define LOG2_PPB       4
+#define NUM_BLOCKS     128
+#define GC_RATIO       4
+#define BASE_SECTORS   300 // sectors written before each transaction
+#define TXN_SECTORS    400 // sectors a transaction writes to (some beyond the base)
+#define TXN_WRITES     60
+#define TXN_SYNC       7 // writes between the syncs inside a transaction
+#define MAX_SECTORS    2048
+
+#if !DHARA_TXN
+#error "test_txn needs DHARA_TXN"
+#endif
+
+// private function prototypes
+static bool test_power_loss_rolls_back(void);
+static bool test_abort(void);
+static bool test_commit_and_remount(void);
+static bool test_journal_full(void);
+
+static bool open_volume(uint32_t sectors);
+static bool remount(void);
+static bool write_version(uint32_t sector, uint32_t version);
+static bool check_versions(const uint32_t *expected, uint32_t sectors);
+static void fill(uint8_t *page, uint32_t sector, uint32_t version);
+
+// private variables
+static struct dhara_nand nand = {
+    .log2_page_size = LOG2_PAGE_SIZE,
+    .log2_ppb = LOG2_PPB,
+    .num_blocks = NUM_BLOCKS,
+};
+static dhara_nand_image_t image;
+static uint8_t *image_buffer;
+static uint8_t *snapshot;
+static struct dhara_map map;
+static uint8_t page_buffer[PAGE_SIZE];
+static uint8_t data[PAGE_SIZE];
+static uint8_t readback[PAGE_SIZE];
+// version last written to each sector (0: never written), and that as of the last commit
+static uint32_t versions[MAX_SECTORS];
+static uint32_t committed[MAX_SECTORS];
+
+// public function definitions
+int main(void)
+{
+    const size_t size = dhara_nand_image_size(&nand);
+    image_buffer = malloc(size);
+    snapshot = malloc(size);
+    if (!image_buffer || !snapshot) return 1;
+    dhara_nand_image_init_ram(&nand, &image, image_buffer);
+
+    int failures = 0;
+    RUN(test_power_loss_rolls_back, failures);
+    RUN(test_abort, failures);
+    RUN(test_commit_and_remount, failures);
+    RUN(test_journal_full, failures);
+
+    free(snapshot);
+    free(image_buffer);
+    return failures ? 1 : 0;
+}
+
+// private function definitions
+/// @brief Power lost inside a transaction -- right after a sync, or between syncs -- resumes to
+/// the base; the same transaction left to commit resumes to its writes
+static bool test_power_loss_rolls_back(void)
+{
+    dhara_error_t err;
+    const size_t size = dhara_nand_image_size(&nand);
+
+    for (int synced = 0; synced < 2; synced++) {
+        CHECK(open_volume(BASE_SECTORS));
+        srand(3);
+        CHECK(0 == dhara_map_txn_begin(&map, &err));
+        for (uint32_t i = 1; i <= TXN_WRITES; i++) {
+            CHECK(write_version((uint32_t)rand() % TXN_SECTORS, 100 + i));
+            if (0 == (i % TXN_SYNC)) CHECK(0 == dhara_map_sync(&map, &err));
+            // half way through: just after a sync, or a write after one
+            if (i == (synced ? 5 * TXN_SYNC : 5 * TXN_SYNC + 3)) {
+                memcpy(snapshot, image_buffer, size);
+            }
+        }
+        CHECK(0 == dhara_map_txn_commit(&map, &err));
+
+        CHECK(remount());
+        CHECK(check_versions(versions, TXN_SECTORS));
+
+        // power lost at the snapshot
+        memcpy(image_buffer, snapshot, size);
+        CHECK(remount());
+        CHECK(BASE_SECTORS == dhara_map_size(&map));
+        CHECK(check_versions(committed, TXN_SECTORS));
+
+        // and the journal carries on from there
+        memcpy(versions, committed, sizeof(versions));
+        CHECK(write_version(1, 1000));
+        CHECK(write_version(BASE_SECTORS + 1, 1000));
+        CHECK(0 == dhara_map_sync(&map, &err));
+        CHECK(remount());
+        CHECK(check_versions(versions, TXN_SECTORS));
+    }
+    return true;
+}
+
+/// @brief An abort goes back to the base in RAM, and the journal carries on from it
+static bool test_abort(void)
+{
+    dhara_error_t err;
+    CHECK(open_volume(BASE_SECTORS));
+
+    srand(4);
+    CHECK(0 == dhara_map_txn_begin(&map, &err));
+    for (uint32_t i = 1; i <= TXN_WRITES; i++) {
+        CHECK(write_version((uint32_t)rand() % TXN_SECTORS, 100 + i));
+        if (0 == (i % TXN_SYNC)) CHECK(0 == dhara_map_sync(&map, &err));
+    }
+    CHECK(0 == dhara_map_txn_abort(&map, &err));
+    CHECK(BASE_SECTORS == dhara_map_size(&map));
+    CHECK(check_versions(committed, TXN_SECTORS));
+
+    memcpy(versions, committed, sizeof(versions));
+    CHECK(write_version(2, 1000));
+    CHECK(0 == dhara_map_sync(&map, &err));
+    CHECK(remount());
+    CHECK(BASE_SECTORS == dhara_map_size(&map));
+    CHECK(check_versions(versions, TXN_SECTORS));
+    return true;
+}
+
+/// @brief A committed transaction is all there after a remount, new sectors included
+static bool test_commit_and_remount(void)
+{
+    dhara_error_t err;
+    CHECK(open_volume(BASE_SECTORS));
+
+    CHECK(0 == dhara_map_txn_begin(&map, &err));
+    for (uint32_t sector = BASE_SECTORS - 10; sector < BASE_SECTORS + 10; sector++) {
+        CHECK(write_version(sector, 200));
+    }
+    CHECK(0 == dhara_map_txn_commit(&map, &err));
+    CHECK(remount());
+    CHECK((BASE_SECTORS + 10) == dhara_map_size(&map));
+    CHECK(check_versions(versions, TXN_SECTORS));
+
+    // committing right on a checkpoint boundary still takes a checkpoint of its own
+    for (uint32_t n = 1; n <= (1u << LOG2_PPB); n++) {
+        CHECK(0 == dhara_map_txn_begin(&map, &err));
+        for (uint32_t i = 0; i < n; i++) CHECK(write_version(i, 300 + n));
+        CHECK(0 == dhara_map_txn_commit(&map, &err));
+        CHECK(remount());
+        CHECK(check_versions(versions, TXN_SECTORS));
+    }
+    return true;
+}
+
+/// @brief On a full journal, a transaction runs into DHARA_E_JOURNAL_FULL after at least
+/// reserve / 2 / (gc_ratio + 1) writes -- that many if every page collected is still live, more as
+/// some are garbage -- and at most reserve / 2; aborting it leaves the volume usable
+static bool test_journal_full(void)
+{
+    dhara_error_t err;
+    CHECK(open_volume(0));
+    const uint32_t capacity = dhara_map_capacity(&map);
+    const uint32_t sectors = capacity * 3 / 4;
+    CHECK((capacity > 0) && (capacity <= MAX_SECTORS));
+
+    // steady state: the journal stays full, with garbage collection keeping pace
+    for (uint32_t sector = 0; sector < sectors; sector++) CHECK(write_version(sector, 1));
+    srand(6);
+    for (uint32_t i = 1; i <= 2 * capacity; i++) {
+        CHECK(write_version((uint32_t)rand() % sectors, 100 + i));
+    }
+    CHECK(dhara_journal_size(&map.journal) >= capacity);
+    CHECK(0 == dhara_map_sync(&map, &err));
+    memcpy(committed, versions, sizeof(committed));
+
+    CHECK(0 == dhara_map_txn_begin(&map, &err));
+    uint32_t writes = 0;
+    for (;;) {
+        const uint32_t sector = (uint32_t)rand() % sectors;
+        fill(data, sector, 5000 + writes);
+        if (0 != dhara_map_write(&map, sector, data, &err)) break;
+        versions[sector] = 5000 + writes;
+        writes++;
+        CHECK(writes < capacity);
+    }
+    CHECK(DHARA_E_JOURNAL_FULL == err);
+
+    const uint32_t reserve = dhara_journal_capacity(&map.journal) / (GC_RATIO + 1);
+    const uint32_t least = reserve / 2 / (GC_RATIO + 1);
+    printf("  %lu writes fit in the transaction (reserve %lu pages, at least %lu expected)\n",
+           (unsigned long)writes, (unsigned long)reserve, (unsigned long)least);
+    CHECK((writes >= least) && (writes <= reserve / 2));
+
+    CHECK(0 == dhara_map_txn_abort(&map, &err));
+    CHECK(check_versions(committed, sectors));
+    memcpy(versions, committed, sizeof(versions));
+    for (uint32_t i = 1; i <= capacity; i++) {
+        CHECK(write_version((uint32_t)rand() % sectors, 9000 + i));
+    }
+    CHECK(0 == dhara_map_sync(&map, &err));
+    CHECK(remount());
+    CHECK(check_versions(versions, sectors));
+    return true;
+}
+
+/// @brief Formats the image, and writes and syncs versions 1 of the first sectors
+static bool open_volume(uint32_t sectors)
+{
+    dhara_error_t err;
+    CHECK(0 == dhara_nand_image_format(&nand));
+    dhara_map_init(&map, &nand, page_buffer, GC_RATIO);
+    dhara_map_resume(&map, &err);
+    dhara_map_clear(&map);
+
+    memset(versions, 0, sizeof(versions));
+    for (uint32_t sector = 0; sector < sectors; sector++) CHECK(write_version(sector, 1));
+    CHECK(0 == dhara_map_sync(&map, &err));
+    memcpy(committed, versions, sizeof(committed));
+    return true;
+}
+
+/// @brief Resumes the map from the image
+static bool remount(void)
+{
+    dhara_error_t err;
+    dhara_map_init(&map, &nand, page_buffer, GC_RATIO);
+    CHECK(0 == dhara_map_resume(&map, &err));
+    return true;
+}
+
+static bool write_version(uint32_t sector, uint32_t version)
+{
+    dhara_error_t err;
+    fill(data, sector, version);
+    CHECK(0 == dhara_map_write(&map, sector, data, &err));
+    versions[sector] = version;
+    return true;
+}
+
+/// @brief Reads back the first sectors, which must hold the given versions
+static bool check_versions(const uint32_t *expected, uint32_t sectors)
+{
+    dhara_error_t err;
+    for (uint32_t sector = 0; sector < sectors; sector++) {
+        CHECK(0 == dhara_map_read(&map, sector, readback, &err));
+        if (expected[sector]) {
+            fill(data, sector, expected[sector]);
+        }
+        else {
+            memset(data, 0xff, PAGE_SIZE);
+        }
+        CHECK(0 == memcmp(data, readback, PAGE_SIZE));
+    }
+    return true;
+}
+
+/// @brief Fills a page with a pattern unique to a sector and version
+static void fill(uint8_t *page, uint32_t sector, uint32_t version)
+{
+    for (size_t i = 0; i < PAGE_SIZE; i++) {
+        page[i] = (uint8_t)((sector * 7) + (version * 13) + i);
+    }
+}
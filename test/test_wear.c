@@ -0,0 +1,226 @@
+/**
+ * @file		test_wear.c
+ * @author		Andrew Loebs
+ * @brief		Host tests of the journal wrap count (DHARA_WRAP_COUNT) and ftl_wear
+ *
+ * Runs a dhara map on a RAM image of a small chip (nand_image.c), with the image's erases counted
+ * per block, and cycles the journal around the chip several times. The wrap count kept in the
+ * checkpoints has to follow the head, and the erase counts ftl_wear works out from it have to match
+ * the erases the chip actually saw -- across remounts and a cleared journal too.
+ *
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/dhara/map.h"
+#include "../src/dhara/nand_image.h"
+#include "ftl_wear.h"
+#include "test.h"
+
+// defines
+#define LOG2_PAGE_SIZE 9
+#define PAGE_SIZE      (1 << LOG2_PAGE_SIZE)
+#define LOG2_PPB       4
+#define NUM_BLOCKS     32
+#define GC_RATIO       4
+#define WRAPS          5
+#define SECTORS        64 // written round robin
+#define SYNC_EVERY     13 // writes between syncs
+
+#if !DHARA_WRAP_COUNT
+#error "test_wear needs DHARA_WRAP_COUNT"
+#endif
+
+// private function prototypes
+static bool test_wraps_follow_head(void);
+static bool test_wraps_survive_resume(void);
+static bool test_wraps_survive_clear(void);
+
+static bool open_volume(void);
+static bool remount(bool lazy);
+static bool write_until_wraps(uint32_t wraps);
+static bool write_next(void);
+static bool erases_match(void);
+static int count_erase(const struct dhara_nand *n, dhara_block_t b, dhara_error_t *err);
+
+// private variables
+// the image's ops, with erases counted per block
+static struct dhara_nand_ops counting_ops;
+static uint32_t block_erases[NUM_BLOCKS];
+static struct dhara_nand nand = {
+    .log2_page_size = LOG2_PAGE_SIZE,
+    .log2_ppb = LOG2_PPB,
+    .num_blocks = NUM_BLOCKS,
+};
+static dhara_nand_image_t image;
+static struct dhara_map map;
+static uint8_t page_buffer[PAGE_SIZE];
+static uint8_t data[PAGE_SIZE];
+// wraps seen from the head moving back to the start of the chip
+static uint32_t seen_wraps;
+static uint32_t writes;
+
+// public function definitions
+int main(void)
+{
+    uint8_t *image_buffer = malloc(dhara_nand_image_size(&nand));
+    if (!image_buffer) return 1;
+    dhara_nand_image_init_ram(&nand, &image, image_buffer);
+    counting_ops = *nand.ops;
+    counting_ops.erase = count_erase;
+    nand.ops = &counting_ops;
+
+    int failures = 0;
+    RUN(test_wraps_follow_head, failures);
+    RUN(test_wraps_survive_resume, failures);
+    RUN(test_wraps_survive_clear, failures);
+
+    free(image_buffer);
+    return failures ? 1 : 0;
+}
+
+// private function definitions
+/// @brief The wrap count goes up by one each time the head comes round, and the erase counts
+/// match the chip's at every step
+static bool test_wraps_follow_head(void)
+{
+    CHECK(open_volume());
+    CHECK(0 == map.journal.wraps);
+    CHECK(erases_match());
+
+    for (uint32_t wraps = 1; wraps <= WRAPS; wraps++) {
+        CHECK(write_until_wraps(wraps));
+        CHECK(wraps == map.journal.wraps);
+    }
+
+    ftl_wear_stats_t stats;
+    CHECK(0 == ftl_wear_get_stats(&stats));
+    CHECK((WRAPS == stats.wraps) && (NUM_BLOCKS == stats.good_blocks));
+    // just past the wrap, only the blocks the head has entered again are one erase ahead
+    CHECK((WRAPS == stats.min_erases) && (stats.max_erases <= WRAPS + 1));
+    return true;
+}
+
+/// @brief A remount picks the wrap count up from the last checkpoint -- right after a wrap, and
+/// part way through one -- and the count carries on from there
+static bool test_wraps_survive_resume(void)
+{
+    dhara_error_t err;
+    CHECK(open_volume());
+
+    for (uint32_t wraps = 1; wraps <= WRAPS; wraps++) {
+        CHECK(write_until_wraps(wraps));
+        CHECK(0 == dhara_map_sync(&map, &err));
+        CHECK(remount(false));
+        CHECK(wraps == map.journal.wraps);
+        CHECK(erases_match());
+
+        // half a wrap on, through a lazy resume, whose head isn't known until the first write
+        for (uint32_t i = 0; i < (NUM_BLOCKS << LOG2_PPB) / 2; i++) CHECK(write_next());
+        CHECK(0 == dhara_map_sync(&map, &err));
+        CHECK(remount(true));
+        uint32_t count;
+        CHECK(-1 == ftl_wear_block_erases(0, &count));
+        memset(data, (uint8_t)writes, sizeof(data));
+        CHECK(0 == dhara_map_write(&map, writes++ % SECTORS, data, &err));
+        CHECK(seen_wraps == map.journal.wraps);
+        CHECK(erases_match());
+    }
+    return true;
+}
+
+/// @brief Trimming the last sector clears the journal, but not the wrap count
+static bool test_wraps_survive_clear(void)
+{
+    dhara_error_t err;
+    CHECK(open_volume());
+    CHECK(write_until_wraps(2));
+
+    for (dhara_sector_t sector = 0; sector < SECTORS; sector++) {
+        CHECK(0 == dhara_map_trim(&map, sector, &err));
+    }
+    CHECK(0 == dhara_map_size(&map));
+    CHECK(0 == dhara_map_sync(&map, &err));
+    CHECK(remount(false));
+    CHECK(2 == map.journal.wraps);
+    CHECK(erases_match());
+
+    CHECK(write_until_wraps(3));
+    CHECK(erases_match());
+    return true;
+}
+
+/// @brief Formats the image and mounts an empty map, with the erase counts zeroed
+static bool open_volume(void)
+{
+    dhara_error_t err;
+    CHECK(0 == dhara_nand_image_format(&nand));
+    dhara_map_init(&map, &nand, page_buffer, GC_RATIO);
+    dhara_map_resume(&map, &err);
+    dhara_map_clear(&map);
+    ftl_wear_init(&map);
+
+    memset(block_erases, 0, sizeof(block_erases));
+    seen_wraps = 0;
+    writes = 0;
+    return true;
+}
+
+static bool remount(bool lazy)
+{
+    dhara_error_t err;
+    dhara_map_init(&map, &nand, page_buffer, GC_RATIO);
+    CHECK(0 == (lazy ? dhara_map_resume_lazy(&map, &err) : dhara_map_resume(&map, &err)));
+    ftl_wear_init(&map);
+    return true;
+}
+
+/// @brief Writes until the head has come round to the start of the chip the given number of times
+static bool write_until_wraps(uint32_t wraps)
+{
+    while (seen_wraps < wraps) {
+        CHECK(write_next());
+        CHECK(writes < 100u * (NUM_BLOCKS << LOG2_PPB));
+    }
+    return true;
+}
+
+/// @brief Writes the next sector of the round robin, syncing now and then, and checks the wrap
+/// count against the head -- and every so often the erase counts
+static bool write_next(void)
+{
+    dhara_error_t err;
+    const dhara_page_t head = map.journal.head;
+    memset(data, (uint8_t)writes, sizeof(data));
+    CHECK(0 == dhara_map_write(&map, writes++ % SECTORS, data, &err));
+    if (0 == (writes % SYNC_EVERY)) CHECK(0 == dhara_map_sync(&map, &err));
+    if (map.journal.head < head) seen_wraps++;
+
+    CHECK(seen_wraps == map.journal.wraps);
+    if (0 == (writes % 37)) CHECK(erases_match());
+    return true;
+}
+
+/// @brief Returns true if ftl_wear gives the erases the chip saw, for every block
+static bool erases_match(void)
+{
+    for (dhara_block_t b = 0; b < NUM_BLOCKS; b++) {
+        uint32_t count;
+        CHECK(0 == ftl_wear_block_erases(b, &count));
+        if (count != block_erases[b]) {
+            printf("  block %lu: %lu erases, ftl_wear says %lu (head %lu, wraps %lu)\n",
+                   (unsigned long)b, (unsigned long)block_erases[b], (unsigned long)count,
+                   (unsigned long)map.journal.head, (unsigned long)map.journal.wraps);
+            return false;
+        }
+    }
+    return true;
+}
+
+static int count_erase(const struct dhara_nand *n, dhara_block_t b, dhara_error_t *err)
+{
+    block_erases[b]++;
+    return dhara_nand_image_ops.erase(n, b, err);
+}